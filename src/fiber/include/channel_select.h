@@ -0,0 +1,190 @@
+#ifndef FIBER_CHANNEL_SELECT_H
+#define FIBER_CHANNEL_SELECT_H
+
+#include "mpmc_channel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace fiber {
+
+// ============================================================================
+// Select - 同时等待多个Channel和超时（Go的select）
+// ============================================================================
+// 用法：
+//   Select sel;
+//   sel.recv(proposals, [&](Proposal p, bool ok) { ... })
+//      .recv(responses, [&](Response r, bool ok) { ... })
+//      .after(election_timeout_ms, [&]() { startElection(); });
+//   while (running) sel.wait();
+//
+// wait阻塞到某个case就绪，执行它的handler并返回case序号（按添加顺序，从0开始）：
+// - recv：取到元素时handler(value, true)；Channel已关闭且为空时handler(T{}, false)；
+// - send：元素进入缓冲时handler(true)；Channel已关闭时handler(false)。元素只发送一次：
+//   case触发后即失效（元素已移入Channel），要再发送需要重新添加send case；
+// - after：从wait开始计时，没有其他case先就绪时执行，多个after取最早的一个。
+// 同时有多个case就绪时等概率随机选择其中一个，不会固定偏向先添加的case。
+//
+// 没有case就绪时Select登记到所有Channel上挂起，Channel有新元素、空位或关闭时
+// 唤醒它，不轮询也不sleep。Select可以反复wait；只能由一个fiber使用。
+// 没有仍有效的case时wait立即返回-1。
+class Select {
+public:
+    Select() : rng_(static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count())) {}
+
+    Select(const Select&) = delete;
+    Select& operator=(const Select&) = delete;
+
+    template <typename T, typename F>
+    Select& recv(const std::shared_ptr<MpmcChannel<T>>& ch, F handler) {
+        Case c;
+        c.index = next_index_++;
+        c.attempt = [ch, handler = std::move(handler)]() mutable {
+            T value{};
+            if (ch->tryRecv(value)) {
+                handler(std::move(value), true);
+                return true;
+            }
+            if (!ch->closed()) {
+                return false;
+            }
+            // 关闭之前送达的元素仍然先交付
+            if (ch->tryRecv(value)) {
+                handler(std::move(value), true);
+            } else {
+                handler(T{}, false);
+            }
+            return true;
+        };
+        c.ready = [ch]() { return ch->readyToRecv(); };
+        c.watch = [ch](SelectWaiter* waiter, bool on) {
+            on ? ch->watch(waiter, true) : ch->unwatch(waiter, true);
+        };
+        addCase(std::move(c));
+        return *this;
+    }
+
+    template <typename T, typename F>
+    Select& send(const std::shared_ptr<MpmcChannel<T>>& ch, T value, F handler) {
+        Case c;
+        c.index = next_index_++;
+        // enqueue只在成功时移走元素，T可以是只能移动的类型（std::function要求可复制，元素放在shared_ptr里）
+        auto slot = std::make_shared<T>(std::move(value));
+        c.attempt = [this, ch, slot, handler = std::move(handler), pos = cases_.size()]() mutable {
+            if (ch->closed()) {
+                cases_[pos].armed = false;
+                handler(false);
+                return true;
+            }
+            if (!ch->enqueue(*slot)) {
+                return false;
+            }
+            cases_[pos].armed = false;
+            ch->wakeReceiver();
+            handler(true);
+            return true;
+        };
+        c.ready = [ch]() { return ch->readyToSend(); };
+        c.watch = [ch](SelectWaiter* waiter, bool on) {
+            on ? ch->watch(waiter, false) : ch->unwatch(waiter, false);
+        };
+        addCase(std::move(c));
+        return *this;
+    }
+
+    template <typename F>
+    Select& after(uint64_t timeout_ms, F handler) {
+        Timer timer;
+        timer.index = next_index_++;
+        timer.timeout_ms = timeout_ms;
+        timer.handler = std::move(handler);
+        if (!earliest_ || timeout_ms < timers_[*earliest_].timeout_ms) {
+            earliest_ = timers_.size();
+        }
+        timers_.push_back(std::move(timer));
+        return *this;
+    }
+
+    // 等待并执行一个case，返回它的序号；没有有效的case时立即返回-1
+    int wait() {
+        bool armed = std::any_of(cases_.begin(), cases_.end(), [](const Case& c) { return c.armed; });
+        if (!armed && timers_.empty()) {
+            return -1;
+        }
+        Clock::time_point deadline;
+        const Timer* timer = earliest_ ? &timers_[*earliest_] : nullptr;
+        if (timer) {
+            deadline = Clock::now() + std::chrono::milliseconds(timer->timeout_ms);
+        }
+        while (true) {
+            std::shuffle(order_.begin(), order_.end(), rng_);
+            for (size_t i : order_) {
+                if (cases_[i].armed && cases_[i].attempt()) {
+                    return cases_[i].index;
+                }
+            }
+            if (timer && Clock::now() >= deadline) {
+                timer->handler();
+                return timer->index;
+            }
+            // 先登记再检查一次：与Channel的“完成操作 -> 看等待者计数”构成握手，
+            // 登记之后发生的事件一定会signal到waiter_
+            for (auto& c : cases_) {
+                if (c.armed) {
+                    c.watch(&waiter_, true);
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool ready = std::any_of(cases_.begin(), cases_.end(), [](const Case& c) { return c.armed && c.ready(); });
+            if (!ready) {
+                waiter_.wait(timer ? &deadline : nullptr);
+            }
+            for (auto& c : cases_) {
+                if (c.armed) {
+                    c.watch(&waiter_, false);
+                }
+            }
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Case {
+        int index = 0;
+        bool armed = true;                               // send case触发后失效
+        std::function<bool()> attempt;                   // 尝试完成操作，成功时执行handler
+        std::function<bool()> ready;                     // 只检查，不取走元素
+        std::function<void(SelectWaiter*, bool)> watch;  // 在Channel上登记/注销waiter
+    };
+
+    struct Timer {
+        int index = 0;
+        uint64_t timeout_ms = 0;
+        std::function<void()> handler;
+    };
+
+    void addCase(Case c) {
+        order_.push_back(cases_.size());
+        cases_.push_back(std::move(c));
+    }
+
+    std::vector<Case> cases_;
+    std::vector<size_t> order_;
+    std::vector<Timer> timers_;
+    std::optional<size_t> earliest_;
+    int next_index_ = 0;
+    SelectWaiter waiter_;
+    std::minstd_rand rng_;
+};
+
+} // namespace fiber
+
+#endif // FIBER_CHANNEL_SELECT_H
@@ -0,0 +1,479 @@
+#ifndef FIBER_MPMC_CHANNEL_H
+#define FIBER_MPMC_CHANNEL_H
+
+#include "sync.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace fiber {
+
+class Select;
+
+// ============================================================================
+// SelectWaiter - Select挂起时登记到各个Channel上的唤醒器
+// ============================================================================
+// Channel在有新元素、有空位或关闭时调用signal；多次signal在被等待方取走之前
+// 合并为一次，等待方每次醒来都会重新检查所有case。
+class SelectWaiter {
+public:
+    void signal() {
+        std::unique_lock<FiberMutex> lock(mu_);
+        signaled_ = true;
+        cond_.notify_one();
+    }
+
+    // 等待到被signal或超时（deadline为空时不超时），返回是否被signal，并清除标记
+    bool wait(const std::chrono::steady_clock::time_point* deadline) {
+        std::unique_lock<FiberMutex> lock(mu_);
+        while (!signaled_) {
+            if (!deadline) {
+                cond_.wait(lock);
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= *deadline) {
+                return false;
+            }
+            cond_.wait_for(lock, std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - now) +
+                                     std::chrono::milliseconds(1));
+        }
+        signaled_ = false;
+        return true;
+    }
+
+private:
+    FiberMutex mu_;
+    FiberCondition cond_;
+    bool signaled_ = false;
+};
+
+// ============================================================================
+// MpmcChannel - 无锁的有界多生产者多消费者Channel
+// ============================================================================
+// 与Channel的send / recv / send_timeout / recv_timeout / close语义相同：
+// close之后send返回false，recv先取完剩余的元素再返回false。
+//
+// 数据通路是Vyukov式的有界MPMC环形队列：每个槽位带一个序号，生产者和消费者各自
+// 用一次CAS抢占位置，然后只写自己的槽位，不同位置的send / recv互不干扰。
+// 只有队列满或空、需要挂起fiber时才进入慢路径：等待者在mu_下登记计数后再检查一次
+// 队列，对端完成操作后看到计数不为0才加锁唤醒，没有等待者时全程不加锁。
+//
+// 与Channel的差异：容量至少为1（capacity为0时按1处理），send在元素进入缓冲后
+// 即返回，不等待接收方取走。
+//
+// 可以与其他Channel和超时一起在Select中等待（见channel_select.h）。
+// send_many / recv_many一次CAS占用一段连续槽位，整批元素只做一次同步和一次唤醒。
+template <typename T>
+class MpmcChannel {
+public:
+    using ptr = std::shared_ptr<MpmcChannel<T>>;
+
+    // capacity会被向上取整为2的幂
+    explicit MpmcChannel(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        mask_ = cap - 1;
+        while ((size_t{1} << shift_) < cap) {
+            ++shift_;
+        }
+        cells_ = std::make_unique<Cell[]>(cap);
+    }
+
+    ~MpmcChannel() {
+        T value;
+        while (tryRecv(value)) {
+        }
+    }
+
+    MpmcChannel(const MpmcChannel&) = delete;
+    MpmcChannel& operator=(const MpmcChannel&) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // 不阻塞：缓冲已满或已关闭时返回false
+    bool trySend(T value) {
+        if (closed_.load(std::memory_order_acquire) || !enqueue(value)) {
+            return false;
+        }
+        wakeReceiver();
+        return true;
+    }
+
+    // 不阻塞：缓冲为空时返回false
+    bool tryRecv(T& value) {
+        if (!dequeue(value)) {
+            return false;
+        }
+        wakeSender();
+        return true;
+    }
+
+    bool send(T value) { return sendUntil(std::move(value), nullptr); }
+
+    bool recv(T& value) { return recvUntil(value, nullptr); }
+
+    bool send_timeout(T value, uint64_t timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        return sendUntil(std::move(value), &deadline);
+    }
+
+    bool recv_timeout(T& value, uint64_t timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        return recvUntil(value, &deadline);
+    }
+
+    // 批量发送，元素从items中移出。阻塞到全部进入缓冲，缓冲有空位时尽量整段写入；
+    // 返回发送的个数，Channel关闭时可能少于items.size()
+    size_t send_many(std::span<T> items) {
+        size_t sent = 0;
+        while (sent < items.size()) {
+            if (closed_.load(std::memory_order_acquire)) {
+                break;
+            }
+            size_t n = enqueueBatch(items.subspan(sent));
+            if (n > 0) {
+                sent += n;
+                wakeReceiver(n);
+                continue;
+            }
+            parkSender(nullptr);
+        }
+        return sent;
+    }
+
+    // 批量接收：等到至少有一个元素，然后不再等待、一次取走最多max个追加到out。
+    // 返回取到的个数，0表示超时，或已关闭且没有剩余元素
+    size_t recv_many(std::vector<T>& out, size_t max, uint64_t timeout_ms) {
+        if (max == 0) {
+            return 0;
+        }
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            size_t n = dequeueBatch(out, max);
+            if (n == 0 && closed_.load(std::memory_order_acquire)) {
+                n = dequeueBatch(out, max);
+                if (n == 0) {
+                    return 0;
+                }
+            }
+            if (n > 0) {
+                wakeSender(n);
+                return n;
+            }
+            if (!parkReceiver(&deadline)) {
+                return 0;
+            }
+        }
+    }
+
+    void close() {
+        closed_.store(true, std::memory_order_seq_cst);
+        std::unique_lock<FiberMutex> lock(mu_);
+        not_empty_.notify_all();
+        not_full_.notify_all();
+        signalAll(recv_selects_);
+        signalAll(send_selects_);
+    }
+
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+    // 近似的元素个数
+    size_t size() const {
+        size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    friend class Select;
+    using Clock = std::chrono::steady_clock;
+
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq{0};
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    // 位置pos在第pos / capacity圈：槽位序号等于2 * 圈数时可写，等于2 * 圈数 + 1时可读，
+    // 读完后进入下一圈（按圈数编号，容量为1时可写与可读的序号也不会混淆）
+    size_t turn(size_t pos) const { return (pos >> shift_) * 2; }
+
+    bool enqueue(T& value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(turn(pos));
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (cell.storage) T(std::move(value));
+                    cell.seq.store(turn(pos) + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 从enqueue_pos_起数出连续可写的槽位，一次CAS全部占用
+    size_t enqueueBatch(std::span<T> items) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            size_t n = 0;
+            while (n < items.size() && cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire) == turn(pos + n)) {
+                ++n;
+            }
+            if (n == 0) {
+                size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+                if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(turn(pos)) < 0) {
+                    return 0;
+                }
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < n; ++i) {
+                    Cell& cell = cells_[(pos + i) & mask_];
+                    new (cell.storage) T(std::move(items[i]));
+                    cell.seq.store(turn(pos + i) + 1, std::memory_order_release);
+                }
+                return n;
+            }
+        }
+    }
+
+    bool dequeue(T& value) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(turn(pos) + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    T* slot = cell.value();
+                    value = std::move(*slot);
+                    slot->~T();
+                    cell.seq.store(turn(pos) + 2, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t dequeueBatch(std::vector<T>& out, size_t max) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            size_t n = 0;
+            while (n < max && cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire) == turn(pos + n) + 1) {
+                ++n;
+            }
+            if (n == 0) {
+                size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+                if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(turn(pos) + 1) < 0) {
+                    return 0;
+                }
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < n; ++i) {
+                    Cell& cell = cells_[(pos + i) & mask_];
+                    T* slot = cell.value();
+                    out.push_back(std::move(*slot));
+                    slot->~T();
+                    cell.seq.store(turn(pos + i) + 2, std::memory_order_release);
+                }
+                return n;
+            }
+        }
+    }
+
+    // 完成count个send / recv之后：对端有等待者时加锁唤醒最多count个。
+    // 与等待方的“登记计数 -> 再检查队列”构成Dekker式握手，两边至少有一方看到对方
+    // 登记在这一侧的Select全部唤醒：被唤醒的Select不一定选中本Channel，
+    // 只唤醒一个可能让元素无人接收
+    void wakeReceiver(size_t count = 1) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (int waiters = recv_waiters_.load(std::memory_order_relaxed); waiters > 0) {
+            std::unique_lock<FiberMutex> lock(mu_);
+            notify(not_empty_, count, waiters);
+            signalAll(recv_selects_);
+        }
+    }
+
+    void wakeSender(size_t count = 1) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (int waiters = send_waiters_.load(std::memory_order_relaxed); waiters > 0) {
+            std::unique_lock<FiberMutex> lock(mu_);
+            notify(not_full_, count, waiters);
+            signalAll(send_selects_);
+        }
+    }
+
+    static void notify(FiberCondition& cond, size_t count, int waiters) {
+        if (count >= static_cast<size_t>(waiters)) {
+            cond.notify_all();
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            cond.notify_one();
+        }
+    }
+
+    static void signalAll(const std::vector<SelectWaiter*>& selects) {
+        for (SelectWaiter* waiter : selects) {
+            waiter->signal();
+        }
+    }
+
+    // Select登记/注销等待：计入等待者计数，使对端走慢路径唤醒它。
+    // 登记之后Select需要再检查一次readyToRecv / readyToSend再挂起
+    void watch(SelectWaiter* waiter, bool recv_side) {
+        std::unique_lock<FiberMutex> lock(mu_);
+        (recv_side ? recv_selects_ : send_selects_).push_back(waiter);
+        (recv_side ? recv_waiters_ : send_waiters_).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void unwatch(SelectWaiter* waiter, bool recv_side) {
+        std::unique_lock<FiberMutex> lock(mu_);
+        auto& selects = recv_side ? recv_selects_ : send_selects_;
+        for (auto it = selects.begin(); it != selects.end(); ++it) {
+            if (*it == waiter) {
+                selects.erase(it);
+                break;
+            }
+        }
+        (recv_side ? recv_waiters_ : send_waiters_).fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool readyToRecv() const { return closed_.load(std::memory_order_relaxed) || hasItem(); }
+
+    bool readyToSend() const { return closed_.load(std::memory_order_relaxed) || hasSpace(); }
+
+    // 在cond上等待到被唤醒或超时，返回false表示已超时
+    bool waitOn(FiberCondition& cond, std::unique_lock<FiberMutex>& lock, const Clock::time_point* deadline) {
+        if (!deadline) {
+            cond.wait(lock);
+            return true;
+        }
+        auto now = Clock::now();
+        if (now >= *deadline) {
+            return false;
+        }
+        cond.wait_for(lock, std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - now) +
+                                std::chrono::milliseconds(1));
+        return true;
+    }
+
+    // 登记为等待者，再检查一次队列后挂起；返回false表示已超时
+    bool parkSender(const Clock::time_point* deadline) {
+        std::unique_lock<FiberMutex> lock(mu_);
+        send_waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = true;
+        if (!closed_.load(std::memory_order_relaxed) && !hasSpace()) {
+            ok = waitOn(not_full_, lock, deadline);
+        }
+        send_waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    bool parkReceiver(const Clock::time_point* deadline) {
+        std::unique_lock<FiberMutex> lock(mu_);
+        recv_waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = true;
+        if (!closed_.load(std::memory_order_relaxed) && !hasItem()) {
+            ok = waitOn(not_empty_, lock, deadline);
+        }
+        recv_waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+    bool sendUntil(T value, const Clock::time_point* deadline) {
+        while (true) {
+            if (closed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (enqueue(value)) {
+                wakeReceiver();
+                return true;
+            }
+            if (!parkSender(deadline)) {
+                return false;
+            }
+        }
+    }
+
+    bool recvUntil(T& value, const Clock::time_point* deadline) {
+        while (true) {
+            if (dequeue(value)) {
+                wakeSender();
+                return true;
+            }
+            if (closed_.load(std::memory_order_acquire)) {
+                // close之前完成的send一定已经可见；再取一次，避免与最后的send竞争时漏掉元素
+                if (dequeue(value)) {
+                    wakeSender();
+                    return true;
+                }
+                return false;
+            }
+            if (!parkReceiver(deadline)) {
+                return false;
+            }
+        }
+    }
+
+    // 只读检查，不取走元素（等待者登记后使用）
+    bool hasItem() const {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].seq.load(std::memory_order_acquire) == turn(pos) + 1;
+    }
+
+    bool hasSpace() const {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].seq.load(std::memory_order_acquire) == turn(pos);
+    }
+
+    size_t mask_ = 0;
+    int shift_ = 0;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+    alignas(64) std::atomic<bool> closed_{false};
+    std::atomic<int> send_waiters_{0};
+    std::atomic<int> recv_waiters_{0};
+
+    FiberMutex mu_;
+    FiberCondition not_empty_;
+    FiberCondition not_full_;
+    std::vector<SelectWaiter*> recv_selects_;   // 由mu_保护
+    std::vector<SelectWaiter*> send_selects_;
+};
+
+template <typename T>
+typename MpmcChannel<T>::ptr make_mpmc_channel(size_t capacity) {
+    return std::make_shared<MpmcChannel<T>>(capacity);
+}
+
+} // namespace fiber
+
+#endif // FIBER_MPMC_CHANNEL_H
@@ -0,0 +1,267 @@
+#ifndef FIBER_WORK_STEALING_QUEUE_H
+#define FIBER_WORK_STEALING_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace fiber {
+
+// ============================================================================
+// WorkStealingDeque - Chase-Lev工作窃取双端队列
+// ============================================================================
+// 只有一个owner线程在底部push/pop（LIFO，刚产生的任务缓存最热），任意线程在顶部
+// steal（FIFO，偷走最早、通常也最大的任务）。owner的push/pop不加锁，只有与窃取者
+// 争抢最后一个元素时用一次CAS；窃取者之间用top的CAS竞争。
+// 内存序按 Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP'13)。
+//
+// 数组满时由owner扩容为两倍，旧数组可能仍被窃取者读取，保留到队列析构时释放
+// （总大小不超过当前数组）。T必须可平凡复制（通常是指针）。
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque requires a trivially copyable T");
+
+public:
+    // capacity会被向上取整为2的幂
+    explicit WorkStealingDeque(size_t capacity = 256) {
+        size_t cap = 1;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        array_.store(new Array(cap), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque() { delete array_.load(std::memory_order_relaxed); }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // 只能由owner调用
+    void push(T item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(a->capacity) - 1) {
+            retired_.emplace_back(a);
+            a = a->grow(t, b);
+            array_.store(a, std::memory_order_release);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // 只能由owner调用，取最近push的元素
+    std::optional<T> pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        T item = a->get(b);
+        if (t == b) {
+            // 最后一个元素，与窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if (!won) {
+                return std::nullopt;
+            }
+        }
+        return item;
+    }
+
+    // 任意线程调用，取最早push的元素；队列为空或与其他线程竞争失败时返回nullopt
+    std::optional<T> steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return std::nullopt;
+        }
+        Array* a = array_.load(std::memory_order_acquire);
+        T item = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    // 近似的元素个数（并发修改时只作参考）
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    struct Array {
+        explicit Array(size_t cap) : capacity(cap), mask(cap - 1), slots(new std::atomic<T>[cap]) {}
+
+        T get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T item) { slots[i & mask].store(item, std::memory_order_relaxed); }
+
+        Array* grow(int64_t top, int64_t bottom) const {
+            auto* bigger = new Array(capacity * 2);
+            for (int64_t i = top; i < bottom; ++i) {
+                bigger->put(i, get(i));
+            }
+            return bigger;
+        }
+
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    alignas(64) std::atomic<Array*> array_{nullptr};
+    std::vector<std::unique_ptr<Array>> retired_;   // 只由owner修改
+};
+
+// ============================================================================
+// WorkStealingRunQueues - 每个调度线程一个运行队列的工作窃取调度
+// ============================================================================
+// 供调度器按worker（调度线程）组织可运行的fiber：
+// - push：worker自己产生的任务（例如在fiber中Fiber::go）进入本地deque；
+// - pushNext：被本worker唤醒的任务（Channel的send唤醒了接收者）放入next槽，
+//   本worker下一个就运行它，唤醒者与被唤醒者共享的数据仍在本核缓存中；
+//   槽中原有的任务转入本地deque，避免两个互相唤醒的fiber饿死其他任务；
+// - submit：非worker线程（IO poller、定时器线程）提交的任务进入全局注入队列；
+// - pop：next槽 → 本地deque → 全局队列 → 从随机选择的其他worker窃取
+//   （先偷各worker的deque顶部，都为空时才偷next槽）。
+//
+// T{}表示“没有任务”，T必须可平凡复制（通常是Fiber*）。线程的休眠和唤醒
+// 由调度器负责：pop返回nullopt后调度器再决定自旋、休眠或等待IO。
+template <typename T>
+class WorkStealingRunQueues {
+public:
+    explicit WorkStealingRunQueues(size_t workers, size_t deque_capacity = 256) {
+        workers_.reserve(workers);
+        for (size_t i = 0; i < workers; ++i) {
+            workers_.push_back(std::make_unique<Worker>(deque_capacity, i));
+        }
+    }
+
+    size_t workers() const { return workers_.size(); }
+
+    // 以下三个函数只能由worker自己的线程调用
+    void push(size_t worker, T task) { workers_[worker]->deque.push(task); }
+
+    void pushNext(size_t worker, T task) {
+        T displaced = workers_[worker]->next.exchange(task, std::memory_order_acq_rel);
+        if (displaced != T{}) {
+            workers_[worker]->deque.push(displaced);
+        }
+    }
+
+    std::optional<T> pop(size_t worker) {
+        Worker& self = *workers_[worker];
+        T next = self.next.exchange(T{}, std::memory_order_acq_rel);
+        if (next != T{}) {
+            return next;
+        }
+        if (auto task = self.deque.pop()) {
+            return task;
+        }
+        if (auto task = popGlobal()) {
+            return task;
+        }
+        return steal(self);
+    }
+
+    // 任意线程调用
+    void submit(T task) {
+        std::lock_guard<std::mutex> lock(global_mu_);
+        global_.push_back(task);
+        global_size_.store(global_.size(), std::memory_order_release);
+    }
+
+    // 近似的待运行任务数
+    size_t pending() const {
+        size_t total = global_size_.load(std::memory_order_acquire);
+        for (const auto& w : workers_) {
+            total += w->deque.size() + (w->next.load(std::memory_order_relaxed) != T{} ? 1 : 0);
+        }
+        return total;
+    }
+
+    // worker成功窃取的任务数
+    uint64_t stolen(size_t worker) const { return workers_[worker]->stolen.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Worker {
+        Worker(size_t capacity, size_t index) : deque(capacity), rng(0x9e3779b97f4a7c15ULL * (index + 1)) {}
+
+        WorkStealingDeque<T> deque;
+        std::atomic<T> next{T{}};
+        uint64_t rng;                       // 只由worker自己使用
+        std::atomic<uint64_t> stolen{0};
+    };
+
+    std::optional<T> popGlobal() {
+        if (global_size_.load(std::memory_order_acquire) == 0) {
+            return std::nullopt;
+        }
+        std::lock_guard<std::mutex> lock(global_mu_);
+        if (global_.empty()) {
+            return std::nullopt;
+        }
+        T task = global_.front();
+        global_.pop_front();
+        global_size_.store(global_.size(), std::memory_order_release);
+        return task;
+    }
+
+    std::optional<T> steal(Worker& self) {
+        size_t n = workers_.size();
+        if (n <= 1) {
+            return std::nullopt;
+        }
+        // xorshift选择起点，依次尝试其他worker，避免所有空闲线程挤向同一个受害者
+        self.rng ^= self.rng << 13;
+        self.rng ^= self.rng >> 7;
+        self.rng ^= self.rng << 17;
+        size_t start = self.rng % n;
+        // 先偷deque；都为空时才偷next槽，尽量让被唤醒的fiber留在唤醒者的线程上
+        for (int pass = 0; pass < 2; ++pass) {
+            for (size_t i = 0; i < n; ++i) {
+                Worker& victim = *workers_[(start + i) % n];
+                if (&victim == &self) {
+                    continue;
+                }
+                std::optional<T> task;
+                if (pass == 0) {
+                    task = victim.deque.steal();
+                } else if (T next = victim.next.exchange(T{}, std::memory_order_acq_rel); next != T{}) {
+                    task = next;
+                }
+                if (task) {
+                    self.stolen.fetch_add(1, std::memory_order_relaxed);
+                    return task;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex global_mu_;
+    std::deque<T> global_;
+    std::atomic<size_t> global_size_{0};
+};
+
+} // namespace fiber
+
+#endif // FIBER_WORK_STEALING_QUEUE_H
@@ -0,0 +1,321 @@
+#include "include/backup.h"
+#include "include/sst.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kv {
+
+namespace {
+
+constexpr char kBackupMagic[8] = {'T', 'K', 'V', 'B', 'A', 'K', '0', '1'};
+constexpr size_t kBackupHeaderSize = sizeof(kBackupMagic) + 8 + 8 + 4;
+
+int64_t steadyNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string encodeHeader(const BackupInfo& info) {
+    std::string header(kBackupMagic, sizeof(kBackupMagic));
+    header.append(reinterpret_cast<const char*>(&info.index), sizeof(info.index));
+    header.append(reinterpret_cast<const char*>(&info.size), sizeof(info.size));
+    header.append(reinterpret_cast<const char*>(&info.crc), sizeof(info.crc));
+    return header;
+}
+
+bool decodeHeader(const std::string& data, BackupInfo& info) {
+    if (data.size() < kBackupHeaderSize || std::memcmp(data.data(), kBackupMagic, sizeof(kBackupMagic)) != 0) {
+        return false;
+    }
+    const char* p = data.data() + sizeof(kBackupMagic);
+    std::memcpy(&info.index, p, sizeof(info.index));
+    std::memcpy(&info.size, p + 8, sizeof(info.size));
+    std::memcpy(&info.crc, p + 16, sizeof(info.crc));
+    return true;
+}
+
+// 写备份文件：内容先写到临时文件，Commit时回填文件头、fsync并rename；没有Commit就析构时删除临时文件
+class BackupFileWriter {
+public:
+    explicit BackupFileWriter(std::string path) : path_(std::move(path)), tmp_(path_ + ".tmp") {}
+
+    ~BackupFileWriter() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            ::unlink(tmp_.c_str());
+        }
+    }
+
+    bool Open(const BackupInfo& info) {
+        fd_ = ::open(tmp_.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd_ < 0) {
+            LOG_ERROR("Backup: failed to create {}: {}", tmp_, strerror(errno));
+            return false;
+        }
+        std::string header = encodeHeader(info);
+        return Append(header.data(), header.size());
+    }
+
+    bool Append(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd_, p, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                LOG_ERROR("Backup: failed to write {}: {}", tmp_, strerror(errno));
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool Commit(const BackupInfo& info) {
+        std::string header = encodeHeader(info);
+        bool ok = ::pwrite(fd_, header.data(), header.size(), 0) == static_cast<ssize_t>(header.size()) &&
+                  ::fsync(fd_) == 0;
+        ::close(fd_);
+        fd_ = -1;
+        if (!ok || ::rename(tmp_.c_str(), path_.c_str()) != 0) {
+            LOG_ERROR("Backup: failed to commit {}: {}", path_, strerror(errno));
+            ::unlink(tmp_.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string path_;
+    std::string tmp_;
+    int fd_ = -1;
+};
+
+} // namespace
+
+// ============================================================================
+// 生成备份
+// ============================================================================
+
+std::unique_ptr<BackupExport> BackupExport::Open(KvStateMachine& sm, uint64_t index) {
+    auto view = sm.NewReadView(index);
+    if (!view) {
+        return nullptr;
+    }
+    // TTL索引只有最新状态，保留仍在视图中的key
+    SnapshotExtras extras;
+    std::string value;
+    for (auto& ttl : sm.TtlEntries()) {
+        if (view->Get(ttl.key, value)) {
+            extras.ttls.push_back(std::move(ttl));
+        }
+    }
+    auto stream = std::make_unique<SnapshotStream>(std::move(view), std::move(extras), sm.GetSnapshotOptions());
+    return std::unique_ptr<BackupExport>(new BackupExport(std::move(stream)));
+}
+
+bool BackupExport::Read(uint64_t offset, size_t max_bytes, std::string& data, bool& last) {
+    if (offset != buffer_offset_ && offset != read_end_) {
+        return false;
+    }
+    // offset之前的数据调用方已经收到
+    buffer_.erase(0, offset - buffer_offset_);
+    buffer_offset_ = offset;
+
+    max_bytes = std::max<size_t>(max_bytes, 1);
+    std::string chunk;
+    while (buffer_.size() < max_bytes && !finished_) {
+        if (!stream_->Next(chunk)) {
+            finished_ = true;
+            break;
+        }
+        info_.size += chunk.size();
+        info_.crc = Crc32(chunk.data(), chunk.size(), info_.crc);
+        buffer_.append(chunk);
+    }
+    data.assign(buffer_, 0, std::min(max_bytes, buffer_.size()));
+    read_end_ = offset + data.size();
+    last = finished_ && data.size() == buffer_.size();
+    return true;
+}
+
+// ============================================================================
+// RateLimiter
+// ============================================================================
+
+RateLimiter::RateLimiter(uint64_t bytes_per_sec) : bytes_per_sec_(bytes_per_sec) {}
+
+void RateLimiter::Acquire(uint64_t bytes) {
+    if (bytes_per_sec_ == 0) {
+        return;
+    }
+    int64_t wait_us;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        int64_t now = steadyNowUs();
+        next_us_ = std::max(next_us_, now);
+        wait_us = next_us_ - now;
+        next_us_ += static_cast<int64_t>(bytes * 1000000 / bytes_per_sec_);
+    }
+    if (wait_us >= 1000) {
+        fiber::Fiber::sleep(wait_us / 1000);
+    }
+}
+
+// ============================================================================
+// 备份文件
+// ============================================================================
+
+bool WriteBackupFile(const std::string& path, const BackupImage& image, size_t chunk_bytes, RateLimiter* limiter) {
+    BackupFileWriter writer(path);
+    if (!writer.Open(image.info)) {
+        return false;
+    }
+    chunk_bytes = std::max<size_t>(chunk_bytes, 1);
+    for (size_t offset = 0; offset < image.snapshot.size(); offset += chunk_bytes) {
+        size_t n = std::min(chunk_bytes, image.snapshot.size() - offset);
+        if (limiter) {
+            limiter->Acquire(n);
+        }
+        if (!writer.Append(image.snapshot.data() + offset, n)) {
+            return false;
+        }
+    }
+    return writer.Commit(image.info);
+}
+
+bool ExportBackup(KvStateMachine& sm, uint64_t index, const std::string& path, const BackupOptions& options,
+                  BackupInfo* info) {
+    auto start = std::chrono::steady_clock::now();
+    auto backup = BackupExport::Open(sm, index);
+    if (!backup) {
+        LOG_ERROR("Backup: no read view at index {} (last applied {})", index, sm.LastApplied());
+        return false;
+    }
+    BackupFileWriter writer(path);
+    if (!writer.Open(backup->Info())) {
+        return false;
+    }
+    RateLimiter limiter(options.bytes_per_sec);
+    uint64_t offset = 0;
+    std::string data;
+    bool last = false;
+    while (!last) {
+        backup->Read(offset, options.chunk_bytes, data, last);
+        limiter.Acquire(data.size());
+        if (!writer.Append(data.data(), data.size())) {
+            return false;
+        }
+        offset += data.size();
+    }
+    const BackupInfo& exported = backup->Info();
+    if (!writer.Commit(exported)) {
+        return false;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Backup: exported index {} to {} ({} bytes, {}ms)", exported.index, path, exported.size, elapsed);
+    if (info) {
+        *info = exported;
+    }
+    return true;
+}
+
+bool ReadBackupFile(const std::string& path, BackupImage& image) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        LOG_ERROR("Backup: cannot open {}", path);
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    BackupInfo info;
+    if (!decodeHeader(data, info)) {
+        LOG_ERROR("Backup: {} is not a backup file", path);
+        return false;
+    }
+    const char* snapshot = data.data() + kBackupHeaderSize;
+    size_t size = data.size() - kBackupHeaderSize;
+    if (size != info.size || Crc32(snapshot, size) != info.crc) {
+        LOG_ERROR("Backup: {} is corrupted (size {} / {})", path, size, info.size);
+        return false;
+    }
+    image.info = info;
+    image.snapshot.assign(snapshot, snapshot + size);
+    return true;
+}
+
+bool RestoreBackup(const std::string& path, const raft::PersisterPtr& persister) {
+    BackupImage image;
+    if (!ReadBackupFile(path, image)) {
+        return false;
+    }
+    persister->Save({}, image.snapshot);
+    LOG_INFO("Backup: restored index {} from {} ({} bytes)", image.info.index, path, image.info.size);
+    return true;
+}
+
+// ============================================================================
+// 客户端辅助：拉取备份
+// ============================================================================
+
+std::optional<std::string> FetchBackup(rpc::RpcClient& client, uint64_t index, const std::string& path,
+                                       BackupInfo& info) {
+    ExportReply start;
+    auto error = client.call(kMethodExport, ExportArgs{index}, start);
+    if (error.has_value()) {
+        return error;
+    }
+    if (start.status != KvStatus::OK) {
+        return "Export failed with status " + std::to_string(static_cast<int>(start.status));
+    }
+    info = BackupInfo{start.index, 0, 0};
+
+    BackupFileWriter writer(path);
+    if (!writer.Open(info)) {
+        return "cannot create " + path;
+    }
+    ExportReadArgs args{start.export_id, 0};
+    uint32_t crc = 0;
+    while (true) {
+        ExportReadReply reply;
+        error = client.call(kMethodExportRead, args, reply);
+        if (error.has_value()) {
+            return error;
+        }
+        if (reply.status != KvStatus::OK) {
+            return "ExportRead failed with status " + std::to_string(static_cast<int>(reply.status));
+        }
+        crc = Crc32(reply.data.data(), reply.data.size(), crc);
+        if (!writer.Append(reply.data.data(), reply.data.size())) {
+            return "cannot write " + path;
+        }
+        args.offset += reply.data.size();
+        if (reply.last) {
+            info.size = reply.size;
+            info.crc = reply.crc;
+            break;
+        }
+        if (reply.data.empty()) {
+            return "ExportRead returned no data at offset " + std::to_string(args.offset);
+        }
+    }
+    if (args.offset != info.size || crc != info.crc) {
+        return "backup checksum mismatch";
+    }
+    if (!writer.Commit(info)) {
+        return "cannot write " + path;
+    }
+    return std::nullopt;
+}
+
+} // namespace kv
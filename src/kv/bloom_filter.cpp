@@ -0,0 +1,204 @@
+#include "include/bloom_filter.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KV_BLOOM_X86 1
+#endif
+
+namespace kv {
+
+// ============================================================================
+// 探测内核
+// ============================================================================
+
+namespace {
+
+constexpr uint8_t kBlockedFormat = 0x80;    // 与块数据区分的格式标记
+
+// 8个奇数盐值，使每个字中的位相互独立
+constexpr uint32_t kSalt[8] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+inline size_t blockIndex(uint64_t hash, size_t num_blocks) {
+    // 用乘法代替取模，把高32位均匀映射到[0, num_blocks)
+    return static_cast<size_t>(((hash >> 32) * num_blocks) >> 32);
+}
+
+inline uint32_t bitOf(uint32_t key, int i) {
+    return 1u << ((key * kSalt[i]) >> 27);
+}
+
+void insertScalar(uint32_t* words, uint32_t key) {
+    for (int i = 0; i < 8; ++i) {
+        words[i] |= bitOf(key, i);
+    }
+}
+
+bool probeScalar(const uint32_t* words, uint32_t key) {
+    for (int i = 0; i < 8; ++i) {
+        if ((words[i] & bitOf(key, i)) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef KV_BLOOM_X86
+
+__attribute__((target("avx2"))) inline __m256i makeMask(uint32_t key) {
+    const __m256i salt = _mm256_setr_epi32(
+        static_cast<int>(kSalt[0]), static_cast<int>(kSalt[1]), static_cast<int>(kSalt[2]),
+        static_cast<int>(kSalt[3]), static_cast<int>(kSalt[4]), static_cast<int>(kSalt[5]),
+        static_cast<int>(kSalt[6]), static_cast<int>(kSalt[7]));
+    __m256i h = _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(key)), salt);
+    h = _mm256_srli_epi32(h, 27);
+    return _mm256_sllv_epi32(_mm256_set1_epi32(1), h);
+}
+
+__attribute__((target("avx2"))) void insertAvx2(uint32_t* words, uint32_t key) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+    block = _mm256_or_si256(block, makeMask(key));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), block);
+}
+
+__attribute__((target("avx2"))) bool probeAvx2(const uint32_t* words, uint32_t key) {
+    // SST中的过滤器来自std::string，不保证32字节对齐，使用非对齐加载
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+    // testc: (~block & mask) == 0，即mask中的位在block中全部置1
+    return _mm256_testc_si256(block, makeMask(key)) != 0;
+}
+
+bool detectAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool detectAvx2() {
+    return false;
+}
+
+#endif
+
+const bool kHasAvx2 = detectAvx2();
+
+inline void insertBlock(uint32_t* words, uint32_t key) {
+#ifdef KV_BLOOM_X86
+    if (kHasAvx2) {
+        insertAvx2(words, key);
+        return;
+    }
+#endif
+    insertScalar(words, key);
+}
+
+inline bool probeBlock(const uint32_t* words, uint32_t key) {
+#ifdef KV_BLOOM_X86
+    if (kHasAvx2) {
+        return probeAvx2(words, key);
+    }
+#endif
+    return probeScalar(words, key);
+}
+
+size_t blocksFor(size_t expected_keys, int bits_per_key) {
+    size_t bits = expected_keys * static_cast<size_t>(std::max(bits_per_key, 1));
+    return std::max<size_t>((bits + 255) / 256, 1);
+}
+
+} // namespace
+
+// ============================================================================
+// BlockedBloomFilter
+// ============================================================================
+
+BlockedBloomFilter::BlockedBloomFilter(size_t expected_keys, int bits_per_key) :
+    blocks_(blocksFor(expected_keys, bits_per_key), BloomBlock{}) {}
+
+void BlockedBloomFilter::Add(uint64_t hash) {
+    insertBlock(blocks_[blockIndex(hash, blocks_.size())].words, static_cast<uint32_t>(hash));
+}
+
+bool BlockedBloomFilter::MayContain(uint64_t hash) const {
+    return probeBlock(blocks_[blockIndex(hash, blocks_.size())].words, static_cast<uint32_t>(hash));
+}
+
+bool BlockedBloomFilter::MayContainScalar(uint64_t hash) const {
+    return probeScalar(blocks_[blockIndex(hash, blocks_.size())].words, static_cast<uint32_t>(hash));
+}
+
+bool BlockedBloomFilter::MayContainAvx2(uint64_t hash) const {
+#ifdef KV_BLOOM_X86
+    if (kHasAvx2) {
+        return probeAvx2(blocks_[blockIndex(hash, blocks_.size())].words, static_cast<uint32_t>(hash));
+    }
+#endif
+    return false;
+}
+
+std::string BlockedBloomFilter::Serialize() const {
+    std::string filter(SizeBytes() + 1, '\0');
+    std::memcpy(filter.data(), blocks_.data(), SizeBytes());
+    filter.back() = static_cast<char>(kBlockedFormat);
+    return filter;
+}
+
+void BlockedBloomFilter::Clear() {
+    std::fill(blocks_.begin(), blocks_.end(), BloomBlock{});
+}
+
+// ============================================================================
+// BloomFilter
+// ============================================================================
+
+uint64_t BloomFilter::HashKey(const std::string& key) {
+    // FNV-1a，再用splitmix64的终结步骤打散低位
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+std::string BloomFilter::Build(const std::vector<uint64_t>& hashes, int bits_per_key) {
+    BlockedBloomFilter filter(hashes.size(), bits_per_key);
+    for (uint64_t hash : hashes) {
+        filter.Add(hash);
+    }
+    return filter.Serialize();
+}
+
+bool BloomFilter::MayContain(const std::string& filter, uint64_t hash) {
+    if (filter.size() < sizeof(BloomBlock) + 1 || static_cast<uint8_t>(filter.back()) != kBlockedFormat ||
+        (filter.size() - 1) % sizeof(BloomBlock) != 0) {
+        return true;
+    }
+    size_t num_blocks = (filter.size() - 1) / sizeof(BloomBlock);
+    const char* block = filter.data() + blockIndex(hash, num_blocks) * sizeof(BloomBlock);
+    // 标量路径逐字读取，需要对齐的副本；AVX2路径直接非对齐加载
+#ifdef KV_BLOOM_X86
+    if (kHasAvx2) {
+        return probeAvx2(reinterpret_cast<const uint32_t*>(block), static_cast<uint32_t>(hash));
+    }
+#endif
+    BloomBlock copy;
+    std::memcpy(copy.words, block, sizeof(copy.words));
+    return probeScalar(copy.words, static_cast<uint32_t>(hash));
+}
+
+bool BloomFilter::HasAvx2() {
+    return kHasAvx2;
+}
+
+} // namespace kv
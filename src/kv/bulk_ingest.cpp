@@ -0,0 +1,212 @@
+#include "include/bulk_ingest.h"
+#include "include/kv_engine.h"
+#include "logger.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kv {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char* kIngestPrefix = "ingest-";
+constexpr const char* kIngestSuffix = ".sst";
+constexpr size_t kChecksumChunk = 1 << 20;
+constexpr size_t kIngestWriteBatch = 4096;     // 默认Ingest每次Write的条目数
+
+} // namespace
+
+// ============================================================================
+// 导入文件
+// ============================================================================
+
+std::string IngestFileName(uint64_t ingest_id, uint64_t seq) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%016llx-%06llu%s", kIngestPrefix, static_cast<unsigned long long>(ingest_id),
+             static_cast<unsigned long long>(seq), kIngestSuffix);
+    return name;
+}
+
+bool ValidIngestFileName(const std::string& name) {
+    size_t prefix = std::strlen(kIngestPrefix);
+    size_t suffix = std::strlen(kIngestSuffix);
+    if (name.size() <= prefix + suffix || name.compare(0, prefix, kIngestPrefix) != 0 ||
+        name.compare(name.size() - suffix, suffix, kIngestSuffix) != 0) {
+        return false;
+    }
+    for (size_t i = prefix; i < name.size() - suffix; ++i) {
+        char c = name[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || c == '-')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string IngestFilePath(const std::string& dir, const std::string& name) {
+    return (fs::path(dir) / name).string();
+}
+
+bool ChecksumFile(const std::string& path, uint64_t& size, uint32_t& crc) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::string buffer(kChecksumChunk, '\0');
+    size = 0;
+    crc = 0;
+    bool ok = true;
+    while (true) {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        crc = Crc32(buffer.data(), n, crc);
+        size += n;
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool VerifyIngestFile(const std::string& path, const IngestFile& file) {
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    if (!ChecksumFile(path, size, crc)) {
+        LOG_ERROR("Ingest: cannot read {}: {}", path, strerror(errno));
+        return false;
+    }
+    if (size != file.size || crc != file.crc) {
+        LOG_ERROR("Ingest: {} mismatch (size {} / {}, crc {:08x} / {:08x})", path, size, file.size, crc, file.crc);
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// IngestBuilder
+// ============================================================================
+
+IngestBuilder::IngestBuilder(uint64_t ingest_id, IngestOptions options) :
+    ingest_id_(ingest_id), options_(std::move(options)) {}
+
+IngestBuilder::~IngestBuilder() {
+    if (finished_) {
+        return;
+    }
+    // 写了一半的文件由SstBuilder的析构删除
+    for (const auto& file : files_) {
+        ::unlink(IngestFilePath(options_.dir, file.name).c_str());
+    }
+}
+
+bool IngestBuilder::Add(const std::vector<KvPair>& pairs) {
+    if (failed_ || finished_) {
+        return false;
+    }
+    // 先检查整批的顺序，保证失败时不写入任何条目
+    const std::string* prev = entries_ > 0 ? &last_key_ : nullptr;
+    for (const auto& pair : pairs) {
+        if (prev != nullptr && pair.key <= *prev) {
+            return false;
+        }
+        prev = &pair.key;
+    }
+
+    for (const auto& pair : pairs) {
+        if (!builder_) {
+            std::error_code ec;
+            fs::create_directories(options_.dir, ec);
+            builder_ = std::make_unique<SstBuilder>(
+                IngestFilePath(options_.dir, IngestFileName(ingest_id_, files_.size())), options_.sst);
+            if (!builder_->Open()) {
+                failed_ = true;
+                return false;
+            }
+        }
+        if (!builder_->Add(pair.key, pair.value, false)) {
+            failed_ = true;
+            return false;
+        }
+        if (builder_->EstimatedSize() >= options_.target_file_bytes && !finishFile()) {
+            failed_ = true;
+            return false;
+        }
+    }
+    if (!pairs.empty()) {
+        last_key_ = pairs.back().key;
+        entries_ += pairs.size();
+    }
+    return true;
+}
+
+bool IngestBuilder::finishFile() {
+    if (!builder_->Finish()) {
+        return false;
+    }
+    IngestFile file;
+    file.name = fs::path(builder_->Path()).filename().string();
+    file.size = builder_->FileSize();
+    file.crc = builder_->FileCrc();
+    file.entries = builder_->NumEntries();
+    files_.push_back(std::move(file));
+    builder_.reset();
+    return true;
+}
+
+bool IngestBuilder::Finish(std::vector<IngestFile>& files) {
+    if (failed_ || finished_ || (builder_ && !finishFile())) {
+        failed_ = true;
+        return false;
+    }
+    finished_ = true;
+    files = files_;
+    return true;
+}
+
+// ============================================================================
+// IKvEngine::Ingest 的默认实现
+// ============================================================================
+
+bool IKvEngine::Ingest(uint64_t index, const std::vector<std::string>& paths) {
+    std::vector<SstReaderPtr> readers;
+    for (const auto& path : paths) {
+        auto reader = SstReader::Open(path, 0);
+        if (!reader) {
+            return false;
+        }
+        readers.push_back(std::move(reader));
+    }
+
+    std::vector<KvMutation> batch;
+    std::vector<KvStatus> statuses;
+    batch.reserve(kIngestWriteBatch);
+    for (const auto& reader : readers) {
+        auto it = reader->NewIterator();
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            batch.push_back(KvMutation{it->deleted() ? KvOp::DELETE : KvOp::PUT, it->key(), it->value()});
+            if (batch.size() >= kIngestWriteBatch) {
+                Write(index, batch, statuses);
+                batch.clear();
+            }
+        }
+        if (!it->status()) {
+            // 文件在提交前已整体校验过，这里只可能是读取失败；已写入的部分无法撤销
+            LOG_ERROR("Ingest: failed to read {}", reader->Path());
+            return false;
+        }
+    }
+    if (!batch.empty()) {
+        Write(index, batch, statuses);
+    }
+    return true;
+}
+
+} // namespace kv
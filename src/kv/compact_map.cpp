@@ -0,0 +1,337 @@
+#include "include/compact_map.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace kv {
+
+namespace {
+
+// 大小分级：256字节以内按16字节，1KB以内按64字节，4KB以内按256字节
+constexpr size_t kSmallLimit = 256;
+constexpr size_t kMediumLimit = 1024;
+constexpr size_t kSmallClasses = kSmallLimit / 16;
+constexpr size_t kMediumClasses = (kMediumLimit - kSmallLimit) / 64;
+constexpr size_t kLargeClasses = (RecordArena::kMaxSlabSize - kMediumLimit) / 256;
+constexpr size_t kNumClasses = kSmallClasses + kMediumClasses + kLargeClasses;
+
+constexpr size_t kMinSlabBytes = 4096;
+constexpr size_t kMaxSlabBytes = 256 * 1024;
+
+size_t classCapacity(size_t cls) {
+    if (cls < kSmallClasses) {
+        return (cls + 1) * 16;
+    }
+    cls -= kSmallClasses;
+    if (cls < kMediumClasses) {
+        return kSmallLimit + (cls + 1) * 64;
+    }
+    cls -= kMediumClasses;
+    return kMediumLimit + (cls + 1) * 256;
+}
+
+} // namespace
+
+// ============================================================================
+// RecordArena
+// ============================================================================
+
+RecordArena::~RecordArena() {
+    for (void* slab : slabs_) {
+        ::operator delete(slab);
+    }
+}
+
+size_t RecordArena::classOf(size_t size) {
+    if (size <= kSmallLimit) {
+        return size == 0 ? 0 : (size + 15) / 16 - 1;
+    }
+    if (size <= kMediumLimit) {
+        return kSmallClasses + (size - kSmallLimit + 63) / 64 - 1;
+    }
+    return kSmallClasses + kMediumClasses + (size - kMediumLimit + 255) / 256 - 1;
+}
+
+size_t RecordArena::CapacityFor(size_t size) {
+    return size > kMaxSlabSize ? size : classCapacity(classOf(size));
+}
+
+void* RecordArena::Allocate(size_t size, size_t& capacity) {
+    if (size > kMaxSlabSize) {
+        capacity = size;
+        allocated_bytes_ += size;
+        used_bytes_ += size;
+        return ::operator new(size);
+    }
+
+    if (classes_.empty()) {
+        classes_.resize(kNumClasses);
+    }
+    size_t cls = classOf(size);
+    capacity = classCapacity(cls);
+    used_bytes_ += capacity;
+    SizeClass& sc = classes_[cls];
+    if (sc.free_list != nullptr) {
+        FreeBlock* block = sc.free_list;
+        sc.free_list = block->next;
+        return block;
+    }
+    if (sc.cursor == nullptr || static_cast<size_t>(sc.limit - sc.cursor) < capacity) {
+        // 每个级别的slab从小到大翻倍，少量数据时不预占大块内存
+        if (sc.slab_bytes == 0) {
+            sc.slab_bytes = std::max(kMinSlabBytes, capacity * 8);
+        }
+        size_t bytes = sc.slab_bytes / capacity * capacity;
+        sc.cursor = static_cast<char*>(::operator new(bytes));
+        sc.limit = sc.cursor + bytes;
+        slabs_.push_back(sc.cursor);
+        allocated_bytes_ += bytes;
+        sc.slab_bytes = std::min(sc.slab_bytes * 2, kMaxSlabBytes);
+    }
+    void* block = sc.cursor;
+    sc.cursor += capacity;
+    return block;
+}
+
+void RecordArena::Free(void* block, size_t capacity) {
+    used_bytes_ -= capacity;
+    if (capacity > kMaxSlabSize) {
+        allocated_bytes_ -= capacity;
+        ::operator delete(block);
+        return;
+    }
+    SizeClass& sc = classes_[classOf(capacity)];
+    auto* free_block = static_cast<FreeBlock*>(block);
+    free_block->next = sc.free_list;
+    sc.free_list = free_block;
+}
+
+// ============================================================================
+// CompactMap
+// ============================================================================
+
+CompactMap::~CompactMap() {
+    // arena析构时整体归还slab，这里只需释放大块
+    for (const Slot& slot : slots_) {
+        if (slot.record != nullptr && slot.record->capacity > RecordArena::kMaxSlabSize) {
+            freeRecord(slot.record);
+        }
+    }
+}
+
+CompactMap::CompactMap(const CompactMap& other) :
+    slots_(other.slots_.size()), size_(other.size_), compression_(other.compression_), dict_(other.dict_),
+    min_compress_bytes_(other.min_compress_bytes_) {
+    // 槽位位置不变，只把记录复制到新的arena中（压缩的值原样复制）
+    for (size_t i = 0; i < other.slots_.size(); ++i) {
+        const Slot& slot = other.slots_[i];
+        if (slot.record != nullptr) {
+            slots_[i].hash = slot.hash;
+            slots_[i].record = newRecord(slot.record->Key(), slot.record->Value(), 0, slot.record->compressed);
+        }
+    }
+}
+
+CompactMap::Record* CompactMap::newRecord(std::string_view key, std::string_view value, size_t reserve,
+                                          bool compressed) {
+    size_t capacity = 0;
+    void* block = arena_.Allocate(sizeof(Record) + key.size() + value.size() + reserve, capacity);
+    auto* record = static_cast<Record*>(block);
+    record->key_size = static_cast<uint32_t>(key.size());
+    record->value_size = static_cast<uint32_t>(value.size());
+    record->capacity = static_cast<uint32_t>(capacity);
+    record->compressed = compressed;
+    std::memcpy(record->Data(), key.data(), key.size());
+    std::memcpy(record->Data() + key.size(), value.data(), value.size());
+    return record;
+}
+
+void CompactMap::freeRecord(Record* record) {
+    arena_.Free(record, record->capacity);
+}
+
+bool CompactMap::encodeValue(std::string_view value, std::string& buffer) const {
+    if (!compression_ || value.size() < min_compress_bytes_) {
+        return false;
+    }
+    buffer = Compress(value, dict_.get());
+    return buffer.size() < value.size();
+}
+
+void CompactMap::decodeValue(const Record* record, std::string& out) const {
+    // 记录只由本表写入，解压失败说明内存被破坏，返回空值
+    if (!Decompress(record->Value(), dict_.get(), out)) {
+        out.clear();
+    }
+}
+
+void CompactMap::SetCompression(CompressionDictPtr dict, size_t min_value_bytes) {
+    compression_ = true;
+    dict_ = std::move(dict);
+    min_compress_bytes_ = min_value_bytes;
+}
+
+void CompactMap::CompressAll() {
+    std::string buffer;
+    for (Slot& slot : slots_) {
+        Record* record = slot.record;
+        if (record == nullptr || record->compressed || !encodeValue(record->Value(), buffer)) {
+            continue;
+        }
+        slot.record = newRecord(record->Key(), buffer, 0, true);
+        freeRecord(record);
+    }
+}
+
+size_t CompactMap::findSlot(std::string_view key, uint64_t hash) const {
+    if (slots_.empty()) {
+        return kNotFound;
+    }
+    for (size_t i = hash & mask();; i = (i + 1) & mask()) {
+        const Slot& slot = slots_[i];
+        if (slot.record == nullptr) {
+            return kNotFound;
+        }
+        if (slot.hash == hash && slot.record->Key() == key) {
+            return i;
+        }
+    }
+}
+
+bool CompactMap::Get(std::string_view key, uint64_t hash, std::string& out) const {
+    size_t i = findSlot(key, hash);
+    if (i == kNotFound) {
+        return false;
+    }
+    const Record* record = slots_[i].record;
+    if (record->compressed) {
+        decodeValue(record, out);
+    } else {
+        out.assign(record->Value().data(), record->Value().size());
+    }
+    return true;
+}
+
+bool CompactMap::Contains(std::string_view key, uint64_t hash) const {
+    return findSlot(key, hash) != kNotFound;
+}
+
+void CompactMap::grow() {
+    std::vector<Slot> old = std::move(slots_);
+    slots_.assign(old.empty() ? 16 : old.size() * 2, Slot());
+    for (const Slot& slot : old) {
+        if (slot.record == nullptr) {
+            continue;
+        }
+        size_t i = slot.hash & mask();
+        while (slots_[i].record != nullptr) {
+            i = (i + 1) & mask();
+        }
+        slots_[i] = slot;
+    }
+}
+
+bool CompactMap::Put(std::string_view key, uint64_t hash, std::string_view value) {
+    std::string buffer;
+    bool compressed = encodeValue(value, buffer);
+    if (compressed) {
+        value = buffer;
+    }
+
+    size_t i = findSlot(key, hash);
+    if (i != kNotFound) {
+        Record* record = slots_[i].record;
+        if (sizeof(Record) + key.size() + value.size() <= record->capacity) {
+            // 新值放得下时原地覆盖
+            std::memcpy(record->Data() + key.size(), value.data(), value.size());
+            record->value_size = static_cast<uint32_t>(value.size());
+            record->compressed = compressed;
+        } else {
+            slots_[i].record = newRecord(key, value, 0, compressed);
+            freeRecord(record);
+        }
+        return false;
+    }
+
+    if ((size_ + 1) * 4 > slots_.size() * 3) {
+        grow();
+    }
+    i = hash & mask();
+    while (slots_[i].record != nullptr) {
+        i = (i + 1) & mask();
+    }
+    slots_[i].hash = hash;
+    slots_[i].record = newRecord(key, value, 0, compressed);
+    ++size_;
+    return true;
+}
+
+bool CompactMap::Append(std::string_view key, uint64_t hash, std::string_view value) {
+    size_t i = findSlot(key, hash);
+    if (i == kNotFound) {
+        return Put(key, hash, value);
+    }
+    Record* record = slots_[i].record;
+    if (record->compressed) {
+        // 解压后以原文存放并预留空间，之后的追加走原地写入
+        std::string current;
+        decodeValue(record, current);
+        current.append(value.data(), value.size());
+        slots_[i].record = newRecord(key, current, current.size() / 2, false);
+        freeRecord(record);
+        return false;
+    }
+    size_t old_size = record->value_size;
+    if (record->Bytes() + value.size() <= record->capacity) {
+        std::memcpy(record->Data() + key.size() + old_size, value.data(), value.size());
+        record->value_size = static_cast<uint32_t>(old_size + value.size());
+        return false;
+    }
+    // 反复追加的值按1.5倍预留空间，均摊复制代价
+    std::string_view old_value = record->Value();
+    Record* grown = newRecord(key, old_value, value.size() + (old_size + value.size()) / 2, false);
+    std::memcpy(grown->Data() + key.size() + old_size, value.data(), value.size());
+    grown->value_size = static_cast<uint32_t>(old_size + value.size());
+    slots_[i].record = grown;
+    freeRecord(record);
+    return false;
+}
+
+bool CompactMap::Erase(std::string_view key, uint64_t hash) {
+    size_t i = findSlot(key, hash);
+    if (i == kNotFound) {
+        return false;
+    }
+    freeRecord(slots_[i].record);
+    --size_;
+
+    // 后移删除：把探测链上后续的槽位前移填补空洞，查找无需识别墓碑
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask(); slots_[j].record != nullptr; j = (j + 1) & mask()) {
+        size_t home = slots_[j].hash & mask();
+        // home不在(hole, j]循环区间内时，j可以移到hole
+        bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+        if (movable) {
+            slots_[hole] = slots_[j];
+            hole = j;
+        }
+    }
+    slots_[hole] = Slot();
+    return true;
+}
+
+void CompactMap::Clear() {
+    for (Slot& slot : slots_) {
+        if (slot.record != nullptr) {
+            freeRecord(slot.record);
+        }
+        slot = Slot();
+    }
+    size_ = 0;
+}
+
+size_t CompactMap::MemoryUsage() const {
+    return slots_.capacity() * sizeof(Slot) + arena_.AllocatedBytes();
+}
+
+} // namespace kv
@@ -0,0 +1,131 @@
+#ifndef KV_BACKUP_H
+#define KV_BACKUP_H
+
+#include "kv_state_machine.h"
+#include "kv_rpc.h"
+#include "persister.h"
+#include "sync.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// 在线备份
+// ============================================================================
+// 备份是某个已apply的index上的一致性快照，可以按普通快照加载（压缩格式，见SnapshotStream）。
+// 快照通过引擎的读视图取得，不暂停apply；导出期间一直持有读视图，按块边编码边发送，
+// 编码的速度跟随受带宽限制的发送，内存中不保留完整的快照。
+//
+// - 导出到本地文件：ExportBackup
+// - 通过RPC导出给客户端：KV.Export 取得备份信息后用 KV.ExportRead 按块拉取（FetchBackup）
+// - 恢复：RestoreBackup 把快照写入新集群各节点的IPersister，节点启动后按普通快照加载
+//
+// 备份只包含数据和TTL，不包含会话表：恢复出的是新集群，客户端需要重新建立会话。
+// index早于LastApplied()时需要引擎还保留着该index上的版本（OrderedEngine），
+// TTL取导出时TTL索引中仍在该视图里的key。
+//
+// 备份文件：[8字节magic][u64 index][u64 快照长度][u32 快照CRC32][快照]
+// 快照长度和CRC32在导出结束时才知道，写完快照后回填文件头
+
+struct BackupOptions {
+    uint64_t bytes_per_sec = 32 << 20;          // 导出限速（本节点所有导出共享），0表示不限
+    size_t chunk_bytes = 1 << 20;               // 每次写文件/每个KV.ExportRead响应的字节数
+    uint64_t session_timeout_ms = 10 * 60 * 1000;  // 超过这么久没有读取的导出会话被丢弃
+};
+
+struct BackupInfo {
+    uint64_t index = 0;     // 快照对应的Raft index
+    uint64_t size = 0;      // 快照字节数
+    uint32_t crc = 0;       // 快照的CRC32
+};
+
+// 读入内存的一份备份（ReadBackupFile）
+struct BackupImage {
+    BackupInfo info;
+    std::vector<uint8_t> snapshot;
+};
+
+// ============================================================================
+// BackupExport - 一次进行中的导出
+// ============================================================================
+// 持有index上的读视图，Read按offset顺序取出快照；只保留最近一次Read返回的数据，
+// 以便用同一个offset重试。不是线程安全的，调用方自己串行化。
+class BackupExport {
+public:
+    // 在index（0表示LastApplied()）上开始导出，可在任意fiber中调用
+    // index上的读视图不可得时返回nullptr
+    static std::unique_ptr<BackupExport> Open(KvStateMachine& sm, uint64_t index);
+
+    uint64_t Index() const { return info_.index; }
+
+    // 从offset读取最多max_bytes字节。offset只能是上一次Read的起点（重试）或终点，
+    // 否则返回false。last为true时已读到结尾，Info()中是完整快照的大小和CRC32
+    bool Read(uint64_t offset, size_t max_bytes, std::string& data, bool& last);
+
+    const BackupInfo& Info() const { return info_; }
+
+private:
+    explicit BackupExport(std::unique_ptr<SnapshotStream> stream) : stream_(std::move(stream)) {
+        info_.index = stream_->Index();
+    }
+
+    std::unique_ptr<SnapshotStream> stream_;
+    BackupInfo info_;           // size / crc为已编码部分的长度和CRC32
+    std::string buffer_;        // 从buffer_offset_开始、已编码还未确认的数据
+    uint64_t buffer_offset_ = 0;    // 上一次Read的起点
+    uint64_t read_end_ = 0;         // 上一次Read的终点
+    bool finished_ = false;     // 编码已结束
+};
+
+// ============================================================================
+// RateLimiter - 按字节限速
+// ============================================================================
+// 每次Acquire按速率预约一段时间，预约排到将来时睡眠当前fiber；线程安全。
+// 空闲后不积累额度，突发不超过一次Acquire的字节数。
+class RateLimiter {
+public:
+    // bytes_per_sec为0表示不限速
+    explicit RateLimiter(uint64_t bytes_per_sec);
+
+    void Acquire(uint64_t bytes);
+
+private:
+    uint64_t bytes_per_sec_;
+    fiber::FiberMutex mu_;
+    int64_t next_us_ = 0;       // 下一次Acquire可以开始的时间
+};
+
+// ============================================================================
+// 备份文件
+// ============================================================================
+
+// 导出到本地文件：先写临时文件，fsync后rename为path，失败时不留下文件
+// 成功时info（可为空）为导出的备份信息
+bool ExportBackup(KvStateMachine& sm, uint64_t index, const std::string& path,
+                  const BackupOptions& options = {}, BackupInfo* info = nullptr);
+
+// 把已编码的备份写成文件，limiter为空表示不限速
+bool WriteBackupFile(const std::string& path, const BackupImage& image, size_t chunk_bytes = 1 << 20,
+                     RateLimiter* limiter = nullptr);
+
+// 读取备份文件并核对长度和CRC32
+bool ReadBackupFile(const std::string& path, BackupImage& image);
+
+// 用备份初始化新节点：快照写入persister，Raft状态为空
+bool RestoreBackup(const std::string& path, const raft::PersisterPtr& persister);
+
+// ============================================================================
+// 客户端辅助：拉取备份
+// ============================================================================
+// 发送 KV.Export 后逐块 KV.ExportRead，写入本地文件path（格式同ExportBackup）。
+// 返回 std::nullopt 表示成功，info为备份信息；否则为错误消息，不留下文件。
+std::optional<std::string> FetchBackup(rpc::RpcClient& client, uint64_t index, const std::string& path,
+                                       BackupInfo& info);
+
+} // namespace kv
+
+#endif // KV_BACKUP_H
@@ -0,0 +1,76 @@
+#ifndef KV_BLOOM_FILTER_H
+#define KV_BLOOM_FILTER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// 分块布隆过滤器（split block bloom filter）
+// ============================================================================
+// 过滤器由若干个256位的块组成，一个key只落在一个块内：高32位哈希选块，
+// 低32位哈希分别乘以8个奇数盐值，在块内的8个32位字中各置1位。
+// 一次探测只访问一条cache line，8个字的计算正好对应一条AVX2指令序列；
+// 运行时检测CPU，不支持AVX2时使用结果相同的标量实现。
+// 相同bits_per_key下误判率略高于经典布隆过滤器（约高10%~30%），换来稳定的单次访存。
+
+// 一个过滤器块：8个32位字，按32字节对齐
+struct alignas(32) BloomBlock {
+    uint32_t words[8];
+};
+
+// ============================================================================
+// BlockedBloomFilter - 内存中的可变过滤器
+// ============================================================================
+// 只支持插入；删除key后需要重建过滤器才能降低误判率。
+class BlockedBloomFilter {
+public:
+    // 按预计key数和每个key的位数分配空间（至少一个块）
+    BlockedBloomFilter(size_t expected_keys, int bits_per_key);
+
+    void Add(uint64_t hash);
+    bool MayContain(uint64_t hash) const;
+
+    // 强制使用指定实现，供基准测试对比；AVX2不可用时返回false
+    bool MayContainScalar(uint64_t hash) const;
+    bool MayContainAvx2(uint64_t hash) const;
+
+    size_t NumBlocks() const { return blocks_.size(); }
+    size_t SizeBytes() const { return blocks_.size() * sizeof(BloomBlock); }
+
+    // 序列化为 BloomFilter::MayContain 可直接探测的字节串
+    std::string Serialize() const;
+
+    void Clear();
+
+private:
+    std::vector<BloomBlock> blocks_;
+};
+
+// ============================================================================
+// BloomFilter - SST文件内的过滤器
+// ============================================================================
+// 格式：[块0] ... [块N-1] [u8 格式标记]。
+// 过滤器以字节串形式写入SST，读取时无需反序列化，直接在字节上探测。
+// 哈希函数与进程无关（不使用std::hash），保证写入磁盘的过滤器在重启后仍然有效。
+class BloomFilter {
+public:
+    // key的64位哈希，构建和探测必须使用同一个哈希值
+    static uint64_t HashKey(const std::string& key);
+
+    // 按每个key bits_per_key位构建过滤器
+    static std::string Build(const std::vector<uint64_t>& hashes, int bits_per_key);
+
+    // 可能包含返回true；返回false时key一定不存在
+    // 过滤器为空或格式无法识别时保守地返回true
+    static bool MayContain(const std::string& filter, uint64_t hash);
+
+    // 当前CPU是否使用AVX2探测
+    static bool HasAvx2();
+};
+
+} // namespace kv
+
+#endif // KV_BLOOM_FILTER_H
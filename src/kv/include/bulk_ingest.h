@@ -0,0 +1,88 @@
+#ifndef KV_BULK_INGEST_H
+#define KV_BULK_INGEST_H
+
+#include "kv_command.h"
+#include "sst.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// 批量导入
+// ============================================================================
+// 逐条Put的初始加载每个key都要走一遍Raft日志、apply和memtable，速度远低于磁盘带宽。
+// 批量导入绕过逐条复制：
+//
+// 1. 客户端按key升序流式发送键值对（KV.IngestWrite），leader用IngestBuilder直接
+//    写成SST文件放在暂存目录中，按target_file_bytes切分；
+// 2. 提交（KV.IngestCommit）时把文件复制到其他副本的暂存目录（KV.IngestPush），
+//    然后只提交一条INGEST日志，其中按文件名引用文件并带上大小和CRC32；
+// 3. 各副本apply时核对文件后交给引擎：LsmEngine把文件硬链接进数据目录，放到
+//    不与已有数据重叠的最深一层，数据不再经过memtable和compaction重写；
+//    内存引擎读出文件后按批写入。
+//
+// 导入的数据覆盖同名key的原值（并清除原有TTL），不产生watch事件。
+
+struct IngestOptions {
+    std::string dir;                            // 暂存目录，为空时不支持导入
+    uint64_t target_file_bytes = 64 << 20;      // 单个导入文件的大小
+    SstOptions sst;                             // 导入文件的块大小、布隆过滤器和压缩
+    uint64_t session_timeout_ms = 10 * 60 * 1000;  // 超过这么久没有写入的导入会话被放弃
+};
+
+// 暂存目录中的导入文件名："ingest-<会话id>-<序号>.sst"
+std::string IngestFileName(uint64_t ingest_id, uint64_t seq);
+
+// 文件名由对端提供，只接受IngestFileName生成的格式，防止写到暂存目录之外
+bool ValidIngestFileName(const std::string& name);
+
+std::string IngestFilePath(const std::string& dir, const std::string& name);
+
+// 读取整个文件计算大小和CRC32
+bool ChecksumFile(const std::string& path, uint64_t& size, uint32_t& crc);
+
+// 文件存在且大小、CRC32与file一致
+bool VerifyIngestFile(const std::string& path, const IngestFile& file);
+
+// ============================================================================
+// IngestBuilder - 把按key升序到达的键值对写成若干个导入文件
+// ============================================================================
+// 单线程使用。析构时删除未Finish的全部文件。
+class IngestBuilder {
+public:
+    IngestBuilder(uint64_t ingest_id, IngestOptions options);
+    ~IngestBuilder();
+
+    IngestBuilder(const IngestBuilder&) = delete;
+    IngestBuilder& operator=(const IngestBuilder&) = delete;
+
+    // 追加一批键值对，key必须（跨批次）严格递增
+    // 顺序不对时返回false且整批都不写入；磁盘错误时返回false，之后的调用都失败
+    bool Add(const std::vector<KvPair>& pairs);
+
+    // 写完最后一个文件，files为全部文件（按key升序）；之后文件由调用方负责删除
+    bool Finish(std::vector<IngestFile>& files);
+
+    uint64_t NumEntries() const { return entries_; }
+
+private:
+    bool finishFile();
+
+    uint64_t ingest_id_;
+    IngestOptions options_;
+    std::unique_ptr<SstBuilder> builder_;
+    std::vector<IngestFile> files_;
+    std::string last_key_;
+    uint64_t entries_ = 0;
+    bool failed_ = false;
+    bool finished_ = false;
+};
+
+using IngestBuilderPtr = std::unique_ptr<IngestBuilder>;
+
+} // namespace kv
+
+#endif // KV_BULK_INGEST_H
@@ -0,0 +1,172 @@
+#ifndef KV_COMPACT_MAP_H
+#define KV_COMPACT_MAP_H
+
+#include "value_codec.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// RecordArena - 按大小分级的slab分配器
+// ============================================================================
+// 小于等于kMaxSlabSize的块按大小分级，从按级别划分的slab中切出，释放后挂入
+// 该级别的空闲链表复用；更大的块直接向系统申请。slab只在arena析构时归还。
+// 不加锁，由持有者（哈希表）负责同步。
+class RecordArena {
+public:
+    static constexpr size_t kMaxSlabSize = 4096;
+
+    RecordArena() = default;
+    ~RecordArena();
+
+    RecordArena(const RecordArena&) = delete;
+    RecordArena& operator=(const RecordArena&) = delete;
+
+    // 分配至少size字节，返回块及其实际容量
+    void* Allocate(size_t size, size_t& capacity);
+    void Free(void* block, size_t capacity);
+
+    // size字节的请求实际占用的容量
+    static size_t CapacityFor(size_t size);
+
+    // 向系统申请的字节数（slab + 大块）
+    size_t AllocatedBytes() const { return allocated_bytes_; }
+
+    // 正在使用的字节数（按实际容量计）
+    size_t UsedBytes() const { return used_bytes_; }
+
+private:
+    static size_t classOf(size_t size);
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct SizeClass {
+        FreeBlock* free_list = nullptr;
+        char* cursor = nullptr;     // 当前slab中未切分部分的起点
+        char* limit = nullptr;
+        size_t slab_bytes = 0;      // 下一个slab的大小，按级别逐步翻倍
+    };
+
+    std::vector<SizeClass> classes_;
+    std::vector<void*> slabs_;
+    size_t allocated_bytes_ = 0;
+    size_t used_bytes_ = 0;
+};
+
+// ============================================================================
+// CompactMap - 紧凑的字符串哈希表
+// ============================================================================
+// 每个键值对是一条记录：[u32 key长度][u32 value长度][u32 块容量][key][value]，key和value
+// 连续存放在同一个arena块中，不再各自占用一次堆分配（也没有std::string的
+// 32字节对象头和链表节点）。小记录按16字节粒度分级，落在同一条或相邻的cache line上。
+// 索引是线性探测的开放寻址表，槽位为 {64位哈希, 记录指针}，一条cache line放4个槽位；
+// 查找比较完整哈希后才访问记录，命中时通常只触碰一条槽位行和一条记录行。
+// 删除使用后移法，不留墓碑。
+//
+// 值压缩（可选）：SetCompression之后，不小于min_value_bytes的值用字典压缩后存放，
+// 记录上带压缩标记，读取（Get/ForEach）时才解压。压缩后的值被追加时解压并以
+// 原文形式重新存放，连续追加不会反复压缩。
+//
+// 哈希值由调用方计算并传入（与std::hash<std::string>一致），便于与分片选择、
+// 过滤器共用同一次计算。不加锁，并发控制由调用方负责；const方法不修改任何状态，
+// 冻结后可被多个读者并发访问。
+class CompactMap {
+public:
+    CompactMap() = default;
+    ~CompactMap();
+
+    // 深拷贝：新表使用自己的arena（用于写时复制）
+    CompactMap(const CompactMap& other);
+    CompactMap& operator=(const CompactMap&) = delete;
+
+    // 存在时把value写入out并返回true
+    bool Get(std::string_view key, uint64_t hash, std::string& out) const;
+    bool Contains(std::string_view key, uint64_t hash) const;
+
+    // 返回是否为新key
+    bool Put(std::string_view key, uint64_t hash, std::string_view value);
+    bool Append(std::string_view key, uint64_t hash, std::string_view value);
+
+    // key存在时删除并返回true
+    bool Erase(std::string_view key, uint64_t hash);
+
+    void Clear();
+
+    // 之后写入的值按字典压缩；dict为空时仍压缩，只是没有字典可引用
+    void SetCompression(CompressionDictPtr dict, size_t min_value_bytes);
+
+    // 把已有的未压缩值按当前设置重新压缩（训练出字典后调用一次）
+    void CompressAll();
+
+    size_t Size() const { return size_; }
+
+    // 占用的内存：槽位数组 + arena向系统申请的字节
+    size_t MemoryUsage() const;
+
+    // 遍历所有键值对：visitor(std::string_view key, std::string_view value)
+    template <typename Visitor>
+    void ForEach(Visitor&& visitor) const {
+        std::string buffer;
+        for (const Slot& slot : slots_) {
+            const Record* record = slot.record;
+            if (record == nullptr) {
+                continue;
+            }
+            if (record->compressed) {
+                decodeValue(record, buffer);
+                visitor(record->Key(), std::string_view(buffer));
+            } else {
+                visitor(record->Key(), record->Value());
+            }
+        }
+    }
+
+private:
+    struct Record {
+        uint32_t key_size;
+        uint32_t value_size;
+        uint32_t capacity : 31; // 所在块的容量（含记录头），追加时放得下就原地写入
+        uint32_t compressed : 1;  // value是Compress的输出
+
+        char* Data() { return reinterpret_cast<char*>(this + 1); }
+        const char* Data() const { return reinterpret_cast<const char*>(this + 1); }
+        std::string_view Key() const { return std::string_view(Data(), key_size); }
+        std::string_view Value() const { return std::string_view(Data() + key_size, value_size); }
+        size_t Bytes() const { return sizeof(Record) + key_size + value_size; }
+    };
+
+    struct Slot {
+        uint64_t hash = 0;
+        Record* record = nullptr;
+    };
+
+    size_t findSlot(std::string_view key, uint64_t hash) const;
+    size_t mask() const { return slots_.size() - 1; }
+    void grow();
+    Record* newRecord(std::string_view key, std::string_view value, size_t reserve, bool compressed);
+    void freeRecord(Record* record);
+
+    // 按当前设置编码要存放的值：需要压缩且压缩后更小时写入buffer并返回true
+    bool encodeValue(std::string_view value, std::string& buffer) const;
+    void decodeValue(const Record* record, std::string& out) const;
+
+    static constexpr size_t kNotFound = SIZE_MAX;
+
+    std::vector<Slot> slots_;   // 容量为2的幂，负载不超过3/4
+    size_t size_ = 0;
+    RecordArena arena_;
+
+    bool compression_ = false;
+    CompressionDictPtr dict_;
+    size_t min_compress_bytes_ = 0;
+};
+
+} // namespace kv
+
+#endif // KV_COMPACT_MAP_H
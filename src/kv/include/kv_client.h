@@ -0,0 +1,149 @@
+#ifndef KV_CLIENT_H
+#define KV_CLIENT_H
+
+#include "kv_rpc.h"
+#include "shard_map.h"
+#include "rpc_client.h"
+#include "channel.h"
+#include "sync.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+struct KvClientOptions {
+    std::vector<std::string> endpoints;     // 集群节点地址（"host:port"）
+    bool sharded = false;                   // 节点运行ShardedKvService时按分片表路由
+
+    int max_attempts = 8;                   // 单个请求最多失败几次（连接失败、没有leader提示的重定向）
+    uint64_t backoff_min_ms = 5;            // 重试的退避时间，每次失败翻倍
+    uint64_t backoff_max_ms = 500;
+    int64_t rpc_timeout_ms = 3000;
+
+    size_t max_batch = 128;                 // 合并并发的Get/Put时一批最多的key数，0表示不合并
+};
+
+struct KvClientStats {
+    uint64_t requests = 0;      // 调用方发起的请求数
+    uint64_t rpcs = 0;          // 实际发出的RPC数
+    uint64_t redirects = 0;     // 收到WRONG_LEADER的次数
+    uint64_t retries = 0;       // 失败后退避重试的次数
+    uint64_t batches = 0;       // 合并发送的MultiGet/MultiPut数
+    uint64_t batched_ops = 0;   // 通过合并发送完成的请求数
+};
+
+// ============================================================================
+// KvClient - 带leader缓存和分片路由的KV客户端
+// ============================================================================
+// 在RpcClient之上封装重试、重定向和连接管理，调用方不需要知道leader在哪里：
+// - 每个Raft组（非分片集群只有一个组）缓存最近一次成功的节点，请求直接发往它；
+// - 收到WRONG_LEADER时按响应中的leader提示立即改发，不退避；没有提示时轮询其他
+//   节点，连接失败或超时时按指数退避（带随机抖动）重试，重试复用同一个RequestId，
+//   不会重复执行；
+// - 分片集群按ShardMapCache路由，收到WRONG_SHARD时刷新分片表后重试；
+// - 同一目标节点上并发的Get和Put由正在发送的请求顺带合并成一次MultiGet /
+//   MultiPut（flat combining）：没有并发时直接发送，不增加延迟；一批请求在途时
+//   到达的请求排队，随下一批发出。合并发送失败的Get退回逐个发送的路径，MultiPut
+//   则用原来的RequestId整批重发，与单个写请求一样不会重复执行。
+//
+// 所有方法可被多个fiber并发调用。
+class KvClient {
+public:
+    explicit KvClient(KvClientOptions options);
+
+    // 断开所有连接
+    ~KvClient();
+
+    KvClient(const KvClient&) = delete;
+    KvClient& operator=(const KvClient&) = delete;
+
+    KvResult Get(const std::string& key);
+    KvStatus Put(const std::string& key, const std::string& value, uint64_t ttl_ms = 0);
+    KvStatus Append(const std::string& key, const std::string& value);
+    KvStatus Delete(const std::string& key);
+
+    // 条件不成立时status为CONDITION_FAILED，value为当前值
+    KvResult CompareAndSwap(const std::string& key, const std::string& expected, const std::string& value);
+    KvResult PutIfAbsent(const std::string& key, const std::string& value);
+
+    // 成功时value为更新后的值
+    KvStatus Increment(const std::string& key, int64_t delta, int64_t& value);
+
+    // 原子地执行跨key（可跨分片）的写入，发往第一个key所在的节点（见txn.h）。
+    // 重试复用同一个RequestId，已提交的事务不会再次执行
+    TxnReply Txn(const std::vector<KvMutation>& writes, const std::vector<KvCompare>& compares = {});
+
+    // 组当前缓存的leader地址，未知时为空（非分片集群的组id为0）
+    std::string CachedLeader(uint64_t group);
+
+    KvClientStats Stats() const;
+
+private:
+    // 请求的目的Raft组
+    struct Route {
+        uint64_t group = 0;
+        std::vector<std::string> endpoints;
+    };
+
+    // 排队等待合并发送的Get / Put
+    struct PendingOp {
+        KvOp op = KvOp::GET;
+        std::string key;
+        std::string value;
+        fiber::Channel<KvResult>::ptr done = fiber::make_channel<KvResult>(1);
+        bool fallback = false;      // 合并发送失败，由调用方逐个重试
+    };
+    using PendingOpPtr = std::shared_ptr<PendingOp>;
+
+    struct Batcher {
+        fiber::FiberMutex mu;
+        std::vector<PendingOpPtr> queue;
+        bool flushing = false;
+    };
+
+    bool resolve(const std::string& key, Route& route);
+    rpc::RpcClientPtr connection(const std::string& endpoint);
+    void dropConnection(const std::string& endpoint);
+    void setLeader(uint64_t group, const std::string& endpoint);
+    void forgetLeader(uint64_t group, const std::string& endpoint);
+    void backoff(int failures);
+
+    ClientSession acquireSession();
+    void releaseSession(ClientSession session);
+
+    // 按key路由并处理重定向与重试，返回最终状态（重试耗尽时为UNAVAILABLE）
+    template <typename Args, typename Reply>
+    KvStatus invoke(const std::string& key, const char* method, const Args& args, Reply& reply);
+
+    // 合并发送：返回false表示没有合并（目标未知或MultiGet失败），调用方改走invoke
+    bool batched(KvOp op, const std::string& key, const std::string& value, KvResult& result);
+    void flush(const std::string& endpoint, KvOp op, Batcher& batcher);
+    void sendBatch(const std::string& endpoint, KvOp op, std::vector<PendingOpPtr>& ops);
+
+    KvClientOptions options_;
+    ShardMapCache shards_;
+
+    fiber::FiberMutex mu_;
+    std::unordered_map<std::string, rpc::RpcClientPtr> connections_;
+    std::unordered_map<uint64_t, std::string> leaders_;
+    std::unordered_map<std::string, std::shared_ptr<Batcher>> batchers_;   // endpoint + group + op
+    std::vector<ClientSession> sessions_;   // 空闲的会话，每个会话同时只有一个写请求
+    std::atomic<uint64_t> next_endpoint_{0};
+
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> rpcs_{0};
+    std::atomic<uint64_t> redirects_{0};
+    std::atomic<uint64_t> retries_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> batched_ops_{0};
+};
+
+using KvClientPtr = std::shared_ptr<KvClient>;
+
+} // namespace kv
+
+#endif // KV_CLIENT_H
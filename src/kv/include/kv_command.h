@@ -0,0 +1,275 @@
+#ifndef KV_COMMAND_H
+#define KV_COMMAND_H
+
+#include "encoder.h"
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// KV操作类型
+enum class KvOp : uint8_t {
+    GET,        // 读（走Raft日志的线性一致读）
+    PUT,        // 覆盖写
+    APPEND,     // 追加写（key不存在时等价于PUT）
+    DELETE,         // 删除
+    BATCH,          // 原子批量写（子操作在 KvCommand::ops 中）
+    CAS,            // 当前值等于expected时写入value
+    PUT_IF_ABSENT,  // key不存在时写入value
+    INCR,           // 把值按十进制整数加上delta（key不存在时视为0，delta为负即递减）
+    EXPIRE,         // 删除已过期的key（由TtlExpirer提交，子操作在ops中）
+    INGEST,         // 批量导入暂存目录中的SST文件（文件在 KvCommand::files 中）
+    TXN_PREPARE,    // 事务第一阶段：检查条件并写入intent（见txn.h）
+    TXN_FENCE,      // 事务恢复：确认intent是否已写入，没有写入的key从此拒绝该事务
+    TXN_END,        // 把事务记录改为提交/中止，或查询事务状态
+    TXN_RESOLVE     // 事务第二阶段：把intent转为数据（提交）或丢弃（中止）
+};
+
+// 操作结果状态
+enum class KvStatus : uint8_t {
+    OK,
+    NO_KEY,             // key不存在
+    WRONG_LEADER,       // 当前节点不是leader（由上层Raft填写）
+    INVALID_ARGUMENT,   // 无法识别的操作；INCR的当前值不是整数或结果溢出
+    CONDITION_FAILED,   // 条件写的条件不成立（CAS值不匹配 / PUT_IF_ABSENT的key已存在）
+    COMPACTED,          // watch请求的revision已不在历史中，需要重新读取后再订阅
+    WRONG_SHARD,        // key所在的分片不在当前节点（客户端的分片表已过期，应刷新后重试）
+    UNAVAILABLE,        // 客户端重试次数用尽仍未完成（连不上节点或一直没有leader）
+    TXN_CONFLICT,       // key被另一个未完成的事务锁住（KvResult::value为该key）
+    TXN_ABORTED         // 事务已被中止（超时后被其他请求恢复）
+};
+
+// 批量写中的单个操作，op只能是 PUT / APPEND / DELETE
+struct KvMutation {
+    KvOp op = KvOp::PUT;
+    std::string key;
+    std::string value;
+    uint64_t expire_at_ms = 0;      // PUT的过期时间（Unix毫秒），0表示不过期
+};
+
+// 批量导入的一个SST文件，文件内容在提交日志之前已放入每个副本的暂存目录，
+// 日志中只引用文件名，apply时按大小和校验和核对
+struct IngestFile {
+    std::string name;           // 暂存目录中的文件名
+    uint64_t size = 0;
+    uint32_t crc = 0;           // 整个文件的CRC32
+    uint64_t entries = 0;
+};
+
+// 事务的条件：exists为true时key必须存在且值等于value，为false时key必须不存在
+struct KvCompare {
+    std::string key;
+    bool exists = true;
+    std::string value;
+};
+
+// 事务状态（事务记录中保存，也是TXN_END / TXN_RESOLVE的目标状态）
+enum class TxnState : uint8_t {
+    PENDING,        // 仅作TXN_END的目标：查询
+    STAGING,        // 已开始提交：所有key的intent都写入后即视为已提交
+    COMMITTED,
+    ABORTED
+};
+
+// 客户端写请求的标识，用于重试去重（见SessionTable）
+// client_id为0表示不去重；同一客户端的seq从1开始递增，重试时复用原值
+struct RequestId {
+    uint64_t client_id = 0;
+    uint64_t seq = 0;
+};
+
+// 事务命令的公共字段
+struct TxnMeta {
+    uint64_t id = 0;
+    std::string anchor;         // 事务记录所在组的路由key（事务中的第一个key）
+    uint64_t start_ms = 0;      // 协调者开始事务的时间（Unix毫秒）
+    uint64_t timeout_ms = 0;    // 超过start_ms + timeout_ms仍未完成的事务可以被其他请求中止
+    TxnState state = TxnState::PENDING;     // TXN_END / TXN_RESOLVE的目标状态
+    std::vector<std::string> keys;  // 仅发往anchor所在组的TXN_PREPARE：事务的全部key，写入事务记录
+    uint64_t now_ms = 0;        // 仅TXN_END查询：发起者的当前时间，apply时据此判断超时，不读本地时钟
+    RequestId request;          // 仅发往anchor所在组的TXN_PREPARE：客户端请求，写入事务记录，提交时记入会话表
+};
+
+// 状态机命令 - 作为Raft日志条目的载荷
+// 所有字段均可被 rpc::Serializer 自动序列化
+struct KvCommand {
+    KvOp op = KvOp::GET;
+    std::string key;
+    std::string value;
+    std::vector<KvMutation> ops;    // 仅BATCH使用：整批作为一条日志，按顺序原子生效
+    std::string expected;           // 仅CAS使用：期望的当前值
+    int64_t delta = 0;              // 仅INCR使用
+    // PUT / PUT_IF_ABSENT 写入的过期时间（Unix毫秒），0表示不过期；
+    // PUT会覆盖原有TTL，APPEND / CAS / INCR 保留原有TTL
+    uint64_t expire_at_ms = 0;
+    RequestId request;              // 写命令的请求标识，重复的请求只执行一次
+    std::vector<IngestFile> files;  // 仅INGEST使用：按key升序、互不重叠
+    std::vector<KvCompare> compares;    // 仅TXN_PREPARE使用：本组中要检查的条件
+    TxnMeta txn;                    // 仅TXN_*使用；TXN_PREPARE / FENCE / RESOLVE的key在ops中
+};
+
+// 键值对（快照、范围扫描结果）
+struct KvPair {
+    std::string key;
+    std::string value;
+};
+
+// key的一次变更，revision为产生该变更的日志index
+struct WatchEvent {
+    uint64_t revision = 0;
+    KvOp type = KvOp::PUT;      // PUT（写入后的完整值在value中）或 DELETE
+    std::string key;
+    std::string value;
+};
+
+// 状态机执行结果
+// 条件写失败时value为key的当前值，INCR成功时value为新值（十进制）
+struct KvResult {
+    KvStatus status = KvStatus::OK;
+    std::string value;
+    std::vector<KvStatus> statuses;     // 仅BATCH使用：每个子操作的结果
+};
+
+// ============================================================================
+// 日志载荷编解码
+// ============================================================================
+
+inline std::string EncodeCommand(const KvCommand& cmd) {
+    auto encoder = rpc::Encoder::New();
+    encoder->Encode(cmd);
+    return encoder->Bytes();
+}
+
+inline bool DecodeCommand(const std::string& data, KvCommand& cmd) {
+    auto decoder = rpc::Decoder::New(data);
+    return decoder->Decode(cmd);
+}
+
+// ============================================================================
+// 事务的保留key
+// ============================================================================
+// intent和事务记录与数据一起存放在引擎中（随快照复制、随分片迁移），放在以
+// kTxnKeyPrefix开头的保留key下，对用户的扫描不可见，应用不能使用这个前缀。
+// 保留key按其中嵌入的用户key路由（TxnRoutingKey），与对应的数据落在同一个分片中：
+//   intent:   prefix 'i' <key>
+//   事务记录: prefix 'r' <16位十六进制事务id> <anchor>
+//   隔离标记: prefix 'f' <16位十六进制事务id> <key>
+
+inline constexpr std::string_view kTxnKeyPrefix = "\xff\xff" "txn/";
+
+// key上的intent：事务提交时要执行的写入（op为GET表示只锁住key、检查条件）
+struct TxnIntent {
+    uint64_t id = 0;
+    std::string anchor;
+    uint64_t start_ms = 0;
+    uint64_t timeout_ms = 0;
+    KvOp op = KvOp::PUT;
+    std::string value;
+    uint64_t expire_at_ms = 0;
+};
+
+struct TxnRecord {
+    TxnState state = TxnState::STAGING;
+    uint64_t start_ms = 0;
+    uint64_t timeout_ms = 0;
+    std::vector<std::string> keys;
+    RequestId request;
+};
+
+inline bool IsTxnKey(std::string_view key) {
+    return key.substr(0, kTxnKeyPrefix.size()) == kTxnKeyPrefix;
+}
+
+namespace detail {
+inline std::string txnKey(char type, uint64_t id, std::string_view key) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id));
+    std::string result(kTxnKeyPrefix);
+    result.push_back(type);
+    result.append(hex, 16);
+    result.append(key);
+    return result;
+}
+} // namespace detail
+
+inline std::string TxnIntentKey(std::string_view key) {
+    std::string result(kTxnKeyPrefix);
+    result.push_back('i');
+    result.append(key);
+    return result;
+}
+
+inline std::string TxnRecordKey(uint64_t id, std::string_view anchor) {
+    return detail::txnKey('r', id, anchor);
+}
+
+inline std::string TxnFenceKey(uint64_t id, std::string_view key) {
+    return detail::txnKey('f', id, key);
+}
+
+// 保留key所属的用户key，普通key返回自身
+inline std::string_view TxnRoutingKey(std::string_view key) {
+    if (!IsTxnKey(key) || key.size() == kTxnKeyPrefix.size()) {
+        return key;
+    }
+    std::string_view rest = key.substr(kTxnKeyPrefix.size() + 1);
+    char type = key[kTxnKeyPrefix.size()];
+    if (type == 'i') {
+        return rest;
+    }
+    return rest.size() >= 16 ? rest.substr(16) : key;
+}
+
+template <typename T>
+std::string EncodeTxnValue(const T& value) {
+    auto encoder = rpc::Encoder::New();
+    encoder->Encode(value);
+    return encoder->Bytes();
+}
+
+template <typename T>
+bool DecodeTxnValue(const std::string& data, T& value) {
+    auto decoder = rpc::Decoder::New(data);
+    return decoder->Decode(value);
+}
+
+// ============================================================================
+// 状态机的保留key
+// ============================================================================
+// TTL索引和会话表是状态机的内存状态，日志重放时重建。持久化引擎（Persistent()）
+// 重启后不再重放DurableIndex()之前的日志，这两部分状态随数据一起写入引擎，在打开时
+// 从中重建：TTL与产生它的写入在同一个批次中写入，会话记录在命令执行后、同一个index上
+// 写入（引擎保证同一个index的写入一起持久化）。
+// 放在kStateKeyPrefix开头的保留key下，对用户的扫描不可见，不进入快照的数据部分，
+// 不随分片迁移（TTL由目标组写入数据时重新生成，会话属于各自的组）：
+//   TTL:  prefix 't' <key>                     值为过期时间
+//   会话: prefix 's' <16位十六进制client_id>    值为SessionEntry
+
+inline constexpr std::string_view kStateKeyPrefix = "\xff\xff" "sm/";
+
+inline bool IsStateKey(std::string_view key) {
+    return key.substr(0, kStateKeyPrefix.size()) == kStateKeyPrefix;
+}
+
+inline std::string TtlStateKey(std::string_view key) {
+    std::string result(kStateKeyPrefix);
+    result.push_back('t');
+    result.append(key);
+    return result;
+}
+
+inline std::string SessionStateKey(uint64_t client_id) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(client_id));
+    std::string result(kStateKeyPrefix);
+    result.push_back('s');
+    result.append(hex, 16);
+    return result;
+}
+
+} // namespace kv
+
+#endif // KV_COMMAND_H
@@ -0,0 +1,167 @@
+#ifndef KV_ENGINE_H
+#define KV_ENGINE_H
+
+#include "kv_command.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// ReadView - 固定在某个Raft index上的一致性只读视图
+// ============================================================================
+// 视图存活期间，该index上可见的数据不会被版本回收，读取不阻塞写入。
+class ReadView {
+public:
+    virtual ~ReadView() = default;
+
+    // 视图所在的Raft index
+    virtual uint64_t Index() const = 0;
+
+    virtual bool Get(const std::string& key, std::string& value) = 0;
+    virtual std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) = 0;
+
+    // 遍历视图中的所有键值对，遍历顺序由实现决定
+    using Visitor = std::function<void(const std::string& key, const std::string& value)>;
+    virtual void ForEach(const Visitor& visitor) = 0;
+};
+
+using ReadViewPtr = std::shared_ptr<ReadView>;
+
+// KV存储引擎抽象接口
+// 状态机只通过该接口访问数据，支持不同实现：
+// - ShardedHashEngine: 分片哈希表（内存，点查为主）
+// - OrderedEngine: 多版本并发跳表（内存，支持范围扫描和一致性读视图）
+// - LsmEngine: LSM树（磁盘，数据量可超过内存）
+// - CachedEngine: 包装任意引擎，在点查前加一层W-TinyLFU读缓存
+//
+// 并发约定：
+// - 读接口（Get/Scan/Size/ForEach）可被任意fiber并发调用
+// - 写接口由apply循环调用，index为产生该写入的Raft日志索引，
+//   需要按版本组织数据的引擎据此定位版本，纯内存引擎可以忽略
+// - ConcurrentWrites()返回true的引擎允许多个fiber并发调用写接口，各fiber写入的
+//   key互不相同、index可能乱序（并行apply）；其他引擎的写接口只有一个调用方
+class IKvEngine {
+public:
+    virtual ~IKvEngine() = default;
+
+    // 点查，存在时写入value并返回true
+    virtual bool Get(const std::string& key, std::string& value) = 0;
+
+    // 覆盖写
+    virtual void Put(uint64_t index, const std::string& key, const std::string& value) = 0;
+
+    // 追加写（key不存在时等价于Put）
+    virtual void Append(uint64_t index, const std::string& key, const std::string& value) = 0;
+
+    // 删除，key存在时返回true
+    virtual bool Delete(uint64_t index, const std::string& key) = 0;
+
+    // 范围扫描 [start, end)，按key升序返回
+    // end为空表示无上界；limit为0表示不限条数
+    virtual std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) = 0;
+
+    // 当前key数量
+    virtual size_t Size() = 0;
+
+    // 遍历所有键值对（用于快照），遍历顺序由实现决定
+    using Visitor = std::function<void(const std::string& key, const std::string& value)>;
+    virtual void ForEach(const Visitor& visitor) = 0;
+
+    // 清空所有数据（用于安装快照）
+    virtual void Clear() = 0;
+
+    // 批量写：batch中的操作按顺序执行，共用同一个index，statuses[i]为第i个操作的结果
+    // （DELETE的key不存在时为NO_KEY）。调用方保证op只有PUT/APPEND/DELETE。
+    // 默认实现逐个调用Put/Append/Delete，并发读者可能看到写了一半的批次；
+    // 引擎应尽量覆盖为对并发读者原子可见的实现
+    virtual void Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) {
+        statuses.assign(batch.size(), KvStatus::OK);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const auto& op = batch[i];
+            if (op.op == KvOp::PUT) {
+                Put(index, op.key, op.value);
+            } else if (op.op == KvOp::APPEND) {
+                Append(index, op.key, op.value);
+            } else if (op.op == KvOp::DELETE) {
+                if (!Delete(index, op.key)) {
+                    statuses[i] = KvStatus::NO_KEY;
+                }
+            } else {
+                statuses[i] = KvStatus::INVALID_ARGUMENT;
+            }
+        }
+    }
+
+    // 批量点查，返回值与keys一一对应（不存在的key状态为NO_KEY）
+    virtual std::vector<KvResult> MultiGet(const std::vector<std::string>& keys) {
+        std::vector<KvResult> results(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (!Get(keys[i], results[i].value)) {
+                results[i].status = KvStatus::NO_KEY;
+            }
+        }
+        return results;
+    }
+
+    // 创建固定在index上的读视图，index为0表示最新已写入的数据
+    // 引擎不支持读视图，或index上的数据已不可得时返回nullptr
+    virtual ReadViewPtr NewReadView(uint64_t index) { return nullptr; }
+
+    // 写接口能否被多个fiber对互不相同的key并发调用
+    virtual bool ConcurrentWrites() const { return false; }
+
+    // 回收不再被任何读者需要的旧版本，返回释放的版本数
+    virtual size_t CollectGarbage() { return 0; }
+
+    // 引擎数据占用的内存字节数（不含读视图独占的旧数据），不统计的引擎返回0
+    virtual size_t MemoryUsage() { return 0; }
+
+    // 已经持久化到引擎自身存储中的最大index，重启后从这里之后重放日志，
+    // 之前的日志可以丢弃；纯内存引擎返回0
+    virtual uint64_t DurableIndex() { return 0; }
+
+    // 数据保存在引擎自身的存储中、重启后仍然存在（DurableIndex()有意义）。
+    // 这样的引擎必须让同一个index上的所有写入一起持久化：状态机在一条日志中可能
+    // 多次写入（见kv_command.h中的“状态机的保留key”）
+    virtual bool Persistent() const { return false; }
+
+    // 批量导入SST文件（见bulk_ingest.h）：paths按key升序、互不重叠，文件中的数据
+    // 覆盖引擎中的同名key。文件全部打开并校验成功后才开始写入，失败返回false且引擎不变。
+    // 默认实现（bulk_ingest.cpp）读出文件后按批调用Write，并发读者可能看到导入了
+    // 一部分的数据；能直接使用SST文件的引擎应覆盖为把文件链接进自己的存储。
+    // 调用方在返回后仍拥有paths中的文件
+    virtual bool Ingest(uint64_t index, const std::vector<std::string>& paths);
+
+    // 用paths中的SST文件替换引擎的全部数据（安装快照），完成后DurableIndex()推进到index。
+    // 文件之间可以重叠但不含同名key。默认实现先Clear再Ingest，失败时引擎可能已被清空；
+    // 能直接使用SST文件的引擎应覆盖为文件全部就绪后一次性替换，失败时引擎不变
+    virtual bool Install(uint64_t index, const std::vector<std::string>& paths) {
+        Clear();
+        return Ingest(index, paths);
+    }
+};
+
+using KvEnginePtr = std::shared_ptr<IKvEngine>;
+
+// 计算前缀扫描的上界：大于所有以prefix开头的key的最小字符串
+// prefix全部由0xff组成（或为空）时没有上界，返回空串
+inline std::string PrefixEnd(const std::string& prefix) {
+    std::string end = prefix;
+    while (!end.empty()) {
+        auto& last = reinterpret_cast<unsigned char&>(end.back());
+        if (last != 0xff) {
+            ++last;
+            return end;
+        }
+        end.pop_back();
+    }
+    return end;
+}
+
+} // namespace kv
+
+#endif // KV_ENGINE_H
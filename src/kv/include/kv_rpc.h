@@ -0,0 +1,430 @@
+#ifndef KV_RPC_H
+#define KV_RPC_H
+
+#include "kv_command.h"
+#include "shard_map.h"
+#include "rpc_client.h"
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// KV RPC 方法名
+// ============================================================================
+inline constexpr const char* kMethodGet = "KV.Get";
+inline constexpr const char* kMethodPutAppend = "KV.PutAppend";
+inline constexpr const char* kMethodDelete = "KV.Delete";
+inline constexpr const char* kMethodScan = "KV.Scan";
+inline constexpr const char* kMethodScanPrefix = "KV.ScanPrefix";
+inline constexpr const char* kMethodMultiGet = "KV.MultiGet";
+inline constexpr const char* kMethodMultiPut = "KV.MultiPut";
+inline constexpr const char* kMethodWriteBatch = "KV.WriteBatch";
+inline constexpr const char* kMethodCompareAndSwap = "KV.CompareAndSwap";
+inline constexpr const char* kMethodPutIfAbsent = "KV.PutIfAbsent";
+inline constexpr const char* kMethodIncrement = "KV.Increment";
+inline constexpr const char* kMethodWatch = "KV.Watch";
+inline constexpr const char* kMethodShardMap = "KV.ShardMap";
+inline constexpr const char* kMethodIngestWrite = "KV.IngestWrite";
+inline constexpr const char* kMethodIngestCommit = "KV.IngestCommit";
+inline constexpr const char* kMethodIngestAbort = "KV.IngestAbort";
+inline constexpr const char* kMethodIngestPush = "KV.IngestPush";
+inline constexpr const char* kMethodExport = "KV.Export";
+inline constexpr const char* kMethodExportRead = "KV.ExportRead";
+inline constexpr const char* kMethodTxn = "KV.Txn";
+
+// 单页扫描的最大条数，客户端请求的limit超过该值时会被截断
+inline constexpr uint64_t kMaxScanPageSize = 1000;
+
+// 单个批量请求的最大key数，限制单条Raft日志的大小
+inline constexpr uint64_t kMaxBatchSize = 10000;
+
+// 单次Watch请求在服务端等待事件的最长时间，需小于 RpcClient::call 的默认超时
+inline constexpr uint64_t kMaxWatchWaitMs = 3000;
+
+// 向其他副本复制导入文件时每个请求携带的字节数
+inline constexpr uint64_t kIngestChunkBytes = 1 << 20;
+
+// ============================================================================
+// 请求/响应结构体（均为聚合类型，由 rpc::Serializer 自动序列化）
+// ============================================================================
+
+struct GetArgs {
+    std::string key;
+};
+
+struct GetReply {
+    KvStatus status = KvStatus::OK;
+    std::string value;
+};
+
+struct PutAppendArgs {
+    KvOp op = KvOp::PUT;    // PUT 或 APPEND
+    std::string key;
+    std::string value;
+    uint64_t ttl_ms = 0;    // 仅PUT：多少毫秒后过期，0表示不过期（并清除原有TTL）
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct PutAppendReply {
+    KvStatus status = KvStatus::OK;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+struct DeleteArgs {
+    std::string key;
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct DeleteReply {
+    KvStatus status = KvStatus::OK;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// 范围扫描 [start, end)，end为空表示无上界
+// 结果分页返回：has_more为true时，用next_start作为下一页的start继续请求
+struct ScanArgs {
+    std::string start;
+    std::string end;
+    uint64_t limit = 0;     // 0 表示使用 kMaxScanPageSize
+};
+
+struct ScanReply {
+    KvStatus status = KvStatus::OK;
+    std::vector<KvPair> pairs;
+    bool has_more = false;
+    std::string next_start;
+};
+
+// 前缀扫描：cursor为空时从prefix开始，否则从cursor（上一页的next_start）继续
+struct ScanPrefixArgs {
+    std::string prefix;
+    std::string cursor;
+    uint64_t limit = 0;
+};
+
+// 批量点查，results与keys一一对应
+struct MultiGetArgs {
+    std::vector<std::string> keys;
+};
+
+struct MultiGetReply {
+    KvStatus status = KvStatus::OK;
+    std::vector<GetReply> results;
+};
+
+// 批量覆盖写，整批作为一条Raft日志原子生效
+struct MultiPutArgs {
+    std::vector<KvPair> pairs;
+    uint64_t ttl_ms = 0;    // 对整批生效，0表示不过期
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct MultiPutReply {
+    KvStatus status = KvStatus::OK;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// 原子批量写：ops按顺序执行（PUT / APPEND / DELETE），整批作为一条Raft日志；
+// 含有其他op时整批被拒绝（INVALID_ARGUMENT），statuses为每个操作的结果。
+// PUT的expire_at_ms为绝对过期时间（Unix毫秒）
+struct WriteBatchArgs {
+    std::vector<KvMutation> ops;
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct WriteBatchReply {
+    KvStatus status = KvStatus::OK;
+    std::vector<KvStatus> statuses;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// 条件写：在apply时原子地求值，一次往返完成读-比较-写
+// 条件不成立时status为CONDITION_FAILED，current为key的当前值
+
+// key的当前值等于expected时写入value；key不存在时返回NO_KEY
+struct CompareAndSwapArgs {
+    std::string key;
+    std::string expected;
+    std::string value;
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct CompareAndSwapReply {
+    KvStatus status = KvStatus::OK;
+    std::string current;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// key不存在时写入value
+struct PutIfAbsentArgs {
+    std::string key;
+    std::string value;
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct PutIfAbsentReply {
+    KvStatus status = KvStatus::OK;
+    std::string current;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// 计数器：值按十进制整数存储，key不存在时从0开始，delta为负即递减
+// 当前值不是整数或结果溢出时返回INVALID_ARGUMENT，值保持不变
+struct IncrementArgs {
+    std::string key;
+    int64_t delta = 1;
+    RequestId request;      // 重试去重，见ClientSession
+};
+
+struct IncrementReply {
+    KvStatus status = KvStatus::OK;
+    int64_t value = 0;      // 更新后的值
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// 订阅key（prefix为true时为前缀）上revision >= start_revision的变更。
+// 长轮询：没有事件时服务端最多等待timeout_ms（不超过kMaxWatchWaitMs）后返回空结果；
+// 收到结果后用next_revision作为下一次请求的start_revision，断线重连后同样从这里恢复，
+// 不会丢失或重复事件。start_revision为0表示只订阅之后的变更。
+// 需要的历史已被覆盖时status为COMPACTED，next_revision为最早可恢复的revision，
+// 客户端应重新读取数据后再订阅。
+struct WatchArgs {
+    std::string key;
+    bool prefix = false;
+    uint64_t start_revision = 0;
+    uint64_t max_events = 0;    // 0 表示使用 kMaxScanPageSize；同一个revision的事件不会被拆开
+    uint64_t timeout_ms = 0;    // 0 表示使用 kMaxWatchWaitMs
+};
+
+struct WatchReply {
+    KvStatus status = KvStatus::OK;
+    std::vector<WatchEvent> events;
+    uint64_t next_revision = 0;
+};
+
+// 拉取节点负责的分片（见ShardMapCache），include_load为true时同时返回各分片的负载
+struct ShardMapArgs {
+    bool include_load = false;
+};
+
+struct ShardMapReply {
+    KvStatus status = KvStatus::OK;
+    std::vector<ShardRange> shards;
+    std::vector<ShardLoad> loads;
+};
+
+// 批量导入（见bulk_ingest.h）：同一个ingest_id的IngestWrite按seq从1开始依次发送，
+// 整个导入中的key必须严格递增；重试时复用seq，已写入的批次不会重复写入。
+// 会话建立在收到请求的节点上，IngestCommit返回WRONG_LEADER时需要在leader上重新导入
+struct IngestWriteArgs {
+    uint64_t ingest_id = 0;     // 客户端随机选择，非0
+    uint64_t seq = 0;
+    std::vector<KvPair> pairs;
+};
+
+struct IngestWriteReply {
+    KvStatus status = KvStatus::OK;     // key顺序不对或会话已失效时为INVALID_ARGUMENT
+};
+
+// 写完最后一个文件，复制到各副本后提交一条INGEST日志
+struct IngestCommitArgs {
+    uint64_t ingest_id = 0;
+    RequestId request;          // 重试去重，见ClientSession
+};
+
+struct IngestCommitReply {
+    KvStatus status = KvStatus::OK;
+    uint64_t entries = 0;       // 导入的键值对数
+    uint64_t files = 0;
+    std::string leader;         // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+struct IngestAbortArgs {
+    uint64_t ingest_id = 0;
+};
+
+struct IngestAbortReply {
+    KvStatus status = KvStatus::OK;
+};
+
+// leader把导入文件写入副本的暂存目录，offset依次递增，last为true时核对整个文件
+struct IngestPushArgs {
+    IngestFile file;
+    uint64_t offset = 0;
+    std::string data;
+    bool last = false;
+};
+
+struct IngestPushReply {
+    KvStatus status = KvStatus::OK;
+};
+
+// 在线备份（见backup.h）：Export在本节点打开index上的读视图，之后用ExportRead按offset
+// 拉取，快照随读取逐块编码，读到最后一块后会话结束。offset由客户端指定，只能重读上一块
+// 或读下一块，重试不会跳过或重复数据。快照的长度和CRC32随最后一块返回
+struct ExportArgs {
+    uint64_t index = 0;         // 0表示本节点的LastApplied()
+};
+
+struct ExportReply {
+    KvStatus status = KvStatus::OK;     // index上的读视图不可得时为INVALID_ARGUMENT
+    uint64_t export_id = 0;
+    uint64_t index = 0;         // 快照实际对应的index
+};
+
+struct ExportReadArgs {
+    uint64_t export_id = 0;
+    uint64_t offset = 0;
+};
+
+struct ExportReadReply {
+    KvStatus status = KvStatus::OK;     // 会话不存在、已过期或offset无效时为INVALID_ARGUMENT
+    std::string data;
+    bool last = false;
+    uint64_t size = 0;          // 仅last时：整个快照的字节数
+    uint32_t crc = 0;           // 仅last时：整个快照的CRC32
+};
+
+// 跨分片事务（见txn.h）：compares全部成立时原子地执行writes（PUT / APPEND / DELETE，
+// key互不相同）。条件不成立时status为CONDITION_FAILED，key为不成立的条件；
+// 涉及不在本节点的分片时为WRONG_SHARD
+struct TxnArgs {
+    std::vector<KvMutation> writes;
+    std::vector<KvCompare> compares;
+    RequestId request;      // 重试去重：已提交的事务不会再次执行，见TxnCoordinator
+};
+
+struct TxnReply {
+    KvStatus status = KvStatus::OK;
+    std::string key;
+    uint64_t txn_id = 0;
+    std::string leader;     // WRONG_LEADER时为已知leader的地址（"host:port"），未知时为空
+};
+
+// ============================================================================
+// 客户端辅助：请求去重
+// ============================================================================
+// 为写请求分配RequestId：client_id随机生成，seq从1开始递增。
+// 服务端只记住每个客户端最近一次请求，因此一个ClientSession同时只能有一个
+// 未完成的写请求；并发写入的各个fiber应各自持有ClientSession。
+// 请求失败（超时、WRONG_LEADER）重试时必须复用同一个RequestId，不能调用Next。
+class ClientSession {
+public:
+    ClientSession() : client_id_(randomClientId()) {}
+    explicit ClientSession(uint64_t client_id) : client_id_(client_id) {}
+
+    RequestId Next() { return RequestId{client_id_, ++seq_}; }
+
+    uint64_t ClientId() const { return client_id_; }
+
+private:
+    static uint64_t randomClientId() {
+        std::random_device rd;
+        std::mt19937_64 gen((static_cast<uint64_t>(rd()) << 32) | rd());
+        uint64_t id = 0;
+        while (id == 0) {
+            id = gen();
+        }
+        return id;
+    }
+
+    uint64_t client_id_;
+    uint64_t seq_ = 0;
+};
+
+// ============================================================================
+// 客户端辅助：流式拉取扫描结果
+// ============================================================================
+// 逐页请求 KV.Scan，每收到一页调用一次on_page；on_page返回false时提前结束。
+// 返回 std::nullopt 表示成功扫描到末尾（或被on_page中止），否则为错误消息。
+inline std::optional<std::string> ScanPages(rpc::RpcClient& client, ScanArgs args,
+                                            const std::function<bool(const std::vector<KvPair>&)>& on_page) {
+    while (true) {
+        ScanReply reply;
+        auto error = client.call(kMethodScan, args, reply);
+        if (error.has_value()) {
+            return error;
+        }
+        if (reply.status != KvStatus::OK) {
+            return "Scan failed with status " + std::to_string(static_cast<int>(reply.status));
+        }
+        if (!on_page(reply.pairs) || !reply.has_more) {
+            return std::nullopt;
+        }
+        args.start = reply.next_start;
+    }
+}
+
+// ============================================================================
+// 客户端辅助：持续接收变更事件
+// ============================================================================
+// 循环发送 KV.Watch，每收到一批事件调用一次on_events；on_events返回false时结束。
+// 返回 std::nullopt 表示被on_events中止，否则为错误消息（包括历史已被覆盖）。
+// 出错后可以用args.start_revision（已更新为下一个未收到的revision）重新调用以恢复。
+inline std::optional<std::string> WatchEvents(rpc::RpcClient& client, WatchArgs& args,
+                                              const std::function<bool(const std::vector<WatchEvent>&)>& on_events) {
+    while (true) {
+        WatchReply reply;
+        auto error = client.call(kMethodWatch, args, reply);
+        if (error.has_value()) {
+            return error;
+        }
+        if (reply.status != KvStatus::OK) {
+            return "Watch failed with status " + std::to_string(static_cast<int>(reply.status)) +
+                   ", oldest revision " + std::to_string(reply.next_revision);
+        }
+        args.start_revision = reply.next_revision;
+        if (!reply.events.empty() && !on_events(reply.events)) {
+            return std::nullopt;
+        }
+    }
+}
+
+// ============================================================================
+// 客户端辅助：批量导入
+// ============================================================================
+// 反复调用next_batch取得下一批按key升序的键值对（返回false表示没有更多数据），
+// 逐批发送 KV.IngestWrite 后提交。client应连接到leader。
+// 返回 std::nullopt 表示RPC都成功，导入结果在reply.status中；出错时放弃本次导入。
+inline std::optional<std::string> BulkIngest(rpc::RpcClient& client,
+                                             const std::function<bool(std::vector<KvPair>&)>& next_batch,
+                                             IngestCommitReply& reply) {
+    ClientSession session;
+    IngestWriteArgs args;
+    args.ingest_id = session.ClientId();
+    auto abort = [&]() {
+        IngestAbortReply abort_reply;
+        client.call(kMethodIngestAbort, IngestAbortArgs{args.ingest_id}, abort_reply);
+    };
+    while (true) {
+        args.pairs.clear();
+        if (!next_batch(args.pairs)) {
+            break;
+        }
+        if (args.pairs.empty()) {
+            continue;
+        }
+        ++args.seq;
+        IngestWriteReply write_reply;
+        auto error = client.call(kMethodIngestWrite, args, write_reply);
+        if (error.has_value()) {
+            abort();
+            return error;
+        }
+        if (write_reply.status != KvStatus::OK) {
+            abort();
+            reply.status = write_reply.status;
+            return std::nullopt;
+        }
+    }
+    return client.call(kMethodIngestCommit, IngestCommitArgs{args.ingest_id, session.Next()}, reply);
+}
+
+} // namespace kv
+
+#endif // KV_RPC_H
@@ -0,0 +1,134 @@
+#ifndef KV_SERVICE_H
+#define KV_SERVICE_H
+
+#include "backup.h"
+#include "kv_rpc.h"
+#include "kv_state_machine.h"
+#include "txn.h"
+#include "rpc_server.h"
+#include "sync.h"
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <memory>
+#include <unordered_map>
+
+namespace kv {
+
+// ============================================================================
+// KvService - 把KV状态机以RPC形式导出
+// ============================================================================
+// 读请求（Get/Scan/MultiGet）直接在本地状态机上执行；写请求交给ProposeFunc，
+// 由上层Raft复制并在apply后返回结果。批量写（MultiPut/WriteBatch）只提交一条日志。
+// Watch在本地状态机的WatchHub上订阅，以长轮询的方式返回变更事件。
+// 批量导入（IngestWrite/IngestCommit）在本节点把数据写成SST文件，由IngestShipFunc
+// 复制到其他副本后只提交一条INGEST日志（见bulk_ingest.h）。
+// 在线备份（Export/ExportRead）在本节点的读视图上随读取逐块编码快照，按块限速返回（见backup.h）。
+// 事务（Txn）由TxnCoordinator执行（见txn.h）；写请求遇到事务的intent时等待事务结束
+// 后重试，Get/MultiGet等待intent消失后再读。
+class KvService {
+public:
+    // 把命令提交到Raft日志并等待其被apply，返回状态机的执行结果
+    // 当前节点不是leader时应返回 KvStatus::WRONG_LEADER，已知leader时把它的地址
+    // （"host:port"）放在KvResult::value中，由写请求的响应带回给客户端
+    using ProposeFunc = std::function<KvResult(const KvCommand& cmd)>;
+
+    // 把本地暂存目录中的导入文件复制到所有其他副本的暂存目录，全部成功时返回true。
+    // 为空表示没有其他副本（单机模式，或各副本共享暂存目录）
+    using IngestShipFunc = std::function<bool(const std::string& path, const IngestFile& file)>;
+
+    // propose为空时工作在单机模式：写命令按递增index直接在本地apply
+    explicit KvService(KvStateMachinePtr sm, ProposeFunc propose = nullptr, IngestShipFunc ship = nullptr,
+                       BackupOptions backup = {});
+
+    // 用KV.IngestPush把文件并行推送给peers（其他副本的"host:port"）
+    static IngestShipFunc MakeIngestShipper(std::vector<std::string> peers);
+
+    // 注册所有KV方法到RPC服务器
+    void RegisterRPC(rpc::RpcServerPtr rpc_server);
+
+    // 提交一条命令（RPC handler和后台任务共用，例如TtlExpirer）
+    // 普通写命令被事务锁住（TXN_CONFLICT）时等待该事务结束后重试
+    KvResult Propose(const KvCommand& cmd);
+
+    const KvStateMachinePtr& StateMachine() const { return sm_; }
+
+    // 默认的协调者只访问本组；分片部署时由ShardedKvService换成覆盖本节点所有分片的协调者，
+    // 须在开始服务前设置。resolve_conflicts为false时写命令遇到intent直接返回TXN_CONFLICT，
+    // 由调用方在释放分片的写登记之后等待（等待期间分片可能要暂停写入以迁移）
+    void SetTxnCoordinator(TxnCoordinatorPtr txn, bool resolve_conflicts = true) {
+        txn_ = std::move(txn);
+        resolve_conflicts_ = resolve_conflicts;
+    }
+
+    // RPC handlers
+    std::optional<std::string> Get(const GetArgs& args, GetReply& reply);
+    std::optional<std::string> PutAppend(const PutAppendArgs& args, PutAppendReply& reply);
+    std::optional<std::string> Delete(const DeleteArgs& args, DeleteReply& reply);
+    std::optional<std::string> Scan(const ScanArgs& args, ScanReply& reply);
+    std::optional<std::string> ScanPrefix(const ScanPrefixArgs& args, ScanReply& reply);
+    std::optional<std::string> MultiGet(const MultiGetArgs& args, MultiGetReply& reply);
+    std::optional<std::string> MultiPut(const MultiPutArgs& args, MultiPutReply& reply);
+    std::optional<std::string> WriteBatch(const WriteBatchArgs& args, WriteBatchReply& reply);
+    std::optional<std::string> CompareAndSwap(const CompareAndSwapArgs& args, CompareAndSwapReply& reply);
+    std::optional<std::string> PutIfAbsent(const PutIfAbsentArgs& args, PutIfAbsentReply& reply);
+    std::optional<std::string> Increment(const IncrementArgs& args, IncrementReply& reply);
+    std::optional<std::string> Watch(const WatchArgs& args, WatchReply& reply);
+    std::optional<std::string> IngestWrite(const IngestWriteArgs& args, IngestWriteReply& reply);
+    std::optional<std::string> IngestCommit(const IngestCommitArgs& args, IngestCommitReply& reply);
+    std::optional<std::string> IngestAbort(const IngestAbortArgs& args, IngestAbortReply& reply);
+    std::optional<std::string> IngestPush(const IngestPushArgs& args, IngestPushReply& reply);
+    std::optional<std::string> Export(const ExportArgs& args, ExportReply& reply);
+    std::optional<std::string> ExportRead(const ExportReadArgs& args, ExportReadReply& reply);
+    std::optional<std::string> Txn(const TxnArgs& args, TxnReply& reply);
+
+private:
+    // 一次批量导入，mu串行化同一会话的请求
+    struct IngestSession {
+        fiber::FiberMutex mu;
+        IngestBuilderPtr builder;
+        uint64_t seq = 0;       // 最后写入的批次
+        bool closed = false;    // 已提交或放弃
+        std::atomic<int64_t> last_active_ms{0};
+    };
+    using IngestSessionPtr = std::shared_ptr<IngestSession>;
+
+    // create为true时创建不存在的会话，同时放弃超时的会话
+    IngestSessionPtr ingestSession(uint64_t ingest_id, bool create);
+    IngestSessionPtr takeIngestSession(uint64_t ingest_id);
+
+    // 一次导出，会话存续期间持有读视图，按读取进度编码快照
+    struct ExportSession {
+        fiber::FiberMutex mu;                   // 串行化同一导出上的ExportRead
+        std::unique_ptr<BackupExport> backup;
+        std::atomic<int64_t> last_active_ms{0};
+    };
+    using ExportSessionPtr = std::shared_ptr<ExportSession>;
+
+    // 扫描一页，多取一条用于判断是否还有下一页
+    void scanPage(const std::string& start, const std::string& end, uint64_t limit, ScanReply& reply);
+
+    KvStateMachinePtr sm_;
+    ProposeFunc propose_;
+    IngestShipFunc ship_;
+    fiber::FiberMutex local_mu_;  // 单机模式下串行化apply
+
+    fiber::FiberMutex ingest_mu_;
+    std::unordered_map<uint64_t, IngestSessionPtr> ingest_sessions_;
+
+    BackupOptions backup_options_;
+    RateLimiter export_limiter_;
+    fiber::FiberMutex export_mu_;
+    uint64_t next_export_id_ = 1;
+    std::unordered_map<uint64_t, ExportSessionPtr> export_sessions_;
+
+    // 最后声明：析构时先等待后台提交完成，它们还会用到上面的成员
+    TxnCoordinatorPtr txn_;
+    bool resolve_conflicts_ = true;
+};
+
+using KvServicePtr = std::shared_ptr<KvService>;
+
+} // namespace kv
+
+#endif // KV_SERVICE_H
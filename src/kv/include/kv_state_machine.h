@@ -0,0 +1,274 @@
+#ifndef KV_STATE_MACHINE_H
+#define KV_STATE_MACHINE_H
+
+#include "kv_command.h"
+#include "kv_engine.h"
+#include "sharded_hash_engine.h"
+#include "ttl_index.h"
+#include "session_table.h"
+#include "watch_hub.h"
+#include "bulk_ingest.h"
+#include "sync.h"
+#include "channel.h"
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+namespace kv {
+
+// 不在引擎中、随快照一起保存的复制状态
+struct SnapshotExtras {
+    std::vector<KvTtl> ttls;
+    std::vector<SessionEntry> sessions;
+};
+
+// 快照压缩：键值对按block_bytes分块，用从快照开头的值训练出的字典逐块压缩。
+// 恢复时按格式头自动识别，压缩与未压缩的快照都能读取
+struct SnapshotOptions {
+    bool compression = false;
+    size_t block_bytes = 256 << 10;
+    size_t dict_bytes = 16 << 10;
+    size_t dict_sample_bytes = 1 << 20;     // 训练字典最多使用的样本字节数
+};
+
+// ============================================================================
+// KvStateMachine - Raft之上的KV状态机
+// ============================================================================
+// Apply由apply循环按日志顺序调用；Get可被RPC handler fiber并发调用，
+// 并发安全由底层引擎保证。
+//
+// TTL：写命令携带绝对过期时间，状态机在TtlIndex中登记。过期的key由TtlExpirer
+// 以EXPIRE命令批量提交删除；在删除被apply之前，Get/MultiGet已不再返回它，
+// 但写操作（APPEND/CAS/INCR）和Scan仍把它视为存在，保证apply结果与时钟无关。
+// 持久化引擎重启后不重放已持久化的日志，TTL与数据在同一个批次中写入引擎的保留key，
+// 构造时从中重建。
+//
+// 去重：带RequestId的写命令先查SessionTable，客户端重试的请求只执行一次。
+// 会话记录与TTL一样写入持久化引擎的保留key，重启后重建。
+//
+// Watch：每条产生变更的日志apply之后，把变更（写入后的完整值或删除）以日志index
+// 为revision发布到WatchHub，订阅者无需轮询。
+//
+// 批量导入：INGEST命令引用暂存目录（IngestOptions::dir）中的文件，核对大小和
+// CRC32后交给引擎。引擎已把数据持久化（DurableIndex() >= index）时立即删除暂存文件；
+// 否则保留到覆盖该index的快照写完（ReleaseIngestFiles），重启重放日志时还要用到。
+//
+// 并行apply：ApplyBatch把一批日志切成段，段内日志按涉及的key哈希合并为冲突集
+// （并查集），不同冲突集的key互不相同，在多个fiber上并行执行，同一冲突集内按日志
+// 顺序执行，因此每个key看到的写入顺序与逐条apply相同。跨越多个key范围或依赖全局
+// 状态的命令（INGEST、TXN_*、写保留key的BATCH）单独成段按顺序执行。会话表的LRU
+// 顺序和淘汰依赖apply顺序：执行前只查询不修改，执行后按日志顺序统一Check/Record；
+// 同一客户端在段内只出现一次，新建会话（可能淘汰其他会话）的日志是段的最后一条。
+// watch事件在段结束后按日志顺序发布。
+//
+// 事务：TXN_*命令在引擎的保留key下维护intent和事务记录（见txn.h）。key上有其他
+// 事务的intent时，普通写命令返回TXN_CONFLICT且不占用会话，由KvService解决冲突后
+// 用同一个RequestId重试；读不等待intent，返回已提交的值。等待intent的一方通过
+// WaitIntent登记，intent被清理（或状态机被整体替换）时立即唤醒，不需要轮询。
+// 带RequestId的事务在事务记录被置为COMMITTED时记入会话表，重试的事务在anchor所在组的
+// PREPARE处被识别为重复，不会再次执行。
+class KvStateMachine {
+public:
+    // 每apply多少条日志触发一次旧版本回收
+    static constexpr uint64_t kGcInterval = 1024;
+
+    // 引擎已持久化的数据视为已apply，LastApplied()从engine->DurableIndex()开始
+    explicit KvStateMachine(KvEnginePtr engine = MakeShardedHashEngine(), SessionOptions sessions = {},
+                            WatchOptions watch = {}, SnapshotOptions snapshot = {}, IngestOptions ingest = {});
+
+    // 应用一条已提交的日志
+    // index <= LastApplied() 的重复日志直接忽略（返回OK）
+    // BATCH命令的子操作结果写入 KvResult::statuses
+    // 重复的请求（RequestId已执行过）不再执行，返回会话表中缓存的结果
+    KvResult Apply(uint64_t index, const KvCommand& cmd);
+
+    // 应用一批已提交的日志，cmds[i]的index为first_index + i，结果与逐条Apply相同。
+    // workers > 1且引擎支持并发写入时，把批次切成若干段，段内按key划分冲突集，
+    // 互不冲突的集合在workers个fiber上并行执行（见“并行apply”）。批次大小和workers
+    // 由驱动apply的一方决定（例如Raft的apply循环按RaftConfig::apply_batch_size取出的日志）
+    std::vector<KvResult> ApplyBatch(uint64_t first_index, const std::vector<KvCommand>& cmds, size_t workers = 1);
+
+    // 本地读（不经过Raft日志）
+    KvResult Get(const std::string& key);
+
+    // 本地批量读，结果与keys一一对应
+    std::vector<KvResult> MultiGet(const std::vector<std::string>& keys);
+
+    // 在指定index上读取（需要引擎支持多版本），不阻塞apply
+    // index上的版本已被回收或引擎不支持时返回 INVALID_ARGUMENT
+    KvResult GetAt(const std::string& key, uint64_t index);
+
+    // 创建固定在index上的一致性读视图，index为0表示LastApplied()
+    ReadViewPtr NewReadView(uint64_t index = 0);
+
+    // 本地范围扫描 [start, end)，end为空表示无上界，limit为0表示不限
+    // 事务和状态机的保留key不出现在结果中
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit);
+
+    uint64_t LastApplied() const {
+        return last_applied_.load(std::memory_order_acquire);
+    }
+
+    // 序列化整个状态机（用于 IPersister::Save 的 snapshot 参数）
+    // 引擎支持读视图时在LastApplied()的视图上序列化，否则直接遍历引擎
+    std::vector<uint8_t> TakeSnapshot();
+
+    // 把读视图和附加状态序列化为快照，与TakeSnapshot格式相同，可在任意fiber中调用
+    // extras应与视图在同一时刻（apply循环中）通过CaptureExtras()取得
+    static std::vector<uint8_t> EncodeSnapshot(ReadView& view, const SnapshotExtras& extras = {},
+                                               const SnapshotOptions& options = {});
+
+    // 复制TTL索引和会话表
+    SnapshotExtras CaptureExtras();
+
+    // 从快照恢复，失败时状态机保持不变。引擎已持久化到快照的index之后时直接跳过；
+    // 持久化引擎先把快照逐块解码写成SST文件（暂存在IngestOptions::dir，未配置时用
+    // 系统临时目录），再用Install整体替换引擎数据，不在内存中展开整个快照
+    bool RestoreSnapshot(const std::vector<uint8_t>& snapshot);
+
+    // 引擎已持久化的index，重启后只需重放之后的日志。Raft层可以据此截断
+    // <= DurableIndex() 的日志而不必等快照写完（落后太多的follower仍需要快照）；
+    // 纯内存引擎为0
+    uint64_t DurableIndex() const { return engine_->DurableIndex(); }
+
+    const KvEnginePtr& Engine() const { return engine_; }
+
+    const SnapshotOptions& GetSnapshotOptions() const { return snapshot_options_; }
+
+    const IngestOptions& GetIngestOptions() const { return ingest_options_; }
+
+    // 快照已覆盖到index：删除 <= index 的INGEST命令保留的暂存文件（由Snapshotter调用）
+    void ReleaseIngestFiles(uint64_t index);
+
+    // 弹出最多limit个已过期的key，由TtlExpirer打包为EXPIRE命令；提交失败时放回
+    std::vector<KvTtl> PopExpired(uint64_t now_ms, size_t limit);
+    void RequeueExpired(const std::vector<KvTtl>& entries);
+
+    // 所有带TTL的key及其过期时间
+    std::vector<KvTtl> TtlEntries();
+
+    // 带TTL的key数量
+    size_t TtlCount() const { return ttl_.Size(); }
+
+    // 客户端会话表
+    SessionTable& Sessions() { return sessions_; }
+
+    // key上有事务的intent时写入intent并返回true
+    bool PendingIntent(const std::string& key, TxnIntent& intent);
+
+    // 本组中未解决的intent数量，为0时读写都不需要检查intent
+    size_t IntentCount() const { return intent_count_.load(std::memory_order_acquire); }
+
+    // 等待key上事务txn_id的intent被清理，最多等待timeout_ms。返回时intent不一定已消失
+    // （超时或状态机被替换），调用方应重新检查
+    void WaitIntent(const std::string& key, uint64_t txn_id, uint64_t timeout_ms);
+
+    // 变更订阅
+    const WatchHubPtr& Watches() const { return watch_; }
+
+private:
+    // 执行一条日志（不含会话去重），返回命令是否执行（未被intent挡住）；
+    // watch开启时把变更事件追加到events
+    bool execute(uint64_t index, const KvCommand& cmd, KvResult& result, std::vector<WatchEvent>& events);
+    // index已apply：推进LastApplied()，每kGcInterval条回收一次旧版本
+    void advanceApplied(uint64_t from, uint64_t index);
+
+    // 会话表的Check/Record，持久化引擎中同时写入会话的保留key
+    bool checkSession(uint64_t index, const RequestId& request, KvOp op, KvResult& result);
+    void recordSession(uint64_t index, const RequestId& request, KvOp op, const KvResult& result);
+    void persistSession(uint64_t index, uint64_t client_id, const std::vector<uint64_t>& evicted);
+    // 从持久化引擎的保留key重建会话表
+    void loadSessions();
+
+    struct ApplySegment;
+    // 从cmds[begin]开始划出一段可并行执行的日志
+    void planSegment(const std::vector<KvCommand>& cmds, size_t begin, ApplySegment& segment);
+    void applySegment(uint64_t first_index, const std::vector<KvCommand>& cmds, const ApplySegment& segment,
+                      size_t workers, std::vector<KvResult>& results);
+
+    void applyCommand(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void collectEvents(uint64_t index, const KvCommand& cmd, const KvResult& result, std::vector<WatchEvent>& events);
+    void applyCas(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyPutIfAbsent(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyIncrement(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyExpire(uint64_t index, const KvCommand& cmd, KvResult& result);
+    // 持久化引擎中写入ops后TTL变化对应的保留key写入，调用方把它们放进同一个批次
+    std::vector<KvMutation> ttlStateWrites(const std::vector<KvMutation>& ops);
+    // 写入数据并设置（expire_at_ms为0时清除）TTL
+    void putWithTtl(uint64_t index, const std::string& key, const std::string& value, uint64_t expire_at_ms);
+    // 删除数据及其TTL，key存在时返回true
+    bool deleteWithTtl(uint64_t index, const std::string& key);
+    // 从持久化引擎的保留key重建TTL索引
+    void loadTtls();
+    void applyIngest(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyTxnPrepare(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyTxnFence(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyTxnEnd(uint64_t index, const KvCommand& cmd, KvResult& result);
+    void applyTxnResolve(uint64_t index, const KvCommand& cmd, KvResult& result);
+
+    // 普通写命令的key上有intent时返回true，result为TXN_CONFLICT
+    bool blockedByIntent(const KvCommand& cmd, KvResult& result);
+    bool getIntent(const std::string& key, TxnIntent& intent);
+    // 重新统计intent数量（启动、安装快照、分片迁移写入了intent之后），并唤醒所有等待者
+    void recountIntents();
+    // 唤醒等待keys上intent的fiber，keys为nullptr时唤醒全部
+    void wakeIntentWaiters(const std::vector<std::string>* keys);
+
+    KvEnginePtr engine_;
+    TtlIndex ttl_;
+    SessionTable sessions_;
+    WatchHubPtr watch_;
+    SnapshotOptions snapshot_options_;
+    IngestOptions ingest_options_;
+    std::atomic<uint64_t> last_applied_{0};
+    std::atomic<size_t> intent_count_{0};
+
+    // 等待intent的fiber：key -> 等待者的channel，唤醒即关闭channel并移除
+    fiber::FiberMutex intent_mu_;
+    std::unordered_multimap<std::string, fiber::Channel<bool>::ptr> intent_waiters_;
+
+    // 等待快照覆盖后删除的暂存文件：(INGEST的index, 路径)
+    fiber::FiberMutex ingest_mu_;
+    std::vector<std::pair<uint64_t, std::string>> retained_ingest_files_;
+};
+
+using KvStateMachinePtr = std::shared_ptr<KvStateMachine>;
+
+// ============================================================================
+// SnapshotStream - 在读视图上按需编码快照
+// ============================================================================
+// 输出压缩格式的快照（options.compression为false时数据块不压缩），可以用
+// KvStateMachine::RestoreSnapshot恢复。第一次Next时启动后台fiber遍历视图，
+// 编码好的数据块经容量为1的channel交给调用方，调用方不取时遍历暂停，
+// 内存中最多只有两三个数据块。析构时停止编码，视图随之释放。
+class SnapshotStream {
+public:
+    SnapshotStream(ReadViewPtr view, SnapshotExtras extras, SnapshotOptions options = {});
+    ~SnapshotStream();
+
+    SnapshotStream(const SnapshotStream&) = delete;
+    SnapshotStream& operator=(const SnapshotStream&) = delete;
+
+    // 取出下一段编码好的数据（头部、一个数据块或结尾的校验和），全部取完后返回false
+    bool Next(std::string& chunk);
+
+    uint64_t Index() const { return index_; }
+
+private:
+    struct State;
+
+    std::shared_ptr<State> state_;
+    uint64_t index_;
+    bool started_ = false;
+};
+
+inline KvStateMachinePtr MakeKvStateMachine(KvEnginePtr engine = MakeShardedHashEngine(),
+                                            SessionOptions sessions = {}, WatchOptions watch = {},
+                                            SnapshotOptions snapshot = {}, IngestOptions ingest = {}) {
+    return std::make_shared<KvStateMachine>(std::move(engine), sessions, watch, snapshot, std::move(ingest));
+}
+
+} // namespace kv
+
+#endif // KV_STATE_MACHINE_H
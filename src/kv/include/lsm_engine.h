@@ -0,0 +1,204 @@
+#ifndef KV_LSM_ENGINE_H
+#define KV_LSM_ENGINE_H
+
+#include "kv_engine.h"
+#include "sst.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kv {
+
+// ============================================================================
+// LsmEngine - 磁盘LSM树存储引擎
+// ============================================================================
+// 写入先进入内存中的有序memtable，超过memtable_bytes后切换为只读并由后台线程
+// flush成level 0的SST文件；各层超过容量后由后台线程做leveled compaction：
+// level 0的文件之间可能重叠，level >= 1 每层内文件按key有序且互不重叠。
+//
+// 本引擎没有自己的WAL：memtable中的数据以Raft日志为准。DurableIndex()返回
+// 已经全部落到SST中的最大Raft index，重启后状态机从这里开始重放日志，
+// 该index之前的日志条目可以直接丢弃。一个index上的写入不会被拆到两个memtable中：
+// memtable超过阈值后，在下一个index的第一次写入时才切换。
+//
+// 损坏：SST块的CRC校验或读取失败时，compaction失败并保留输入文件，之后不再
+// compaction；读接口无法返回错误，读到损坏的块时停止进程（不能当作key不存在）。
+//
+// 锁：mu_只保护内存中的元数据（memtable、文件列表），持锁时间很短；
+// SST的读写、flush和compaction都在锁外进行。后台工作在独立的线程池中执行，
+// 不占用fiber调度线程。
+struct LsmOptions {
+    std::string dir;                            // 数据目录，不存在时自动创建
+    size_t memtable_bytes = 4 << 20;            // memtable切换阈值
+    size_t max_immutable_memtables = 4;         // 待flush的memtable超过该值时写入等待
+    SstOptions sst;                             // SST块大小和布隆过滤器
+    uint64_t target_file_bytes = 2 << 20;       // compaction输出的单文件大小
+    int level0_compaction_trigger = 4;          // level 0文件数达到该值时compact到level 1
+    uint64_t level1_max_bytes = 10 << 20;       // level 1容量，往下每层乘以multiplier
+    int level_size_multiplier = 10;
+    int num_levels = 7;
+    int background_threads = 2;                 // flush与compaction线程数
+};
+
+class LsmEngine : public IKvEngine {
+public:
+    // 打开（或创建）options.dir下的数据，文件损坏时返回nullptr
+    static std::shared_ptr<LsmEngine> Open(LsmOptions options);
+
+    // 停止后台线程；未flush的memtable直接丢弃，重启后由Raft日志重放
+    ~LsmEngine() override;
+
+    LsmEngine(const LsmEngine&) = delete;
+    LsmEngine& operator=(const LsmEngine&) = delete;
+
+    bool Get(const std::string& key, std::string& value) override;
+    void Put(uint64_t index, const std::string& key, const std::string& value) override;
+    // Append和Delete需要先读出旧值，可能访问磁盘
+    void Append(uint64_t index, const std::string& key, const std::string& value) override;
+    bool Delete(uint64_t index, const std::string& key) override;
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override;
+    // 估计值：各memtable与SST条目数之和，重复key和墓碑也会被计入
+    size_t Size() override;
+    void ForEach(const Visitor& visitor) override;
+    void Clear() override;
+
+    // 先在批次内解析出每个key的最终值，再在一次加锁中整体写入memtable；
+    // 整批写完后才允许切换memtable，批次不会被拆到两个文件中
+    void Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) override;
+
+    // 冻结当前memtable与文件列表作为读视图，只能在最新已写入的index上创建
+    ReadViewPtr NewReadView(uint64_t index) override;
+
+    uint64_t DurableIndex() override;
+    bool Persistent() const override { return true; }
+
+    // 把文件硬链接（跨文件系统时复制）进数据目录，不重写数据：先flush memtable，
+    // 再把每个文件放到它与以上各层都不重叠的最深一层（与level 0重叠时放在level 0
+    // 最新的位置），完成后DurableIndex()推进到index
+    bool Ingest(uint64_t index, const std::vector<std::string>& paths) override;
+
+    // 文件全部链接并打开后，在一次加锁中替换memtable和所有层：互不重叠的文件
+    // 放到最底层，否则全部放在level 0
+    bool Install(uint64_t index, const std::vector<std::string>& paths) override;
+
+    // 把当前memtable切换为只读并等待其flush完成
+    void Flush();
+
+    // 等待所有flush和compaction完成
+    void WaitIdle();
+
+    // 每层的文件数
+    std::vector<size_t> LevelFileCounts();
+
+private:
+    class View;
+
+    struct MemEntry {
+        std::string value;
+        bool deleted;
+    };
+
+    struct MemTable {
+        std::map<std::string, MemEntry> entries;
+        size_t bytes = 0;
+        uint64_t max_index = 0;
+    };
+
+    using MemTablePtr = std::shared_ptr<const MemTable>;
+
+    // 只读memtable与SST文件列表，任何变化都生成新对象替换，读者持有引用即可无锁访问
+    struct Tables {
+        std::vector<MemTablePtr> immutables;            // 从旧到新
+        std::vector<std::vector<SstReaderPtr>> levels;  // level 0按从旧到新，其余按key有序
+    };
+
+    using TablesPtr = std::shared_ptr<const Tables>;
+
+    struct Compaction {
+        int level = 0;                      // 输入层，输出到level + 1
+        std::vector<SstReaderPtr> inputs;   // level层的输入
+        std::vector<SstReaderPtr> next;     // level + 1层中重叠的文件
+        bool drop_tombstones = false;       // 更深的层中没有重叠数据时可以丢弃墓碑
+        uint64_t epoch = 0;
+    };
+
+    explicit LsmEngine(LsmOptions options);
+
+    bool recover();
+    void start();
+
+    void write(uint64_t index, const std::string& key, MemEntry entry);
+
+    // 待flush的memtable过多时等待后台flush（不持有mu_）
+    void throttle();
+
+    // 以下需持有mu_
+    void insertLocked(uint64_t index, const std::string& key, MemEntry entry);
+    void rotateMemTable();
+    // memtable超过阈值且index比其中的写入都新时切换
+    void maybeRotateLocked(uint64_t index);
+    bool writeManifest();
+    bool pickCompaction(Compaction* compaction);
+    bool hasBackgroundWork();
+    uint64_t maxBytesForLevel(int level) const;
+    // 丢弃memtable和所有文件，换成tables，written/flushed index设为index（Clear与Install共用）
+    void resetLocked(TablesPtr tables, uint64_t index);
+
+    void backgroundLoop();
+    bool flushMemTable(const MemTablePtr& imm, uint64_t epoch);
+    bool runCompaction(const Compaction& compaction);
+
+    // 把迭代器中的条目写成若干个SST文件，超过target_bytes时切分（0表示不切分）
+    bool buildTables(EntryIterator& it, bool drop_tombstones, uint64_t target_bytes,
+                     std::vector<SstReaderPtr>& outputs);
+
+    // 把外部文件硬链接（跨文件系统时复制）到数据目录并打开，失败时已链接的文件被删除
+    bool linkFiles(const std::vector<std::string>& paths, std::vector<SstReaderPtr>& files);
+
+    std::string tablePath(uint64_t number) const;
+
+    // 由memtable和文件列表构造归并迭代器，同名key以最新的为准（结果中包含墓碑）
+    static EntryIteratorPtr newMergingIterator(const MemTablePtr& mem, const TablesPtr& tables);
+
+    static std::vector<KvPair> scanIterator(EntryIterator& it, const std::string& start, const std::string& end,
+                                            size_t limit);
+
+    LsmOptions options_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;                // 后台工作与等待者共用
+    std::shared_ptr<MemTable> mem_;
+    TablesPtr tables_;
+    uint64_t next_file_number_ = 1;
+    uint64_t written_index_ = 0;
+    uint64_t flushed_index_ = 0;
+    uint64_t epoch_ = 0;                        // Clear时递增，丢弃之前开始的后台结果
+    bool flushing_ = false;
+    std::vector<bool> busy_levels_;             // 正在参与compaction的层
+    std::vector<std::string> compact_pointer_;  // 每层下一次compaction的起点（轮转选择文件）
+    bool compaction_stopped_ = false;           // 输入文件损坏，不再compaction（读到损坏的块时停止进程）
+    bool stopping_ = false;
+
+    std::atomic<size_t> immutable_count_{0};    // 写入限流用，免锁读取
+    std::vector<std::thread> threads_;
+};
+
+using LsmEnginePtr = std::shared_ptr<LsmEngine>;
+
+// ============================================================================
+// 工厂函数
+// ============================================================================
+
+// 打开失败时返回nullptr
+inline KvEnginePtr MakeLsmEngine(LsmOptions options) {
+    return LsmEngine::Open(std::move(options));
+}
+
+} // namespace kv
+
+#endif // KV_LSM_ENGINE_H
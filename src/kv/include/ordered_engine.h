@@ -0,0 +1,208 @@
+#ifndef KV_ORDERED_ENGINE_H
+#define KV_ORDERED_ENGINE_H
+
+#include "kv_engine.h"
+#include "sync.h"
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace kv {
+
+// ============================================================================
+// OrderedEngine - 多版本并发跳表
+// ============================================================================
+// 单写多读：写操作（来自apply循环）由write_mu_串行化，读操作完全无锁。
+// next指针以release发布、acquire读取。
+//
+// 多版本：每个key挂一条按Raft index从新到旧的版本链，写入只在链头追加
+// 新版本（删除写入墓碑版本），已发布的版本不可变。在index r上的读取
+// 返回链上第一个 index <= r 的版本，因此任意已apply的index都可以被
+// 一致地读取，读者从不阻塞写者。
+//
+// 版本回收：每个读者（包括单次Get）在读取期间占用一个reader slot并写入
+// 自己的读index r。CollectGarbage先发布回收水位W，再取W与所有slot的 r-1 的最小值
+// 作为cutoff：每个key保留所有 index > cutoff 的版本和第一个 <= cutoff
+// 的版本，其余释放。读者占用slot后会复查水位，低于水位则重试（最新读）
+// 或失败（指定index的读视图），保证不会读到已释放的版本。
+//
+// 节点回收：回收后只剩一个 index <= cutoff 的墓碑的节点对所有读者都等同于不存在，
+// CollectGarbage把它从跳表中摘除（不修改它自己的next，停在它上面的读者可以继续前进），
+// 然后推进回收epoch。读者占用slot时记下当时的epoch；摘除时的epoch不大于所有
+// 在用slot记下的epoch后，再没有读者可能持有该节点，才真正释放。
+class OrderedEngine : public IKvEngine, public std::enable_shared_from_this<OrderedEngine> {
+    struct Node;
+    struct Version;
+
+public:
+    static constexpr int kMaxHeight = 12;
+    static constexpr size_t kReaderSlots = 128;
+
+    OrderedEngine();
+    ~OrderedEngine() override;
+
+    OrderedEngine(const OrderedEngine&) = delete;
+    OrderedEngine& operator=(const OrderedEngine&) = delete;
+
+    bool Get(const std::string& key, std::string& value) override;
+    void Put(uint64_t index, const std::string& key, const std::string& value) override;
+    void Append(uint64_t index, const std::string& key, const std::string& value) override;
+    bool Delete(uint64_t index, const std::string& key) override;
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override;
+    size_t Size() override;
+    void ForEach(const Visitor& visitor) override;
+    void Clear() override;
+
+    // 整批写入后才推进VisibleIndex()，最新读看不到写了一半的批次
+    void Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) override;
+
+    ReadViewPtr NewReadView(uint64_t index) override;
+    size_t CollectGarbage() override;
+
+    // 已写入的最大index（最新读使用的读index）
+    uint64_t VisibleIndex() const { return visible_index_.load(std::memory_order_acquire); }
+
+    // 低于该index的读视图无法再创建
+    uint64_t GcWatermark() const { return gc_watermark_.load(std::memory_order_acquire); }
+
+    // 当前保存的版本总数（含墓碑），用于观察回收效果
+    size_t VersionCount() const { return version_count_.load(std::memory_order_relaxed); }
+
+    // 跳表节点数（含已摘除、等待读者离开后释放的节点）
+    size_t NodeCount() const { return node_count_.load(std::memory_order_relaxed); }
+
+    // 有序只读迭代器，无锁
+    // 迭代器在生命周期内占用一个reader slot，读取固定在创建时的index上
+    class Iterator {
+    public:
+        Iterator(Iterator&& other) noexcept;
+        Iterator& operator=(Iterator&&) = delete;
+        ~Iterator();
+
+        bool Valid() const { return node_ != nullptr; }
+
+        // 定位到第一个 >= target 的有效key
+        void Seek(const std::string& target);
+        void SeekToFirst();
+        void Next();
+
+        const std::string& key() const;
+        const std::string& value() const;
+        uint64_t index() const { return read_index_; }
+
+    private:
+        friend class OrderedEngine;
+        Iterator(const OrderedEngine* engine, size_t slot, uint64_t read_index) :
+            engine_(engine), slot_(slot), read_index_(read_index), node_(nullptr), version_(nullptr) {}
+
+        // 跳过在read_index_上不可见或已删除的节点
+        void skipInvisible();
+
+        const OrderedEngine* engine_;
+        size_t slot_;
+        uint64_t read_index_;
+        Node* node_;
+        Version* version_;
+    };
+
+    // 最新数据上的迭代器
+    Iterator NewIterator() const;
+
+private:
+    class View;
+
+    static constexpr uint64_t kFreeSlot = UINT64_MAX;
+
+    struct Version {
+        const uint64_t index;
+        const bool deleted;
+        const std::string value;
+        std::atomic<Version*> older;
+
+        Version(uint64_t i, bool d, std::string v, Version* o) : index(i), deleted(d), value(std::move(v)), older(o) {}
+    };
+
+    struct Node {
+        const std::string key;
+        std::atomic<Version*> versions;  // 链头为最新版本
+        bool gc_pending = false;         // 是否已在gc_candidates_中（受write_mu_保护）
+        const int height;
+        std::atomic<Node*> next[1];      // 实际长度为height，随节点一起分配
+
+        Node(const std::string& k, int h) : key(k), versions(nullptr), height(h) {}
+    };
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> index{kFreeSlot};
+        std::atomic<uint64_t> epoch{0};     // 占用时的回收epoch，0表示尚未写入
+    };
+
+    static Node* newNode(const std::string& key, int height);
+    static void deleteNode(Node* node);
+
+    // 返回在index上可见的版本（可能是墓碑），没有则返回nullptr
+    static Version* visibleVersion(const Node* node, uint64_t index);
+
+    int randomHeight();
+
+    // 返回第一个 >= key 的节点，prev非空时记录每层的前驱
+    Node* findGreaterOrEqual(const std::string& key, Node** prev) const;
+
+    // 查找或插入key对应的节点（需持有write_mu_）
+    Node* findOrInsert(const std::string& key);
+
+    // 在链头追加版本（需持有write_mu_）
+    // 新版本在publish之前对最新读不可见
+    void pushVersion(Node* node, uint64_t index, bool deleted, std::string value);
+
+    // 推进VisibleIndex()，使index上的全部版本对最新读可见（需持有write_mu_）
+    void publish(uint64_t index);
+
+    // 单个写操作的实现（需持有write_mu_，不发布）
+    void putLocked(uint64_t index, const std::string& key, const std::string& value);
+    void appendLocked(uint64_t index, const std::string& key, const std::string& value);
+    bool deleteLocked(uint64_t index, const std::string& key);
+
+    // 占用一个reader slot。latest为true时读index取VisibleIndex()，
+    // 否则固定为index，若已低于回收水位则返回false
+    bool acquireSlot(bool latest, uint64_t index, size_t& slot, uint64_t& read_index) const;
+    void releaseSlot(size_t slot) const;
+
+    // 把节点从各层摘除（需持有write_mu_），节点本身保持不变
+    void unlinkNode(Node* node);
+
+    // 释放已没有读者可能持有的摘除节点，返回释放的版本数（需持有write_mu_）
+    size_t freeRetired();
+
+    // 在read_index上执行读操作的公共实现
+    bool getAt(const std::string& key, uint64_t read_index, std::string& value) const;
+    std::vector<KvPair> scanAt(Iterator& it, const std::string& start, const std::string& end, size_t limit) const;
+
+    Node* head_;
+    std::atomic<int> max_height_;
+    std::atomic<size_t> live_count_;
+    std::atomic<size_t> version_count_;
+    std::atomic<uint64_t> visible_index_;
+    std::atomic<uint64_t> gc_watermark_;
+    std::atomic<size_t> node_count_;
+    std::atomic<uint64_t> retire_epoch_;
+    mutable ReaderSlot slots_[kReaderSlots];
+
+    fiber::FiberMutex write_mu_;
+    std::mt19937 rng_;                 // 仅写者使用
+    std::vector<Node*> gc_candidates_; // 拥有多个版本的节点（受write_mu_保护）
+    std::vector<std::pair<Node*, uint64_t>> retired_;  // 已摘除的节点及摘除后的epoch（受write_mu_保护）
+};
+
+// ============================================================================
+// 工厂函数
+// ============================================================================
+
+inline KvEnginePtr MakeOrderedEngine() {
+    return std::make_shared<OrderedEngine>();
+}
+
+} // namespace kv
+
+#endif // KV_ORDERED_ENGINE_H
@@ -0,0 +1,192 @@
+#ifndef KV_READ_CACHE_H
+#define KV_READ_CACHE_H
+
+#include "kv_engine.h"
+#include "sync.h"
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace kv {
+
+struct ReadCacheOptions {
+    size_t capacity_bytes = 64 << 20;   // 缓存总容量（key + value + 每条记录的固定开销）
+    size_t shard_count = 16;            // 向上取整为2的幂
+    size_t max_entry_bytes = 64 << 10;  // 超过该大小的键值对不缓存
+    double window_ratio = 0.01;         // 准入窗口占总容量的比例
+};
+
+// 累计计数，Stats()按分片汇总
+struct ReadCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t admitted = 0;      // 从窗口晋升到主区的记录
+    uint64_t rejected = 0;      // 频率不足、未能进入主区的记录
+    uint64_t evicted = 0;       // 被新记录挤出主区的记录
+    uint64_t invalidated = 0;   // 因写入被删除的记录
+    size_t entries = 0;
+    size_t charged_bytes = 0;
+
+    double HitRatio() const {
+        uint64_t total = hits + misses;
+        return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+    }
+};
+
+// ============================================================================
+// ReadCache - 分片的W-TinyLFU读缓存
+// ============================================================================
+// key按哈希分散到各分片，每个分片一把FiberMutex，只在查表、拷贝value时持有。
+// 分片内分为两段：
+// - 窗口：容量约1%的LRU，新记录先进入这里，吸收突发的新key；
+// - 主区：其余容量，CLOCK置换（命中只置引用位，不移动节点）。
+// 窗口溢出的记录与主区CLOCK选出的牺牲者比较访问频率（4行count-min sketch，
+// 计数达到采样上限后整体减半以衰减历史），频率更高才能进入主区，
+// 否则直接丢弃。只访问一两次的key不会冲掉热点。
+//
+// 与写入的同步：Lookup未命中时返回分片的写入代数，调用方读完引擎后用它调用Fill；
+// Invalidate在引擎写入之后删除记录并推进代数，期间的Fill因代数不符被放弃，
+// 不会把写入之前读到的旧值放回缓存。
+class ReadCache {
+public:
+    explicit ReadCache(ReadCacheOptions options = {});
+
+    // 命中时写入value并返回true；未命中时把写入代数写入ticket
+    bool Lookup(const std::string& key, std::string& value, uint64_t& ticket);
+
+    // 把从引擎读到的值放入缓存，ticket为同一个key上次Lookup未命中时返回的值
+    void Fill(const std::string& key, const std::string& value, uint64_t ticket);
+
+    // key被写入或删除后调用（在引擎写入完成之后）
+    void Invalidate(const std::string& key);
+
+    void Clear();
+
+    ReadCacheStats Stats();
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Entry {
+        std::string key;
+        std::string value;
+        uint64_t hash = 0;
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        bool in_main = false;
+        bool referenced = false;    // CLOCK引用位
+
+        size_t Charge() const;
+    };
+
+    // 4行、每行width个8位计数器的count-min sketch，计数上限15
+    class FrequencySketch {
+    public:
+        explicit FrequencySketch(size_t width);
+        void Increment(uint64_t hash);
+        uint32_t Estimate(uint64_t hash) const;
+        void Clear();
+
+    private:
+        size_t indexOf(uint64_t hash, int row) const;
+
+        std::vector<uint8_t> counters_;
+        size_t mask_;
+        size_t samples_ = 0;
+        size_t sample_limit_;
+    };
+
+    struct alignas(64) Shard {
+        explicit Shard(size_t sketch_width) : sketch(sketch_width) {}
+
+        fiber::FiberMutex mu;
+        uint64_t generation = 0;
+        // key指向entries中的字符串；deque追加时不移动元素，槽位复用前先删除索引
+        std::unordered_map<std::string_view, uint32_t> index;
+        std::deque<Entry> entries;
+        std::vector<uint32_t> free;
+        FrequencySketch sketch;
+
+        uint32_t window_head = kNil;    // 最近使用
+        uint32_t window_tail = kNil;
+        uint32_t hand = kNil;           // CLOCK指针，主区为环形链表
+        size_t window_bytes = 0;
+        size_t main_bytes = 0;
+
+        ReadCacheStats stats;
+    };
+
+    Shard& shardFor(uint64_t hash);
+
+    // 以下均需持有shard.mu
+    void windowUnlink(Shard& shard, uint32_t id);
+    void windowPushFront(Shard& shard, uint32_t id);
+    void mainInsert(Shard& shard, uint32_t id);
+    void mainUnlink(Shard& shard, uint32_t id);
+    uint32_t clockVictim(Shard& shard);
+    void promote(Shard& shard, uint32_t id);
+    void remove(Shard& shard, uint32_t id);
+
+    ReadCacheOptions options_;
+    size_t window_capacity_;    // 每个分片
+    size_t main_capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    int shard_bits_;
+};
+
+// ============================================================================
+// CachedEngine - 带读缓存的引擎包装
+// ============================================================================
+// Get/MultiGet先查ReadCache，未命中再读底层引擎并回填；写接口先写底层引擎，
+// 再让涉及的key失效，因此apply循环的每次写入都会同步清理缓存。
+// Scan、ForEach和读视图直接访问底层引擎，不经过缓存。
+// 适合放在LsmEngine这类点查代价高（磁盘读取、反序列化）的引擎前面。
+class CachedEngine : public IKvEngine {
+public:
+    explicit CachedEngine(KvEnginePtr engine, ReadCacheOptions options = {});
+
+    bool Get(const std::string& key, std::string& value) override;
+    void Put(uint64_t index, const std::string& key, const std::string& value) override;
+    void Append(uint64_t index, const std::string& key, const std::string& value) override;
+    bool Delete(uint64_t index, const std::string& key) override;
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override;
+    size_t Size() override;
+    void ForEach(const Visitor& visitor) override;
+    void Clear() override;
+
+    void Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) override;
+    std::vector<KvResult> MultiGet(const std::vector<std::string>& keys) override;
+
+    ReadViewPtr NewReadView(uint64_t index) override;
+    size_t CollectGarbage() override;
+    size_t MemoryUsage() override;
+    uint64_t DurableIndex() override;
+    bool Persistent() const override;
+    // 导入可能覆盖任意key，完成后清空缓存
+    bool Ingest(uint64_t index, const std::vector<std::string>& paths) override;
+    bool Install(uint64_t index, const std::vector<std::string>& paths) override;
+
+    ReadCacheStats CacheStats() { return cache_.Stats(); }
+
+    const KvEnginePtr& Inner() const { return engine_; }
+
+private:
+    KvEnginePtr engine_;
+    ReadCache cache_;
+};
+
+// ============================================================================
+// 工厂函数
+// ============================================================================
+
+inline KvEnginePtr MakeCachedEngine(KvEnginePtr engine, ReadCacheOptions options = {}) {
+    return std::make_shared<CachedEngine>(std::move(engine), options);
+}
+
+} // namespace kv
+
+#endif // KV_READ_CACHE_H
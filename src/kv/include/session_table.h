@@ -0,0 +1,104 @@
+#ifndef KV_SESSION_TABLE_H
+#define KV_SESSION_TABLE_H
+
+#include "kv_command.h"
+#include "sync.h"
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// 会话表中的一条记录（定长，随快照一起保存）
+struct SessionEntry {
+    uint64_t client_id = 0;
+    uint64_t seq = 0;               // 最近一次已apply的请求序号
+    uint64_t last_index = 0;        // 最近一次活动的日志index，淘汰依据
+    int64_t number = 0;             // 该请求为INCR且成功时的新值
+    KvStatus status = KvStatus::OK; // 该请求的执行结果
+};
+
+struct SessionOptions {
+    size_t max_sessions = 65536;        // 会话数上限，超出时淘汰最久未活动的会话
+    uint64_t expire_entries = 1 << 20;  // 超过这么多条日志未活动的会话过期，0表示不按活动时间过期
+};
+
+// ============================================================================
+// SessionTable - 客户端请求去重表（exactly-once）
+// ============================================================================
+// 每个客户端只记录最近一次已apply请求的序号和结果，要求同一个client_id
+// 同时只有一个未完成的写请求（见ClientSession），重试时复用原来的RequestId：
+//   seq == 记录的seq：重复请求，不再执行，返回第一次执行的结果；
+//   seq <  记录的seq：客户端早已收到结果的过期重试，不执行，返回OK；
+//   seq >  记录的seq：新请求，执行后更新记录。
+//
+// 记录是定长的：缓存的结果只有状态和INCR的新值，重复的CAS/PUT_IF_ABSENT失败时
+// 不再带回当前值，重复的BATCH不带回逐条结果。
+//
+// 内存有界：记录存放在定长槽位数组中，按最近活动串成LRU链表（槽位下标，无额外分配）。
+// 新增会话时淘汰超过expire_entries条日志未活动的会话，并保证总数不超过max_sessions。
+// 淘汰只依赖日志index和apply顺序，各副本淘汰同样的会话；被淘汰的客户端再重试旧请求
+// 会被当作新请求执行，上限应远大于同时活跃的客户端数。
+class SessionTable {
+public:
+    explicit SessionTable(SessionOptions options = {});
+
+    // 检查请求是否已执行过：是则把缓存的结果写入result、刷新会话的活动时间并返回true
+    bool Check(uint64_t index, const RequestId& request, KvOp op, KvResult& result);
+
+    // 只查询、不刷新活动时间：client_id是否有会话，以及请求是否已执行过（Check会返回true）。
+    // 并行apply据此在执行前划分日志，见KvStateMachine::ApplyBatch
+    bool Contains(uint64_t client_id);
+    bool Executed(const RequestId& request);
+
+    // 记录新请求在index上的执行结果，必要时淘汰旧会话（evicted非空时追加被淘汰的client_id）
+    void Record(uint64_t index, const RequestId& request, KvOp op, const KvResult& result,
+                std::vector<uint64_t>* evicted = nullptr);
+
+    // client_id的会话记录，没有会话时返回false
+    bool Find(uint64_t client_id, SessionEntry& entry);
+
+    // 所有会话，按最近活动时间从旧到新排列（用于快照）
+    std::vector<SessionEntry> Entries();
+
+    // 用快照中的会话替换当前内容，entries按Entries()的顺序排列。
+    // 超出上限或已过期的会话按同样的规则淘汰，evicted非空时追加被淘汰的client_id
+    void Restore(const std::vector<SessionEntry>& entries, std::vector<uint64_t>* evicted = nullptr);
+
+    void Clear();
+
+    size_t Size() const { return size_.load(std::memory_order_acquire); }
+
+    // 累计淘汰的会话数
+    uint64_t EvictedCount() const { return evicted_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Slot {
+        SessionEntry entry;
+        uint32_t prev = kNil;   // 更新的一端
+        uint32_t next = kNil;   // 更旧的一端
+    };
+
+    void unlink(uint32_t slot);
+    void pushFront(uint32_t slot);
+    uint32_t allocate();
+    void evictLocked(uint64_t index, std::vector<uint64_t>* evicted);
+    void clearLocked();
+
+    SessionOptions options_;
+    fiber::FiberMutex mu_;
+    std::unordered_map<uint64_t, uint32_t> clients_;    // client_id -> 槽位
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_;
+    uint32_t head_ = kNil;      // 最近活动
+    uint32_t tail_ = kNil;      // 最久未活动
+    std::atomic<size_t> size_{0};
+    std::atomic<uint64_t> evicted_{0};
+};
+
+} // namespace kv
+
+#endif // KV_SESSION_TABLE_H
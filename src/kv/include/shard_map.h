@@ -0,0 +1,93 @@
+#ifndef KV_SHARD_MAP_H
+#define KV_SHARD_MAP_H
+
+#include "kv_command.h"
+#include "sync.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// 分片：key哈希空间上的连续区间
+// ============================================================================
+// keyspace按ShardKeyHash划分为若干首尾相接的闭区间 [first, last]，
+// 每个分片由一个独立的Raft组负责，分片id即组id。
+// 分裂和合并只改变区间，每次改变递增分片的epoch：同一个分片的两份描述中
+// epoch大的较新。
+struct ShardRange {
+    uint64_t id = 0;
+    uint64_t first = 0;
+    uint64_t last = UINT64_MAX;
+    uint64_t epoch = 0;
+    std::vector<std::string> endpoints;     // 负责该分片的节点地址（"host:port"）
+};
+
+// 分片的负载统计（上一个统计周期内）
+struct ShardLoad {
+    uint64_t id = 0;
+    double reads_per_sec = 0;
+    double writes_per_sec = 0;
+    uint64_t keys = 0;
+};
+
+// 分片使用的key哈希，客户端与服务端必须一致，不能依赖std::hash
+// （FNV-1a之后再做一次混合，短key的高位也分布均匀）
+// 事务的保留key按其中的用户key计算，与数据落在同一个分片
+inline uint64_t ShardKeyHash(std::string_view key) {
+    key = TxnRoutingKey(key);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// 把整个哈希空间均分为count个分片，id从1开始
+std::vector<ShardRange> UniformShards(size_t count, const std::vector<std::string>& endpoints = {});
+
+// 解析 "host:port"
+bool ParseEndpoint(const std::string& endpoint, std::string& host, uint16_t& port);
+
+// ============================================================================
+// ShardMapCache - 客户端缓存的分片表
+// ============================================================================
+// 按区间记录每个分片所在的节点，客户端据此把请求直接发往负责的节点。
+// 节点只对自己负责的分片有权威信息：Update时新描述覆盖与之重叠的旧区间
+// （同一分片的描述按epoch取新）。请求返回WRONG_SHARD说明缓存已过期，
+// 应调用Refresh重新拉取后重试。
+class ShardMapCache {
+public:
+    // seeds为初始节点地址，Refresh时逐个拉取
+    explicit ShardMapCache(std::vector<std::string> seeds = {});
+
+    // 查找key所在的分片，缓存中没有覆盖该key的区间时返回nullopt
+    std::optional<ShardRange> Locate(const std::string& key);
+
+    // 合并一个节点返回的分片描述
+    void Update(const std::vector<ShardRange>& shards);
+
+    // 向seeds及缓存中出现过的所有节点拉取分片表（KV.ShardMap），返回成功的节点数
+    size_t Refresh();
+
+    // 缓存中的所有分片，按first升序
+    std::vector<ShardRange> Shards();
+
+    // 缓存的区间是否覆盖了整个哈希空间
+    bool Complete();
+
+private:
+    std::vector<std::string> seeds_;
+    fiber::FiberMutex mu_;
+    std::vector<ShardRange> shards_;    // 按first升序，互不重叠
+};
+
+} // namespace kv
+
+#endif // KV_SHARD_MAP_H
@@ -0,0 +1,167 @@
+#ifndef KV_SHARDED_HASH_ENGINE_H
+#define KV_SHARDED_HASH_ENGINE_H
+
+#include "kv_engine.h"
+#include "bloom_filter.h"
+#include "compact_map.h"
+#include "sync.h"
+#include <atomic>
+#include <vector>
+#include <memory>
+
+namespace kv {
+
+// ============================================================================
+// ShardedHashEngine - 锁分段哈希表
+// ============================================================================
+// key按哈希值分散到2^n个分片，每个分片独立持有一把FiberMutex和一张
+// CompactMap。不同分片上的读写互不阻塞，读吞吐随调度线程数线性扩展。
+// 分片按cache line对齐，避免相邻分片的锁产生伪共享。
+// 哈希表无序，Scan需要遍历全部分片后排序，范围查询应使用OrderedEngine。
+//
+// 分页：分片内的数据再按哈希分成页，每页是一张不超过kMaxPageKeys个key的CompactMap。
+// 页按可扩展哈希组织：分片持有一个大小为2^全局深度的目录，页的局部深度为d时，
+// 它的key哈希低d位相同，被2^(全局深度-d)个目录项引用；页超过上限时只分裂这一页，
+// 局部深度等于全局深度时目录先翻倍（只复制指针）。
+//
+// 写时复制读视图：NewReadView在各分片锁内复制一次目录指针并推进分片的epoch即完成
+// 冻结（代价与分片数相关，与数据量无关）。目录和页各自记录创建时的epoch，
+// 早于分片当前epoch的可能被视图引用：写入时先复制目录（指针数组）和目标页再修改，
+// 因此一次写入的复制代价以一页为上限，与分片大小无关。
+// 引擎只保存最新版本，因此只能在最新已写入的index上创建视图；index为0时
+// 冻结当前数据，只有在apply循环中（没有并发写入时）调用才是一致的。
+//
+// 前置过滤器（可选）：每个分片维护一个分块布隆过滤器，Get先探测过滤器，
+// 不存在的key不再查找哈希表。过滤器不支持删除，插入数超过容量或删除过多时
+// 在分片锁内按当前数据重建。
+//
+// 批量操作：Write/MultiGet先计算所有key的哈希并按分片分组，每个分片只加锁一次。
+// Write按分片号升序锁住涉及的全部分片后再统一写入，并发读者看到的批次是原子的。
+// 写接口同样只锁涉及的分片，key互不相同的写入可以并发（见KvStateMachine::ApplyBatch）。
+//
+// 内存布局：键值对以紧凑记录的形式存放在分片自己的slab arena中（见CompactMap），
+// 没有std::string对象和链表节点的开销。MemoryUsage()汇总各页的槽位数组和arena以及目录。
+//
+// 值压缩（可选）：每个分片先收集一段写入的值作为样本，训练出分片自己的字典后，
+// 把已有的值和之后写入的值按字典压缩存放，读取时才解压。字典训练之后不再更换，
+// 读视图与分片共用同一个字典。
+class ShardedHashEngine : public IKvEngine {
+public:
+    static constexpr size_t kDefaultShardCount = 64;
+
+    // 写时复制的单位：一页最多容纳的key数，超过后分裂
+    static constexpr size_t kMaxPageKeys = 1024;
+
+    // shard_count会被向上取整为2的幂
+    // filter_bits_per_key为0时不启用前置过滤器
+    explicit ShardedHashEngine(size_t shard_count = kDefaultShardCount, int filter_bits_per_key = 0,
+                               bool compress_values = false);
+
+    bool Get(const std::string& key, std::string& value) override;
+    void Put(uint64_t index, const std::string& key, const std::string& value) override;
+    void Append(uint64_t index, const std::string& key, const std::string& value) override;
+    bool Delete(uint64_t index, const std::string& key) override;
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override;
+    size_t Size() override;
+    void ForEach(const Visitor& visitor) override;
+    void Clear() override;
+
+    void Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) override;
+    std::vector<KvResult> MultiGet(const std::vector<std::string>& keys) override;
+
+    ReadViewPtr NewReadView(uint64_t index) override;
+
+    // 不同key的写入只锁各自的分片，可以并发调用
+    bool ConcurrentWrites() const override { return true; }
+
+    size_t MemoryUsage() override;
+
+    size_t ShardCount() const { return shards_.size(); }
+
+    // 已写入的最大index
+    uint64_t WrittenIndex() const { return written_index_.load(std::memory_order_acquire); }
+
+private:
+    class View;
+
+    struct Page {
+        CompactMap map;
+        int depth = 0;              // 局部深度：页中key的页哈希低depth位相同
+        uint64_t epoch = 0;         // 创建（或复制）时分片的epoch
+    };
+    using PagePtr = std::shared_ptr<Page>;
+
+    // 大小为2^全局深度，下标为页哈希的低位
+    using Directory = std::vector<PagePtr>;
+    using DirectoryPtr = std::shared_ptr<Directory>;
+
+    struct alignas(64) Shard {
+        fiber::FiberMutex mu;
+        DirectoryPtr dir;
+        uint64_t dir_epoch = 0;     // 目录创建（或复制）时的epoch
+        uint64_t epoch = 0;         // 每创建一个读视图加一
+
+        // 前置过滤器，未启用时为空
+        std::unique_ptr<BlockedBloomFilter> filter;
+        size_t filter_capacity = 0;     // 重建时按该key数分配
+        size_t filter_inserts = 0;      // 自上次重建以来插入的key数
+        size_t filter_deletes = 0;      // 自上次重建以来删除的key数
+
+        // 值压缩：字典训练出来之前收集样本
+        bool dict_trained = false;
+        CompressionDictPtr dict;
+        std::vector<std::string> samples;
+        size_t sample_bytes = 0;
+    };
+
+    Shard& shardFor(uint64_t hash);
+
+    // key所在的页（需持有shard.mu）
+    static Page& pageFor(const Shard& shard, uint64_t hash);
+
+    // 新建一个空页，按分片的压缩设置初始化
+    PagePtr newPage(const Shard& shard, int depth) const;
+
+    // 把分片清空为只有一页的目录（需持有shard.mu）
+    void resetShard(Shard& shard);
+
+    // 分片中的key数（需持有shard.mu）
+    static size_t shardSize(const Shard& shard);
+
+    // 新key写入后更新过滤器（需持有shard.mu）
+    void filterInsert(Shard& shard, uint64_t hash);
+    void filterDelete(Shard& shard);
+    void rebuildFilter(Shard& shard);
+
+    // 记录写入的值作为字典样本，样本足够时训练字典并压缩分片中已有的值（需持有shard.mu）
+    void sampleValue(Shard& shard, const std::string& value);
+
+    // 返回可修改的页（需持有shard.mu）：目录或页可能被读视图引用时先复制
+    Page& writable(Shard& shard, uint64_t hash);
+    Page& writableAt(Shard& shard, size_t slot);
+
+    // 写入新key后，页超过kMaxPageKeys时分裂（需持有shard.mu）
+    void maybeSplit(Shard& shard, uint64_t hash);
+
+    // 记录写入的index（需持有shard.mu，且在修改map之前调用）
+    void markWritten(uint64_t index);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    int shard_bits_;
+    int filter_bits_per_key_;
+    bool compress_values_;
+    std::atomic<uint64_t> written_index_{0};
+};
+
+// ============================================================================
+// 工厂函数
+// ============================================================================
+
+inline KvEnginePtr MakeShardedHashEngine(size_t shard_count = ShardedHashEngine::kDefaultShardCount,
+                                         int filter_bits_per_key = 0, bool compress_values = false) {
+    return std::make_shared<ShardedHashEngine>(shard_count, filter_bits_per_key, compress_values);
+}
+
+} // namespace kv
+
+#endif // KV_SHARDED_HASH_ENGINE_H
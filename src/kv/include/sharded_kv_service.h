@@ -0,0 +1,218 @@
+#ifndef KV_SHARDED_KV_SERVICE_H
+#define KV_SHARDED_KV_SERVICE_H
+
+#include "kv_service.h"
+#include "shard_map.h"
+#include "rpc_server.h"
+#include "sync.h"
+#include "timer.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace kv {
+
+struct ShardingOptions {
+    std::vector<std::string> endpoints;     // 本节点对外的地址，写入分片表供客户端路由
+
+    // 负载驱动的分裂与合并（Start之后按interval_ms周期检查）
+    uint64_t interval_ms = 10000;
+    double split_ops_per_sec = 20000;       // 单个分片读写合计超过该值时分裂
+    double merge_ops_per_sec = 1000;        // 相邻两个分片合计低于该值时合并
+    size_t max_shards = 64;
+    size_t min_shards = 1;
+
+    size_t migrate_batch = 1000;            // 迁移数据时每条BATCH日志的key数
+};
+
+// ============================================================================
+// ShardedKvService - 按key哈希区间把keyspace分给多个Raft组
+// ============================================================================
+// 单个Raft组只有一个leader在apply，吞吐受限于一个核。把哈希空间切成多个分片，
+// 每个分片是一个独立的Raft组（由GroupFactory创建，各自有状态机和propose），
+// 不同分片的leader可以分布在不同的核和节点上。
+//
+// 路由：请求按ShardKeyHash(key)找到本节点负责的分片，转给该分片的KvService；
+// key不在本节点的分片内时返回WRONG_SHARD，客户端用KV.ShardMap刷新缓存
+// （ShardMapCache）后直接发往正确的节点。多key请求按分片拆开：MultiGet、MultiPut
+// 分别发往各分片（MultiPut只在单个分片内原子），WriteBatch要求所有key在同一个
+// 分片内，前缀Watch要求本节点只有一个覆盖整个哈希空间的分片；Scan从本节点各分片
+// 的有序结果中归并出一页（只包含本节点分片中的数据）。
+//
+// 分裂与合并：每个分片统计读写次数，并在环形缓冲中采样最近访问的key哈希。
+// 后台按周期检查：最热且超过split_ops_per_sec的分片在采样的中位数处一分为二
+// （热点集中在区间一侧时按负载而不是按区间平分），合计低于merge_ops_per_sec的
+// 相邻分片合并为一个。迁移时源分片暂停写入（读照常由源分片服务），等进行中的写
+// 完成后经Raft把区间内的数据写入目标组，切换路由后恢复写入，再从源组删除已迁走
+// 的key；暂停期间到达的写请求等待切换完成后发往新的分片，客户端不会看到错误。
+//
+// 事务（Txn）可以跨本节点的多个分片，由一个覆盖所有本地分片的TxnCoordinator执行
+// （见txn.h）；intent和事务记录按其中的用户key路由，随数据一起迁移。
+class ShardedKvService {
+public:
+    // 为新分片创建Raft组，返回nullptr表示无法创建（分裂放弃）
+    using GroupFactory = std::function<KvServicePtr(uint64_t shard_id)>;
+
+    // 负载采样的环形缓冲大小
+    static constexpr size_t kLoadSamples = 256;
+
+    // shards为本节点初始负责的分片，为空时本节点负责整个哈希空间（一个分片）
+    ShardedKvService(GroupFactory factory, std::vector<ShardRange> shards = {}, ShardingOptions options = {});
+
+    // 停止后台负载检查，等待事务的后台提交完成
+    ~ShardedKvService();
+
+    ShardedKvService(const ShardedKvService&) = delete;
+    ShardedKvService& operator=(const ShardedKvService&) = delete;
+
+    // 注册所有KV方法和KV.ShardMap到RPC服务器
+    void RegisterRPC(rpc::RpcServerPtr rpc_server);
+
+    // 启动/停止周期性的负载检查
+    void Start();
+    void Stop();
+
+    // 本节点负责的分片，按first升序
+    std::vector<ShardRange> Shards();
+
+    // 当前统计周期（上一次RebalanceOnce以来）各分片的负载，按first升序
+    std::vector<ShardLoad> Loads();
+
+    // key所在的本地分片的KvService，不在本节点时返回nullptr
+    KvServicePtr ServiceFor(const std::string& key);
+
+    // 把分片在哈希值at处分为 [first, at-1] 和 [at, last]，后一半迁到新建的组
+    // at为0时按负载采样的中位数选择分裂点；成功时返回新分片的id
+    std::optional<uint64_t> Split(uint64_t shard_id, uint64_t at = 0);
+
+    // 把分片与其右侧相邻的本地分片合并，右侧分片的数据迁入左侧的组后销毁右侧的组
+    bool Merge(uint64_t left_id);
+
+    // 按当前统计周期的负载执行至多一次分裂或合并，并开始新的统计周期
+    // 返回是否做了调整
+    bool RebalanceOnce();
+
+    // RPC handlers
+    std::optional<std::string> Get(const GetArgs& args, GetReply& reply);
+    std::optional<std::string> PutAppend(const PutAppendArgs& args, PutAppendReply& reply);
+    std::optional<std::string> Delete(const DeleteArgs& args, DeleteReply& reply);
+    std::optional<std::string> Scan(const ScanArgs& args, ScanReply& reply);
+    std::optional<std::string> ScanPrefix(const ScanPrefixArgs& args, ScanReply& reply);
+    std::optional<std::string> MultiGet(const MultiGetArgs& args, MultiGetReply& reply);
+    std::optional<std::string> MultiPut(const MultiPutArgs& args, MultiPutReply& reply);
+    std::optional<std::string> WriteBatch(const WriteBatchArgs& args, WriteBatchReply& reply);
+    std::optional<std::string> CompareAndSwap(const CompareAndSwapArgs& args, CompareAndSwapReply& reply);
+    std::optional<std::string> PutIfAbsent(const PutIfAbsentArgs& args, PutIfAbsentReply& reply);
+    std::optional<std::string> Increment(const IncrementArgs& args, IncrementReply& reply);
+    std::optional<std::string> Watch(const WatchArgs& args, WatchReply& reply);
+    std::optional<std::string> ShardMap(const ShardMapArgs& args, ShardMapReply& reply);
+    std::optional<std::string> Txn(const TxnArgs& args, TxnReply& reply);
+
+private:
+    struct Shard {
+        ShardRange range;
+        KvServicePtr service;
+        std::atomic<uint64_t> reads{0};
+        std::atomic<uint64_t> writes{0};
+        std::atomic<uint64_t> sample_pos{0};
+        std::array<std::atomic<uint64_t>, kLoadSamples> samples{};
+        size_t inflight = 0;    // 进行中的写请求，受mu_保护
+        bool frozen = false;    // 迁移中，新的写请求等待，受mu_保护
+
+        void record(uint64_t hash, bool write);
+    };
+    using ShardPtr = std::shared_ptr<Shard>;
+
+    // 写请求的登记：构造时等待分片解冻并计入inflight，析构时注销
+    class WriteGuard {
+    public:
+        WriteGuard(ShardedKvService* owner, ShardPtr shard) : owner_(owner), shard_(std::move(shard)) {}
+        WriteGuard(WriteGuard&& other) noexcept : owner_(other.owner_), shard_(std::move(other.shard_)) {}
+        WriteGuard(const WriteGuard&) = delete;
+        WriteGuard& operator=(const WriteGuard&) = delete;
+        ~WriteGuard();
+
+        explicit operator bool() const { return shard_ != nullptr; }
+        const ShardPtr& shard() const { return shard_; }
+
+    private:
+        ShardedKvService* owner_;
+        ShardPtr shard_;
+    };
+
+    using TimerHandle = decltype(std::declval<fiber::TimerWheel&>().addTimer(
+        uint64_t{}, std::function<void()>{}, bool{}));
+
+    ShardPtr newShard(ShardRange range, KvServicePtr service);
+    ShardPtr locate(uint64_t hash);     // 调用方持有mu_
+    ShardPtr readShard(const std::string& key);
+    WriteGuard writeShard(const std::string& key);
+
+    // 暂停分片的写入并等待进行中的写完成
+    void freeze(const ShardPtr& shard);
+    void unfreeze(const ShardPtr& shard);
+
+    // 经Raft把src中哈希落在 [first, last] 的键值对（含TTL）写入dst，返回迁移的key
+    bool migrate(const KvServicePtr& src, const KvServicePtr& dst, uint64_t first, uint64_t last,
+                 std::vector<std::string>& moved);
+    // 经Raft删除keys，事务的intent先于数据删除
+    void dropKeys(const KvServicePtr& service, const std::vector<std::string>& keys);
+
+    // 采样中位数作为分裂点，样本不足或无法分裂时返回0
+    uint64_t splitPoint(const Shard& shard);
+
+    // 单key写请求：等待分片可写后转给分片的KvService；
+    // key被事务锁住时在释放写登记后等待事务结束，再重试
+    template <typename Args, typename Reply>
+    std::optional<std::string> forwardWrite(
+        const std::string& key, const Args& args, Reply& reply,
+        std::optional<std::string> (KvService::*method)(const Args&, Reply&)) {
+        for (int retry = 0;; ++retry) {
+            std::optional<std::string> error;
+            {
+                auto guard = writeShard(key);
+                if (!guard) {
+                    reply.status = KvStatus::WRONG_SHARD;
+                    return std::nullopt;
+                }
+                error = (guard.shard()->service.get()->*method)(args, reply);
+            }
+            if (error.has_value() || !retryConflict(reply.status, {key}, retry)) {
+                return error;
+            }
+        }
+    }
+
+    // 写请求返回TXN_CONFLICT时等待keys上的事务结束，返回是否应重试
+    bool retryConflict(KvStatus status, const std::vector<std::string>& keys, int retry);
+
+    uint64_t newShardId();
+    void scanPage(const std::string& start, const std::string& end, uint64_t limit, ScanReply& reply);
+    void tick();
+
+    GroupFactory factory_;
+    ShardingOptions options_;
+
+    fiber::FiberMutex mu_;
+    fiber::FiberCondition cond_;
+    std::map<uint64_t, ShardPtr> shards_;   // first -> 分片
+    fiber::FiberMutex rebalance_mu_;        // 串行化分裂与合并
+    std::chrono::steady_clock::time_point last_loads_ = std::chrono::steady_clock::now();
+
+    TimerHandle timer_{};
+    std::atomic<bool> stopped_{true};
+    std::atomic<bool> running_{false};
+
+    TxnCoordinatorPtr txn_;
+};
+
+using ShardedKvServicePtr = std::shared_ptr<ShardedKvService>;
+
+} // namespace kv
+
+#endif // KV_SHARDED_KV_SERVICE_H
@@ -0,0 +1,66 @@
+#ifndef KV_SNAPSHOTTER_H
+#define KV_SNAPSHOTTER_H
+
+#include "kv_state_machine.h"
+#include "persister.h"
+#include "sync.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace kv {
+
+// ============================================================================
+// Snapshotter - 不暂停apply的后台快照
+// ============================================================================
+// Start在apply循环中调用：通过引擎的读视图在LastApplied()上逻辑冻结状态机
+// （跳表引擎是多版本读视图，哈希引擎是分片级写时复制，代价都与数据量无关），
+// 随后由后台fiber遍历视图、序列化并调用 IPersister::Save，期间apply照常进行。
+// 同一时刻最多只有一个快照在写入。
+class Snapshotter {
+public:
+    // 返回保存快照时要一起写入的Raft状态，为空时沿用persister中已有的状态
+    using RaftStateFunc = std::function<std::vector<uint8_t>()>;
+
+    // 快照写入完成后在后台fiber中回调，index为快照对应的Raft index
+    // Raft层可在回调中截断 <= index 的日志
+    using DoneCallback = std::function<void(uint64_t index)>;
+
+    Snapshotter(KvStateMachinePtr sm, raft::PersisterPtr persister, RaftStateFunc raftstate = nullptr);
+
+    // 等待进行中的快照写完
+    ~Snapshotter();
+
+    Snapshotter(const Snapshotter&) = delete;
+    Snapshotter& operator=(const Snapshotter&) = delete;
+
+    // 冻结当前状态并启动后台写入
+    // 已有快照在写入，或引擎不支持读视图时返回false
+    bool Start(DoneCallback done = nullptr);
+
+    bool InProgress();
+
+    // 阻塞直到进行中的快照写完
+    void Wait();
+
+    // 最近一次成功写入的快照index，0表示还没有
+    uint64_t LastSnapshotIndex();
+
+private:
+    void write(ReadViewPtr view, SnapshotExtras extras, DoneCallback done);
+
+    KvStateMachinePtr sm_;
+    raft::PersisterPtr persister_;
+    RaftStateFunc raftstate_;
+
+    fiber::FiberMutex mu_;
+    fiber::FiberCondition cond_;
+    bool in_progress_ = false;
+    uint64_t last_index_ = 0;
+};
+
+using SnapshotterPtr = std::shared_ptr<Snapshotter>;
+
+} // namespace kv
+
+#endif // KV_SNAPSHOTTER_H
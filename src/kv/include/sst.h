@@ -0,0 +1,212 @@
+#ifndef KV_SST_H
+#define KV_SST_H
+
+#include "value_codec.h"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// SST文件格式
+// ============================================================================
+// 不可变的有序表文件，按key升序保存键值对（含删除墓碑）：
+//
+//   [data block 0] ... [data block N-1] [index block] [bloom block] [meta block] [footer]
+//
+// - data block:  若干条 [u32 key_len][u32 value_len][u8 flags][key][value]
+// - index block: 每个data block一条 [u32 key_len][last_key][u64 offset][u64 size]
+// - bloom block: BloomFilter::Build 的输出
+// - meta block:  [u32 len][smallest key][u32 len][largest key]，压缩的文件后接
+//                [u8 codec][u32 len][dictionary]
+// - footer:      index/bloom/meta 三个块的 (u64 offset, u64 size)、u64 条目数、u64 magic
+//
+// 除footer外每个块末尾附带 u32 CRC32 校验。整数均为小端序。
+//
+// 压缩（可选）：每个文件用自己开头一段条目训练一个字典，存放在meta block中；
+// 每个data block前加一个字节表示是否压缩（压缩后不变小的块保持原样），
+// 块之间互不依赖。读取时只解压被访问到的块。
+
+inline constexpr uint64_t kSstMagic = 0x5353564b594e4954ULL;  // "TINYKVSS"
+inline constexpr size_t kSstFooterSize = 8 * 8;
+
+// CRC32（IEEE多项式），用于块和文件校验
+uint32_t Crc32(const char* data, size_t size, uint32_t crc = 0);
+
+struct SstOptions {
+    size_t block_size = 4096;       // data block目标大小
+    int bloom_bits_per_key = 10;    // 0 表示不生成布隆过滤器
+    bool compression = false;       // 用文件级字典压缩data block
+    size_t dict_bytes = 16 << 10;   // 字典大小
+    size_t dict_sample_bytes = 256 << 10;  // 缓存这么多数据后训练字典，再开始写data block
+};
+
+// ============================================================================
+// EntryIterator - 有序条目迭代器（SST、memtable和多路归并共用）
+// ============================================================================
+class EntryIterator {
+public:
+    virtual ~EntryIterator() = default;
+
+    virtual bool Valid() const = 0;
+    virtual void SeekToFirst() = 0;
+    // 定位到第一个 >= target 的条目
+    virtual void Seek(const std::string& target) = 0;
+    virtual void Next() = 0;
+
+    virtual const std::string& key() const = 0;
+    virtual const std::string& value() const = 0;
+    virtual bool deleted() const = 0;
+
+    // 遇到读取失败或损坏的数据时返回false，此时Valid()也为false，
+    // 调用方在遍历结束后必须检查，不能把它当作正常的结尾
+    virtual bool status() const { return true; }
+};
+
+using EntryIteratorPtr = std::unique_ptr<EntryIterator>;
+
+// ============================================================================
+// SstBuilder - 顺序写入一个SST文件
+// ============================================================================
+class SstBuilder {
+public:
+    SstBuilder(std::string path, SstOptions options = SstOptions());
+
+    // 未Finish时删除写了一半的文件
+    ~SstBuilder();
+
+    SstBuilder(const SstBuilder&) = delete;
+    SstBuilder& operator=(const SstBuilder&) = delete;
+
+    // 创建文件，失败返回false
+    bool Open();
+
+    // 追加条目，key必须严格递增
+    bool Add(const std::string& key, const std::string& value, bool deleted);
+
+    // 写入索引、过滤器和footer并fsync
+    bool Finish();
+
+    const std::string& Path() const { return path_; }
+    uint64_t FileSize() const { return offset_; }
+    // 已写入内容的CRC32（Finish后为整个文件的校验和，等于Crc32(文件内容)）
+    uint32_t FileCrc() const { return file_crc_; }
+    uint64_t NumEntries() const { return num_entries_; }
+    // 已写入data block的估计大小（含当前未满的块和等待训练字典的块）
+    uint64_t EstimatedSize() const { return offset_ + pending_bytes_ + block_.size(); }
+    const std::string& Smallest() const { return smallest_; }
+    const std::string& Largest() const { return largest_; }
+
+private:
+    bool flushBlock();
+    bool writeBlock(const std::string& block, uint64_t& offset, uint64_t& size);
+    bool writeDataBlock(const std::string& block, const std::string& last_key);
+
+    // 用缓存的样本训练字典，并写出等待中的块
+    bool trainAndFlushPending();
+
+    std::string path_;
+    SstOptions options_;
+    int fd_;
+    bool finished_;
+    uint64_t offset_;
+    uint32_t file_crc_;
+    uint64_t num_entries_;
+
+    std::string block_;
+    std::string index_;
+    std::vector<uint64_t> key_hashes_;
+    std::string smallest_;
+    std::string largest_;
+
+    // 压缩：字典训练之前的data block及其last key暂存在内存中
+    bool dict_ready_;
+    CompressionDictPtr dict_;
+    std::vector<std::string> samples_;
+    std::vector<std::pair<std::string, std::string>> pending_;
+    uint64_t pending_bytes_;
+};
+
+// ============================================================================
+// SstReader - 只读打开的SST文件
+// ============================================================================
+// 打开时把索引、过滤器和元信息读入内存，data block按需用pread读取，
+// 可被多个线程并发读取。
+class SstReader : public std::enable_shared_from_this<SstReader> {
+public:
+    enum class LookupResult {
+        NOT_FOUND,
+        FOUND,
+        DELETED,    // 找到删除墓碑，更老的文件中的同名key已失效
+        ERROR,      // 读取失败或数据块损坏，无法确定key是否存在
+    };
+
+    // 打开并校验文件，失败返回nullptr
+    static std::shared_ptr<SstReader> Open(const std::string& path, uint64_t number);
+
+    ~SstReader();
+
+    LookupResult Get(const std::string& key, std::string& value) const;
+    LookupResult Get(const std::string& key, uint64_t hash, std::string& value) const;
+
+    // 迭代器持有reader的引用
+    EntryIteratorPtr NewIterator() const;
+
+    // 文件被compaction替换后调用，最后一个引用释放时删除文件
+    void MarkObsolete() { obsolete_.store(true, std::memory_order_release); }
+
+    // 校验全部data block的CRC，用于外部导入的文件
+    bool VerifyChecksums() const;
+
+    uint64_t Number() const { return number_; }
+    const std::string& Path() const { return path_; }
+    uint64_t FileSize() const { return file_size_; }
+    uint64_t NumEntries() const { return num_entries_; }
+    const std::string& Smallest() const { return smallest_; }
+    const std::string& Largest() const { return largest_; }
+
+private:
+    friend class SstIterator;
+
+    struct BlockHandle {
+        std::string last_key;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    SstReader(std::string path, uint64_t number, int fd, uint64_t file_size);
+
+    bool load();
+
+    // 读取并校验一个块（不含CRC）
+    bool readBlock(uint64_t offset, uint64_t size, std::string& block) const;
+
+    // 读取第index个data block，压缩的块在这里解压
+    bool readDataBlock(size_t index, std::string& block) const;
+
+    // 第一个 last_key >= key 的data block，没有返回blocks_.size()
+    size_t findBlock(const std::string& key) const;
+
+    std::string path_;
+    uint64_t number_;
+    int fd_;
+    uint64_t file_size_;
+    uint64_t num_entries_;
+    std::atomic<bool> obsolete_;
+
+    std::vector<BlockHandle> blocks_;
+    std::string bloom_;
+    std::string smallest_;
+    std::string largest_;
+    bool compressed_;
+    CompressionDictPtr dict_;
+};
+
+using SstReaderPtr = std::shared_ptr<SstReader>;
+
+} // namespace kv
+
+#endif // KV_SST_H
@@ -0,0 +1,68 @@
+#ifndef KV_TTL_EXPIRER_H
+#define KV_TTL_EXPIRER_H
+
+#include "kv_state_machine.h"
+#include "timer.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace kv {
+
+struct TtlExpirerOptions {
+    uint64_t tick_ms = 100;             // TimerWheel的触发间隔
+    size_t max_keys_per_entry = 256;    // 一条EXPIRE日志最多删除的key数，限制单条日志占用apply循环的时间
+    size_t max_keys_per_tick = 20000;   // 一次tick最多删除的key数，超出的留给下一次tick
+};
+
+// ============================================================================
+// TtlExpirer - 周期性地把已过期的key打包成EXPIRE命令提交
+// ============================================================================
+// 由fiber::TimerWheel的循环定时器驱动，每次tick从状态机的TTL索引中弹出已过期
+// 的key（不扫描keyspace），按max_keys_per_entry分批提交。删除经Raft日志复制，
+// 所有副本在同一个index上删除同一批key。
+// 每次tick的删除量有上限，大量key同时过期时被摊到后续的tick中，
+// 不会产生长时间占用apply循环的大日志条目。
+// 每个节点都可以运行；非leader提交失败时把弹出的key放回索引，成为leader后继续。
+// 定时器回调只持有共享状态的weak_ptr，与cancel竞争的tick不会访问已析构的TtlExpirer；
+// Stop在条件变量上等待进行中的提交结束。
+class TtlExpirer {
+public:
+    using ProposeFunc = std::function<KvResult(const KvCommand& cmd)>;
+
+    TtlExpirer(KvStateMachinePtr sm, ProposeFunc propose, TtlExpirerOptions options = {});
+
+    // 停止定时器并等待进行中的tick完成
+    ~TtlExpirer();
+
+    TtlExpirer(const TtlExpirer&) = delete;
+    TtlExpirer& operator=(const TtlExpirer&) = delete;
+
+    void Start();
+    void Stop();
+
+    // 立即执行一次过期删除，返回已提交删除的key数
+    size_t RunOnce(uint64_t now_ms);
+
+    // 累计提交删除的key数
+    uint64_t ExpiredCount() const;
+
+private:
+    using TimerHandle = decltype(std::declval<fiber::TimerWheel&>().addTimer(
+        uint64_t{}, std::function<void()>{}, bool{}));
+
+    // 定时器回调和提交fiber共享的状态，生命周期可能长于TtlExpirer
+    struct State;
+    static void tick(const std::shared_ptr<State>& state);
+    static size_t runOnce(State& state, uint64_t now_ms);
+
+    std::shared_ptr<State> state_;
+    TimerHandle timer_{};
+};
+
+using TtlExpirerPtr = std::shared_ptr<TtlExpirer>;
+
+} // namespace kv
+
+#endif // KV_TTL_EXPIRER_H
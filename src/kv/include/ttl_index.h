@@ -0,0 +1,74 @@
+#ifndef KV_TTL_INDEX_H
+#define KV_TTL_INDEX_H
+
+#include "sync.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// 带TTL的key及其过期时间（Unix毫秒），随快照一起保存
+struct KvTtl {
+    std::string key;
+    uint64_t expire_at_ms = 0;
+};
+
+// 当前Unix时间（毫秒）。过期时间是绝对时间，由提交命令的节点计算后写入日志，
+// 各副本apply时不读取本地时钟
+uint64_t NowUnixMs();
+
+// ============================================================================
+// TtlIndex - 按过期时间排序的TTL索引
+// ============================================================================
+// key -> 过期时间的哈希表是权威数据；另有一组按过期时间排序的桶（每桶kBucketMs），
+// 设置TTL时把key追加到对应桶中，O(1)且不需要扫描keyspace。
+// TTL被修改或清除时不从旧桶中删除，弹出时与权威数据比对后跳过（惰性删除）。
+//
+// 索引属于状态机：由apply循环修改，各副本内容一致；读路径只在存在TTL时加锁。
+class TtlIndex {
+public:
+    // 桶的时间粒度，key最多比过期时间晚这么久被弹出
+    static constexpr uint64_t kBucketMs = 10;
+
+    // expire_at_ms为0时清除TTL
+    void Set(const std::string& key, uint64_t expire_at_ms);
+    void Remove(const std::string& key);
+
+    // key的过期时间，没有TTL时返回0
+    uint64_t Deadline(const std::string& key);
+
+    // key设置了TTL且在now_ms时已过期
+    bool Expired(const std::string& key, uint64_t now_ms);
+
+    // 弹出最多limit个在now_ms时已过期的key（附带弹出时的过期时间）。
+    // 弹出只是把key从桶中取走，不清除TTL：删除由Raft日志apply后完成。
+    // 提交失败时用Requeue放回，否则这些key不会再被弹出
+    std::vector<KvTtl> PopExpired(uint64_t now_ms, size_t limit);
+    void Requeue(const std::vector<KvTtl>& entries);
+
+    // 一次加锁清除过期时间仍与entries一致的TTL，返回每个条目是否被清除
+    std::vector<bool> RemoveMatching(const std::vector<KvTtl>& entries);
+
+    // 所有带TTL的key（用于快照）
+    std::vector<KvTtl> Entries();
+
+    void Clear();
+
+    size_t Size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+    static uint64_t bucketOf(uint64_t expire_at_ms);
+
+    fiber::FiberMutex mu_;
+    std::unordered_map<std::string, uint64_t> deadlines_;
+    std::map<uint64_t, std::vector<std::string>> buckets_;  // 桶的截止时间 -> key
+    std::atomic<size_t> size_{0};
+};
+
+} // namespace kv
+
+#endif // KV_TTL_INDEX_H
@@ -0,0 +1,129 @@
+#ifndef KV_TXN_H
+#define KV_TXN_H
+
+#include "kv_state_machine.h"
+#include "sync.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+struct TxnOptions {
+    uint64_t timeout_ms = 5000;     // 超过这么久没有完成的事务可以被遇到其intent的请求中止或提交
+    bool parallel_commit = true;    // 所有PREPARE成功后立即返回，提交记录和清理intent在后台完成
+    int max_retries = 3;            // 与其他事务冲突时换一个事务id重试的次数
+};
+
+struct TxnResult {
+    KvStatus status = KvStatus::OK;
+    std::string key;        // CONDITION_FAILED / TXN_CONFLICT时为出错的key；WRONG_LEADER时为leader地址
+    uint64_t txn_id = 0;
+};
+
+// ============================================================================
+// TxnCoordinator - 跨分片的原子写
+// ============================================================================
+// WriteBatch只在一个Raft组内原子。跨组的事务按两阶段提交执行，锁和事务记录都
+// 经Raft复制，协调者本身不保存状态，崩溃后由其他请求完成恢复：
+//
+// 1. PREPARE：按组拆分写入和条件，各组并行提交一条TXN_PREPARE，在apply时检查
+//    条件并在每个key上写入intent（待提交的写入，同时是锁）。第一个key是anchor，
+//    发往anchor所在组的PREPARE同时写入STAGING状态的事务记录，记下全部key。
+// 2. 提交：所有组的PREPARE都成功时事务即已提交（STAGING记录 + 全部intent），
+//    parallel_commit时到此就返回客户端，省去一轮复制的延迟；随后把事务记录改为
+//    COMMITTED（TXN_END），各组把intent转为数据（TXN_RESOLVE），anchor所在组最后
+//    清理并删除事务记录。任一组失败时把记录置为ABORTED并丢弃已写入的intent。
+//
+// 遇到intent的请求：写请求和PREPARE返回TXN_CONFLICT，读请求（Get / MultiGet）
+// 等待intent消失以读到刚提交的数据。超过start_ms + timeout_ms后等待方执行恢复：
+// 查询事务记录，STAGING时对全部key提交TXN_FENCE——intent都在则事务已提交，
+// 缺少的key上留下隔离标记，之后到达的PREPARE被拒绝，事务被中止——再按结论
+// 清理intent。Scan不等待intent，只读已提交的数据。
+//
+// 协调者只能访问本节点负责的组（GroupFunc），涉及其他节点分片的key返回WRONG_SHARD。
+//
+// 去重：带RequestId的事务把它写入事务记录，记录被置为COMMITTED时（不论由协调者还是
+// 恢复流程）anchor所在组把请求记入会话表。客户端重试时anchor的PREPARE被识别为重复，
+// 协调者丢弃本次在其他组写入的intent并返回成功；原事务还没有结论时，重试的PREPARE
+// 与它的intent冲突，等它结束后再判断。中止的事务不记入会话表，重试会重新执行。
+class TxnCoordinator {
+public:
+    // key所在的本地组，0表示不在本节点
+    using GroupFunc = std::function<uint64_t(const std::string& key)>;
+    // 把命令提交到key所在的组；命令中的key不都属于该组时返回WRONG_SHARD
+    using ProposeFunc = std::function<KvResult(const std::string& key, const KvCommand& cmd)>;
+    // key所在组的本地状态机，不在本节点时返回nullptr
+    using StateMachineFunc = std::function<KvStateMachinePtr(const std::string& key)>;
+
+    TxnCoordinator(GroupFunc group, ProposeFunc propose, StateMachineFunc sm, TxnOptions options = {});
+
+    // 等待后台的提交完成
+    ~TxnCoordinator();
+
+    TxnCoordinator(const TxnCoordinator&) = delete;
+    TxnCoordinator& operator=(const TxnCoordinator&) = delete;
+
+    // 原子地执行writes（PUT / APPEND / DELETE，key互不相同），compares全部成立时才生效。
+    // 条件不成立时返回CONDITION_FAILED，key为第一个不成立的条件。
+    // request非空时同一个请求的事务最多提交一次
+    TxnResult Execute(const std::vector<KvMutation>& writes, const std::vector<KvCompare>& compares = {},
+                      const RequestId& request = {});
+
+    // 等待key上的intent消失（由状态机在清理intent时唤醒），事务超时后执行恢复。
+    // for_read时忽略只用于检查条件的intent。
+    // 返回false表示无法得出事务的结论（涉及不在本节点的组，或提交失败）
+    bool ResolveIntent(const std::string& key, bool for_read = false);
+
+    // 等待所有后台提交完成
+    void Drain();
+
+private:
+    // 一个组中的写入和条件，route为用于路由的key
+    struct Part {
+        std::string route;
+        std::vector<KvMutation> ops;
+        std::vector<KvCompare> compares;
+    };
+
+    TxnResult attemptOnce(const std::vector<KvMutation>& writes, const std::vector<KvCompare>& compares,
+                          const RequestId& request);
+
+    using MakeFunc = std::function<KvCommand(const std::vector<std::string>& keys)>;
+    using DoneFunc = std::function<void(const std::vector<std::string>& keys, const KvResult& result)>;
+
+    // 把keys按组分开，对每组提交make生成的命令并把结果交给done；组在提交前被分裂或
+    // 合并时重新分组。返回false表示有key不在本节点，或某组提交失败
+    bool proposeGrouped(const std::vector<std::string>& keys, const MakeFunc& make, const DoneFunc& done = nullptr);
+
+    // 所有PREPARE成功之后：提交事务记录并清理intent
+    void finish(const TxnMeta& meta, const std::vector<std::string>& keys);
+    // 有PREPARE失败：中止事务，result为返回给调用方的结果；
+    // has_record为false表示anchor所在组没有写入事务记录（明确拒绝了PREPARE，或识别为重复的请求），
+    // 不需要把事务记录置为ABORTED
+    void abort(const TxnMeta& meta, const std::vector<std::string>& keys, bool has_record, TxnResult& result);
+
+    // 把事务记录改为state（PENDING为查询），record为返回的事务记录
+    KvStatus endTxn(const TxnMeta& meta, TxnState state, TxnRecord& record);
+    // 按结论清理keys上的intent，anchor所在组最后清理
+    bool resolveKeys(const TxnMeta& meta, TxnState state, const std::vector<std::string>& keys);
+    // 确定超时事务的结论并清理
+    bool recover(const std::string& key, const TxnIntent& intent);
+
+    GroupFunc group_;
+    ProposeFunc propose_;
+    StateMachineFunc sm_;
+    TxnOptions options_;
+
+    fiber::FiberMutex mu_;
+    fiber::FiberCondition cond_;
+    size_t finishing_ = 0;      // 后台进行中的提交
+};
+
+using TxnCoordinatorPtr = std::shared_ptr<TxnCoordinator>;
+
+} // namespace kv
+
+#endif // KV_TXN_H
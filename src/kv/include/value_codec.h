@@ -0,0 +1,56 @@
+#ifndef KV_VALUE_CODEC_H
+#define KV_VALUE_CODEC_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// ============================================================================
+// 带预置字典的LZ77压缩
+// ============================================================================
+// 值大多是结构相似的短文本（JSON一类），单条压缩几乎没有可复用的历史。
+// 把样本中反复出现的片段训练成字典，压缩时字典相当于输入之前的一段历史，
+// 匹配可以直接引用字典，短值也能得到可观的压缩率。
+//
+// 压缩格式：[varint 原始长度] 之后是若干序列，每个序列为
+//   [varint 字面量长度][字面量][varint 匹配长度-4][varint 距离]
+// 最后一个序列只有字面量。距离从当前输出位置往回数，超过已输出长度的部分
+// 落在字典末尾。解压时必须使用压缩时的同一个字典。
+class CompressionDict {
+public:
+    // 字典内容不超过64KB，距离可以用较短的varint表示
+    static constexpr size_t kMaxSize = 64 << 10;
+
+    explicit CompressionDict(std::string content);
+
+    CompressionDict(const CompressionDict&) = delete;
+    CompressionDict& operator=(const CompressionDict&) = delete;
+
+    const std::string& Content() const { return content_; }
+    size_t Size() const { return content_.size(); }
+
+private:
+    friend std::string Compress(std::string_view, const CompressionDict*);
+
+    std::string content_;
+    std::vector<uint32_t> table_;   // 4字节前缀哈希 -> 字典中最后出现的位置+1
+};
+
+using CompressionDictPtr = std::shared_ptr<const CompressionDict>;
+
+// 从样本中挑选出现在最多样本里的片段组成字典，样本不足时返回nullptr
+CompressionDictPtr TrainDictionary(const std::vector<std::string>& samples, size_t dict_size);
+
+// dict为空时不使用字典
+std::string Compress(std::string_view input, const CompressionDict* dict = nullptr);
+
+// 数据损坏（或字典不符导致越界）时返回false
+bool Decompress(std::string_view input, const CompressionDict* dict, std::string& out);
+
+} // namespace kv
+
+#endif // KV_VALUE_CODEC_H
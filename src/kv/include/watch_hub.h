@@ -0,0 +1,129 @@
+#ifndef KV_WATCH_HUB_H
+#define KV_WATCH_HUB_H
+
+#include "kv_command.h"
+#include "channel.h"
+#include "sync.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace kv {
+
+// 历史环默认关闭：每次写入都要把完整的值复制进环中。开启后断线重连可以从环中任意
+// revision恢复，环按事件的key和值的总字节数限制大小
+struct WatchOptions {
+    size_t history_bytes = 0;       // 历史环保留的事件字节数上限，0表示不保留历史
+    size_t channel_capacity = 256;  // 每个订阅者未取走的事件批次上限，超出后转为从历史环追赶
+};
+
+class WatchHub;
+
+// ============================================================================
+// Watcher - 一个key或前缀上的订阅
+// ============================================================================
+// 由WatchHub::Subscribe创建，析构时自动取消订阅。只允许一个fiber调用Next。
+class Watcher {
+public:
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // 取出下一批事件（按revision递增），没有事件时最多等待timeout_ms，超时返回OK且events为空。
+    // 返回COMPACTED表示需要的历史已被覆盖（或订阅已取消），应重新读取后从新的revision订阅
+    KvStatus Next(std::vector<WatchEvent>& events, uint64_t timeout_ms);
+
+    // 下一个尚未交付的revision，断线重连时从这里恢复
+    uint64_t NextRevision() const { return next_revision_; }
+
+    void Cancel();
+
+private:
+    friend class WatchHub;
+
+    Watcher(std::weak_ptr<WatchHub> hub, std::string key, bool prefix, uint64_t start_revision, size_t capacity);
+
+    bool matches(const std::string& key) const;
+
+    std::weak_ptr<WatchHub> hub_;
+    const std::string key_;
+    const bool prefix_;
+    const size_t capacity_;
+    fiber::Channel<std::vector<WatchEvent>>::ptr chan_;
+    uint64_t next_revision_;                // 仅由Next所在的fiber访问
+
+    // 以下字段由WatchHub在其锁内修改
+    std::vector<WatchEvent> backlog_;       // 订阅/追赶时从历史环回放的事件
+    std::vector<WatchEvent> staging_;       // Publish时收集本批事件
+    std::atomic<size_t> pending_{0};        // 已发送未取走的批次数
+    std::atomic<bool> lagged_{false};       // channel满后暂停投递，等待从历史环追赶
+    std::atomic<bool> compacted_{false};
+    bool registered_ = false;
+};
+
+using WatcherPtr = std::shared_ptr<Watcher>;
+
+// ============================================================================
+// WatchHub - 变更事件的分发中心
+// ============================================================================
+// apply循环在每条产生变更的日志之后调用Publish：事件追加到有界的历史环，
+// 并按key（精确订阅走哈希表，前缀订阅逐个匹配）分发给订阅者，每个订阅者每条日志
+// 最多收到一个批次。投递通过fiber::Channel完成，pending_保证发送永远不会阻塞apply：
+// 订阅者消费过慢、channel已满时不再投递，由订阅者取完channel后从历史环追赶。
+//
+// 没有订阅者且不保留历史时，apply路径通过Collect跳过事件收集（不复制值，APPEND不回读）；
+// 被跳过的revision记为已压缩，之后的订阅不能从这些revision开始。
+class WatchHub : public std::enable_shared_from_this<WatchHub> {
+public:
+    explicit WatchHub(WatchOptions options = {});
+
+    // 订阅key（prefix为true时订阅以key为前缀的所有key）上revision >= start_revision的变更，
+    // start_revision为0表示只订阅之后的变更。需要的历史已被覆盖时返回nullptr
+    WatcherPtr Subscribe(const std::string& key, bool prefix, uint64_t start_revision);
+
+    // 发布index上的变更（由apply循环调用，events非空）
+    void Publish(uint64_t revision, std::vector<WatchEvent> events);
+
+    // 状态机整体被替换（快照恢复）：清空历史，所有订阅者收到COMPACTED
+    void Reset(uint64_t revision);
+
+    // 历史环中最早可恢复的revision
+    uint64_t OldestRevision();
+
+    size_t WatcherCount() const { return watcher_count_.load(std::memory_order_acquire); }
+
+    // apply路径在执行revision之前调用：返回是否需要收集它的事件（保留历史或者有订阅者）。
+    // 返回false时revision被记为跳过；与Subscribe登记订阅者构成握手，
+    // 两者同时发生时要么收集事件，要么新的订阅从该revision之后开始
+    bool Collect(uint64_t revision);
+
+private:
+    friend class Watcher;
+
+    // 把watcher需要的历史事件回放到backlog_，历史已被覆盖时返回false（调用方持有mu_）
+    bool replayLocked(Watcher* watcher, uint64_t start_revision);
+    bool resync(Watcher* watcher, uint64_t start_revision);
+    void unsubscribe(Watcher* watcher);
+
+    WatchOptions options_;
+    fiber::FiberMutex mu_;
+    std::deque<WatchEvent> history_;
+    size_t history_used_ = 0;           // history_中事件的字节数
+    uint64_t compacted_revision_ = 0;   // <= 该revision的事件已不完整
+    uint64_t last_revision_ = 0;        // 最近发布的revision
+    std::unordered_map<std::string, std::vector<Watcher*>> key_watchers_;
+    std::vector<Watcher*> prefix_watchers_;
+    std::atomic<size_t> watcher_count_{0};
+    std::atomic<uint64_t> skipped_revision_{0};     // 最近一个没有收集事件的revision
+};
+
+using WatchHubPtr = std::shared_ptr<WatchHub>;
+
+} // namespace kv
+
+#endif // KV_WATCH_HUB_H
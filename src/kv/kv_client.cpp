@@ -0,0 +1,425 @@
+#include "include/kv_client.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+#include <mutex>
+#include <random>
+
+namespace kv {
+
+KvClient::KvClient(KvClientOptions options) : options_(std::move(options)), shards_(options_.endpoints) {}
+
+KvClient::~KvClient() {
+    std::unordered_map<std::string, rpc::RpcClientPtr> connections;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        connections.swap(connections_);
+    }
+    for (auto& [endpoint, client] : connections) {
+        client->disconnect();
+    }
+}
+
+// ============================================================================
+// 路由、连接与leader缓存
+// ============================================================================
+
+bool KvClient::resolve(const std::string& key, Route& route) {
+    if (!options_.sharded) {
+        route.group = 0;
+        route.endpoints = options_.endpoints;
+        return !route.endpoints.empty();
+    }
+    auto shard = shards_.Locate(key);
+    if (!shard) {
+        shards_.Refresh();
+        shard = shards_.Locate(key);
+        if (!shard) {
+            return false;
+        }
+    }
+    route.group = shard->id;
+    route.endpoints = shard->endpoints.empty() ? options_.endpoints : std::move(shard->endpoints);
+    return !route.endpoints.empty();
+}
+
+rpc::RpcClientPtr KvClient::connection(const std::string& endpoint) {
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        auto it = connections_.find(endpoint);
+        if (it != connections_.end()) {
+            return it->second;
+        }
+    }
+    std::string host;
+    uint16_t port = 0;
+    if (!ParseEndpoint(endpoint, host, port)) {
+        LOG_WARN("KvClient: invalid endpoint {}", endpoint);
+        return nullptr;
+    }
+    // 建立连接时不持有锁，并发建立的多余连接在插入时关闭
+    auto client = rpc::RpcClient::Make();
+    if (!client->connect(host, port)) {
+        return nullptr;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto [it, inserted] = connections_.emplace(endpoint, client);
+    if (!inserted) {
+        client->disconnect();
+    }
+    return it->second;
+}
+
+void KvClient::dropConnection(const std::string& endpoint) {
+    rpc::RpcClientPtr client;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        auto it = connections_.find(endpoint);
+        if (it == connections_.end()) {
+            return;
+        }
+        client = std::move(it->second);
+        connections_.erase(it);
+    }
+    client->disconnect();
+}
+
+std::string KvClient::CachedLeader(uint64_t group) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = leaders_.find(group);
+    return it == leaders_.end() ? std::string() : it->second;
+}
+
+void KvClient::setLeader(uint64_t group, const std::string& endpoint) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    leaders_[group] = endpoint;
+}
+
+void KvClient::forgetLeader(uint64_t group, const std::string& endpoint) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = leaders_.find(group);
+    if (it != leaders_.end() && it->second == endpoint) {
+        leaders_.erase(it);
+    }
+}
+
+void KvClient::backoff(int failures) {
+    static thread_local std::mt19937_64 gen(std::random_device{}());
+    uint64_t ms = options_.backoff_min_ms << std::min(failures - 1, 20);
+    ms = std::min(ms, options_.backoff_max_ms);
+    // 抖动：[ms/2, ms]，避免大量客户端在故障切换后同时重试
+    ms = ms / 2 + gen() % (ms / 2 + 1);
+    retries_.fetch_add(1, std::memory_order_relaxed);
+    if (ms > 0) {
+        fiber::Fiber::sleep(ms);
+    }
+}
+
+ClientSession KvClient::acquireSession() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    if (sessions_.empty()) {
+        return ClientSession();
+    }
+    ClientSession session = sessions_.back();
+    sessions_.pop_back();
+    return session;
+}
+
+void KvClient::releaseSession(ClientSession session) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    sessions_.push_back(session);
+}
+
+template <typename Args, typename Reply>
+KvStatus KvClient::invoke(const std::string& key, const char* method, const Args& args, Reply& reply) {
+    int failures = 0;
+    int redirects = 0;
+    bool refreshed = false;
+    Route route;
+    while (failures < options_.max_attempts) {
+        if (!resolve(key, route)) {
+            backoff(++failures);
+            continue;
+        }
+        std::string target = CachedLeader(route.group);
+        if (target.empty()) {
+            target = route.endpoints[next_endpoint_.fetch_add(1, std::memory_order_relaxed) % route.endpoints.size()];
+        }
+
+        std::optional<std::string> error = "connect failed";
+        if (auto client = connection(target)) {
+            rpcs_.fetch_add(1, std::memory_order_relaxed);
+            error = client->call(method, args, reply, options_.rpc_timeout_ms);
+        }
+        if (error.has_value()) {
+            LOG_DEBUG("KvClient: {} to {} failed: {}", method, target, *error);
+            dropConnection(target);
+            forgetLeader(route.group, target);
+            backoff(++failures);
+            continue;
+        }
+
+        if (reply.status == KvStatus::WRONG_LEADER) {
+            redirects_.fetch_add(1, std::memory_order_relaxed);
+            forgetLeader(route.group, target);
+            std::string hint;
+            if constexpr (requires { reply.leader; }) {
+                hint = reply.leader;
+            }
+            // 按提示改发不退避，也不计入失败；提示成环时由redirects兜底
+            if (!hint.empty() && hint != target && ++redirects <= options_.max_attempts) {
+                setLeader(route.group, hint);
+                continue;
+            }
+            backoff(++failures);
+            continue;
+        }
+        if (reply.status == KvStatus::WRONG_SHARD && options_.sharded) {
+            // 第一次立即刷新重试，之后分片可能正在迁移，退避等待
+            shards_.Refresh();
+            if (refreshed) {
+                backoff(++failures);
+            } else {
+                ++failures;
+            }
+            refreshed = true;
+            continue;
+        }
+
+        setLeader(route.group, target);
+        return reply.status;
+    }
+    return KvStatus::UNAVAILABLE;
+}
+
+// ============================================================================
+// 合并发送
+// ============================================================================
+
+bool KvClient::batched(KvOp op, const std::string& key, const std::string& value, KvResult& result) {
+    if (options_.max_batch == 0) {
+        return false;
+    }
+    Route route;
+    if (!resolve(key, route)) {
+        return false;
+    }
+    // 目标未知时先走单个请求，由它找到leader
+    std::string endpoint = CachedLeader(route.group);
+    if (endpoint.empty()) {
+        return false;
+    }
+
+    auto pending = std::make_shared<PendingOp>();
+    pending->op = op;
+    pending->key = key;
+    pending->value = value;
+    std::shared_ptr<Batcher> batcher;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        // 一批只含同一个组的key：MultiPut的重发按第一个key路由
+        auto& slot = batchers_[endpoint + "#" + std::to_string(route.group) + (op == KvOp::GET ? "#get" : "#put")];
+        if (!slot) {
+            slot = std::make_shared<Batcher>();
+        }
+        batcher = slot;
+    }
+
+    bool flusher = false;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(batcher->mu);
+        batcher->queue.push_back(pending);
+        if (!batcher->flushing) {
+            batcher->flushing = true;
+            flusher = true;
+        }
+    }
+    // 没有在途的批次时由自己发送，并把发送期间排队的请求一起发完
+    if (flusher) {
+        flush(endpoint, op, *batcher);
+    }
+    pending->done->recv(result);
+    if (pending->fallback) {
+        return false;
+    }
+    batched_ops_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void KvClient::flush(const std::string& endpoint, KvOp op, Batcher& batcher) {
+    while (true) {
+        std::vector<PendingOpPtr> ops;
+        {
+            std::unique_lock<fiber::FiberMutex> lock(batcher.mu);
+            if (batcher.queue.empty()) {
+                batcher.flushing = false;
+                return;
+            }
+            size_t count = std::min(batcher.queue.size(), options_.max_batch);
+            ops.assign(batcher.queue.begin(), batcher.queue.begin() + count);
+            batcher.queue.erase(batcher.queue.begin(), batcher.queue.begin() + count);
+        }
+        sendBatch(endpoint, op, ops);
+    }
+}
+
+void KvClient::sendBatch(const std::string& endpoint, KvOp op, std::vector<PendingOpPtr>& ops) {
+    std::vector<KvResult> results(ops.size());
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    if (op != KvOp::GET) {
+        // 整批作为一次MultiPut，按到达顺序生效。失败时用同一个RequestId重发同一批，由服务端会话去重，
+        // 直到得到确定的结果；不能退回逐个PUT：已经生效的批次会以新的RequestId再执行一次
+        MultiPutArgs args;
+        args.pairs.reserve(ops.size());
+        for (const auto& pending : ops) {
+            args.pairs.push_back(KvPair{pending->key, pending->value});
+        }
+        auto session = acquireSession();
+        args.request = session.Next();
+        MultiPutReply reply;
+        auto status = invoke(ops.front()->key, kMethodMultiPut, args, reply);
+        releaseSession(session);
+        for (size_t i = 0; i < ops.size(); ++i) {
+            results[i].status = status;
+            ops[i]->done->send(std::move(results[i]));
+        }
+        return;
+    }
+
+    // MultiGet没有副作用，失败时退回逐个发送的路径
+    bool ok = false;
+    if (auto client = connection(endpoint)) {
+        rpcs_.fetch_add(1, std::memory_order_relaxed);
+        MultiGetArgs args;
+        args.keys.reserve(ops.size());
+        for (const auto& pending : ops) {
+            args.keys.push_back(pending->key);
+        }
+        MultiGetReply reply;
+        auto error = client->call(kMethodMultiGet, args, reply, options_.rpc_timeout_ms);
+        if (error.has_value()) {
+            dropConnection(endpoint);
+        } else if (reply.status == KvStatus::OK && reply.results.size() == ops.size()) {
+            for (size_t i = 0; i < ops.size(); ++i) {
+                // 分片已迁走的key逐个重试
+                ops[i]->fallback = reply.results[i].status == KvStatus::WRONG_SHARD;
+                results[i].status = reply.results[i].status;
+                results[i].value = std::move(reply.results[i].value);
+            }
+            ok = true;
+        }
+    }
+    for (size_t i = 0; i < ops.size(); ++i) {
+        if (!ok) {
+            ops[i]->fallback = true;
+        }
+        ops[i]->done->send(std::move(results[i]));
+    }
+}
+
+// ============================================================================
+// 公共接口
+// ============================================================================
+
+KvResult KvClient::Get(const std::string& key) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    KvResult result;
+    if (batched(KvOp::GET, key, std::string(), result)) {
+        return result;
+    }
+    GetReply reply;
+    result.status = invoke(key, kMethodGet, GetArgs{key}, reply);
+    result.value = std::move(reply.value);
+    return result;
+}
+
+KvStatus KvClient::Put(const std::string& key, const std::string& value, uint64_t ttl_ms) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    KvResult result;
+    if (ttl_ms == 0 && batched(KvOp::PUT, key, value, result)) {
+        return result.status;
+    }
+    auto session = acquireSession();
+    PutAppendReply reply;
+    auto status = invoke(key, kMethodPutAppend, PutAppendArgs{KvOp::PUT, key, value, ttl_ms, session.Next()}, reply);
+    releaseSession(session);
+    return status;
+}
+
+KvStatus KvClient::Append(const std::string& key, const std::string& value) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto session = acquireSession();
+    PutAppendReply reply;
+    auto status = invoke(key, kMethodPutAppend, PutAppendArgs{KvOp::APPEND, key, value, 0, session.Next()}, reply);
+    releaseSession(session);
+    return status;
+}
+
+KvStatus KvClient::Delete(const std::string& key) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto session = acquireSession();
+    DeleteReply reply;
+    auto status = invoke(key, kMethodDelete, DeleteArgs{key, session.Next()}, reply);
+    releaseSession(session);
+    return status;
+}
+
+KvResult KvClient::CompareAndSwap(const std::string& key, const std::string& expected, const std::string& value) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto session = acquireSession();
+    CompareAndSwapReply reply;
+    KvResult result;
+    result.status = invoke(key, kMethodCompareAndSwap, CompareAndSwapArgs{key, expected, value, session.Next()}, reply);
+    result.value = std::move(reply.current);
+    releaseSession(session);
+    return result;
+}
+
+KvResult KvClient::PutIfAbsent(const std::string& key, const std::string& value) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto session = acquireSession();
+    PutIfAbsentReply reply;
+    KvResult result;
+    result.status = invoke(key, kMethodPutIfAbsent, PutIfAbsentArgs{key, value, session.Next()}, reply);
+    result.value = std::move(reply.current);
+    releaseSession(session);
+    return result;
+}
+
+KvStatus KvClient::Increment(const std::string& key, int64_t delta, int64_t& value) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto session = acquireSession();
+    IncrementReply reply;
+    auto status = invoke(key, kMethodIncrement, IncrementArgs{key, delta, session.Next()}, reply);
+    releaseSession(session);
+    if (status == KvStatus::OK) {
+        value = reply.value;
+    }
+    return status;
+}
+
+TxnReply KvClient::Txn(const std::vector<KvMutation>& writes, const std::vector<KvCompare>& compares) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    TxnReply reply;
+    if (writes.empty()) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return reply;
+    }
+    auto session = acquireSession();
+    reply.status = invoke(writes.front().key, kMethodTxn, TxnArgs{writes, compares, session.Next()}, reply);
+    releaseSession(session);
+    return reply;
+}
+
+KvClientStats KvClient::Stats() const {
+    KvClientStats stats;
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.rpcs = rpcs_.load(std::memory_order_relaxed);
+    stats.redirects = redirects_.load(std::memory_order_relaxed);
+    stats.retries = retries_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.batched_ops = batched_ops_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace kv
@@ -0,0 +1,654 @@
+#include "include/kv_service.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kv {
+
+namespace {
+
+// 写请求的状态；WRONG_LEADER时KvResult::value是leader地址，放进响应作为重定向提示
+template <typename Reply>
+void setStatus(const KvResult& result, Reply& reply) {
+    reply.status = result.status;
+    if (result.status == KvStatus::WRONG_LEADER) {
+        reply.leader = result.value;
+    }
+}
+
+int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 按块读取文件并用KV.IngestPush写到对端的暂存目录
+bool pushIngestFile(rpc::RpcClient& client, const std::string& path, const IngestFile& file) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("KvService: cannot open {}: {}", path, strerror(errno));
+        return false;
+    }
+    IngestPushArgs args;
+    args.file = file;
+    std::string buffer(kIngestChunkBytes, '\0');
+    bool ok = true;
+    while (ok && !args.last) {
+        ssize_t n = ::pread(fd, buffer.data(), buffer.size(), args.offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = false;     // 读错误，或文件比声明的短
+            break;
+        }
+        args.data.assign(buffer.data(), n);
+        args.last = args.offset + n >= file.size;
+        IngestPushReply reply;
+        auto error = client.call(kMethodIngestPush, args, reply);
+        ok = !error.has_value() && reply.status == KvStatus::OK;
+        args.offset += n;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// 被事务的intent挡住的写命令最多重试的次数
+constexpr int kMaxConflictRetries = 8;
+
+} // namespace
+
+KvService::KvService(KvStateMachinePtr sm, ProposeFunc propose, IngestShipFunc ship, BackupOptions backup) :
+    sm_(std::move(sm)), propose_(std::move(propose)), ship_(std::move(ship)), backup_options_(backup),
+    export_limiter_(backup.bytes_per_sec) {
+    txn_ = std::make_shared<TxnCoordinator>(
+        [](const std::string&) { return uint64_t{1}; },
+        [this](const std::string&, const KvCommand& cmd) { return Propose(cmd); },
+        [this](const std::string&) { return sm_; });
+}
+
+void KvService::RegisterRPC(rpc::RpcServerPtr rpc_server) {
+    rpc_server->registerHandler(kMethodGet, [this](const GetArgs& args, GetReply& reply) {
+        return this->Get(args, reply);
+    });
+    rpc_server->registerHandler(kMethodPutAppend, [this](const PutAppendArgs& args, PutAppendReply& reply) {
+        return this->PutAppend(args, reply);
+    });
+    rpc_server->registerHandler(kMethodDelete, [this](const DeleteArgs& args, DeleteReply& reply) {
+        return this->Delete(args, reply);
+    });
+    rpc_server->registerHandler(kMethodScan, [this](const ScanArgs& args, ScanReply& reply) {
+        return this->Scan(args, reply);
+    });
+    rpc_server->registerHandler(kMethodScanPrefix, [this](const ScanPrefixArgs& args, ScanReply& reply) {
+        return this->ScanPrefix(args, reply);
+    });
+    rpc_server->registerHandler(kMethodMultiGet, [this](const MultiGetArgs& args, MultiGetReply& reply) {
+        return this->MultiGet(args, reply);
+    });
+    rpc_server->registerHandler(kMethodMultiPut, [this](const MultiPutArgs& args, MultiPutReply& reply) {
+        return this->MultiPut(args, reply);
+    });
+    rpc_server->registerHandler(kMethodWriteBatch, [this](const WriteBatchArgs& args, WriteBatchReply& reply) {
+        return this->WriteBatch(args, reply);
+    });
+    rpc_server->registerHandler(kMethodCompareAndSwap,
+                                [this](const CompareAndSwapArgs& args, CompareAndSwapReply& reply) {
+                                    return this->CompareAndSwap(args, reply);
+                                });
+    rpc_server->registerHandler(kMethodPutIfAbsent, [this](const PutIfAbsentArgs& args, PutIfAbsentReply& reply) {
+        return this->PutIfAbsent(args, reply);
+    });
+    rpc_server->registerHandler(kMethodIncrement, [this](const IncrementArgs& args, IncrementReply& reply) {
+        return this->Increment(args, reply);
+    });
+    rpc_server->registerHandler(kMethodWatch, [this](const WatchArgs& args, WatchReply& reply) {
+        return this->Watch(args, reply);
+    });
+    rpc_server->registerHandler(kMethodIngestWrite, [this](const IngestWriteArgs& args, IngestWriteReply& reply) {
+        return this->IngestWrite(args, reply);
+    });
+    rpc_server->registerHandler(kMethodIngestCommit, [this](const IngestCommitArgs& args, IngestCommitReply& reply) {
+        return this->IngestCommit(args, reply);
+    });
+    rpc_server->registerHandler(kMethodIngestAbort, [this](const IngestAbortArgs& args, IngestAbortReply& reply) {
+        return this->IngestAbort(args, reply);
+    });
+    rpc_server->registerHandler(kMethodIngestPush, [this](const IngestPushArgs& args, IngestPushReply& reply) {
+        return this->IngestPush(args, reply);
+    });
+    rpc_server->registerHandler(kMethodExport, [this](const ExportArgs& args, ExportReply& reply) {
+        return this->Export(args, reply);
+    });
+    rpc_server->registerHandler(kMethodExportRead, [this](const ExportReadArgs& args, ExportReadReply& reply) {
+        return this->ExportRead(args, reply);
+    });
+    rpc_server->registerHandler(kMethodTxn, [this](const TxnArgs& args, TxnReply& reply) {
+        return this->Txn(args, reply);
+    });
+    LOG_INFO("KvService: registered KV RPC methods");
+}
+
+KvResult KvService::Propose(const KvCommand& cmd) {
+    auto propose = [this, &cmd]() {
+        if (propose_) {
+            return propose_(cmd);
+        }
+        std::unique_lock<fiber::FiberMutex> lock(local_mu_);
+        return sm_->Apply(sm_->LastApplied() + 1, cmd);
+    };
+    auto result = propose();
+    // 事务命令的冲突由TxnCoordinator自己处理
+    bool txn = cmd.op == KvOp::TXN_PREPARE || cmd.op == KvOp::TXN_FENCE || cmd.op == KvOp::TXN_END ||
+               cmd.op == KvOp::TXN_RESOLVE;
+    for (int retry = 0; !txn && resolve_conflicts_ && result.status == KvStatus::TXN_CONFLICT && retry < kMaxConflictRetries; ++retry) {
+        if (!txn_->ResolveIntent(result.value)) {
+            break;
+        }
+        result = propose();
+    }
+    return result;
+}
+
+std::optional<std::string> KvService::Get(const GetArgs& args, GetReply& reply) {
+    if (sm_->IntentCount() > 0) {
+        txn_->ResolveIntent(args.key, true);
+    }
+    auto result = sm_->Get(args.key);
+    reply.status = result.status;
+    reply.value = std::move(result.value);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::PutAppend(const PutAppendArgs& args, PutAppendReply& reply) {
+    if (args.op != KvOp::PUT && args.op != KvOp::APPEND) {
+        return "PutAppend: unsupported op " + std::to_string(static_cast<int>(args.op));
+    }
+    KvCommand cmd;
+    cmd.op = args.op;
+    cmd.request = args.request;
+    cmd.key = args.key;
+    cmd.value = args.value;
+    if (args.op == KvOp::PUT && args.ttl_ms > 0) {
+        // 过期时间在提交前确定，写入日志后各副本使用同一个绝对时间
+        cmd.expire_at_ms = NowUnixMs() + args.ttl_ms;
+    }
+    setStatus(Propose(cmd), reply);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::Delete(const DeleteArgs& args, DeleteReply& reply) {
+    KvCommand cmd;
+    cmd.op = KvOp::DELETE;
+    cmd.request = args.request;
+    cmd.key = args.key;
+    setStatus(Propose(cmd), reply);
+    return std::nullopt;
+}
+
+void KvService::scanPage(const std::string& start, const std::string& end, uint64_t limit, ScanReply& reply) {
+    if (limit == 0 || limit > kMaxScanPageSize) {
+        limit = kMaxScanPageSize;
+    }
+    reply.pairs = sm_->Scan(start, end, limit + 1);
+    reply.has_more = reply.pairs.size() > limit;
+    if (reply.has_more) {
+        reply.next_start = std::move(reply.pairs.back().key);
+        reply.pairs.pop_back();
+    }
+    reply.status = KvStatus::OK;
+}
+
+std::optional<std::string> KvService::Scan(const ScanArgs& args, ScanReply& reply) {
+    if (!args.end.empty() && args.end <= args.start) {
+        reply.status = KvStatus::OK;
+        return std::nullopt;
+    }
+    scanPage(args.start, args.end, args.limit, reply);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::ScanPrefix(const ScanPrefixArgs& args, ScanReply& reply) {
+    const std::string& start = args.cursor > args.prefix ? args.cursor : args.prefix;
+    scanPage(start, PrefixEnd(args.prefix), args.limit, reply);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::MultiGet(const MultiGetArgs& args, MultiGetReply& reply) {
+    if (args.keys.size() > kMaxBatchSize) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    if (sm_->IntentCount() > 0) {
+        for (const auto& key : args.keys) {
+            txn_->ResolveIntent(key, true);
+        }
+    }
+    auto results = sm_->MultiGet(args.keys);
+    reply.results.resize(results.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        reply.results[i].status = results[i].status;
+        reply.results[i].value = std::move(results[i].value);
+    }
+    reply.status = KvStatus::OK;
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::MultiPut(const MultiPutArgs& args, MultiPutReply& reply) {
+    if (args.pairs.size() > kMaxBatchSize) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    if (args.pairs.empty()) {
+        reply.status = KvStatus::OK;
+        return std::nullopt;
+    }
+    KvCommand cmd;
+    cmd.op = KvOp::BATCH;
+    cmd.request = args.request;
+    cmd.ops.reserve(args.pairs.size());
+    uint64_t expire_at_ms = args.ttl_ms > 0 ? NowUnixMs() + args.ttl_ms : 0;
+    for (const auto& pair : args.pairs) {
+        cmd.ops.push_back(KvMutation{KvOp::PUT, pair.key, pair.value, expire_at_ms});
+    }
+    setStatus(Propose(cmd), reply);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::WriteBatch(const WriteBatchArgs& args, WriteBatchReply& reply) {
+    if (args.ops.size() > kMaxBatchSize) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    if (args.ops.empty()) {
+        reply.status = KvStatus::OK;
+        return std::nullopt;
+    }
+    KvCommand cmd;
+    cmd.op = KvOp::BATCH;
+    cmd.request = args.request;
+    cmd.ops = args.ops;
+    auto result = Propose(cmd);
+    setStatus(result, reply);
+    reply.statuses = std::move(result.statuses);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::CompareAndSwap(const CompareAndSwapArgs& args, CompareAndSwapReply& reply) {
+    KvCommand cmd;
+    cmd.op = KvOp::CAS;
+    cmd.request = args.request;
+    cmd.key = args.key;
+    cmd.value = args.value;
+    cmd.expected = args.expected;
+    auto result = Propose(cmd);
+    setStatus(result, reply);
+    if (result.status != KvStatus::WRONG_LEADER) {
+        reply.current = std::move(result.value);
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::PutIfAbsent(const PutIfAbsentArgs& args, PutIfAbsentReply& reply) {
+    KvCommand cmd;
+    cmd.op = KvOp::PUT_IF_ABSENT;
+    cmd.request = args.request;
+    cmd.key = args.key;
+    cmd.value = args.value;
+    auto result = Propose(cmd);
+    setStatus(result, reply);
+    if (result.status != KvStatus::WRONG_LEADER) {
+        reply.current = std::move(result.value);
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::Increment(const IncrementArgs& args, IncrementReply& reply) {
+    KvCommand cmd;
+    cmd.op = KvOp::INCR;
+    cmd.request = args.request;
+    cmd.key = args.key;
+    cmd.delta = args.delta;
+    auto result = Propose(cmd);
+    setStatus(result, reply);
+    if (result.status == KvStatus::OK) {
+        reply.value = std::strtoll(result.value.c_str(), nullptr, 10);
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::Watch(const WatchArgs& args, WatchReply& reply) {
+    const auto& hub = sm_->Watches();
+    auto watcher = hub->Subscribe(args.key, args.prefix, args.start_revision);
+    if (!watcher) {
+        reply.status = KvStatus::COMPACTED;
+        reply.next_revision = hub->OldestRevision();
+        return std::nullopt;
+    }
+    uint64_t timeout_ms = args.timeout_ms == 0 ? kMaxWatchWaitMs : std::min(args.timeout_ms, kMaxWatchWaitMs);
+    reply.status = watcher->Next(reply.events, timeout_ms);
+    reply.next_revision = watcher->NextRevision();
+    if (reply.status != KvStatus::OK) {
+        reply.events.clear();
+        reply.next_revision = hub->OldestRevision();
+        return std::nullopt;
+    }
+
+    // 超出max_events时在revision边界截断，被截掉的事件由下一次请求取回
+    uint64_t max_events = args.max_events == 0 ? kMaxScanPageSize : args.max_events;
+    if (reply.events.size() > max_events) {
+        size_t cut = max_events;
+        while (cut > 0 && reply.events[cut - 1].revision == reply.events[cut].revision) {
+            --cut;
+        }
+        if (cut == 0) {
+            // 单个revision的事件就超过了上限，整个revision一起返回
+            cut = max_events;
+            while (cut < reply.events.size() && reply.events[cut].revision == reply.events[cut - 1].revision) {
+                ++cut;
+            }
+        }
+        if (cut < reply.events.size()) {
+            reply.next_revision = reply.events[cut].revision;
+            reply.events.resize(cut);
+        }
+    }
+    return std::nullopt;
+}
+
+// ============================================================================
+// 批量导入
+// ============================================================================
+
+KvService::IngestSessionPtr KvService::ingestSession(uint64_t ingest_id, bool create) {
+    std::vector<IngestSessionPtr> expired;
+    IngestSessionPtr session;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(ingest_mu_);
+        auto it = ingest_sessions_.find(ingest_id);
+        if (it != ingest_sessions_.end()) {
+            return it->second;
+        }
+        if (!create) {
+            return nullptr;
+        }
+        // 客户端中途消失的会话在新会话建立时清理
+        int64_t deadline = steadyNowMs() - static_cast<int64_t>(sm_->GetIngestOptions().session_timeout_ms);
+        for (auto entry = ingest_sessions_.begin(); entry != ingest_sessions_.end();) {
+            if (entry->second->last_active_ms.load(std::memory_order_relaxed) < deadline) {
+                expired.push_back(std::move(entry->second));
+                entry = ingest_sessions_.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+        session = std::make_shared<IngestSession>();
+        session->builder = std::make_unique<IngestBuilder>(ingest_id, sm_->GetIngestOptions());
+        session->last_active_ms.store(steadyNowMs(), std::memory_order_relaxed);
+        ingest_sessions_.emplace(ingest_id, session);
+    }
+    for (const auto& old : expired) {
+        std::unique_lock<fiber::FiberMutex> lock(old->mu);
+        LOG_WARN("KvService: abandoned idle ingest session after {} batches", old->seq);
+        old->closed = true;
+        old->builder.reset();
+    }
+    return session;
+}
+
+KvService::IngestSessionPtr KvService::takeIngestSession(uint64_t ingest_id) {
+    std::unique_lock<fiber::FiberMutex> lock(ingest_mu_);
+    auto it = ingest_sessions_.find(ingest_id);
+    if (it == ingest_sessions_.end()) {
+        return nullptr;
+    }
+    auto session = std::move(it->second);
+    ingest_sessions_.erase(it);
+    return session;
+}
+
+std::optional<std::string> KvService::IngestWrite(const IngestWriteArgs& args, IngestWriteReply& reply) {
+    if (args.ingest_id == 0 || sm_->GetIngestOptions().dir.empty()) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    // 只有第一批可以建立会话，避免已提交或已放弃的会话被迟到的重试重新打开
+    auto session = ingestSession(args.ingest_id, args.seq == 1);
+    if (!session) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(session->mu);
+    session->last_active_ms.store(steadyNowMs(), std::memory_order_relaxed);
+    if (session->closed) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+    } else if (args.seq <= session->seq) {
+        reply.status = KvStatus::OK;    // 重试的批次已经写入
+    } else if (args.seq != session->seq + 1 || !session->builder->Add(args.pairs)) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+    } else {
+        session->seq = args.seq;
+        reply.status = KvStatus::OK;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::IngestCommit(const IngestCommitArgs& args, IngestCommitReply& reply) {
+    auto session = takeIngestSession(args.ingest_id);
+    if (!session) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    std::vector<IngestFile> files;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(session->mu);
+        bool ok = !session->closed && session->builder->Finish(files);
+        session->closed = true;
+        session->builder.reset();
+        if (!ok) {
+            reply.status = KvStatus::INVALID_ARGUMENT;
+            return std::nullopt;
+        }
+    }
+
+    const auto& dir = sm_->GetIngestOptions().dir;
+    auto discard = [&]() {
+        for (const auto& file : files) {
+            ::unlink(IngestFilePath(dir, file.name).c_str());
+        }
+    };
+    for (const auto& file : files) {
+        if (ship_ && !ship_(IngestFilePath(dir, file.name), file)) {
+            LOG_WARN("KvService: failed to ship {} to replicas", file.name);
+            discard();
+            reply.status = KvStatus::UNAVAILABLE;
+            return std::nullopt;
+        }
+    }
+
+    KvCommand cmd;
+    cmd.op = KvOp::INGEST;
+    cmd.files = files;
+    cmd.request = args.request;
+    auto result = Propose(cmd);
+    setStatus(result, reply);
+    if (result.status != KvStatus::OK) {
+        // Propose返回时日志已经apply（或没有提交），暂存文件不会再被用到
+        discard();
+        return std::nullopt;
+    }
+    reply.files = files.size();
+    for (const auto& file : files) {
+        reply.entries += file.entries;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::IngestAbort(const IngestAbortArgs& args, IngestAbortReply& reply) {
+    // 析构IngestBuilder时删除已写出的文件
+    if (auto session = takeIngestSession(args.ingest_id)) {
+        std::unique_lock<fiber::FiberMutex> lock(session->mu);
+        session->closed = true;
+        session->builder.reset();
+    }
+    reply.status = KvStatus::OK;
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::IngestPush(const IngestPushArgs& args, IngestPushReply& reply) {
+    const auto& dir = sm_->GetIngestOptions().dir;
+    if (dir.empty() || !ValidIngestFileName(args.file.name) || args.offset + args.data.size() > args.file.size) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::string path = IngestFilePath(dir, args.file.name);
+    int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | (args.offset == 0 ? O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        return "cannot open " + path + ": " + strerror(errno);
+    }
+    const char* data = args.data.data();
+    size_t size = args.data.size();
+    uint64_t offset = args.offset;
+    bool ok = true;
+    while (ok && size > 0) {
+        ssize_t n = ::pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = n > 0;
+        if (ok) {
+            data += n;
+            size -= n;
+            offset += n;
+        }
+    }
+    if (ok && args.last) {
+        ok = ::fsync(fd) == 0;
+    }
+    ::close(fd);
+    if (!ok) {
+        ::unlink(path.c_str());
+        return "write " + path + " failed: " + strerror(errno);
+    }
+    if (args.last && !VerifyIngestFile(path, args.file)) {
+        ::unlink(path.c_str());
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    reply.status = KvStatus::OK;
+    return std::nullopt;
+}
+
+KvService::IngestShipFunc KvService::MakeIngestShipper(std::vector<std::string> peers) {
+    return [peers = std::move(peers)](const std::string& path, const IngestFile& file) {
+        std::atomic<bool> ok{true};
+        fiber::WaitGroup wg;
+        wg.add(static_cast<int>(peers.size()));
+        for (const auto& peer : peers) {
+            fiber::Fiber::go([&, peer]() {
+                std::string host;
+                uint16_t port = 0;
+                auto client = rpc::RpcClient::Make();
+                if (!ParseEndpoint(peer, host, port) || !client->connect(host, port)) {
+                    LOG_WARN("KvService: cannot connect to {} to ship {}", peer, file.name);
+                    ok = false;
+                } else {
+                    if (!pushIngestFile(*client, path, file)) {
+                        LOG_WARN("KvService: failed to push {} to {}", file.name, peer);
+                        ok = false;
+                    }
+                    client->disconnect();
+                }
+                wg.done();
+            });
+        }
+        wg.wait();
+        return ok.load();
+    };
+}
+
+// ============================================================================
+// 在线备份
+// ============================================================================
+
+std::optional<std::string> KvService::Export(const ExportArgs& args, ExportReply& reply) {
+    // 只打开读视图，快照在ExportRead时逐块编码，不阻塞apply和前台请求
+    auto backup = BackupExport::Open(*sm_, args.index);
+    if (!backup) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    reply.index = backup->Index();
+    auto session = std::make_shared<ExportSession>();
+    session->backup = std::move(backup);
+    session->last_active_ms.store(steadyNowMs(), std::memory_order_relaxed);
+
+    std::unique_lock<fiber::FiberMutex> lock(export_mu_);
+    // 客户端中途消失的会话在新导出开始时清理
+    int64_t deadline = steadyNowMs() - static_cast<int64_t>(backup_options_.session_timeout_ms);
+    std::erase_if(export_sessions_, [deadline](const auto& entry) {
+        return entry.second->last_active_ms.load(std::memory_order_relaxed) < deadline;
+    });
+    reply.export_id = next_export_id_++;
+    export_sessions_.emplace(reply.export_id, std::move(session));
+    reply.status = KvStatus::OK;
+    LOG_INFO("KvService: export {} at index {}", reply.export_id, reply.index);
+    return std::nullopt;
+}
+
+std::optional<std::string> KvService::ExportRead(const ExportReadArgs& args, ExportReadReply& reply) {
+    ExportSessionPtr session;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(export_mu_);
+        auto it = export_sessions_.find(args.export_id);
+        if (it != export_sessions_.end()) {
+            session = it->second;
+        }
+    }
+    if (!session) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    std::unique_lock<fiber::FiberMutex> session_lock(session->mu);
+    session->last_active_ms.store(steadyNowMs(), std::memory_order_relaxed);
+    if (!session->backup->Read(args.offset, backup_options_.chunk_bytes, reply.data, reply.last)) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    // 所有导出共享带宽额度，在发送前等待；编码跟随发送，也一同被限速
+    export_limiter_.Acquire(reply.data.size());
+    reply.status = KvStatus::OK;
+    if (reply.last) {
+        reply.size = session->backup->Info().size;
+        reply.crc = session->backup->Info().crc;
+        std::unique_lock<fiber::FiberMutex> lock(export_mu_);
+        export_sessions_.erase(args.export_id);
+    }
+    return std::nullopt;
+}
+
+// ============================================================================
+// 事务
+// ============================================================================
+
+std::optional<std::string> KvService::Txn(const TxnArgs& args, TxnReply& reply) {
+    auto result = txn_->Execute(args.writes, args.compares, args.request);
+    reply.status = result.status;
+    reply.txn_id = result.txn_id;
+    if (result.status == KvStatus::WRONG_LEADER) {
+        reply.leader = std::move(result.key);
+    } else {
+        reply.key = std::move(result.key);
+    }
+    return std::nullopt;
+}
+
+} // namespace kv
@@ -0,0 +1,1680 @@
+#include "include/kv_state_machine.h"
+#include "include/sst.h"
+#include "include/value_codec.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
+
+namespace kv {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool validBatch(const std::vector<KvMutation>& ops) {
+    for (const auto& op : ops) {
+        if (op.op != KvOp::PUT && op.op != KvOp::APPEND && op.op != KvOp::DELETE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 整个字符串都必须是十进制整数（可带符号）
+bool parseInt64(const std::string& text, int64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    const char* begin = text.data();
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(begin, end, value);
+    return ec == std::errc() && ptr == end;
+}
+
+// TTL保留key的值：十进制的过期时间
+std::string encodeDeadline(uint64_t expire_at_ms) {
+    return std::to_string(expire_at_ms);
+}
+
+bool decodeDeadline(const std::string& text, uint64_t& expire_at_ms) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), expire_at_ms);
+    return ec == std::errc() && ptr == text.data() + text.size() && expire_at_ms != 0;
+}
+
+// 会话保留key的值
+std::string encodeSession(const SessionEntry& entry) {
+    auto encoder = rpc::Encoder::New();
+    encoder->Encode(entry);
+    return encoder->Bytes();
+}
+
+bool decodeSession(const std::string& data, SessionEntry& entry) {
+    auto decoder = rpc::Decoder::New(data);
+    return decoder->Decode(entry);
+}
+
+// 命令读写的key，返回false表示命令不能与其他日志并行执行
+bool commandKeys(const KvCommand& cmd, std::vector<std::string_view>& keys) {
+    switch (cmd.op) {
+        case KvOp::GET:
+        case KvOp::PUT:
+        case KvOp::APPEND:
+        case KvOp::DELETE:
+        case KvOp::CAS:
+        case KvOp::PUT_IF_ABSENT:
+        case KvOp::INCR:
+            if (IsTxnKey(cmd.key)) {
+                return false;
+            }
+            keys.push_back(cmd.key);
+            return true;
+        case KvOp::BATCH:
+        case KvOp::EXPIRE:
+            // 写入保留key的BATCH（分片迁移）会重新统计intent
+            for (const auto& op : cmd.ops) {
+                if (IsTxnKey(op.key)) {
+                    return false;
+                }
+                keys.push_back(op.key);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+KvStateMachine::KvStateMachine(KvEnginePtr engine, SessionOptions sessions, WatchOptions watch,
+                               SnapshotOptions snapshot, IngestOptions ingest) :
+    engine_(std::move(engine)), sessions_(sessions), watch_(std::make_shared<WatchHub>(watch)),
+    snapshot_options_(snapshot), ingest_options_(std::move(ingest)), last_applied_(engine_->DurableIndex()) {
+    // 引擎中已有的数据没有历史事件，只能从之后的revision开始watch
+    watch_->Reset(LastApplied());
+    loadTtls();
+    loadSessions();
+    recountIntents();
+}
+
+KvResult KvStateMachine::Apply(uint64_t index, const KvCommand& cmd) {
+    KvResult result;
+    if (index <= LastApplied()) {
+        LOG_WARN("KvStateMachine: skip stale entry index={} (last_applied={})", index, LastApplied());
+        return result;
+    }
+
+    // 读命令不改变状态，重复执行无害，不占用会话
+    bool tracked = cmd.request.client_id != 0 && cmd.op != KvOp::GET;
+    if (!tracked || !checkSession(index, cmd.request, cmd.op, result)) {
+        std::vector<WatchEvent> events;
+        // 被intent挡住的命令没有执行，不记入会话，解决冲突后用同一个RequestId重试
+        if (execute(index, cmd, result, events) && tracked) {
+            recordSession(index, cmd.request, cmd.op, result);
+        }
+        if (!events.empty()) {
+            watch_->Publish(index, std::move(events));
+        }
+    }
+
+    advanceApplied(index - 1, index);
+    return result;
+}
+
+bool KvStateMachine::execute(uint64_t index, const KvCommand& cmd, KvResult& result,
+                             std::vector<WatchEvent>& events) {
+    applyCommand(index, cmd, result);
+    if (result.status == KvStatus::TXN_CONFLICT) {
+        return false;
+    }
+    if (cmd.op != KvOp::GET && watch_->Collect(index)) {
+        collectEvents(index, cmd, result, events);
+    }
+    return true;
+}
+
+void KvStateMachine::advanceApplied(uint64_t from, uint64_t index) {
+    last_applied_.store(index, std::memory_order_release);
+    if (index / kGcInterval > from / kGcInterval) {
+        engine_->CollectGarbage();
+    }
+}
+
+// ============================================================================
+// 会话
+// ============================================================================
+// 持久化引擎中会话记录在同一个index上写入保留key，见kv_command.h中的“状态机的保留key”
+
+bool KvStateMachine::checkSession(uint64_t index, const RequestId& request, KvOp op, KvResult& result) {
+    if (!sessions_.Check(index, request, op, result)) {
+        return false;
+    }
+    // 重复请求刷新了会话的活动时间，淘汰顺序依赖它
+    persistSession(index, request.client_id, {});
+    return true;
+}
+
+void KvStateMachine::recordSession(uint64_t index, const RequestId& request, KvOp op, const KvResult& result) {
+    if (!engine_->Persistent()) {
+        sessions_.Record(index, request, op, result);
+        return;
+    }
+    std::vector<uint64_t> evicted;
+    sessions_.Record(index, request, op, result, &evicted);
+    persistSession(index, request.client_id, evicted);
+}
+
+void KvStateMachine::persistSession(uint64_t index, uint64_t client_id, const std::vector<uint64_t>& evicted) {
+    SessionEntry entry;
+    if (!engine_->Persistent() || !sessions_.Find(client_id, entry)) {
+        return;
+    }
+    std::vector<KvMutation> writes{KvMutation{KvOp::PUT, SessionStateKey(client_id), encodeSession(entry), 0}};
+    for (uint64_t evicted_id : evicted) {
+        writes.push_back(KvMutation{KvOp::DELETE, SessionStateKey(evicted_id), std::string(), 0});
+    }
+    std::vector<KvStatus> statuses;
+    engine_->Write(index, writes, statuses);
+}
+
+void KvStateMachine::loadSessions() {
+    if (!engine_->Persistent()) {
+        return;
+    }
+    std::string begin = std::string(kStateKeyPrefix) + 's';
+    std::vector<SessionEntry> entries;
+    for (const auto& pair : engine_->Scan(begin, PrefixEnd(begin), 0)) {
+        SessionEntry entry;
+        if (!decodeSession(pair.value, entry)) {
+            LOG_WARN("KvStateMachine: ignore bad session record {}", pair.key.substr(begin.size()));
+            continue;
+        }
+        entries.push_back(entry);
+    }
+    // Restore按从旧到新的活动顺序重建LRU链表；每个index最多刷新一个会话
+    std::sort(entries.begin(), entries.end(), [](const SessionEntry& a, const SessionEntry& b) {
+        return a.last_index < b.last_index;
+    });
+    sessions_.Restore(entries);
+}
+
+// ============================================================================
+// 并行apply
+// ============================================================================
+
+struct KvStateMachine::ApplySegment {
+    size_t begin = 0;
+    size_t end = 0;                             // 段为cmds[begin, end)
+    bool parallel = false;                      // false时段内只有一条日志，按Apply执行
+    std::vector<char> duplicate;                // 相对begin：会话表中已执行过的请求，不执行
+    std::vector<std::vector<size_t>> groups;    // 冲突集，集合内的日志位置按顺序排列
+};
+
+std::vector<KvResult> KvStateMachine::ApplyBatch(uint64_t first_index, const std::vector<KvCommand>& cmds,
+                                                 size_t workers) {
+    std::vector<KvResult> results(cmds.size());
+    bool parallel = workers > 1 && engine_->ConcurrentWrites();
+    size_t pos = 0;
+    while (pos < cmds.size()) {
+        uint64_t index = first_index + pos;
+        ApplySegment segment;
+        if (parallel && index > LastApplied()) {
+            planSegment(cmds, pos, segment);
+        }
+        if (!segment.parallel) {
+            results[pos] = Apply(index, cmds[pos]);
+            ++pos;
+            continue;
+        }
+        applySegment(first_index, cmds, segment, workers, results);
+        advanceApplied(index - 1, first_index + segment.end - 1);
+        pos = segment.end;
+    }
+    return results;
+}
+
+void KvStateMachine::planSegment(const std::vector<KvCommand>& cmds, size_t begin, ApplySegment& segment) {
+    segment.begin = begin;
+    std::vector<size_t> parent;                     // 并查集，下标相对begin
+    std::unordered_map<uint64_t, size_t> owners;    // key哈希 -> 访问过它的日志
+    std::unordered_set<uint64_t> clients;
+    std::vector<std::string_view> keys;
+    auto find = [&parent](size_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+
+    size_t pos = begin;
+    while (pos < cmds.size()) {
+        const auto& cmd = cmds[pos];
+        keys.clear();
+        bool tracked = cmd.request.client_id != 0 && cmd.op != KvOp::GET;
+        if (!commandKeys(cmd, keys) || (tracked && !clients.insert(cmd.request.client_id).second)) {
+            break;
+        }
+        size_t self = pos - begin;
+        parent.push_back(self);
+        // 新建会话可能淘汰其他会话，之后的日志要在Record之后才能查询会话表
+        bool fresh = tracked && !sessions_.Contains(cmd.request.client_id);
+        bool duplicate = tracked && !fresh && sessions_.Executed(cmd.request);
+        segment.duplicate.push_back(duplicate);
+        if (!duplicate) {
+            // 哈希碰撞只会让无关的日志多合并一次，不影响结果
+            for (auto key : keys) {
+                auto [it, inserted] = owners.try_emplace(std::hash<std::string_view>()(key), self);
+                size_t a = find(it->second);
+                size_t b = find(self);
+                if (a != b) {
+                    parent[std::max(a, b)] = std::min(a, b);
+                }
+            }
+        }
+        ++pos;
+        if (fresh) {
+            break;
+        }
+    }
+    if (pos == begin) {
+        return;
+    }
+
+    segment.end = pos;
+    segment.parallel = true;
+    std::unordered_map<size_t, size_t> group_of;    // 并查集的根 -> groups中的位置
+    for (size_t i = 0; i < pos - begin; ++i) {
+        if (segment.duplicate[i]) {
+            continue;
+        }
+        auto [it, inserted] = group_of.try_emplace(find(i), segment.groups.size());
+        if (inserted) {
+            segment.groups.emplace_back();
+        }
+        segment.groups[it->second].push_back(begin + i);
+    }
+}
+
+void KvStateMachine::applySegment(uint64_t first_index, const std::vector<KvCommand>& cmds,
+                                  const ApplySegment& segment, size_t workers, std::vector<KvResult>& results) {
+    size_t count = segment.end - segment.begin;
+    std::vector<std::vector<WatchEvent>> events(count);
+    std::vector<char> executed(count, 0);
+    auto run = [&](const std::vector<size_t>& group) {
+        for (size_t pos : group) {
+            size_t i = pos - segment.begin;
+            executed[i] = execute(first_index + pos, cmds[pos], results[pos], events[i]);
+        }
+    };
+
+    size_t fibers = std::min(workers, segment.groups.size());
+    if (fibers <= 1) {
+        for (const auto& group : segment.groups) {
+            run(group);
+        }
+    } else {
+        std::atomic<size_t> next{0};
+        fiber::WaitGroup wg;
+        wg.add(static_cast<int>(fibers));
+        for (size_t w = 0; w < fibers; ++w) {
+            fiber::Fiber::go([&]() {
+                for (size_t g = next.fetch_add(1); g < segment.groups.size(); g = next.fetch_add(1)) {
+                    run(segment.groups[g]);
+                }
+                wg.done();
+            });
+        }
+        wg.wait();
+    }
+
+    // 会话表和watch按日志顺序处理，与逐条apply一致
+    for (size_t i = 0; i < count; ++i) {
+        size_t pos = segment.begin + i;
+        uint64_t index = first_index + pos;
+        const auto& cmd = cmds[pos];
+        if (segment.duplicate[i]) {
+            checkSession(index, cmd.request, cmd.op, results[pos]);
+        } else if (executed[i] && cmd.request.client_id != 0 && cmd.op != KvOp::GET) {
+            recordSession(index, cmd.request, cmd.op, results[pos]);
+        }
+        if (!events[i].empty()) {
+            watch_->Publish(index, std::move(events[i]));
+        }
+    }
+}
+
+void KvStateMachine::applyCommand(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    if (intent_count_.load(std::memory_order_relaxed) > 0 && blockedByIntent(cmd, result)) {
+        return;
+    }
+    switch (cmd.op) {
+        case KvOp::GET:
+            result = Get(cmd.key);
+            break;
+        case KvOp::PUT:
+            putWithTtl(index, cmd.key, cmd.value, cmd.expire_at_ms);
+            break;
+        case KvOp::APPEND:
+            engine_->Append(index, cmd.key, cmd.value);
+            break;
+        case KvOp::DELETE:
+            if (!deleteWithTtl(index, cmd.key)) {
+                result.status = KvStatus::NO_KEY;
+            }
+            break;
+        case KvOp::BATCH:
+            // 任一子操作无法识别时整批拒绝，保证批次要么全部生效要么全部不生效
+            if (!validBatch(cmd.ops)) {
+                result.status = KvStatus::INVALID_ARGUMENT;
+                break;
+            }
+            if (std::vector<KvMutation> state = ttlStateWrites(cmd.ops); state.empty()) {
+                engine_->Write(index, cmd.ops, result.statuses);
+            } else {
+                std::vector<KvMutation> writes = cmd.ops;
+                writes.insert(writes.end(), std::make_move_iterator(state.begin()), std::make_move_iterator(state.end()));
+                engine_->Write(index, writes, result.statuses);
+                result.statuses.resize(cmd.ops.size());
+            }
+            for (const auto& op : cmd.ops) {
+                if (op.op == KvOp::PUT) {
+                    ttl_.Set(op.key, op.expire_at_ms);
+                } else if (op.op == KvOp::DELETE) {
+                    ttl_.Remove(op.key);
+                }
+            }
+            // 分片迁移把intent作为普通key写入目标组
+            if (std::any_of(cmd.ops.begin(), cmd.ops.end(), [](const KvMutation& op) { return IsTxnKey(op.key); })) {
+                recountIntents();
+            }
+            break;
+        case KvOp::CAS:
+            applyCas(index, cmd, result);
+            break;
+        case KvOp::PUT_IF_ABSENT:
+            applyPutIfAbsent(index, cmd, result);
+            break;
+        case KvOp::INCR:
+            applyIncrement(index, cmd, result);
+            break;
+        case KvOp::EXPIRE:
+            applyExpire(index, cmd, result);
+            break;
+        case KvOp::INGEST:
+            applyIngest(index, cmd, result);
+            break;
+        case KvOp::TXN_PREPARE:
+            applyTxnPrepare(index, cmd, result);
+            break;
+        case KvOp::TXN_FENCE:
+            applyTxnFence(index, cmd, result);
+            break;
+        case KvOp::TXN_END:
+            applyTxnEnd(index, cmd, result);
+            break;
+        case KvOp::TXN_RESOLVE:
+            applyTxnResolve(index, cmd, result);
+            break;
+        default:
+            result.status = KvStatus::INVALID_ARGUMENT;
+            break;
+    }
+}
+
+// ============================================================================
+// 条件写
+// ============================================================================
+// apply循环是唯一的写者，读-比较-写之间不会有其他写入，条件在apply时原子地求值；
+// 各副本按相同的日志顺序求值，结果一致。
+
+void KvStateMachine::applyCas(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    std::string current;
+    if (!engine_->Get(cmd.key, current)) {
+        result.status = KvStatus::NO_KEY;
+        return;
+    }
+    if (current != cmd.expected) {
+        result.status = KvStatus::CONDITION_FAILED;
+        result.value = std::move(current);
+        return;
+    }
+    engine_->Put(index, cmd.key, cmd.value);
+}
+
+void KvStateMachine::applyPutIfAbsent(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    if (engine_->Get(cmd.key, result.value)) {
+        result.status = KvStatus::CONDITION_FAILED;
+        return;
+    }
+    putWithTtl(index, cmd.key, cmd.value, cmd.expire_at_ms);
+}
+
+void KvStateMachine::applyIncrement(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    int64_t current = 0;
+    std::string text;
+    if (engine_->Get(cmd.key, text) && !parseInt64(text, current)) {
+        result.status = KvStatus::INVALID_ARGUMENT;
+        result.value = std::move(text);
+        return;
+    }
+    int64_t updated = 0;
+    if (__builtin_add_overflow(current, cmd.delta, &updated)) {
+        result.status = KvStatus::INVALID_ARGUMENT;
+        result.value = std::move(text);
+        return;
+    }
+    result.value = std::to_string(updated);
+    engine_->Put(index, cmd.key, result.value);
+}
+
+// ============================================================================
+// TTL
+// ============================================================================
+
+// 持久化引擎中TTL与数据在同一个批次中写入，见kv_command.h中的“状态机的保留key”
+
+std::vector<KvMutation> KvStateMachine::ttlStateWrites(const std::vector<KvMutation>& ops) {
+    std::vector<KvMutation> writes;
+    if (!engine_->Persistent()) {
+        return writes;
+    }
+    // 同一个key在批次中可能写入多次，最后一次PUT/DELETE决定TTL，APPEND不改变TTL
+    std::unordered_map<std::string_view, uint64_t> deadlines;
+    for (const auto& op : ops) {
+        if (op.op == KvOp::PUT) {
+            deadlines[op.key] = op.expire_at_ms;
+        } else if (op.op == KvOp::DELETE) {
+            deadlines[op.key] = 0;
+        }
+    }
+    for (const auto& [key, expire_at_ms] : deadlines) {
+        if (expire_at_ms != 0) {
+            writes.push_back(KvMutation{KvOp::PUT, TtlStateKey(key), encodeDeadline(expire_at_ms), 0});
+        } else if (ttl_.Size() > 0 && ttl_.Deadline(std::string(key)) != 0) {
+            writes.push_back(KvMutation{KvOp::DELETE, TtlStateKey(key), std::string(), 0});
+        }
+    }
+    return writes;
+}
+
+void KvStateMachine::putWithTtl(uint64_t index, const std::string& key, const std::string& value,
+                                uint64_t expire_at_ms) {
+    std::vector<KvMutation> writes{KvMutation{KvOp::PUT, key, value, expire_at_ms}};
+    std::vector<KvMutation> state = ttlStateWrites(writes);
+    if (state.empty()) {
+        engine_->Put(index, key, value);
+    } else {
+        writes.push_back(std::move(state.front()));
+        std::vector<KvStatus> statuses;
+        engine_->Write(index, writes, statuses);
+    }
+    ttl_.Set(key, expire_at_ms);
+}
+
+bool KvStateMachine::deleteWithTtl(uint64_t index, const std::string& key) {
+    std::vector<KvMutation> writes{KvMutation{KvOp::DELETE, key, std::string(), 0}};
+    std::vector<KvMutation> state = ttlStateWrites(writes);
+    bool existed;
+    if (state.empty()) {
+        existed = engine_->Delete(index, key);
+    } else {
+        writes.push_back(std::move(state.front()));
+        std::vector<KvStatus> statuses;
+        engine_->Write(index, writes, statuses);
+        existed = statuses[0] == KvStatus::OK;
+    }
+    ttl_.Remove(key);
+    return existed;
+}
+
+void KvStateMachine::loadTtls() {
+    if (!engine_->Persistent()) {
+        return;
+    }
+    std::string begin = TtlStateKey("");
+    uint64_t expire_at_ms = 0;
+    for (const auto& pair : engine_->Scan(begin, PrefixEnd(begin), 0)) {
+        if (!decodeDeadline(pair.value, expire_at_ms)) {
+            LOG_WARN("KvStateMachine: ignore bad TTL record for key {}", pair.key.substr(begin.size()));
+            continue;
+        }
+        ttl_.Set(pair.key.substr(begin.size()), expire_at_ms);
+    }
+}
+
+void KvStateMachine::applyExpire(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    // 只删除过期时间仍与提交时一致的key：提交之后被重新写入（TTL改变或被清除）的key保留。
+    // 判断只依赖复制的TTL索引，不读取本地时钟，各副本结果一致
+    std::vector<KvTtl> entries;
+    entries.reserve(cmd.ops.size());
+    for (const auto& op : cmd.ops) {
+        entries.push_back(KvTtl{op.key, op.expire_at_ms});
+    }
+    std::vector<bool> matched = ttl_.RemoveMatching(entries);
+
+    std::vector<KvMutation> deletes;
+    std::vector<size_t> positions;
+    result.statuses.assign(cmd.ops.size(), KvStatus::NO_KEY);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (matched[i]) {
+            deletes.push_back(KvMutation{KvOp::DELETE, std::move(entries[i].key), std::string(), 0});
+            positions.push_back(i);
+        }
+    }
+    if (deletes.empty()) {
+        return;
+    }
+    if (engine_->Persistent()) {
+        for (size_t i = 0, count = deletes.size(); i < count; ++i) {
+            deletes.push_back(KvMutation{KvOp::DELETE, TtlStateKey(deletes[i].key), std::string(), 0});
+        }
+    }
+    std::vector<KvStatus> statuses;
+    engine_->Write(index, deletes, statuses);
+    for (size_t i = 0; i < positions.size(); ++i) {
+        result.statuses[positions[i]] = statuses[i];
+    }
+}
+
+// ============================================================================
+// 批量导入
+// ============================================================================
+
+void KvStateMachine::applyIngest(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    // 文件在提交日志之前已复制到每个副本，核对失败说明本副本的暂存文件丢失或损坏，
+    // 只能拒绝并记录错误
+    if (ingest_options_.dir.empty()) {
+        LOG_ERROR("KvStateMachine: INGEST at index {} but no ingest dir is configured", index);
+        result.status = KvStatus::INVALID_ARGUMENT;
+        return;
+    }
+    std::vector<std::string> paths;
+    uint64_t entries = 0;
+    for (const auto& file : cmd.files) {
+        std::string path = IngestFilePath(ingest_options_.dir, file.name);
+        if (!ValidIngestFileName(file.name) || !VerifyIngestFile(path, file)) {
+            LOG_ERROR("KvStateMachine: INGEST at index {} rejected, bad file {}", index, file.name);
+            result.status = KvStatus::INVALID_ARGUMENT;
+            return;
+        }
+        paths.push_back(std::move(path));
+        entries += file.entries;
+    }
+
+    // 导入的值覆盖原值，原有TTL随之清除（与PUT一致）；带TTL的key通常远少于导入的数据，
+    // 逐个到文件中查找（布隆过滤器）。持久化引擎导入后DurableIndex()已推进到index，
+    // TTL保留key的删除要在导入之前写入，导入失败时再写回
+    std::vector<KvTtl> overwritten;
+    if (ttl_.Size() > 0) {
+        std::vector<SstReaderPtr> readers;
+        for (const auto& path : paths) {
+            if (auto reader = SstReader::Open(path, 0)) {
+                readers.push_back(std::move(reader));
+            }
+        }
+        std::string value;
+        for (auto& ttl : ttl_.Entries()) {
+            for (const auto& reader : readers) {
+                if (ttl.key < reader->Smallest() || ttl.key > reader->Largest()) {
+                    continue;
+                }
+                auto found = reader->Get(ttl.key, value);
+                if (found == SstReader::LookupResult::ERROR) {
+                    LOG_ERROR("KvStateMachine: INGEST at index {} rejected, cannot read {}", index, reader->Path());
+                    result.status = KvStatus::INVALID_ARGUMENT;
+                    return;
+                }
+                if (found == SstReader::LookupResult::FOUND) {
+                    overwritten.push_back(std::move(ttl));
+                    break;
+                }
+            }
+        }
+    }
+    std::vector<KvMutation> state;
+    if (engine_->Persistent()) {
+        for (const auto& ttl : overwritten) {
+            state.push_back(KvMutation{KvOp::DELETE, TtlStateKey(ttl.key), std::string(), 0});
+        }
+        // 会话记录同理：按成功的结果提前写入。Apply之后再写的记录（及其淘汰的会话）
+        // 在重启后丢失，打开时由SessionTable::Restore按同样的规则重新淘汰
+        if (cmd.request.client_id != 0) {
+            SessionEntry entry{cmd.request.client_id, cmd.request.seq, index, 0, KvStatus::OK};
+            state.push_back(KvMutation{KvOp::PUT, SessionStateKey(entry.client_id), encodeSession(entry), 0});
+        }
+    }
+    std::vector<KvStatus> statuses;
+    if (!state.empty()) {
+        engine_->Write(index, state, statuses);
+    }
+    if (!engine_->Ingest(index, paths)) {
+        LOG_ERROR("KvStateMachine: engine failed to ingest {} files at index {}", paths.size(), index);
+        // 引擎没有推进DurableIndex()，会话记录由Apply按失败的结果覆盖
+        if (engine_->Persistent() && !overwritten.empty()) {
+            std::vector<KvMutation> restored;
+            for (const auto& ttl : overwritten) {
+                restored.push_back(KvMutation{KvOp::PUT, TtlStateKey(ttl.key), encodeDeadline(ttl.expire_at_ms), 0});
+            }
+            engine_->Write(index, restored, statuses);
+        }
+        result.status = KvStatus::INVALID_ARGUMENT;
+        return;
+    }
+    ttl_.RemoveMatching(overwritten);
+    result.value = std::to_string(entries);
+
+    if (engine_->DurableIndex() >= index) {
+        for (const auto& path : paths) {
+            ::unlink(path.c_str());
+        }
+        return;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(ingest_mu_);
+    for (auto& path : paths) {
+        retained_ingest_files_.emplace_back(index, std::move(path));
+    }
+}
+
+void KvStateMachine::ReleaseIngestFiles(uint64_t index) {
+    std::vector<std::string> released;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(ingest_mu_);
+        auto it = std::stable_partition(retained_ingest_files_.begin(), retained_ingest_files_.end(),
+                                        [index](const auto& entry) { return entry.first > index; });
+        for (auto released_it = it; released_it != retained_ingest_files_.end(); ++released_it) {
+            released.push_back(std::move(released_it->second));
+        }
+        retained_ingest_files_.erase(it, retained_ingest_files_.end());
+    }
+    for (const auto& path : released) {
+        ::unlink(path.c_str());
+    }
+}
+
+// ============================================================================
+// 事务
+// ============================================================================
+// TXN_PREPARE在本组检查条件并为每个key写入intent，发往anchor所在组的同时写入
+// STAGING事务记录。intent锁住key：其他事务的PREPARE和普通写命令返回TXN_CONFLICT。
+// 恢复流程用TXN_FENCE确认intent是否已写入，并在没写入的key上留下隔离标记，
+// 之后到达的PREPARE被拒绝；事务记录一旦是ABORTED，anchor的PREPARE同样被拒绝。
+// 中止的事务记录和隔离标记不删除，保证迟到的PREPARE永远不会生效。
+
+bool KvStateMachine::getIntent(const std::string& key, TxnIntent& intent) {
+    std::string value;
+    return engine_->Get(TxnIntentKey(key), value) && DecodeTxnValue(value, intent);
+}
+
+bool KvStateMachine::PendingIntent(const std::string& key, TxnIntent& intent) {
+    return IntentCount() > 0 && getIntent(key, intent);
+}
+
+void KvStateMachine::recountIntents() {
+    std::string begin = TxnIntentKey("");
+    intent_count_.store(engine_->Scan(begin, PrefixEnd(begin), 0).size(), std::memory_order_release);
+    wakeIntentWaiters(nullptr);
+}
+
+void KvStateMachine::WaitIntent(const std::string& key, uint64_t txn_id, uint64_t timeout_ms) {
+    auto chan = fiber::make_channel<bool>(1);
+    {
+        std::unique_lock<fiber::FiberMutex> lock(intent_mu_);
+        intent_waiters_.emplace(key, chan);
+    }
+    // 先登记再检查：检查之后才清理的intent一定会唤醒这里
+    TxnIntent intent;
+    if (getIntent(key, intent) && intent.id == txn_id) {
+        bool woken;
+        chan->recv_timeout(woken, static_cast<int64_t>(timeout_ms));
+    }
+    std::unique_lock<fiber::FiberMutex> lock(intent_mu_);
+    auto [begin, end] = intent_waiters_.equal_range(key);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == chan) {
+            intent_waiters_.erase(it);
+            break;
+        }
+    }
+}
+
+void KvStateMachine::wakeIntentWaiters(const std::vector<std::string>* keys) {
+    std::unique_lock<fiber::FiberMutex> lock(intent_mu_);
+    if (intent_waiters_.empty()) {
+        return;
+    }
+    auto wake = [this](auto begin, auto end) {
+        for (auto it = begin; it != end; ++it) {
+            it->second->close();
+        }
+        intent_waiters_.erase(begin, end);
+    };
+    if (keys == nullptr) {
+        wake(intent_waiters_.begin(), intent_waiters_.end());
+        return;
+    }
+    for (const auto& key : *keys) {
+        auto [begin, end] = intent_waiters_.equal_range(key);
+        wake(begin, end);
+    }
+}
+
+bool KvStateMachine::blockedByIntent(const KvCommand& cmd, KvResult& result) {
+    TxnIntent intent;
+    auto blocked = [&](const std::string& key) {
+        if (!IsTxnKey(key) && getIntent(key, intent)) {
+            result.status = KvStatus::TXN_CONFLICT;
+            result.value = key;
+            return true;
+        }
+        return false;
+    };
+    switch (cmd.op) {
+        case KvOp::PUT:
+        case KvOp::APPEND:
+        case KvOp::DELETE:
+        case KvOp::CAS:
+        case KvOp::PUT_IF_ABSENT:
+        case KvOp::INCR:
+            return blocked(cmd.key);
+        case KvOp::BATCH:
+            return std::any_of(cmd.ops.begin(), cmd.ops.end(), [&](const KvMutation& op) { return blocked(op.key); });
+        default:
+            return false;
+    }
+}
+
+void KvStateMachine::applyTxnPrepare(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    const TxnMeta& txn = cmd.txn;
+    if (!txn.keys.empty() && txn.request.client_id != 0 &&
+        checkSession(index, txn.request, KvOp::TXN_PREPARE, result)) {
+        // 同一个请求的事务已经提交过（客户端重试）：不再执行，value带回已提交的记录
+        result.value = EncodeTxnValue(TxnRecord{TxnState::COMMITTED, txn.start_ms, txn.timeout_ms, {}, txn.request});
+        return;
+    }
+    std::string value;
+    if (!txn.keys.empty() && engine_->Get(TxnRecordKey(txn.id, txn.anchor), value)) {
+        // 已被恢复流程中止，或是重复的PREPARE
+        TxnRecord record;
+        if (!DecodeTxnValue(value, record) || record.state == TxnState::ABORTED) {
+            result.status = KvStatus::TXN_ABORTED;
+        }
+        return;
+    }
+
+    std::vector<const std::string*> keys;
+    std::unordered_set<std::string_view> written;
+    for (const auto& op : cmd.ops) {
+        bool write = op.op == KvOp::PUT || op.op == KvOp::APPEND || op.op == KvOp::DELETE;
+        if (!write || IsTxnKey(op.key) || !written.insert(op.key).second) {
+            result.status = KvStatus::INVALID_ARGUMENT;
+            return;
+        }
+        keys.push_back(&op.key);
+    }
+    for (const auto& compare : cmd.compares) {
+        keys.push_back(&compare.key);
+    }
+    TxnIntent intent;
+    for (const auto* key : keys) {
+        if (engine_->Get(TxnFenceKey(txn.id, *key), value)) {
+            result.status = KvStatus::TXN_ABORTED;
+            return;
+        }
+        if (getIntent(*key, intent) && intent.id != txn.id) {
+            result.status = KvStatus::TXN_CONFLICT;
+            result.value = *key;
+            return;
+        }
+    }
+    for (const auto& compare : cmd.compares) {
+        bool exists = engine_->Get(compare.key, value);
+        if (exists != compare.exists || (exists && value != compare.value)) {
+            result.status = KvStatus::CONDITION_FAILED;
+            result.value = compare.key;
+            return;
+        }
+    }
+
+    // 只检查条件的key也写入intent（op为GET），在事务结束前锁住
+    std::vector<KvMutation> writes;
+    size_t added = 0;
+    auto addIntent = [&](const std::string& key, KvOp op, const std::string& data, uint64_t expire_at_ms) {
+        TxnIntent existing;
+        if (!getIntent(key, existing)) {
+            ++added;
+        }
+        TxnIntent intent{txn.id, txn.anchor, txn.start_ms, txn.timeout_ms, op, data, expire_at_ms};
+        writes.push_back(KvMutation{KvOp::PUT, TxnIntentKey(key), EncodeTxnValue(intent), 0});
+    };
+    for (const auto& op : cmd.ops) {
+        addIntent(op.key, op.op, op.value, op.expire_at_ms);
+    }
+    for (const auto& compare : cmd.compares) {
+        if (written.insert(compare.key).second) {
+            addIntent(compare.key, KvOp::GET, std::string(), 0);
+        }
+    }
+    if (!txn.keys.empty()) {
+        TxnRecord record{TxnState::STAGING, txn.start_ms, txn.timeout_ms, txn.keys, txn.request};
+        writes.push_back(KvMutation{KvOp::PUT, TxnRecordKey(txn.id, txn.anchor), EncodeTxnValue(record), 0});
+    }
+    std::vector<KvStatus> statuses;
+    engine_->Write(index, writes, statuses);
+    intent_count_.fetch_add(added, std::memory_order_release);
+}
+
+void KvStateMachine::applyTxnFence(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    std::vector<KvMutation> fences;
+    result.statuses.assign(cmd.ops.size(), KvStatus::OK);
+    TxnIntent intent;
+    for (size_t i = 0; i < cmd.ops.size(); ++i) {
+        const auto& key = cmd.ops[i].key;
+        if (!getIntent(key, intent) || intent.id != cmd.txn.id) {
+            result.statuses[i] = KvStatus::NO_KEY;
+            fences.push_back(KvMutation{KvOp::PUT, TxnFenceKey(cmd.txn.id, key), std::string(), 0});
+        }
+    }
+    if (!fences.empty()) {
+        std::vector<KvStatus> statuses;
+        engine_->Write(index, fences, statuses);
+    }
+}
+
+void KvStateMachine::applyTxnEnd(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    const TxnMeta& txn = cmd.txn;
+    std::string key = TxnRecordKey(txn.id, txn.anchor);
+    std::string value;
+    TxnRecord record;
+    if (!engine_->Get(key, value) || !DecodeTxnValue(value, record)) {
+        // 查询时事务还没超时：anchor的PREPARE可能还在路上
+        bool live = txn.state == TxnState::PENDING && txn.now_ms < txn.start_ms + txn.timeout_ms;
+        if (txn.state == TxnState::COMMITTED || live) {
+            result.status = KvStatus::NO_KEY;
+            return;
+        }
+        // 中止或查询一个超时且没有记录的事务：记为ABORTED，之后到达的anchor的PREPARE被拒绝
+        record = TxnRecord{TxnState::ABORTED, txn.start_ms, txn.timeout_ms, {}};
+        engine_->Put(index, key, EncodeTxnValue(record));
+        result.value = EncodeTxnValue(record);
+        return;
+    }
+
+    if (txn.state == TxnState::COMMITTED && record.state != TxnState::COMMITTED) {
+        if (record.state == TxnState::ABORTED) {
+            result.status = KvStatus::TXN_ABORTED;
+        } else {
+            record.state = TxnState::COMMITTED;
+            engine_->Put(index, key, EncodeTxnValue(record));
+            // 事务的结论已确定：此后客户端重试同一个请求时不再执行。
+            // 并行提交时客户端可能已经发出了下一个请求，不能让会话倒退
+            if (record.request.client_id != 0 && !sessions_.Executed(record.request)) {
+                recordSession(index, record.request, KvOp::TXN_PREPARE, result);
+            }
+        }
+    } else if (txn.state == TxnState::ABORTED && record.state != TxnState::ABORTED) {
+        if (record.state == TxnState::COMMITTED) {
+            result.status = KvStatus::CONDITION_FAILED;
+        } else {
+            record.state = TxnState::ABORTED;
+            engine_->Put(index, key, EncodeTxnValue(record));
+        }
+    }
+    result.value = EncodeTxnValue(record);
+}
+
+void KvStateMachine::applyTxnResolve(uint64_t index, const KvCommand& cmd, KvResult& result) {
+    const TxnMeta& txn = cmd.txn;
+    bool commit = txn.state == TxnState::COMMITTED;
+    std::vector<KvMutation> writes;
+    std::vector<size_t> data_writes;    // writes中提交的数据写入的位置
+    size_t removed = 0;
+    result.statuses.assign(cmd.ops.size(), KvStatus::NO_KEY);
+    std::unordered_set<std::string_view> seen;
+    TxnIntent intent;
+    for (size_t i = 0; i < cmd.ops.size(); ++i) {
+        const auto& key = cmd.ops[i].key;
+        if (!seen.insert(key).second || !getIntent(key, intent) || intent.id != txn.id) {
+            continue;
+        }
+        result.statuses[i] = KvStatus::OK;
+        writes.push_back(KvMutation{KvOp::DELETE, TxnIntentKey(key), std::string(), 0});
+        ++removed;
+        if (commit && intent.op != KvOp::GET) {
+            data_writes.push_back(writes.size());
+            writes.push_back(KvMutation{intent.op, key, std::move(intent.value), intent.expire_at_ms});
+        }
+    }
+    // anchor所在组最后清理：提交的事务记录在其他组的intent都解决之后才删除
+    std::string value;
+    std::string record_key = TxnRecordKey(txn.id, txn.anchor);
+    if (commit && engine_->Get(record_key, value)) {
+        writes.push_back(KvMutation{KvOp::DELETE, std::move(record_key), std::string(), 0});
+    }
+    if (writes.empty()) {
+        return;
+    }
+    std::vector<KvMutation> state = ttlStateWrites(writes);
+    writes.insert(writes.end(), std::make_move_iterator(state.begin()), std::make_move_iterator(state.end()));
+    std::vector<KvStatus> statuses;
+    engine_->Write(index, writes, statuses);
+    intent_count_.fetch_sub(removed, std::memory_order_release);
+    if (removed > 0) {
+        std::vector<std::string> resolved;
+        resolved.reserve(removed);
+        for (size_t i = 0; i < cmd.ops.size(); ++i) {
+            if (result.statuses[i] == KvStatus::OK) {
+                resolved.push_back(cmd.ops[i].key);
+            }
+        }
+        wakeIntentWaiters(&resolved);
+    }
+
+    bool collect = watch_->Collect(index);
+    std::vector<WatchEvent> events;
+    for (size_t pos : data_writes) {
+        const auto& op = writes[pos];
+        if (op.op == KvOp::PUT) {
+            ttl_.Set(op.key, op.expire_at_ms);
+            if (collect) {
+                events.push_back(WatchEvent{index, KvOp::PUT, op.key, op.value});
+            }
+        } else if (op.op == KvOp::DELETE) {
+            ttl_.Remove(op.key);
+            if (collect && statuses[pos] == KvStatus::OK) {
+                events.push_back(WatchEvent{index, KvOp::DELETE, op.key, std::string()});
+            }
+        } else if (collect) {
+            std::string appended;
+            engine_->Get(op.key, appended);
+            events.push_back(WatchEvent{index, KvOp::PUT, op.key, std::move(appended)});
+        }
+    }
+    if (!events.empty()) {
+        watch_->Publish(index, std::move(events));
+    }
+}
+
+// ============================================================================
+// Watch
+// ============================================================================
+// 由命令和执行结果推出变更事件，事件带写入后的完整值；只有APPEND需要回读引擎
+// （批次内对同一个key多次APPEND时，各事件都带批次结束后的值）。
+
+void KvStateMachine::collectEvents(uint64_t index, const KvCommand& cmd, const KvResult& result,
+                                   std::vector<WatchEvent>& events) {
+    auto put = [&](const std::string& key, std::string value) {
+        events.push_back(WatchEvent{index, KvOp::PUT, key, std::move(value)});
+    };
+    auto appended = [&](const std::string& key) {
+        std::string value;
+        engine_->Get(key, value);
+        put(key, std::move(value));
+    };
+    auto del = [&](const std::string& key) {
+        events.push_back(WatchEvent{index, KvOp::DELETE, key, std::string()});
+    };
+
+    switch (cmd.op) {
+        case KvOp::PUT:
+            put(cmd.key, cmd.value);
+            break;
+        case KvOp::APPEND:
+            appended(cmd.key);
+            break;
+        case KvOp::CAS:
+        case KvOp::PUT_IF_ABSENT:
+            if (result.status == KvStatus::OK) {
+                put(cmd.key, cmd.value);
+            }
+            break;
+        case KvOp::INCR:
+            if (result.status == KvStatus::OK) {
+                put(cmd.key, result.value);
+            }
+            break;
+        case KvOp::DELETE:
+            if (result.status == KvStatus::OK) {
+                del(cmd.key);
+            }
+            break;
+        case KvOp::BATCH:
+        case KvOp::EXPIRE:
+            if (result.status != KvStatus::OK) {
+                break;
+            }
+            for (size_t i = 0; i < cmd.ops.size() && i < result.statuses.size(); ++i) {
+                const auto& op = cmd.ops[i];
+                if (cmd.op == KvOp::EXPIRE || op.op == KvOp::DELETE) {
+                    if (result.statuses[i] == KvStatus::OK) {
+                        del(op.key);
+                    }
+                } else if (op.op == KvOp::PUT) {
+                    put(op.key, op.value);
+                } else if (op.op == KvOp::APPEND) {
+                    appended(op.key);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+std::vector<KvTtl> KvStateMachine::PopExpired(uint64_t now_ms, size_t limit) {
+    return ttl_.PopExpired(now_ms, limit);
+}
+
+void KvStateMachine::RequeueExpired(const std::vector<KvTtl>& entries) {
+    ttl_.Requeue(entries);
+}
+
+std::vector<KvTtl> KvStateMachine::TtlEntries() {
+    return ttl_.Entries();
+}
+
+// ============================================================================
+// 读取
+// ============================================================================
+
+KvResult KvStateMachine::Get(const std::string& key) {
+    KvResult result;
+    if (!engine_->Get(key, result.value) || ttl_.Expired(key, NowUnixMs())) {
+        result.value.clear();
+        result.status = KvStatus::NO_KEY;
+    }
+    return result;
+}
+
+std::vector<KvResult> KvStateMachine::MultiGet(const std::vector<std::string>& keys) {
+    auto results = engine_->MultiGet(keys);
+    if (ttl_.Size() > 0) {
+        uint64_t now_ms = NowUnixMs();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (results[i].status == KvStatus::OK && ttl_.Expired(keys[i], now_ms)) {
+                results[i].status = KvStatus::NO_KEY;
+                results[i].value.clear();
+            }
+        }
+    }
+    return results;
+}
+
+KvResult KvStateMachine::GetAt(const std::string& key, uint64_t index) {
+    KvResult result;
+    auto view = NewReadView(index);
+    if (!view) {
+        result.status = KvStatus::INVALID_ARGUMENT;
+        return result;
+    }
+    if (!view->Get(key, result.value)) {
+        result.status = KvStatus::NO_KEY;
+    }
+    return result;
+}
+
+ReadViewPtr KvStateMachine::NewReadView(uint64_t index) {
+    uint64_t applied = LastApplied();
+    if (index == 0) {
+        index = applied;
+    }
+    if (index > applied) {
+        return nullptr;
+    }
+    return engine_->NewReadView(index);
+}
+
+std::vector<KvPair> KvStateMachine::Scan(const std::string& start, const std::string& end, size_t limit) {
+    // 跳过保留key区间，按key升序排列
+    static const std::pair<std::string, std::string> reserved[] = {
+        {std::string(kStateKeyPrefix), PrefixEnd(std::string(kStateKeyPrefix))},
+        {std::string(kTxnKeyPrefix), PrefixEnd(std::string(kTxnKeyPrefix))},
+    };
+    std::vector<KvPair> pairs;
+    auto scan = [&](const std::string& from, const std::string& to) {
+        auto part = engine_->Scan(from, to, limit == 0 ? 0 : limit - pairs.size());
+        if (pairs.empty()) {
+            pairs = std::move(part);
+        } else {
+            pairs.insert(pairs.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+        }
+        return limit == 0 || pairs.size() < limit;
+    };
+    std::string from = start;
+    for (const auto& [reserved_begin, reserved_end] : reserved) {
+        if (!end.empty() && end <= reserved_begin) {
+            break;
+        }
+        if (from >= reserved_end) {
+            continue;
+        }
+        if (from < reserved_begin && !scan(from, reserved_begin)) {
+            return pairs;
+        }
+        from = reserved_end;
+    }
+    if (end.empty() || from < end) {
+        scan(from, end);
+    }
+    return pairs;
+}
+
+namespace {
+
+// ============================================================================
+// 快照格式
+// ============================================================================
+// 未压缩：Encoder编码的 [index, pairs, ttls, sessions]（JSON数组，以'['开头）
+// 压缩：  [8字节magic][u64 index][u32 len][字典][u32 len][Encoder编码的ttls, sessions]
+//         若干个 [u32 len][u8 类型][数据块]，最后是前面全部内容的u32 CRC32。
+//         数据块解压后为连续的 [u32 key_len][u32 value_len][key][value]
+
+constexpr char kCompressedSnapshotMagic[8] = {'T', 'K', 'V', 'S', 'N', 'P', 'Z', '1'};
+constexpr char kSnapshotBlockRaw = 0;
+constexpr char kSnapshotBlockCompressed = 1;
+
+void putU32(std::vector<uint8_t>& dst, uint32_t v) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&v);
+    dst.insert(dst.end(), p, p + sizeof(v));
+}
+
+void putU64(std::vector<uint8_t>& dst, uint64_t v) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&v);
+    dst.insert(dst.end(), p, p + sizeof(v));
+}
+
+void putBytes(std::vector<uint8_t>& dst, std::string_view bytes) {
+    putU32(dst, static_cast<uint32_t>(bytes.size()));
+    dst.insert(dst.end(), bytes.begin(), bytes.end());
+}
+
+// 顺序读取压缩快照，越界返回false
+class SnapshotReader {
+public:
+    explicit SnapshotReader(std::string_view data) : data_(data) {}
+
+    bool U32(uint32_t& v) { return Raw(&v, sizeof(v)); }
+    bool U64(uint64_t& v) { return Raw(&v, sizeof(v)); }
+
+    bool Take(size_t size, std::string_view& out) {
+        if (size > data_.size() - pos_) {
+            return false;
+        }
+        out = data_.substr(pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    // 带u32长度前缀的字节串
+    bool Bytes(std::string_view& out) {
+        uint32_t len = 0;
+        return U32(len) && Take(len, out);
+    }
+
+    bool Done() const { return pos_ == data_.size(); }
+
+private:
+    bool Raw(void* out, size_t size) {
+        if (size > data_.size() - pos_) {
+            return false;
+        }
+        std::memcpy(out, data_.data() + pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+std::string encodeExtras(const SnapshotExtras& extras) {
+    auto encoder = rpc::Encoder::New();
+    encoder->Encode(extras.ttls);
+    encoder->Encode(extras.sessions);
+    return encoder->Bytes();
+}
+
+std::vector<uint8_t> encodeSnapshot(uint64_t index, const std::vector<KvPair>& pairs, const SnapshotExtras& extras) {
+    auto encoder = rpc::Encoder::New();
+    encoder->Encode(index);
+    encoder->Encode(pairs);
+    encoder->Encode(extras.ttls);
+    encoder->Encode(extras.sessions);
+    std::string bytes = encoder->Bytes();
+    return std::vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+// 追加一个数据块：压缩后没有变小（或dict为nullptr且不压缩）时原样保存
+void appendBlock(std::vector<uint8_t>& out, const std::string& block, const CompressionDict* dict, bool compress) {
+    std::string compressed = compress ? Compress(block, dict) : std::string();
+    bool use_compressed = compress && compressed.size() < block.size();
+    const std::string& payload = use_compressed ? compressed : block;
+    putU32(out, static_cast<uint32_t>(payload.size() + 1));
+    out.push_back(static_cast<uint8_t>(use_compressed ? kSnapshotBlockCompressed : kSnapshotBlockRaw));
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+void appendEntry(std::string& block, const std::string& key, const std::string& value) {
+    uint32_t sizes[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+    block.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    block.append(key);
+    block.append(value);
+}
+
+std::vector<uint8_t> encodeCompressedSnapshot(uint64_t index, const std::vector<KvPair>& pairs,
+                                              const SnapshotExtras& extras, const SnapshotOptions& options) {
+    std::vector<std::string> samples;
+    size_t sample_bytes = 0;
+    for (const auto& pair : pairs) {
+        if (sample_bytes >= options.dict_sample_bytes) {
+            break;
+        }
+        if (!pair.value.empty()) {
+            samples.push_back(pair.value);
+            sample_bytes += pair.value.size();
+        }
+    }
+    auto dict = TrainDictionary(samples, options.dict_bytes);
+
+    std::vector<uint8_t> out(std::begin(kCompressedSnapshotMagic), std::end(kCompressedSnapshotMagic));
+    putU64(out, index);
+    putBytes(out, dict ? std::string_view(dict->Content()) : std::string_view());
+    putBytes(out, encodeExtras(extras));
+
+    std::string block;
+    for (const auto& pair : pairs) {
+        appendEntry(block, pair.key, pair.value);
+        if (block.size() >= options.block_bytes) {
+            appendBlock(out, block, dict.get(), true);
+            block.clear();
+        }
+    }
+    if (!block.empty()) {
+        appendBlock(out, block, dict.get(), true);
+    }
+    putU32(out, Crc32(reinterpret_cast<const char*>(out.data()), out.size()));
+    return out;
+}
+
+bool decodeExtras(const std::string& data, SnapshotExtras& extras) {
+    auto decoder = rpc::Decoder::New(data);
+    return decoder->Decode(extras.ttls) && decoder->Decode(extras.sessions);
+}
+
+// 快照解码时逐个回调键值对，回调返回false时停止解码
+using SnapshotVisitor = std::function<bool(std::string_view key, std::string_view value)>;
+
+bool decodeCompressedSnapshot(std::string_view data, uint64_t& index, SnapshotExtras& extras,
+                              const SnapshotVisitor& visit) {
+    if (data.size() < sizeof(kCompressedSnapshotMagic) + 4) {
+        return false;
+    }
+    uint32_t expected;
+    std::memcpy(&expected, data.data() + data.size() - 4, sizeof(expected));
+    data.remove_suffix(4);
+    if (Crc32(data.data(), data.size()) != expected) {
+        return false;
+    }
+
+    SnapshotReader reader(data.substr(sizeof(kCompressedSnapshotMagic)));
+    std::string_view dict_bytes;
+    std::string_view extras_bytes;
+    if (!reader.U64(index) || !reader.Bytes(dict_bytes) || !reader.Bytes(extras_bytes) ||
+        !decodeExtras(std::string(extras_bytes), extras)) {
+        return false;
+    }
+    std::unique_ptr<CompressionDict> dict;
+    if (!dict_bytes.empty()) {
+        dict = std::make_unique<CompressionDict>(std::string(dict_bytes));
+    }
+
+    std::string raw;
+    while (!reader.Done()) {
+        std::string_view block;
+        if (!reader.Bytes(block) || block.empty()) {
+            return false;
+        }
+        if (block[0] == kSnapshotBlockCompressed) {
+            if (!Decompress(block.substr(1), dict.get(), raw)) {
+                return false;
+            }
+        } else if (block[0] == kSnapshotBlockRaw) {
+            raw.assign(block.substr(1));
+        } else {
+            return false;
+        }
+        SnapshotReader entries(raw);
+        while (!entries.Done()) {
+            uint32_t key_size = 0;
+            uint32_t value_size = 0;
+            std::string_view key;
+            std::string_view value;
+            if (!entries.U32(key_size) || !entries.U32(value_size) || !entries.Take(key_size, key) ||
+                !entries.Take(value_size, value) || !visit(key, value)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool isCompressedSnapshot(std::string_view data) {
+    return data.size() >= sizeof(kCompressedSnapshotMagic) &&
+           std::memcmp(data.data(), kCompressedSnapshotMagic, sizeof(kCompressedSnapshotMagic)) == 0;
+}
+
+// 只读出快照的index，不解码数据；压缩格式先校验CRC，避免按损坏的index跳过恢复
+bool peekSnapshotIndex(std::string_view data, uint64_t& index) {
+    if (!isCompressedSnapshot(data)) {
+        return rpc::Decoder::New(std::string(data))->Decode(index);
+    }
+    if (data.size() < sizeof(kCompressedSnapshotMagic) + sizeof(uint64_t) + 4) {
+        return false;
+    }
+    uint32_t expected;
+    std::memcpy(&expected, data.data() + data.size() - 4, sizeof(expected));
+    if (Crc32(data.data(), data.size() - 4) != expected) {
+        return false;
+    }
+    std::memcpy(&index, data.data() + sizeof(kCompressedSnapshotMagic), sizeof(index));
+    return true;
+}
+
+bool decodeSnapshot(std::string_view data, uint64_t& index, SnapshotExtras& extras, const SnapshotVisitor& visit) {
+    if (isCompressedSnapshot(data)) {
+        return decodeCompressedSnapshot(data, index, extras, visit);
+    }
+    std::vector<KvPair> pairs;
+    auto decoder = rpc::Decoder::New(std::string(data));
+    if (!decoder->Decode(index) || !decoder->Decode(pairs)) {
+        return false;
+    }
+    // 旧格式快照没有TTL和会话表字段
+    if (decoder->HasMore() && !decoder->Decode(extras.ttls)) {
+        return false;
+    }
+    if (decoder->HasMore() && !decoder->Decode(extras.sessions)) {
+        return false;
+    }
+    for (const auto& pair : pairs) {
+        if (!visit(pair.key, pair.value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// SnapshotFileWriter - 持久化引擎安装快照时把键值对写成SST文件
+// ============================================================================
+// 每攒够target_bytes排序后写一个文件，内存中最多保留一个文件的数据。LSM引擎生成的
+// 快照本身有序，文件互不重叠；其它引擎生成的快照无序，文件之间会重叠但没有同名key。
+// 析构时删除写出的文件：Install已把它们链接（或复制）进引擎的数据目录
+class SnapshotFileWriter {
+public:
+    SnapshotFileWriter(std::string dir, uint64_t index, uint64_t target_bytes, SstOptions options) :
+        dir_(std::move(dir)), index_(index), target_bytes_(target_bytes), options_(options) {}
+
+    ~SnapshotFileWriter() {
+        for (const auto& path : paths_) {
+            ::unlink(path.c_str());
+        }
+    }
+
+    SnapshotFileWriter(const SnapshotFileWriter&) = delete;
+    SnapshotFileWriter& operator=(const SnapshotFileWriter&) = delete;
+
+    bool Add(std::string_view key, std::string_view value) {
+        bytes_ += key.size() + value.size();
+        entries_.emplace_back(std::string(key), std::string(value));
+        return bytes_ < target_bytes_ || flush();
+    }
+
+    bool Finish() { return entries_.empty() || flush(); }
+
+    const std::vector<std::string>& Paths() const { return paths_; }
+
+private:
+    bool flush() {
+        auto less = [](const auto& a, const auto& b) { return a.first < b.first; };
+        if (!std::is_sorted(entries_.begin(), entries_.end(), less)) {
+            std::sort(entries_.begin(), entries_.end(), less);
+        }
+        std::error_code ec;
+        fs::create_directories(dir_, ec);
+        std::string name = "snapshot-" + std::to_string(index_) + "-" + std::to_string(paths_.size()) + ".sst";
+        SstBuilder builder((fs::path(dir_) / name).string(), options_);
+        if (!builder.Open()) {
+            return false;
+        }
+        for (const auto& [key, value] : entries_) {
+            if (!builder.Add(key, value, false)) {
+                return false;
+            }
+        }
+        if (!builder.Finish()) {
+            return false;
+        }
+        paths_.push_back(builder.Path());
+        entries_.clear();
+        bytes_ = 0;
+        return true;
+    }
+
+    std::string dir_;
+    uint64_t index_;
+    uint64_t target_bytes_;
+    SstOptions options_;
+    std::vector<std::pair<std::string, std::string>> entries_;
+    uint64_t bytes_ = 0;
+    std::vector<std::string> paths_;
+};
+
+} // namespace
+
+std::vector<uint8_t> KvStateMachine::TakeSnapshot() {
+    if (auto view = NewReadView()) {
+        return EncodeSnapshot(*view, CaptureExtras(), snapshot_options_);
+    }
+
+    std::vector<KvPair> pairs;
+    pairs.reserve(engine_->Size());
+    engine_->ForEach([&pairs](const std::string& key, const std::string& value) {
+        if (!IsStateKey(key)) {
+            pairs.push_back(KvPair{key, value});
+        }
+    });
+    if (snapshot_options_.compression) {
+        return encodeCompressedSnapshot(LastApplied(), pairs, CaptureExtras(), snapshot_options_);
+    }
+    return encodeSnapshot(LastApplied(), pairs, CaptureExtras());
+}
+
+SnapshotExtras KvStateMachine::CaptureExtras() {
+    SnapshotExtras extras;
+    extras.ttls = TtlEntries();
+    extras.sessions = sessions_.Entries();
+    return extras;
+}
+
+std::vector<uint8_t> KvStateMachine::EncodeSnapshot(ReadView& view, const SnapshotExtras& extras,
+                                                    const SnapshotOptions& options) {
+    std::vector<KvPair> pairs;
+    view.ForEach([&pairs](const std::string& key, const std::string& value) {
+        if (!IsStateKey(key)) {
+            pairs.push_back(KvPair{key, value});
+        }
+    });
+    if (options.compression) {
+        return encodeCompressedSnapshot(view.Index(), pairs, extras, options);
+    }
+    return encodeSnapshot(view.Index(), pairs, extras);
+}
+
+// ============================================================================
+// SnapshotStream
+// ============================================================================
+
+struct SnapshotStream::State {
+    ReadViewPtr view;
+    SnapshotExtras extras;
+    SnapshotOptions options;
+    fiber::Channel<std::string>::ptr chan = fiber::make_channel<std::string>(1);
+};
+
+SnapshotStream::SnapshotStream(ReadViewPtr view, SnapshotExtras extras, SnapshotOptions options) :
+    state_(std::make_shared<State>()), index_(view->Index()) {
+    state_->view = std::move(view);
+    state_->extras = std::move(extras);
+    state_->options = options;
+}
+
+SnapshotStream::~SnapshotStream() {
+    // 编码fiber的下一次发送失败，之后只空转完剩下的遍历
+    state_->chan->close();
+}
+
+bool SnapshotStream::Next(std::string& chunk) {
+    if (!started_) {
+        started_ = true;
+        fiber::Fiber::go([state = state_]() {
+            const auto& options = state->options;
+            std::vector<uint8_t> out(std::begin(kCompressedSnapshotMagic), std::end(kCompressedSnapshotMagic));
+            uint32_t crc = 0;
+            bool open = true;
+            auto emit = [&]() {
+                crc = Crc32(reinterpret_cast<const char*>(out.data()), out.size(), crc);
+                open = open && state->chan->send(std::string(out.begin(), out.end()));
+                out.clear();
+            };
+
+            // 字典只用视图开头的样本训练
+            CompressionDictPtr dict;
+            if (options.compression) {
+                std::vector<std::string> samples;
+                size_t sample_bytes = 0;
+                state->view->ForEach([&](const std::string&, const std::string& value) {
+                    if (sample_bytes < options.dict_sample_bytes && !value.empty()) {
+                        samples.push_back(value);
+                        sample_bytes += value.size();
+                    }
+                });
+                dict = TrainDictionary(samples, options.dict_bytes);
+            }
+            putU64(out, state->view->Index());
+            putBytes(out, dict ? std::string_view(dict->Content()) : std::string_view());
+            putBytes(out, encodeExtras(state->extras));
+            emit();
+
+            std::string block;
+            state->view->ForEach([&](const std::string& key, const std::string& value) {
+                if (!open || IsStateKey(key)) {
+                    return;
+                }
+                appendEntry(block, key, value);
+                if (block.size() >= options.block_bytes) {
+                    appendBlock(out, block, dict.get(), options.compression);
+                    block.clear();
+                    emit();
+                }
+            });
+            if (open && !block.empty()) {
+                appendBlock(out, block, dict.get(), options.compression);
+                emit();
+            }
+            if (open) {
+                putU32(out, crc);
+                state->chan->send(std::string(out.begin(), out.end()));
+            }
+            state->chan->close();
+            state->view.reset();
+        });
+    }
+    return state_->chan->recv(chunk);
+}
+
+bool KvStateMachine::RestoreSnapshot(const std::vector<uint8_t>& snapshot) {
+    if (snapshot.empty()) {
+        return true;
+    }
+
+    std::string_view data(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+    uint64_t snapshot_index = 0;
+    if (!peekSnapshotIndex(data, snapshot_index)) {
+        LOG_ERROR("KvStateMachine: failed to decode snapshot ({} bytes)", snapshot.size());
+        return false;
+    }
+    // 引擎中已有快照的全部数据，TTL和会话表也已在打开时从保留key恢复
+    if (engine_->Persistent() && engine_->DurableIndex() >= snapshot_index) {
+        LOG_INFO("KvStateMachine: skipped snapshot at index {}, engine is durable at {}", snapshot_index,
+                 engine_->DurableIndex());
+        return true;
+    }
+
+    uint64_t last_applied = 0;
+    SnapshotExtras extras;
+    size_t keys = 0;
+    if (engine_->Persistent()) {
+        // 写好全部文件后才替换引擎数据；保留key一起写进文件，安装完成即持久化
+        std::string dir = ingest_options_.dir.empty() ? fs::temp_directory_path().string() : ingest_options_.dir;
+        SnapshotFileWriter writer(dir, snapshot_index, ingest_options_.target_file_bytes, ingest_options_.sst);
+        bool ok = decodeSnapshot(data, last_applied, extras, [&](std::string_view key, std::string_view value) {
+            if (IsStateKey(key)) {
+                return true;
+            }
+            ++keys;
+            return writer.Add(key, value);
+        });
+        for (const auto& ttl : extras.ttls) {
+            ok = ok && writer.Add(TtlStateKey(ttl.key), encodeDeadline(ttl.expire_at_ms));
+        }
+        for (const auto& entry : extras.sessions) {
+            ok = ok && writer.Add(SessionStateKey(entry.client_id), encodeSession(entry));
+        }
+        if (!ok || !writer.Finish()) {
+            LOG_ERROR("KvStateMachine: failed to decode snapshot at index {} into files", snapshot_index);
+            return false;
+        }
+        if (!engine_->Install(last_applied, writer.Paths())) {
+            LOG_ERROR("KvStateMachine: failed to install snapshot at index {}", last_applied);
+            return false;
+        }
+    } else {
+        std::vector<KvPair> pairs;
+        bool ok = decodeSnapshot(data, last_applied, extras, [&pairs](std::string_view key, std::string_view value) {
+            pairs.push_back(KvPair{std::string(key), std::string(value)});
+            return true;
+        });
+        if (!ok) {
+            LOG_ERROR("KvStateMachine: failed to decode snapshot ({} bytes)", snapshot.size());
+            return false;
+        }
+        engine_->Clear();
+        for (const auto& pair : pairs) {
+            if (!IsStateKey(pair.key)) {
+                engine_->Put(last_applied, pair.key, pair.value);
+                ++keys;
+            }
+        }
+    }
+
+    ttl_.Clear();
+    for (const auto& ttl : extras.ttls) {
+        ttl_.Set(ttl.key, ttl.expire_at_ms);
+    }
+    sessions_.Restore(extras.sessions);
+    recountIntents();
+    watch_->Reset(last_applied);
+    last_applied_.store(last_applied, std::memory_order_release);
+    LOG_INFO("KvStateMachine: restored snapshot at index {} ({} keys, {} sessions)", last_applied, keys,
+             extras.sessions.size());
+    return true;
+}
+
+} // namespace kv
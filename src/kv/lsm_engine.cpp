@@ -0,0 +1,1154 @@
+#include "include/lsm_engine.h"
+#include "include/bloom_filter.h"
+#include "fiber.h"
+#include "logger.h"
+#include "encoder.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kv {
+
+namespace fs = std::filesystem;
+
+// ============================================================================
+// MANIFEST：记录每层的文件编号和已flush的index，整体重写后rename替换
+// ============================================================================
+
+namespace {
+
+constexpr const char* kManifestName = "MANIFEST";
+constexpr size_t kMemEntryOverhead = 32;    // map节点等额外开销的估计
+
+struct ManifestFile {
+    uint64_t number = 0;
+    int level = 0;
+};
+
+struct Manifest {
+    uint64_t next_file_number = 1;
+    uint64_t flushed_index = 0;
+    std::vector<ManifestFile> files;
+};
+
+bool overlaps(const SstReaderPtr& file, const std::string& smallest, const std::string& largest) {
+    return !(file->Largest() < smallest || file->Smallest() > largest);
+}
+
+void keyRange(const std::vector<SstReaderPtr>& files, std::string& smallest, std::string& largest) {
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (i == 0 || files[i]->Smallest() < smallest) {
+            smallest = files[i]->Smallest();
+        }
+        if (i == 0 || files[i]->Largest() > largest) {
+            largest = files[i]->Largest();
+        }
+    }
+}
+
+uint64_t totalBytes(const std::vector<SstReaderPtr>& files) {
+    uint64_t total = 0;
+    for (const auto& file : files) {
+        total += file->FileSize();
+    }
+    return total;
+}
+
+// level >= 1 中第一个 largest >= key 的文件
+size_t findFile(const std::vector<SstReaderPtr>& files, const std::string& key) {
+    auto it = std::lower_bound(files.begin(), files.end(), key,
+                               [](const SstReaderPtr& file, const std::string& k) {
+                                   return file->Largest() < k;
+                               });
+    return it - files.begin();
+}
+
+// 文件读取失败或损坏时无法给出正确的读结果：当作key不存在或读到更老的版本，都会让
+// 本副本与其他副本的状态悄悄分叉。读接口没有错误返回值，只能停止进程，由快照重建
+[[noreturn]] void abortOnCorruption(const char* operation) {
+    LOG_ERROR("LsmEngine: {} hit an unreadable or corrupted table, aborting", operation);
+    std::abort();
+}
+
+} // namespace
+
+// ============================================================================
+// 迭代器
+// ============================================================================
+
+namespace {
+
+// 遍历只读memtable
+template<typename MemTablePtr>
+class MemTableIterator : public EntryIterator {
+public:
+    explicit MemTableIterator(MemTablePtr mem) : mem_(std::move(mem)), it_(mem_->entries.end()) {}
+
+    bool Valid() const override { return it_ != mem_->entries.end(); }
+    void SeekToFirst() override { it_ = mem_->entries.begin(); }
+    void Seek(const std::string& target) override { it_ = mem_->entries.lower_bound(target); }
+    void Next() override { ++it_; }
+
+    const std::string& key() const override { return it_->first; }
+    const std::string& value() const override { return it_->second.value; }
+    bool deleted() const override { return it_->second.deleted; }
+
+private:
+    MemTablePtr mem_;
+    decltype(mem_->entries.cbegin()) it_;
+};
+
+// 依次遍历一层中按key有序、互不重叠的文件
+class LevelIterator : public EntryIterator {
+public:
+    explicit LevelIterator(std::vector<SstReaderPtr> files) : files_(std::move(files)), index_(0) {}
+
+    bool Valid() const override { return current_ && current_->Valid(); }
+    bool status() const override { return !current_ || current_->status(); }
+
+    void SeekToFirst() override {
+        open(0);
+        if (current_) {
+            current_->SeekToFirst();
+        }
+        skipEmptyFiles();
+    }
+
+    void Seek(const std::string& target) override {
+        open(findFile(files_, target));
+        if (current_) {
+            current_->Seek(target);
+        }
+        skipEmptyFiles();
+    }
+
+    void Next() override {
+        current_->Next();
+        skipEmptyFiles();
+    }
+
+    const std::string& key() const override { return current_->key(); }
+    const std::string& value() const override { return current_->value(); }
+    bool deleted() const override { return current_->deleted(); }
+
+private:
+    void open(size_t index) {
+        index_ = index;
+        current_ = index < files_.size() ? files_[index]->NewIterator() : nullptr;
+    }
+
+    // 出错的文件不跳过，status()随之为false
+    void skipEmptyFiles() {
+        while (current_ && !current_->Valid() && current_->status()) {
+            open(index_ + 1);
+            if (current_) {
+                current_->SeekToFirst();
+            }
+        }
+    }
+
+    std::vector<SstReaderPtr> files_;
+    size_t index_;
+    EntryIteratorPtr current_;
+};
+
+// 多路归并：children按从新到旧排列，同名key只输出最新的一条
+// 子迭代器数量是层数加memtable数，线性选取最小key即可
+class MergingIterator : public EntryIterator {
+public:
+    explicit MergingIterator(std::vector<EntryIteratorPtr> children) :
+        children_(std::move(children)), current_(nullptr) {}
+
+    bool Valid() const override { return current_ != nullptr; }
+
+    bool status() const override {
+        return std::all_of(children_.begin(), children_.end(),
+                           [](const EntryIteratorPtr& child) { return child->status(); });
+    }
+
+    void SeekToFirst() override {
+        for (auto& child : children_) {
+            child->SeekToFirst();
+        }
+        findSmallest();
+    }
+
+    void Seek(const std::string& target) override {
+        for (auto& child : children_) {
+            child->Seek(target);
+        }
+        findSmallest();
+    }
+
+    void Next() override {
+        // 跳过所有子迭代器中与当前key相同的旧条目
+        std::string key = current_->key();
+        for (auto& child : children_) {
+            while (child->Valid() && child->key() == key) {
+                child->Next();
+            }
+        }
+        findSmallest();
+    }
+
+    const std::string& key() const override { return current_->key(); }
+    const std::string& value() const override { return current_->value(); }
+    bool deleted() const override { return current_->deleted(); }
+
+private:
+    // 任一子迭代器出错时停止：缺了它的条目，归并结果不再正确
+    void findSmallest() {
+        current_ = nullptr;
+        if (!status()) {
+            return;
+        }
+        for (auto& child : children_) {
+            // 严格小于：相同key时保留排在前面（更新）的子迭代器
+            if (child->Valid() && (current_ == nullptr || child->key() < current_->key())) {
+                current_ = child.get();
+            }
+        }
+    }
+
+    std::vector<EntryIteratorPtr> children_;
+    EntryIterator* current_;
+};
+
+} // namespace
+
+EntryIteratorPtr LsmEngine::newMergingIterator(const MemTablePtr& mem, const TablesPtr& tables) {
+    std::vector<EntryIteratorPtr> children;
+    if (mem) {
+        children.push_back(std::make_unique<MemTableIterator<MemTablePtr>>(mem));
+    }
+    for (auto it = tables->immutables.rbegin(); it != tables->immutables.rend(); ++it) {
+        children.push_back(std::make_unique<MemTableIterator<MemTablePtr>>(*it));
+    }
+    const auto& level0 = tables->levels[0];
+    for (auto it = level0.rbegin(); it != level0.rend(); ++it) {
+        children.push_back((*it)->NewIterator());
+    }
+    for (size_t level = 1; level < tables->levels.size(); ++level) {
+        if (!tables->levels[level].empty()) {
+            children.push_back(std::make_unique<LevelIterator>(tables->levels[level]));
+        }
+    }
+    return std::make_unique<MergingIterator>(std::move(children));
+}
+
+std::vector<KvPair> LsmEngine::scanIterator(EntryIterator& it, const std::string& start, const std::string& end,
+                                            size_t limit) {
+    std::vector<KvPair> pairs;
+    for (it.Seek(start); it.Valid(); it.Next()) {
+        if (!end.empty() && it.key() >= end) {
+            break;
+        }
+        if (it.deleted()) {
+            continue;
+        }
+        pairs.push_back(KvPair{it.key(), it.value()});
+        if (limit > 0 && pairs.size() >= limit) {
+            break;
+        }
+    }
+    if (!it.status()) {
+        abortOnCorruption("scan");
+    }
+    return pairs;
+}
+
+// ============================================================================
+// 打开与恢复
+// ============================================================================
+
+LsmEngine::LsmEngine(LsmOptions options) :
+    options_(std::move(options)),
+    mem_(std::make_shared<MemTable>()),
+    busy_levels_(options_.num_levels, false),
+    compact_pointer_(options_.num_levels) {
+    auto tables = std::make_shared<Tables>();
+    tables->levels.resize(options_.num_levels);
+    tables_ = std::move(tables);
+}
+
+std::shared_ptr<LsmEngine> LsmEngine::Open(LsmOptions options) {
+    if (options.num_levels < 2) {
+        options.num_levels = 2;
+    }
+    if (options.background_threads < 1) {
+        options.background_threads = 1;
+    }
+    std::error_code ec;
+    fs::create_directories(options.dir, ec);
+    if (ec) {
+        LOG_ERROR("LsmEngine: failed to create {}: {}", options.dir, ec.message());
+        return nullptr;
+    }
+
+    std::shared_ptr<LsmEngine> engine(new LsmEngine(std::move(options)));
+    if (!engine->recover()) {
+        return nullptr;
+    }
+    engine->start();
+    return engine;
+}
+
+std::string LsmEngine::tablePath(uint64_t number) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%06llu.sst", static_cast<unsigned long long>(number));
+    return (fs::path(options_.dir) / name).string();
+}
+
+bool LsmEngine::recover() {
+    fs::path manifest_path = fs::path(options_.dir) / kManifestName;
+    Manifest manifest;
+    if (fs::exists(manifest_path)) {
+        std::ifstream in(manifest_path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        auto decoder = rpc::Decoder::New(bytes);
+        if (!decoder->Decode(manifest)) {
+            LOG_ERROR("LsmEngine: failed to decode {}", manifest_path.string());
+            return false;
+        }
+    }
+
+    auto tables = std::make_shared<Tables>();
+    tables->levels.resize(options_.num_levels);
+    std::set<uint64_t> live;
+    for (const auto& file : manifest.files) {
+        if (file.level < 0 || file.level >= options_.num_levels) {
+            LOG_ERROR("LsmEngine: file {} has invalid level {}", file.number, file.level);
+            return false;
+        }
+        auto reader = SstReader::Open(tablePath(file.number), file.number);
+        if (!reader) {
+            return false;
+        }
+        tables->levels[file.level].push_back(std::move(reader));
+        live.insert(file.number);
+    }
+    std::sort(tables->levels[0].begin(), tables->levels[0].end(), [](const auto& a, const auto& b) {
+        return a->Number() < b->Number();
+    });
+    for (int level = 1; level < options_.num_levels; ++level) {
+        std::sort(tables->levels[level].begin(), tables->levels[level].end(), [](const auto& a, const auto& b) {
+            return a->Smallest() < b->Smallest();
+        });
+    }
+
+    // 删除不在MANIFEST中的文件（flush或compaction中途崩溃留下的）
+    for (const auto& entry : fs::directory_iterator(options_.dir)) {
+        const auto& path = entry.path();
+        if (path.extension() != ".sst") {
+            continue;
+        }
+        uint64_t number = std::strtoull(path.stem().string().c_str(), nullptr, 10);
+        if (live.count(number) == 0) {
+            LOG_INFO("LsmEngine: removing orphan table {}", path.string());
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+    }
+
+    next_file_number_ = manifest.next_file_number;
+    flushed_index_ = manifest.flushed_index;
+    written_index_ = flushed_index_;
+    tables_ = std::move(tables);
+    LOG_INFO("LsmEngine: opened {} ({} tables, durable index {})", options_.dir, live.size(), flushed_index_);
+    return true;
+}
+
+bool LsmEngine::writeManifest() {
+    Manifest manifest;
+    manifest.next_file_number = next_file_number_;
+    manifest.flushed_index = flushed_index_;
+    for (int level = 0; level < options_.num_levels; ++level) {
+        for (const auto& file : tables_->levels[level]) {
+            manifest.files.push_back(ManifestFile{file->Number(), level});
+        }
+    }
+    auto encoder = rpc::Encoder::New();
+    encoder->Encode(manifest);
+    std::string bytes = encoder->Bytes();
+
+    // 写临时文件、fsync后rename，保证MANIFEST要么是旧的要么是新的
+    fs::path path = fs::path(options_.dir) / kManifestName;
+    std::string tmp = path.string() + ".tmp";
+    int fd = ::open(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        LOG_ERROR("LsmEngine: failed to create {}: {}", tmp, strerror(errno));
+        return false;
+    }
+    bool ok = ::write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("LsmEngine: failed to write {}: {}", path.string(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void LsmEngine::start() {
+    for (int i = 0; i < options_.background_threads; ++i) {
+        threads_.emplace_back([this]() { backgroundLoop(); });
+    }
+}
+
+LsmEngine::~LsmEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+// ============================================================================
+// 写入
+// ============================================================================
+
+void LsmEngine::throttle() {
+    // 待flush的memtable过多时限流，让出调度线程等待后台flush
+    while (immutable_count_.load(std::memory_order_acquire) >= options_.max_immutable_memtables) {
+        fiber::Fiber::sleep(1);
+    }
+}
+
+void LsmEngine::insertLocked(uint64_t index, const std::string& key, MemEntry entry) {
+    size_t bytes = key.size() + entry.value.size() + kMemEntryOverhead;
+    auto [it, inserted] = mem_->entries.try_emplace(key);
+    if (!inserted) {
+        mem_->bytes -= std::min(mem_->bytes, key.size() + it->second.value.size() + kMemEntryOverhead);
+    }
+    it->second = std::move(entry);
+    mem_->bytes += bytes;
+    mem_->max_index = std::max(mem_->max_index, index);
+    written_index_ = std::max(written_index_, index);
+}
+
+void LsmEngine::write(uint64_t index, const std::string& key, MemEntry entry) {
+    throttle();
+    std::lock_guard<std::mutex> lock(mu_);
+    maybeRotateLocked(index);
+    insertLocked(index, key, std::move(entry));
+}
+
+void LsmEngine::maybeRotateLocked(uint64_t index) {
+    // 状态机在一条日志中可能多次写入，同一个index的写入留在同一个memtable中，
+    // 否则flush了前一部分后DurableIndex()已推进到index，重启时后一部分丢失
+    if (mem_->bytes >= options_.memtable_bytes && index > mem_->max_index) {
+        rotateMemTable();
+    }
+}
+
+void LsmEngine::rotateMemTable() {
+    if (mem_->entries.empty()) {
+        return;
+    }
+    auto tables = std::make_shared<Tables>(*tables_);
+    tables->immutables.push_back(std::move(mem_));
+    immutable_count_.store(tables->immutables.size(), std::memory_order_release);
+    tables_ = std::move(tables);
+    mem_ = std::make_shared<MemTable>();
+    cv_.notify_all();
+}
+
+void LsmEngine::Put(uint64_t index, const std::string& key, const std::string& value) {
+    write(index, key, MemEntry{value, false});
+}
+
+void LsmEngine::Append(uint64_t index, const std::string& key, const std::string& value) {
+    // 写入只来自apply循环，读-改-写之间不会有其他写者
+    std::string updated;
+    Get(key, updated);
+    updated.append(value);
+    write(index, key, MemEntry{std::move(updated), false});
+}
+
+bool LsmEngine::Delete(uint64_t index, const std::string& key) {
+    std::string value;
+    if (!Get(key, value)) {
+        return false;
+    }
+    write(index, key, MemEntry{std::string(), true});
+    return true;
+}
+
+void LsmEngine::Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) {
+    statuses.assign(batch.size(), KvStatus::OK);
+
+    // APPEND/DELETE依赖key的当前值，批次内前面的写入优先于引擎中的数据
+    std::unordered_map<std::string, MemEntry> updates;
+    auto current = [&](const std::string& key, std::string& value) {
+        auto it = updates.find(key);
+        if (it == updates.end()) {
+            return Get(key, value);
+        }
+        if (it->second.deleted) {
+            return false;
+        }
+        value = it->second.value;
+        return true;
+    };
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const auto& op = batch[i];
+        if (op.op == KvOp::PUT) {
+            updates[op.key] = MemEntry{op.value, false};
+        } else if (op.op == KvOp::APPEND) {
+            std::string updated;
+            current(op.key, updated);
+            updated.append(op.value);
+            updates[op.key] = MemEntry{std::move(updated), false};
+        } else if (op.op == KvOp::DELETE) {
+            std::string value;
+            if (!current(op.key, value)) {
+                statuses[i] = KvStatus::NO_KEY;
+                continue;
+            }
+            updates[op.key] = MemEntry{std::string(), true};
+        } else {
+            statuses[i] = KvStatus::INVALID_ARGUMENT;
+        }
+    }
+    if (updates.empty()) {
+        return;
+    }
+
+    throttle();
+    std::lock_guard<std::mutex> lock(mu_);
+    maybeRotateLocked(index);
+    for (auto& [key, entry] : updates) {
+        insertLocked(index, key, std::move(entry));
+    }
+}
+
+void LsmEngine::Clear() {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto tables = std::make_shared<Tables>();
+    tables->levels.resize(options_.num_levels);
+    resetLocked(std::move(tables), 0);
+}
+
+void LsmEngine::resetLocked(TablesPtr tables, uint64_t index) {
+    for (const auto& level : tables_->levels) {
+        for (const auto& file : level) {
+            file->MarkObsolete();
+        }
+    }
+    tables_ = std::move(tables);
+    mem_ = std::make_shared<MemTable>();
+    immutable_count_.store(0, std::memory_order_release);
+    written_index_ = index;
+    flushed_index_ = index;
+    compaction_stopped_ = false;
+    // 进行中的flush/compaction完成后发现epoch变化会丢弃结果
+    ++epoch_;
+    writeManifest();
+    cv_.notify_all();
+}
+
+// ============================================================================
+// 读取
+// ============================================================================
+
+bool LsmEngine::Get(const std::string& key, std::string& value) {
+    TablesPtr tables;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = mem_->entries.find(key);
+        if (it != mem_->entries.end()) {
+            if (it->second.deleted) {
+                return false;
+            }
+            value = it->second.value;
+            return true;
+        }
+        tables = tables_;
+    }
+
+    for (auto imm = tables->immutables.rbegin(); imm != tables->immutables.rend(); ++imm) {
+        auto it = (*imm)->entries.find(key);
+        if (it != (*imm)->entries.end()) {
+            if (it->second.deleted) {
+                return false;
+            }
+            value = it->second.value;
+            return true;
+        }
+    }
+
+    uint64_t hash = BloomFilter::HashKey(key);
+    auto probe = [&](const SstReaderPtr& file, bool& found) {
+        switch (file->Get(key, hash, value)) {
+            case SstReader::LookupResult::FOUND:
+                found = true;
+                return true;
+            case SstReader::LookupResult::DELETED:
+                found = false;
+                return true;
+            case SstReader::LookupResult::ERROR:
+                abortOnCorruption("get");
+            default:
+                return false;
+        }
+    };
+
+    bool found = false;
+    const auto& level0 = tables->levels[0];
+    for (auto file = level0.rbegin(); file != level0.rend(); ++file) {
+        if (probe(*file, found)) {
+            return found;
+        }
+    }
+    for (size_t level = 1; level < tables->levels.size(); ++level) {
+        const auto& files = tables->levels[level];
+        size_t i = findFile(files, key);
+        if (i < files.size() && files[i]->Smallest() <= key && probe(files[i], found)) {
+            return found;
+        }
+    }
+    return false;
+}
+
+std::vector<KvPair> LsmEngine::Scan(const std::string& start, const std::string& end, size_t limit) {
+    // 可变的memtable只复制扫描范围内的部分，大小受memtable_bytes限制
+    auto mem = std::make_shared<MemTable>();
+    TablesPtr tables;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto first = mem_->entries.lower_bound(start);
+        auto last = end.empty() ? mem_->entries.end() : mem_->entries.lower_bound(end);
+        mem->entries.insert(first, last);
+        tables = tables_;
+    }
+    auto it = newMergingIterator(mem, tables);
+    return scanIterator(*it, start, end, limit);
+}
+
+size_t LsmEngine::Size() {
+    std::lock_guard<std::mutex> lock(mu_);
+    size_t total = mem_->entries.size();
+    for (const auto& imm : tables_->immutables) {
+        total += imm->entries.size();
+    }
+    for (const auto& level : tables_->levels) {
+        for (const auto& file : level) {
+            total += file->NumEntries();
+        }
+    }
+    return total;
+}
+
+void LsmEngine::ForEach(const Visitor& visitor) {
+    auto view = NewReadView(0);
+    view->ForEach(visitor);
+}
+
+uint64_t LsmEngine::DurableIndex() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return flushed_index_;
+}
+
+// ============================================================================
+// 批量导入
+// ============================================================================
+
+bool LsmEngine::Ingest(uint64_t index, const std::vector<std::string>& paths) {
+    // memtable中的数据比导入的文件旧，却排在所有文件前面被读到，必须先落盘。
+    // 写入只来自apply循环，之后直到安装完成都不会有新的memtable；导入文件的编号
+    // 在flush之后分配，重启时level 0按编号排序仍然是正确的新旧顺序
+    Flush();
+
+    // 把文件全部链接进来并打开，任何一个失败都不改变引擎
+    std::vector<SstReaderPtr> files;
+    if (!linkFiles(paths, files)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto tables = std::make_shared<Tables>(*tables_);
+    auto overlapsLevel = [](const std::vector<SstReaderPtr>& level, const SstReaderPtr& file) {
+        return std::any_of(level.begin(), level.end(), [&file](const SstReaderPtr& other) {
+            return overlaps(other, file->Smallest(), file->Largest());
+        });
+    };
+    std::vector<int> placed;
+    for (auto& file : files) {
+        // 放在更深的层时，上面各层都不能有同名key；正在compaction的层的输出区间
+        // 无法预知，跳过
+        int target = 0;
+        if (!overlapsLevel(tables->levels[0], file)) {
+            for (int level = 1; level < options_.num_levels; ++level) {
+                if (overlapsLevel(tables->levels[level], file)) {
+                    break;
+                }
+                if (!busy_levels_[level]) {
+                    target = level;
+                }
+            }
+        }
+        auto& level = tables->levels[target];
+        level.push_back(file);
+        if (target > 0) {
+            std::sort(level.begin(), level.end(), [](const SstReaderPtr& a, const SstReaderPtr& b) {
+                return a->Smallest() < b->Smallest();
+            });
+        }
+        placed.push_back(target);
+    }
+    tables_ = std::move(tables);
+    // memtable已经为空，index之前的数据都已在SST中
+    written_index_ = std::max(written_index_, index);
+    flushed_index_ = std::max(flushed_index_, index);
+    writeManifest();
+    cv_.notify_all();
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        LOG_INFO("LsmEngine: ingested {} ({} entries) into level {}", files[i]->Path(), files[i]->NumEntries(),
+                 placed[i]);
+    }
+    return true;
+}
+
+bool LsmEngine::Install(uint64_t index, const std::vector<std::string>& paths) {
+    std::vector<SstReaderPtr> files;
+    if (!linkFiles(paths, files)) {
+        return false;
+    }
+    auto sorted = files;
+    std::sort(sorted.begin(), sorted.end(), [](const SstReaderPtr& a, const SstReaderPtr& b) {
+        return a->Smallest() < b->Smallest();
+    });
+    bool disjoint = true;
+    for (size_t i = 1; i < sorted.size(); ++i) {
+        if (sorted[i - 1]->Largest() >= sorted[i]->Smallest()) {
+            disjoint = false;
+            break;
+        }
+    }
+
+    auto tables = std::make_shared<Tables>();
+    tables->levels.resize(options_.num_levels);
+    int target = disjoint ? options_.num_levels - 1 : 0;
+    // level 0按编号排序；文件之间没有同名key，顺序不影响结果
+    tables->levels[target] = disjoint ? std::move(sorted) : std::move(files);
+    size_t count = tables->levels[target].size();
+
+    std::lock_guard<std::mutex> lock(mu_);
+    resetLocked(std::move(tables), index);
+    LOG_INFO("LsmEngine: installed {} files at index {} into level {}", count, index, target);
+    return true;
+}
+
+bool LsmEngine::linkFiles(const std::vector<std::string>& paths, std::vector<SstReaderPtr>& files) {
+    auto discard = [&files]() {
+        for (const auto& file : files) {
+            file->MarkObsolete();
+        }
+        files.clear();
+    };
+    for (const auto& path : paths) {
+        uint64_t number;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            number = next_file_number_++;
+        }
+        std::string target = tablePath(number);
+        if (::link(path.c_str(), target.c_str()) != 0) {
+            std::error_code ec;
+            fs::copy_file(path, target, fs::copy_options::overwrite_existing, ec);
+            if (ec) {
+                LOG_ERROR("LsmEngine: failed to ingest {}: {}", path, ec.message());
+                discard();
+                return false;
+            }
+        }
+        auto reader = SstReader::Open(target, number);
+        if (!reader) {
+            ::unlink(target.c_str());
+            discard();
+            return false;
+        }
+        files.push_back(std::move(reader));
+    }
+    return true;
+}
+
+// ============================================================================
+// ReadView
+// ============================================================================
+
+class LsmEngine::View : public ReadView {
+public:
+    View(MemTablePtr mem, TablesPtr tables, uint64_t index) :
+        mem_(std::move(mem)), tables_(std::move(tables)), index_(index) {}
+
+    uint64_t Index() const override { return index_; }
+
+    bool Get(const std::string& key, std::string& value) override {
+        auto it = newMergingIterator(mem_, tables_);
+        it->Seek(key);
+        if (!it->status()) {
+            abortOnCorruption("get");
+        }
+        if (!it->Valid() || it->key() != key || it->deleted()) {
+            return false;
+        }
+        value = it->value();
+        return true;
+    }
+
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override {
+        auto it = newMergingIterator(mem_, tables_);
+        return scanIterator(*it, start, end, limit);
+    }
+
+    void ForEach(const Visitor& visitor) override {
+        auto it = newMergingIterator(mem_, tables_);
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            if (!it->deleted()) {
+                visitor(it->key(), it->value());
+            }
+        }
+        if (!it->status()) {
+            abortOnCorruption("iteration");
+        }
+    }
+
+private:
+    MemTablePtr mem_;   // 冻结时复制的小memtable，可能为空
+    TablesPtr tables_;  // 持有文件引用，视图存活期间文件不会被删除
+    uint64_t index_;
+};
+
+ReadViewPtr LsmEngine::NewReadView(uint64_t index) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (index == 0) {
+        index = written_index_;
+    } else if (written_index_ > index) {
+        return nullptr;
+    }
+
+    // 较大的memtable直接切换为只读（O(1)）；较小的复制一份，避免频繁创建视图时产生大量小文件
+    MemTablePtr mem;
+    if (mem_->bytes >= options_.memtable_bytes / 8) {
+        rotateMemTable();
+    } else if (!mem_->entries.empty()) {
+        mem = std::make_shared<MemTable>(*mem_);
+    }
+    return std::make_shared<View>(std::move(mem), tables_, index);
+}
+
+// ============================================================================
+// 后台flush与compaction
+// ============================================================================
+
+uint64_t LsmEngine::maxBytesForLevel(int level) const {
+    uint64_t bytes = options_.level1_max_bytes;
+    for (int i = 1; i < level; ++i) {
+        bytes *= options_.level_size_multiplier;
+    }
+    return bytes;
+}
+
+bool LsmEngine::pickCompaction(Compaction* compaction) {
+    if (compaction_stopped_) {
+        return false;
+    }
+    const auto& levels = tables_->levels;
+    int best_level = -1;
+    double best_score = 1.0;
+    for (int level = 0; level + 1 < options_.num_levels; ++level) {
+        if (busy_levels_[level] || busy_levels_[level + 1] || levels[level].empty()) {
+            continue;
+        }
+        double score = level == 0
+            ? static_cast<double>(levels[0].size()) / options_.level0_compaction_trigger
+            : static_cast<double>(totalBytes(levels[level])) / maxBytesForLevel(level);
+        if (score >= best_score) {
+            best_score = score;
+            best_level = level;
+        }
+    }
+    if (best_level < 0) {
+        return false;
+    }
+    if (compaction == nullptr) {
+        return true;
+    }
+
+    compaction->level = best_level;
+    if (best_level == 0) {
+        // level 0的文件互相重叠，全部参与
+        compaction->inputs = levels[0];
+    } else {
+        // 轮转选择：从上次compact结束的位置之后的第一个文件开始
+        const auto& files = levels[best_level];
+        const std::string& pointer = compact_pointer_[best_level];
+        auto it = std::find_if(files.begin(), files.end(), [&pointer](const SstReaderPtr& file) {
+            return file->Smallest() > pointer;
+        });
+        compaction->inputs.push_back(it != files.end() ? *it : files.front());
+    }
+
+    std::string smallest;
+    std::string largest;
+    keyRange(compaction->inputs, smallest, largest);
+    for (const auto& file : levels[best_level + 1]) {
+        if (overlaps(file, smallest, largest)) {
+            compaction->next.push_back(file);
+        }
+    }
+    std::vector<SstReaderPtr> all = compaction->inputs;
+    all.insert(all.end(), compaction->next.begin(), compaction->next.end());
+    keyRange(all, smallest, largest);
+
+    compaction->drop_tombstones = true;
+    for (int level = best_level + 2; level < options_.num_levels; ++level) {
+        for (const auto& file : levels[level]) {
+            if (overlaps(file, smallest, largest)) {
+                compaction->drop_tombstones = false;
+            }
+        }
+    }
+    compaction->epoch = epoch_;
+    compact_pointer_[best_level] = compaction->inputs.back()->Largest();
+    busy_levels_[best_level] = true;
+    busy_levels_[best_level + 1] = true;
+    return true;
+}
+
+bool LsmEngine::hasBackgroundWork() {
+    return (!flushing_ && !tables_->immutables.empty()) || pickCompaction(nullptr);
+}
+
+void LsmEngine::backgroundLoop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this]() { return stopping_ || hasBackgroundWork(); });
+        if (stopping_) {
+            return;
+        }
+
+        bool ok = true;
+        if (!flushing_ && !tables_->immutables.empty()) {
+            flushing_ = true;
+            MemTablePtr imm = tables_->immutables.front();
+            uint64_t epoch = epoch_;
+            lock.unlock();
+            ok = flushMemTable(imm, epoch);
+            lock.lock();
+            flushing_ = false;
+        } else {
+            Compaction compaction;
+            if (pickCompaction(&compaction)) {
+                lock.unlock();
+                ok = runCompaction(compaction);
+                lock.lock();
+                busy_levels_[compaction.level] = false;
+                busy_levels_[compaction.level + 1] = false;
+            }
+        }
+        cv_.notify_all();
+
+        if (!ok) {
+            // 磁盘错误时退避，避免空转
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+bool LsmEngine::buildTables(EntryIterator& it, bool drop_tombstones, uint64_t target_bytes,
+                            std::vector<SstReaderPtr>& outputs) {
+    std::unique_ptr<SstBuilder> builder;
+    uint64_t number = 0;
+
+    auto finish = [&]() {
+        if (!builder->Finish()) {
+            return false;
+        }
+        auto reader = SstReader::Open(builder->Path(), number);
+        if (!reader) {
+            return false;
+        }
+        outputs.push_back(std::move(reader));
+        builder.reset();
+        return true;
+    };
+
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        if (drop_tombstones && it.deleted()) {
+            continue;
+        }
+        if (!builder) {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                number = next_file_number_++;
+            }
+            builder = std::make_unique<SstBuilder>(tablePath(number), options_.sst);
+            if (!builder->Open()) {
+                return false;
+            }
+        }
+        if (!builder->Add(it.key(), it.value(), it.deleted())) {
+            return false;
+        }
+        if (target_bytes > 0 && builder->EstimatedSize() >= target_bytes && !finish()) {
+            return false;
+        }
+    }
+    // 输入读到一半出错时不能把已读出的部分当作全部
+    if (!it.status()) {
+        return false;
+    }
+    return !builder || finish();
+}
+
+bool LsmEngine::flushMemTable(const MemTablePtr& imm, uint64_t epoch) {
+    MemTableIterator<MemTablePtr> it(imm);
+    std::vector<SstReaderPtr> outputs;
+    // 不能丢弃墓碑：更老的数据可能还在其他层中
+    if (!buildTables(it, false, 0, outputs)) {
+        LOG_ERROR("LsmEngine: flush failed, will retry");
+        for (const auto& file : outputs) {
+            file->MarkObsolete();
+        }
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    if (epoch != epoch_) {
+        for (const auto& file : outputs) {
+            file->MarkObsolete();
+        }
+        return true;
+    }
+    auto tables = std::make_shared<Tables>(*tables_);
+    tables->immutables.erase(tables->immutables.begin());
+    for (auto& file : outputs) {
+        tables->levels[0].push_back(std::move(file));
+    }
+    immutable_count_.store(tables->immutables.size(), std::memory_order_release);
+    tables_ = std::move(tables);
+    // memtable按切换顺序flush，因此flushed_index_单调递增
+    flushed_index_ = std::max(flushed_index_, imm->max_index);
+    writeManifest();
+    return true;
+}
+
+bool LsmEngine::runCompaction(const Compaction& compaction) {
+    // 输入按从新到旧排列：level 0中编号大的更新，level层整体比level + 1层新
+    std::vector<EntryIteratorPtr> children;
+    if (compaction.level == 0) {
+        for (auto it = compaction.inputs.rbegin(); it != compaction.inputs.rend(); ++it) {
+            children.push_back((*it)->NewIterator());
+        }
+    } else {
+        children.push_back(std::make_unique<LevelIterator>(compaction.inputs));
+    }
+    if (!compaction.next.empty()) {
+        children.push_back(std::make_unique<LevelIterator>(compaction.next));
+    }
+
+    std::vector<SstReaderPtr> outputs;
+    bool trivial_move = compaction.level > 0 && compaction.next.empty();
+    if (trivial_move) {
+        // 下一层没有重叠文件，直接把文件移到下一层，无需重写
+        outputs = compaction.inputs;
+    } else {
+        MergingIterator it(std::move(children));
+        if (!buildTables(it, compaction.drop_tombstones, options_.target_file_bytes, outputs)) {
+            LOG_ERROR("LsmEngine: compaction of level {} failed", compaction.level);
+            for (const auto& file : outputs) {
+                file->MarkObsolete();
+            }
+            // 输入文件保持原样；输入损坏时重试也不会成功，停止之后的compaction
+            if (!it.status()) {
+                LOG_ERROR("LsmEngine: compaction input of level {} is corrupted, compaction stopped",
+                          compaction.level);
+                std::lock_guard<std::mutex> lock(mu_);
+                compaction_stopped_ = true;
+            }
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    if (compaction.epoch != epoch_) {
+        if (!trivial_move) {
+            for (const auto& file : outputs) {
+                file->MarkObsolete();
+            }
+        }
+        return true;
+    }
+
+    std::set<uint64_t> removed;
+    for (const auto* files : {&compaction.inputs, &compaction.next}) {
+        for (const auto& file : *files) {
+            removed.insert(file->Number());
+        }
+    }
+    auto tables = std::make_shared<Tables>(*tables_);
+    for (int level : {compaction.level, compaction.level + 1}) {
+        auto& files = tables->levels[level];
+        files.erase(std::remove_if(files.begin(), files.end(), [&removed](const SstReaderPtr& file) {
+            return removed.count(file->Number()) > 0;
+        }), files.end());
+    }
+    auto& next_level = tables->levels[compaction.level + 1];
+    next_level.insert(next_level.end(), outputs.begin(), outputs.end());
+    std::sort(next_level.begin(), next_level.end(), [](const SstReaderPtr& a, const SstReaderPtr& b) {
+        return a->Smallest() < b->Smallest();
+    });
+    tables_ = std::move(tables);
+    writeManifest();
+
+    if (!trivial_move) {
+        // 旧文件在最后一个读者释放后删除
+        for (const auto* files : {&compaction.inputs, &compaction.next}) {
+            for (const auto& file : *files) {
+                file->MarkObsolete();
+            }
+        }
+    }
+    LOG_DEBUG("LsmEngine: compacted {} + {} tables from level {} into {} tables", compaction.inputs.size(),
+              compaction.next.size(), compaction.level, outputs.size());
+    return true;
+}
+
+void LsmEngine::Flush() {
+    std::unique_lock<std::mutex> lock(mu_);
+    rotateMemTable();
+    cv_.wait(lock, [this]() { return tables_->immutables.empty() && !flushing_; });
+}
+
+void LsmEngine::WaitIdle() {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this]() {
+        bool busy = std::find(busy_levels_.begin(), busy_levels_.end(), true) != busy_levels_.end();
+        return !busy && !flushing_ && !hasBackgroundWork();
+    });
+}
+
+std::vector<size_t> LsmEngine::LevelFileCounts() {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::vector<size_t> counts;
+    for (const auto& level : tables_->levels) {
+        counts.push_back(level.size());
+    }
+    return counts;
+}
+
+} // namespace kv
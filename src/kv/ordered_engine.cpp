@@ -0,0 +1,543 @@
+#include "include/ordered_engine.h"
+#include "fiber.h"
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace kv {
+
+// ============================================================================
+// 节点分配
+// ============================================================================
+
+OrderedEngine::Node* OrderedEngine::newNode(const std::string& key, int height) {
+    size_t bytes = sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1);
+    void* mem = ::operator new(bytes);
+    Node* node = new (mem) Node(key, height);
+    node->next[0].store(nullptr, std::memory_order_relaxed);
+    for (int i = 1; i < height; ++i) {
+        new (&node->next[i]) std::atomic<Node*>(nullptr);
+    }
+    return node;
+}
+
+void OrderedEngine::deleteNode(Node* node) {
+    Version* v = node->versions.load(std::memory_order_relaxed);
+    while (v != nullptr) {
+        Version* older = v->older.load(std::memory_order_relaxed);
+        delete v;
+        v = older;
+    }
+    node->~Node();
+    ::operator delete(node);
+}
+
+OrderedEngine::OrderedEngine() :
+    head_(newNode(std::string(), kMaxHeight)),
+    max_height_(1),
+    live_count_(0),
+    version_count_(0),
+    visible_index_(0),
+    gc_watermark_(0),
+    node_count_(0),
+    retire_epoch_(1),
+    rng_(0xdeadbeef) {}
+
+OrderedEngine::~OrderedEngine() {
+    Node* node = head_;
+    while (node != nullptr) {
+        Node* next = node->next[0].load(std::memory_order_relaxed);
+        deleteNode(node);
+        node = next;
+    }
+    for (auto& [retired, epoch] : retired_) {
+        deleteNode(retired);
+    }
+}
+
+int OrderedEngine::randomHeight() {
+    // 每层以1/4的概率增长
+    int height = 1;
+    while (height < kMaxHeight && (rng_() & 3) == 0) {
+        ++height;
+    }
+    return height;
+}
+
+// ============================================================================
+// 查找
+// ============================================================================
+
+OrderedEngine::Version* OrderedEngine::visibleVersion(const Node* node, uint64_t index) {
+    Version* v = node->versions.load(std::memory_order_acquire);
+    while (v != nullptr && v->index > index) {
+        v = v->older.load(std::memory_order_acquire);
+    }
+    return v;
+}
+
+OrderedEngine::Node* OrderedEngine::findGreaterOrEqual(const std::string& key, Node** prev) const {
+    Node* x = head_;
+    int level = max_height_.load(std::memory_order_acquire) - 1;
+    while (true) {
+        Node* next = x->next[level].load(std::memory_order_acquire);
+        if (next != nullptr && next->key < key) {
+            x = next;
+        } else {
+            if (prev != nullptr) {
+                prev[level] = x;
+            }
+            if (level == 0) {
+                return next;
+            }
+            --level;
+        }
+    }
+}
+
+OrderedEngine::Node* OrderedEngine::findOrInsert(const std::string& key) {
+    Node* prev[kMaxHeight];
+    Node* x = findGreaterOrEqual(key, prev);
+    if (x != nullptr && x->key == key) {
+        return x;
+    }
+
+    int height = randomHeight();
+    int max_height = max_height_.load(std::memory_order_relaxed);
+    if (height > max_height) {
+        for (int i = max_height; i < height; ++i) {
+            prev[i] = head_;
+        }
+        // 读者看到新高度但还没看到新节点时，会从head_的空指针直接下降，不影响正确性
+        max_height_.store(height, std::memory_order_release);
+    }
+
+    x = newNode(key, height);
+    for (int i = 0; i < height; ++i) {
+        // 先设置新节点的后继，再通过release发布到前驱
+        x->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        prev[i]->next[i].store(x, std::memory_order_release);
+    }
+    node_count_.fetch_add(1, std::memory_order_relaxed);
+    return x;
+}
+
+void OrderedEngine::unlinkNode(Node* node) {
+    Node* prev[kMaxHeight];
+    findGreaterOrEqual(node->key, prev);
+    // 节点在它的每一层上都紧跟在prev之后；它自己的next不变，停在它上面的读者照常前进
+    for (int i = 0; i < node->height; ++i) {
+        prev[i]->next[i].store(node->next[i].load(std::memory_order_relaxed), std::memory_order_release);
+    }
+}
+
+// ============================================================================
+// 写入
+// ============================================================================
+
+void OrderedEngine::pushVersion(Node* node, uint64_t index, bool deleted, std::string value) {
+    Version* head = node->versions.load(std::memory_order_relaxed);
+    bool was_live = head != nullptr && !head->deleted;
+    node->versions.store(new Version(index, deleted, std::move(value), head), std::memory_order_release);
+    version_count_.fetch_add(1, std::memory_order_relaxed);
+
+    if (was_live && deleted) {
+        live_count_.fetch_sub(1, std::memory_order_relaxed);
+    } else if (!was_live && !deleted) {
+        live_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (head != nullptr && !node->gc_pending) {
+        node->gc_pending = true;
+        gc_candidates_.push_back(node);
+    }
+}
+
+void OrderedEngine::publish(uint64_t index) {
+    if (index > visible_index_.load(std::memory_order_relaxed)) {
+        visible_index_.store(index, std::memory_order_release);
+    }
+}
+
+void OrderedEngine::putLocked(uint64_t index, const std::string& key, const std::string& value) {
+    pushVersion(findOrInsert(key), index, false, value);
+}
+
+void OrderedEngine::appendLocked(uint64_t index, const std::string& key, const std::string& value) {
+    Node* x = findOrInsert(key);
+    Version* head = x->versions.load(std::memory_order_relaxed);
+    std::string updated = head != nullptr && !head->deleted ? head->value : std::string();
+    updated.append(value);
+    pushVersion(x, index, false, std::move(updated));
+}
+
+bool OrderedEngine::deleteLocked(uint64_t index, const std::string& key) {
+    Node* x = findGreaterOrEqual(key, nullptr);
+    if (x == nullptr || x->key != key) {
+        return false;
+    }
+    Version* head = x->versions.load(std::memory_order_relaxed);
+    if (head == nullptr || head->deleted) {
+        return false;
+    }
+    // 只追加墓碑版本：更早的读者仍要看到旧值，节点等墓碑对所有读者可见后由回收摘除
+    pushVersion(x, index, true, std::string());
+    return true;
+}
+
+void OrderedEngine::Put(uint64_t index, const std::string& key, const std::string& value) {
+    std::unique_lock<fiber::FiberMutex> lock(write_mu_);
+    putLocked(index, key, value);
+    publish(index);
+}
+
+void OrderedEngine::Append(uint64_t index, const std::string& key, const std::string& value) {
+    std::unique_lock<fiber::FiberMutex> lock(write_mu_);
+    appendLocked(index, key, value);
+    publish(index);
+}
+
+bool OrderedEngine::Delete(uint64_t index, const std::string& key) {
+    std::unique_lock<fiber::FiberMutex> lock(write_mu_);
+    if (!deleteLocked(index, key)) {
+        return false;
+    }
+    publish(index);
+    return true;
+}
+
+void OrderedEngine::Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) {
+    statuses.assign(batch.size(), KvStatus::OK);
+    std::unique_lock<fiber::FiberMutex> lock(write_mu_);
+    // 同一批次的版本共用一个index，同一个key被多次写入时后写的版本在链头
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const auto& op = batch[i];
+        if (op.op == KvOp::PUT) {
+            putLocked(index, op.key, op.value);
+        } else if (op.op == KvOp::APPEND) {
+            appendLocked(index, op.key, op.value);
+        } else if (op.op == KvOp::DELETE) {
+            if (!deleteLocked(index, op.key)) {
+                statuses[i] = KvStatus::NO_KEY;
+            }
+        } else {
+            statuses[i] = KvStatus::INVALID_ARGUMENT;
+        }
+    }
+    publish(index);
+}
+
+void OrderedEngine::Clear() {
+    // 在当前可见index上给所有存活key写入墓碑，旧版本和节点交给回收
+    std::unique_lock<fiber::FiberMutex> lock(write_mu_);
+    uint64_t index = visible_index_.load(std::memory_order_relaxed);
+    for (Node* x = head_->next[0].load(std::memory_order_acquire); x != nullptr;
+         x = x->next[0].load(std::memory_order_acquire)) {
+        Version* head = x->versions.load(std::memory_order_relaxed);
+        if (head != nullptr && !head->deleted) {
+            pushVersion(x, index, true, std::string());
+        }
+    }
+}
+
+// ============================================================================
+// 读者登记
+// ============================================================================
+
+bool OrderedEngine::acquireSlot(bool latest, uint64_t index, size_t& slot, uint64_t& read_index) const {
+    size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    while (true) {
+        read_index = latest ? visible_index_.load(std::memory_order_acquire) : index;
+        bool acquired = false;
+        for (size_t i = 0; i < kReaderSlots && !acquired; ++i) {
+            slot = (start + i) % kReaderSlots;
+            uint64_t expected = kFreeSlot;
+            acquired = slots_[slot].index.compare_exchange_strong(expected, read_index, std::memory_order_seq_cst);
+        }
+        if (!acquired) {
+            // 读者数超过slot数，让出CPU等待其他读者完成
+            fiber::Fiber::yield();
+            continue;
+        }
+        // 登记之后读取回收epoch：读到的epoch之前摘除的节点已不可达（见freeRetired）
+        slots_[slot].epoch.store(retire_epoch_.load(std::memory_order_seq_cst), std::memory_order_release);
+
+        // 与CollectGarbage的握手：若回收已越过read_index，该视图上的版本可能已被释放
+        if (read_index >= gc_watermark_.load(std::memory_order_seq_cst)) {
+            return true;
+        }
+        releaseSlot(slot);
+        if (!latest) {
+            return false;
+        }
+    }
+}
+
+void OrderedEngine::releaseSlot(size_t slot) const {
+    slots_[slot].epoch.store(0, std::memory_order_relaxed);
+    slots_[slot].index.store(kFreeSlot, std::memory_order_release);
+}
+
+// ============================================================================
+// 读取
+// ============================================================================
+
+bool OrderedEngine::getAt(const std::string& key, uint64_t read_index, std::string& value) const {
+    Node* x = findGreaterOrEqual(key, nullptr);
+    if (x == nullptr || x->key != key) {
+        return false;
+    }
+    Version* v = visibleVersion(x, read_index);
+    if (v == nullptr || v->deleted) {
+        return false;
+    }
+    value = v->value;
+    return true;
+}
+
+std::vector<KvPair> OrderedEngine::scanAt(Iterator& it, const std::string& start, const std::string& end,
+                                          size_t limit) const {
+    std::vector<KvPair> pairs;
+    for (it.Seek(start); it.Valid(); it.Next()) {
+        if (!end.empty() && it.key() >= end) {
+            break;
+        }
+        pairs.push_back(KvPair{it.key(), it.value()});
+        if (limit > 0 && pairs.size() >= limit) {
+            break;
+        }
+    }
+    return pairs;
+}
+
+bool OrderedEngine::Get(const std::string& key, std::string& value) {
+    size_t slot;
+    uint64_t read_index;
+    acquireSlot(true, 0, slot, read_index);
+    bool found = getAt(key, read_index, value);
+    releaseSlot(slot);
+    return found;
+}
+
+std::vector<KvPair> OrderedEngine::Scan(const std::string& start, const std::string& end, size_t limit) {
+    auto it = NewIterator();
+    return scanAt(it, start, end, limit);
+}
+
+size_t OrderedEngine::Size() {
+    return live_count_.load(std::memory_order_relaxed);
+}
+
+void OrderedEngine::ForEach(const Visitor& visitor) {
+    auto it = NewIterator();
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        visitor(it.key(), it.value());
+    }
+}
+
+OrderedEngine::Iterator OrderedEngine::NewIterator() const {
+    size_t slot;
+    uint64_t read_index;
+    acquireSlot(true, 0, slot, read_index);
+    return Iterator(this, slot, read_index);
+}
+
+// ============================================================================
+// ReadView
+// ============================================================================
+
+class OrderedEngine::View : public ReadView {
+public:
+    View(std::shared_ptr<const OrderedEngine> owner, const OrderedEngine* engine, size_t slot, uint64_t index) :
+        owner_(std::move(owner)), engine_(engine), slot_(slot), index_(index) {}
+
+    ~View() override {
+        engine_->releaseSlot(slot_);
+    }
+
+    uint64_t Index() const override { return index_; }
+
+    bool Get(const std::string& key, std::string& value) override {
+        return engine_->getAt(key, index_, value);
+    }
+
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override {
+        auto it = newIterator();
+        return engine_->scanAt(it, start, end, limit);
+    }
+
+    void ForEach(const Visitor& visitor) override {
+        auto it = newIterator();
+        for (it.SeekToFirst(); it.Valid(); it.Next()) {
+            visitor(it.key(), it.value());
+        }
+    }
+
+private:
+    // 视图内的迭代器复用视图的slot，不再单独登记
+    Iterator newIterator() {
+        return Iterator(engine_, kReaderSlots, index_);
+    }
+
+    std::shared_ptr<const OrderedEngine> owner_;  // 引擎由shared_ptr管理时保证视图不悬空
+    const OrderedEngine* engine_;
+    size_t slot_;
+    uint64_t index_;
+};
+
+ReadViewPtr OrderedEngine::NewReadView(uint64_t index) {
+    size_t slot;
+    uint64_t read_index;
+    if (!acquireSlot(index == 0, index, slot, read_index)) {
+        return nullptr;
+    }
+    return std::make_shared<View>(weak_from_this().lock(), this, slot, read_index);
+}
+
+// ============================================================================
+// 版本回收
+// ============================================================================
+
+size_t OrderedEngine::CollectGarbage() {
+    std::unique_lock<fiber::FiberMutex> lock(write_mu_);
+
+    // 先发布水位，再扫描slot；与acquireSlot中"先登记slot，再读水位"构成握手
+    uint64_t cutoff = visible_index_.load(std::memory_order_acquire);
+    if (cutoff > gc_watermark_.load(std::memory_order_relaxed)) {
+        gc_watermark_.store(cutoff, std::memory_order_seq_cst);
+    }
+    for (auto& slot : slots_) {
+        uint64_t index = slot.index.load(std::memory_order_seq_cst);
+        if (index == kFreeSlot) {
+            continue;
+        }
+        // 读者可能在index上的写入完成前就开始读取，此时它看到的是index之前的版本，
+        // 因此对读者按index-1取cutoff，保证该版本也被保留
+        uint64_t bound = index == 0 ? 0 : index - 1;
+        if (bound < cutoff) {
+            cutoff = bound;
+        }
+    }
+
+    size_t freed = 0;
+    size_t kept = 0;
+    std::vector<Node*> dead;
+    for (Node* node : gc_candidates_) {
+        Version* keep = visibleVersion(node, cutoff);
+        Version* v = keep != nullptr ? keep->older.exchange(nullptr, std::memory_order_acq_rel) : nullptr;
+        while (v != nullptr) {
+            Version* older = v->older.load(std::memory_order_relaxed);
+            delete v;
+            ++freed;
+            v = older;
+        }
+        if (node->versions.load(std::memory_order_relaxed) != keep) {
+            // 仍有比cutoff新的版本，留到下次回收
+            gc_candidates_[kept++] = node;
+        } else {
+            node->gc_pending = false;
+            // 只剩cutoff之前的墓碑：所有读者都看不到这个key
+            if (keep != nullptr && keep->deleted) {
+                dead.push_back(node);
+            }
+        }
+    }
+    gc_candidates_.resize(kept);
+    version_count_.fetch_sub(freed, std::memory_order_relaxed);
+
+    if (!dead.empty()) {
+        for (Node* node : dead) {
+            unlinkNode(node);
+        }
+        // 摘除之后才推进epoch：读到新epoch的读者一定看不到这些节点
+        uint64_t epoch = retire_epoch_.load(std::memory_order_relaxed) + 1;
+        retire_epoch_.store(epoch, std::memory_order_seq_cst);
+        for (Node* node : dead) {
+            retired_.emplace_back(node, epoch);
+        }
+    }
+    return freed + freeRetired();
+}
+
+size_t OrderedEngine::freeRetired() {
+    if (retired_.empty()) {
+        return 0;
+    }
+    // 在用slot中最早的epoch；与acquireSlot中"先登记slot，再读epoch"构成握手：
+    // 这里没看到的读者一定会读到已推进的epoch
+    uint64_t oldest = UINT64_MAX;
+    for (auto& slot : slots_) {
+        if (slot.index.load(std::memory_order_seq_cst) == kFreeSlot) {
+            continue;
+        }
+        // 已登记但还没写入epoch的读者按最早处理
+        oldest = std::min(oldest, slot.epoch.load(std::memory_order_acquire));
+    }
+
+    // 节点只剩一个墓碑版本，释放节点即释放该版本
+    size_t freed = 0;
+    size_t pos = 0;
+    for (; pos < retired_.size() && retired_[pos].second <= oldest; ++pos) {
+        deleteNode(retired_[pos].first);
+        ++freed;
+    }
+    retired_.erase(retired_.begin(), retired_.begin() + pos);
+    node_count_.fetch_sub(freed, std::memory_order_relaxed);
+    version_count_.fetch_sub(freed, std::memory_order_relaxed);
+    return freed;
+}
+
+// ============================================================================
+// Iterator
+// ============================================================================
+
+OrderedEngine::Iterator::Iterator(Iterator&& other) noexcept :
+    engine_(other.engine_),
+    slot_(other.slot_),
+    read_index_(other.read_index_),
+    node_(other.node_),
+    version_(other.version_) {
+    other.slot_ = kReaderSlots;
+}
+
+OrderedEngine::Iterator::~Iterator() {
+    if (slot_ < kReaderSlots) {
+        engine_->releaseSlot(slot_);
+    }
+}
+
+void OrderedEngine::Iterator::Seek(const std::string& target) {
+    node_ = engine_->findGreaterOrEqual(target, nullptr);
+    skipInvisible();
+}
+
+void OrderedEngine::Iterator::SeekToFirst() {
+    node_ = engine_->head_->next[0].load(std::memory_order_acquire);
+    skipInvisible();
+}
+
+void OrderedEngine::Iterator::Next() {
+    node_ = node_->next[0].load(std::memory_order_acquire);
+    skipInvisible();
+}
+
+const std::string& OrderedEngine::Iterator::key() const {
+    return node_->key;
+}
+
+const std::string& OrderedEngine::Iterator::value() const {
+    return version_->value;
+}
+
+void OrderedEngine::Iterator::skipInvisible() {
+    while (node_ != nullptr) {
+        version_ = visibleVersion(node_, read_index_);
+        if (version_ != nullptr && !version_->deleted) {
+            return;
+        }
+        node_ = node_->next[0].load(std::memory_order_acquire);
+    }
+    version_ = nullptr;
+}
+
+} // namespace kv
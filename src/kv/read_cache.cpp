@@ -0,0 +1,445 @@
+#include "include/read_cache.h"
+#include <algorithm>
+#include <mutex>
+
+namespace kv {
+
+namespace {
+
+// 每条记录在key和value之外的开销估计：Entry本身和索引节点
+constexpr size_t kIndexNodeBytes = 32;
+
+// sketch的宽度按每条记录约64字节估算，至少256个计数器
+constexpr size_t kAssumedEntryBytes = 64;
+constexpr size_t kMinSketchWidth = 256;
+
+// 计数器上限（与4位计数器等价），累计采样达到宽度的10倍后整体减半
+constexpr uint8_t kMaxCount = 15;
+constexpr size_t kSampleFactor = 10;
+
+constexpr uint64_t kSketchSeeds[4] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+};
+
+uint64_t keyHash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+size_t roundUpPow2(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+} // namespace
+
+// ============================================================================
+// FrequencySketch
+// ============================================================================
+
+ReadCache::FrequencySketch::FrequencySketch(size_t width) :
+    counters_(4 * width), mask_(width - 1), sample_limit_(kSampleFactor * width) {}
+
+size_t ReadCache::FrequencySketch::indexOf(uint64_t hash, int row) const {
+    // 每行用不同的种子重新打散，取乘积的高位
+    uint64_t h = (hash ^ kSketchSeeds[row]) * 0x9E3779B97F4A7C15ULL;
+    return row * (mask_ + 1) + ((h >> 32) & mask_);
+}
+
+void ReadCache::FrequencySketch::Increment(uint64_t hash) {
+    // 保守更新：只增加当前最小的计数器，降低哈希冲突带来的高估
+    uint32_t min = Estimate(hash);
+    if (min < kMaxCount) {
+        for (int row = 0; row < 4; ++row) {
+            uint8_t& counter = counters_[indexOf(hash, row)];
+            if (counter == min) {
+                ++counter;
+            }
+        }
+    }
+    if (++samples_ >= sample_limit_) {
+        // 衰减：所有计数减半，使频率反映最近的访问
+        for (uint8_t& counter : counters_) {
+            counter >>= 1;
+        }
+        samples_ /= 2;
+    }
+}
+
+uint32_t ReadCache::FrequencySketch::Estimate(uint64_t hash) const {
+    uint32_t min = kMaxCount;
+    for (int row = 0; row < 4; ++row) {
+        min = std::min<uint32_t>(min, counters_[indexOf(hash, row)]);
+    }
+    return min;
+}
+
+void ReadCache::FrequencySketch::Clear() {
+    std::fill(counters_.begin(), counters_.end(), 0);
+    samples_ = 0;
+}
+
+// ============================================================================
+// ReadCache
+// ============================================================================
+
+size_t ReadCache::Entry::Charge() const {
+    return key.size() + value.size() + sizeof(Entry) + kIndexNodeBytes;
+}
+
+ReadCache::ReadCache(ReadCacheOptions options) : options_(options), shard_bits_(0) {
+    while ((size_t(1) << shard_bits_) < options_.shard_count) {
+        ++shard_bits_;
+    }
+    size_t shard_count = size_t(1) << shard_bits_;
+    size_t per_shard = options_.capacity_bytes / shard_count;
+    window_capacity_ = static_cast<size_t>(per_shard * options_.window_ratio);
+    main_capacity_ = per_shard - window_capacity_;
+
+    size_t sketch_width = roundUpPow2(std::max(kMinSketchWidth, per_shard / kAssumedEntryBytes));
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<Shard>(sketch_width));
+    }
+}
+
+ReadCache::Shard& ReadCache::shardFor(uint64_t hash) {
+    if (shard_bits_ == 0) {
+        return *shards_[0];
+    }
+    return *shards_[(hash * 0x9E3779B97F4A7C15ULL) >> (64 - shard_bits_)];
+}
+
+bool ReadCache::Lookup(const std::string& key, std::string& value, uint64_t& ticket) {
+    uint64_t hash = keyHash(key);
+    auto& shard = shardFor(hash);
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    // 未命中也计入频率，被拒绝的key再次访问时更容易进入主区
+    shard.sketch.Increment(hash);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++shard.stats.misses;
+        ticket = shard.generation;
+        return false;
+    }
+    uint32_t id = it->second;
+    Entry& entry = shard.entries[id];
+    if (entry.in_main) {
+        entry.referenced = true;
+    } else {
+        windowUnlink(shard, id);
+        windowPushFront(shard, id);
+    }
+    value = entry.value;
+    ++shard.stats.hits;
+    return true;
+}
+
+void ReadCache::Fill(const std::string& key, const std::string& value, uint64_t ticket) {
+    size_t charge = key.size() + value.size() + sizeof(Entry) + kIndexNodeBytes;
+    if (charge > options_.max_entry_bytes || charge > main_capacity_) {
+        return;
+    }
+    uint64_t hash = keyHash(key);
+    auto& shard = shardFor(hash);
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    // 读引擎期间有写入（代数已推进），value可能已过时
+    if (shard.generation != ticket || shard.index.count(key) > 0) {
+        return;
+    }
+
+    uint32_t id;
+    if (!shard.free.empty()) {
+        id = shard.free.back();
+        shard.free.pop_back();
+    } else {
+        id = static_cast<uint32_t>(shard.entries.size());
+        shard.entries.emplace_back();
+    }
+    Entry& entry = shard.entries[id];
+    entry.key = key;
+    entry.value = value;
+    entry.hash = hash;
+    entry.in_main = false;
+    entry.referenced = false;
+    shard.index.emplace(std::string_view(entry.key), id);
+    windowPushFront(shard, id);
+    shard.window_bytes += charge;
+
+    while (shard.window_bytes > window_capacity_ && shard.window_tail != kNil) {
+        promote(shard, shard.window_tail);
+    }
+}
+
+void ReadCache::Invalidate(const std::string& key) {
+    auto& shard = shardFor(keyHash(key));
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    ++shard.generation;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        remove(shard, it->second);
+        ++shard.stats.invalidated;
+    }
+}
+
+void ReadCache::Clear() {
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        ++shard->generation;
+        shard->index.clear();
+        shard->entries.clear();
+        shard->free.clear();
+        shard->sketch.Clear();
+        shard->window_head = shard->window_tail = shard->hand = kNil;
+        shard->window_bytes = shard->main_bytes = 0;
+    }
+}
+
+ReadCacheStats ReadCache::Stats() {
+    ReadCacheStats total;
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        const auto& stats = shard->stats;
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.admitted += stats.admitted;
+        total.rejected += stats.rejected;
+        total.evicted += stats.evicted;
+        total.invalidated += stats.invalidated;
+        total.entries += shard->index.size();
+        total.charged_bytes += shard->window_bytes + shard->main_bytes;
+    }
+    return total;
+}
+
+void ReadCache::windowUnlink(Shard& shard, uint32_t id) {
+    Entry& entry = shard.entries[id];
+    if (entry.prev != kNil) {
+        shard.entries[entry.prev].next = entry.next;
+    } else {
+        shard.window_head = entry.next;
+    }
+    if (entry.next != kNil) {
+        shard.entries[entry.next].prev = entry.prev;
+    } else {
+        shard.window_tail = entry.prev;
+    }
+    entry.prev = entry.next = kNil;
+}
+
+void ReadCache::windowPushFront(Shard& shard, uint32_t id) {
+    Entry& entry = shard.entries[id];
+    entry.prev = kNil;
+    entry.next = shard.window_head;
+    if (shard.window_head != kNil) {
+        shard.entries[shard.window_head].prev = id;
+    } else {
+        shard.window_tail = id;
+    }
+    shard.window_head = id;
+}
+
+void ReadCache::mainInsert(Shard& shard, uint32_t id) {
+    Entry& entry = shard.entries[id];
+    entry.in_main = true;
+    entry.referenced = false;
+    if (shard.hand == kNil) {
+        entry.prev = entry.next = id;
+        shard.hand = id;
+        return;
+    }
+    // 插在指针之前，新记录要等指针转完一整圈才会被检查
+    uint32_t prev = shard.entries[shard.hand].prev;
+    entry.prev = prev;
+    entry.next = shard.hand;
+    shard.entries[prev].next = id;
+    shard.entries[shard.hand].prev = id;
+}
+
+void ReadCache::mainUnlink(Shard& shard, uint32_t id) {
+    Entry& entry = shard.entries[id];
+    if (entry.next == id) {
+        shard.hand = kNil;
+    } else {
+        shard.entries[entry.prev].next = entry.next;
+        shard.entries[entry.next].prev = entry.prev;
+        if (shard.hand == id) {
+            shard.hand = entry.next;
+        }
+    }
+    entry.prev = entry.next = kNil;
+    entry.in_main = false;
+}
+
+uint32_t ReadCache::clockVictim(Shard& shard) {
+    // 清除沿途的引用位，停在第一个未被引用的记录上（不越过它）
+    while (true) {
+        Entry& entry = shard.entries[shard.hand];
+        if (!entry.referenced) {
+            return shard.hand;
+        }
+        entry.referenced = false;
+        shard.hand = entry.next;
+    }
+}
+
+void ReadCache::promote(Shard& shard, uint32_t id) {
+    Entry& candidate = shard.entries[id];
+    size_t charge = candidate.Charge();
+    // 主区已满时，候选者的频率必须高于CLOCK选出的牺牲者
+    if (shard.main_bytes + charge > main_capacity_) {
+        uint32_t victim = clockVictim(shard);
+        if (shard.sketch.Estimate(candidate.hash) <= shard.sketch.Estimate(shard.entries[victim].hash)) {
+            remove(shard, id);
+            ++shard.stats.rejected;
+            return;
+        }
+    }
+    windowUnlink(shard, id);
+    shard.window_bytes -= charge;
+    while (shard.main_bytes + charge > main_capacity_) {
+        remove(shard, clockVictim(shard));
+        ++shard.stats.evicted;
+    }
+    mainInsert(shard, id);
+    shard.main_bytes += charge;
+    ++shard.stats.admitted;
+}
+
+void ReadCache::remove(Shard& shard, uint32_t id) {
+    Entry& entry = shard.entries[id];
+    size_t charge = entry.Charge();
+    if (entry.in_main) {
+        mainUnlink(shard, id);
+        shard.main_bytes -= charge;
+    } else {
+        windowUnlink(shard, id);
+        shard.window_bytes -= charge;
+    }
+    shard.index.erase(std::string_view(entry.key));
+    entry.key.clear();
+    std::string().swap(entry.value);
+    shard.free.push_back(id);
+}
+
+// ============================================================================
+// CachedEngine
+// ============================================================================
+
+CachedEngine::CachedEngine(KvEnginePtr engine, ReadCacheOptions options) :
+    engine_(std::move(engine)), cache_(options) {}
+
+bool CachedEngine::Get(const std::string& key, std::string& value) {
+    uint64_t ticket = 0;
+    if (cache_.Lookup(key, value, ticket)) {
+        return true;
+    }
+    if (!engine_->Get(key, value)) {
+        return false;
+    }
+    cache_.Fill(key, value, ticket);
+    return true;
+}
+
+void CachedEngine::Put(uint64_t index, const std::string& key, const std::string& value) {
+    engine_->Put(index, key, value);
+    cache_.Invalidate(key);
+}
+
+void CachedEngine::Append(uint64_t index, const std::string& key, const std::string& value) {
+    engine_->Append(index, key, value);
+    cache_.Invalidate(key);
+}
+
+bool CachedEngine::Delete(uint64_t index, const std::string& key) {
+    bool removed = engine_->Delete(index, key);
+    cache_.Invalidate(key);
+    return removed;
+}
+
+std::vector<KvPair> CachedEngine::Scan(const std::string& start, const std::string& end, size_t limit) {
+    return engine_->Scan(start, end, limit);
+}
+
+size_t CachedEngine::Size() {
+    return engine_->Size();
+}
+
+void CachedEngine::ForEach(const Visitor& visitor) {
+    engine_->ForEach(visitor);
+}
+
+void CachedEngine::Clear() {
+    engine_->Clear();
+    cache_.Clear();
+}
+
+void CachedEngine::Write(uint64_t index, const std::vector<KvMutation>& batch, std::vector<KvStatus>& statuses) {
+    engine_->Write(index, batch, statuses);
+    for (const auto& op : batch) {
+        cache_.Invalidate(op.key);
+    }
+}
+
+std::vector<KvResult> CachedEngine::MultiGet(const std::vector<std::string>& keys) {
+    std::vector<KvResult> results(keys.size());
+    std::vector<std::string> missing;
+    std::vector<size_t> positions;
+    std::vector<uint64_t> tickets;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t ticket = 0;
+        if (!cache_.Lookup(keys[i], results[i].value, ticket)) {
+            missing.push_back(keys[i]);
+            positions.push_back(i);
+            tickets.push_back(ticket);
+        }
+    }
+    if (missing.empty()) {
+        return results;
+    }
+    // 未命中的key合并为一次引擎批量读
+    auto loaded = engine_->MultiGet(missing);
+    for (size_t j = 0; j < missing.size(); ++j) {
+        if (loaded[j].status == KvStatus::OK) {
+            cache_.Fill(missing[j], loaded[j].value, tickets[j]);
+        }
+        results[positions[j]] = std::move(loaded[j]);
+    }
+    return results;
+}
+
+ReadViewPtr CachedEngine::NewReadView(uint64_t index) {
+    return engine_->NewReadView(index);
+}
+
+size_t CachedEngine::CollectGarbage() {
+    return engine_->CollectGarbage();
+}
+
+size_t CachedEngine::MemoryUsage() {
+    return engine_->MemoryUsage() + cache_.Stats().charged_bytes;
+}
+
+uint64_t CachedEngine::DurableIndex() {
+    return engine_->DurableIndex();
+}
+
+bool CachedEngine::Persistent() const {
+    return engine_->Persistent();
+}
+
+bool CachedEngine::Ingest(uint64_t index, const std::vector<std::string>& paths) {
+    bool ok = engine_->Ingest(index, paths);
+    cache_.Clear();
+    return ok;
+}
+
+bool CachedEngine::Install(uint64_t index, const std::vector<std::string>& paths) {
+    bool ok = engine_->Install(index, paths);
+    cache_.Clear();
+    return ok;
+}
+
+} // namespace kv
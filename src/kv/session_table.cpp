@@ -0,0 +1,193 @@
+#include "include/session_table.h"
+#include "logger.h"
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+
+namespace kv {
+
+SessionTable::SessionTable(SessionOptions options) : options_(options) {
+    if (options_.max_sessions == 0) {
+        options_.max_sessions = 1;
+    }
+}
+
+bool SessionTable::Check(uint64_t index, const RequestId& request, KvOp op, KvResult& result) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = clients_.find(request.client_id);
+    if (it == clients_.end()) {
+        return false;
+    }
+    Slot& slot = slots_[it->second];
+    if (request.seq > slot.entry.seq) {
+        return false;
+    }
+    slot.entry.last_index = index;
+    unlink(it->second);
+    pushFront(it->second);
+
+    result = KvResult();
+    if (request.seq == slot.entry.seq) {
+        result.status = slot.entry.status;
+        if (op == KvOp::INCR && result.status == KvStatus::OK) {
+            result.value = std::to_string(slot.entry.number);
+        }
+    }
+    return true;
+}
+
+bool SessionTable::Contains(uint64_t client_id) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    return clients_.count(client_id) > 0;
+}
+
+bool SessionTable::Executed(const RequestId& request) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = clients_.find(request.client_id);
+    return it != clients_.end() && request.seq <= slots_[it->second].entry.seq;
+}
+
+void SessionTable::Record(uint64_t index, const RequestId& request, KvOp op, const KvResult& result,
+                          std::vector<uint64_t>* evicted) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto [it, inserted] = clients_.try_emplace(request.client_id, kNil);
+    if (inserted) {
+        it->second = allocate();
+        slots_[it->second].entry.client_id = request.client_id;
+    } else {
+        unlink(it->second);
+    }
+    pushFront(it->second);
+
+    SessionEntry& entry = slots_[it->second].entry;
+    entry.seq = request.seq;
+    entry.last_index = index;
+    entry.status = result.status;
+    entry.number = 0;
+    if (op == KvOp::INCR && result.status == KvStatus::OK) {
+        const char* begin = result.value.data();
+        std::from_chars(begin, begin + result.value.size(), entry.number);
+    }
+
+    if (inserted) {
+        evictLocked(index, evicted);
+    }
+    size_.store(clients_.size(), std::memory_order_release);
+}
+
+bool SessionTable::Find(uint64_t client_id, SessionEntry& entry) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = clients_.find(client_id);
+    if (it == clients_.end()) {
+        return false;
+    }
+    entry = slots_[it->second].entry;
+    return true;
+}
+
+std::vector<SessionEntry> SessionTable::Entries() {
+    std::vector<SessionEntry> entries;
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    entries.reserve(clients_.size());
+    for (uint32_t slot = tail_; slot != kNil; slot = slots_[slot].prev) {
+        entries.push_back(slots_[slot].entry);
+    }
+    return entries;
+}
+
+void SessionTable::Restore(const std::vector<SessionEntry>& entries, std::vector<uint64_t>* evicted) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    clearLocked();
+    uint64_t last_index = 0;
+    for (const auto& entry : entries) {
+        last_index = std::max(last_index, entry.last_index);
+        auto [it, inserted] = clients_.try_emplace(entry.client_id, kNil);
+        if (!inserted) {
+            LOG_WARN("SessionTable: duplicate client {} in snapshot", entry.client_id);
+            unlink(it->second);
+        } else {
+            it->second = allocate();
+        }
+        slots_[it->second].entry = entry;
+        pushFront(it->second);
+    }
+    evictLocked(last_index, evicted);
+    size_.store(clients_.size(), std::memory_order_release);
+}
+
+void SessionTable::Clear() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    clearLocked();
+}
+
+// ============================================================================
+// LRU链表与槽位管理（调用方持有mu_）
+// ============================================================================
+
+void SessionTable::unlink(uint32_t slot) {
+    Slot& s = slots_[slot];
+    if (s.prev != kNil) {
+        slots_[s.prev].next = s.next;
+    } else {
+        head_ = s.next;
+    }
+    if (s.next != kNil) {
+        slots_[s.next].prev = s.prev;
+    } else {
+        tail_ = s.prev;
+    }
+    s.prev = s.next = kNil;
+}
+
+void SessionTable::pushFront(uint32_t slot) {
+    Slot& s = slots_[slot];
+    s.prev = kNil;
+    s.next = head_;
+    if (head_ != kNil) {
+        slots_[head_].prev = slot;
+    }
+    head_ = slot;
+    if (tail_ == kNil) {
+        tail_ = slot;
+    }
+}
+
+uint32_t SessionTable::allocate() {
+    if (!free_.empty()) {
+        uint32_t slot = free_.back();
+        free_.pop_back();
+        return slot;
+    }
+    slots_.emplace_back();
+    return static_cast<uint32_t>(slots_.size() - 1);
+}
+
+void SessionTable::evictLocked(uint64_t index, std::vector<uint64_t>* evicted) {
+    // 从最久未活动的一端淘汰：先淘汰过期的会话，再把总数压到上限以内
+    while (tail_ != kNil) {
+        const SessionEntry& oldest = slots_[tail_].entry;
+        bool expired = options_.expire_entries > 0 && oldest.last_index + options_.expire_entries <= index;
+        if (!expired && clients_.size() <= options_.max_sessions) {
+            break;
+        }
+        uint32_t slot = tail_;
+        if (evicted) {
+            evicted->push_back(oldest.client_id);
+        }
+        clients_.erase(oldest.client_id);
+        unlink(slot);
+        slots_[slot].entry = SessionEntry();
+        free_.push_back(slot);
+        evicted_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SessionTable::clearLocked() {
+    clients_.clear();
+    slots_.clear();
+    free_.clear();
+    head_ = tail_ = kNil;
+    size_.store(0, std::memory_order_release);
+}
+
+} // namespace kv
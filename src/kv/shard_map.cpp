@@ -0,0 +1,170 @@
+#include "include/shard_map.h"
+#include "include/kv_rpc.h"
+#include "logger.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+namespace kv {
+
+std::vector<ShardRange> UniformShards(size_t count, const std::vector<std::string>& endpoints) {
+    std::vector<ShardRange> shards;
+    if (count == 0) {
+        return shards;
+    }
+    uint64_t step = UINT64_MAX / count;
+    uint64_t first = 0;
+    for (size_t i = 0; i < count; ++i) {
+        ShardRange shard;
+        shard.id = i + 1;
+        shard.first = first;
+        shard.last = i + 1 == count ? UINT64_MAX : first + step - 1;
+        shard.endpoints = endpoints;
+        shards.push_back(std::move(shard));
+        first += step;
+    }
+    return shards;
+}
+
+bool ParseEndpoint(const std::string& endpoint, std::string& host, uint16_t& port) {
+    auto colon = endpoint.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == endpoint.size()) {
+        return false;
+    }
+    unsigned long value = 0;
+    for (size_t i = colon + 1; i < endpoint.size(); ++i) {
+        if (endpoint[i] < '0' || endpoint[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (endpoint[i] - '0');
+        if (value > UINT16_MAX) {
+            return false;
+        }
+    }
+    host = endpoint.substr(0, colon);
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+// ============================================================================
+// ShardMapCache
+// ============================================================================
+
+ShardMapCache::ShardMapCache(std::vector<std::string> seeds) : seeds_(std::move(seeds)) {}
+
+std::optional<ShardRange> ShardMapCache::Locate(const std::string& key) {
+    uint64_t hash = ShardKeyHash(key);
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = std::upper_bound(shards_.begin(), shards_.end(), hash,
+                               [](uint64_t h, const ShardRange& shard) { return h < shard.first; });
+    if (it == shards_.begin()) {
+        return std::nullopt;
+    }
+    --it;
+    if (hash > it->last) {
+        return std::nullopt;
+    }
+    return *it;
+}
+
+void ShardMapCache::Update(const std::vector<ShardRange>& shards) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    for (const auto& incoming : shards) {
+        if (incoming.first > incoming.last) {
+            continue;
+        }
+        bool stale = std::any_of(shards_.begin(), shards_.end(), [&](const ShardRange& cached) {
+            return cached.id == incoming.id && cached.epoch > incoming.epoch;
+        });
+        if (stale) {
+            continue;
+        }
+
+        // 与新区间重叠的旧区间被裁掉重叠部分，不重叠的部分仍然可用
+        std::vector<ShardRange> next;
+        next.reserve(shards_.size() + 2);
+        for (auto& cached : shards_) {
+            if (cached.last < incoming.first || cached.first > incoming.last) {
+                next.push_back(std::move(cached));
+                continue;
+            }
+            if (cached.id == incoming.id) {
+                continue;
+            }
+            if (cached.first < incoming.first) {
+                ShardRange left = cached;
+                left.last = incoming.first - 1;
+                next.push_back(std::move(left));
+            }
+            if (cached.last > incoming.last) {
+                ShardRange right = std::move(cached);
+                right.first = incoming.last + 1;
+                next.push_back(std::move(right));
+            }
+        }
+        // 同一分片的旧描述（区间已变）也要去掉
+        next.erase(std::remove_if(next.begin(), next.end(),
+                                  [&](const ShardRange& cached) { return cached.id == incoming.id; }),
+                   next.end());
+        next.push_back(incoming);
+        std::sort(next.begin(), next.end(),
+                  [](const ShardRange& a, const ShardRange& b) { return a.first < b.first; });
+        shards_ = std::move(next);
+    }
+}
+
+size_t ShardMapCache::Refresh() {
+    std::set<std::string> endpoints(seeds_.begin(), seeds_.end());
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (const auto& shard : shards_) {
+            endpoints.insert(shard.endpoints.begin(), shard.endpoints.end());
+        }
+    }
+
+    size_t succeeded = 0;
+    for (const auto& endpoint : endpoints) {
+        std::string host;
+        uint16_t port = 0;
+        if (!ParseEndpoint(endpoint, host, port)) {
+            LOG_WARN("ShardMapCache: invalid endpoint {}", endpoint);
+            continue;
+        }
+        auto client = rpc::RpcClient::Make();
+        if (!client->connect(host, port)) {
+            continue;
+        }
+        ShardMapReply reply;
+        auto error = client->call(kMethodShardMap, ShardMapArgs{}, reply);
+        client->disconnect();
+        if (error.has_value() || reply.status != KvStatus::OK) {
+            LOG_WARN("ShardMapCache: fetch shard map from {} failed: {}", endpoint, error.value_or("bad status"));
+            continue;
+        }
+        Update(reply.shards);
+        ++succeeded;
+    }
+    return succeeded;
+}
+
+std::vector<ShardRange> ShardMapCache::Shards() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    return shards_;
+}
+
+bool ShardMapCache::Complete() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    uint64_t next = 0;
+    for (const auto& shard : shards_) {
+        if (shard.first != next) {
+            return false;
+        }
+        if (shard.last == UINT64_MAX) {
+            return true;
+        }
+        next = shard.last + 1;
+    }
+    return false;
+}
+
+} // namespace kv
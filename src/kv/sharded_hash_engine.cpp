@@ -0,0 +1,551 @@
+#include "include/sharded_hash_engine.h"
+#include <algorithm>
+#include <bit>
+#include <mutex>
+
+namespace kv {
+
+namespace {
+
+// 分片过滤器的初始容量（key数）
+constexpr size_t kMinFilterCapacity = 1024;
+
+// 值压缩：每个分片收集64KB样本训练4KB字典，短于32字节的值不压缩
+constexpr size_t kDictSampleBytes = 64 << 10;
+constexpr size_t kDictBytes = 4 << 10;
+constexpr size_t kMinCompressBytes = 32;
+
+uint64_t keyHash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+size_t shardIndex(uint64_t hash, int shard_bits) {
+    if (shard_bits == 0) {
+        return 0;
+    }
+    // 与CompactMap使用同一个哈希值，乘法混淆后取高位，
+    // 避免分片选择与槽位选择（低位）相关
+    return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - shard_bits);
+}
+
+// 过滤器使用再次打散的哈希，与分片选择的位不相关
+uint64_t filterHash(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// 页的选择取另一次混淆后的低位，与分片选择（高位）、CompactMap的槽位（原始哈希的低位）
+// 和过滤器都不相关，否则同一页中的key会挤在相同的槽位上
+uint64_t pageHash(uint64_t hash) {
+    return filterHash(hash * 0xC2B2AE3D27D4EB4FULL);
+}
+
+// 页的局部深度上限，防止哈希碰撞严重时目录无限翻倍
+constexpr int kMaxPageDepth = 24;
+
+// 逐个访问目录中的页（每页一次）：局部深度为d的页，下标最小的引用是它哈希的低d位
+template <typename Directory, typename Fn>
+void forEachPage(const Directory& dir, Fn&& fn) {
+    for (size_t slot = 0; slot < dir.size(); ++slot) {
+        if ((slot >> dir[slot]->depth) == 0) {
+            fn(*dir[slot]);
+        }
+    }
+}
+
+} // namespace
+
+ShardedHashEngine::ShardedHashEngine(size_t shard_count, int filter_bits_per_key, bool compress_values) :
+    shard_bits_(0), filter_bits_per_key_(filter_bits_per_key), compress_values_(compress_values) {
+    // 向上取整为2的幂，便于用高位直接定位分片
+    while ((size_t(1) << shard_bits_) < shard_count) {
+        ++shard_bits_;
+    }
+    shards_.reserve(size_t(1) << shard_bits_);
+    for (size_t i = 0; i < (size_t(1) << shard_bits_); ++i) {
+        auto shard = std::make_unique<Shard>();
+        resetShard(*shard);
+        if (filter_bits_per_key_ > 0) {
+            shard->filter_capacity = kMinFilterCapacity;
+            shard->filter = std::make_unique<BlockedBloomFilter>(kMinFilterCapacity, filter_bits_per_key_);
+        }
+        shards_.push_back(std::move(shard));
+    }
+}
+
+ShardedHashEngine::Shard& ShardedHashEngine::shardFor(uint64_t hash) {
+    return *shards_[shardIndex(hash, shard_bits_)];
+}
+
+ShardedHashEngine::Page& ShardedHashEngine::pageFor(const Shard& shard, uint64_t hash) {
+    const Directory& dir = *shard.dir;
+    return *dir[pageHash(hash) & (dir.size() - 1)];
+}
+
+ShardedHashEngine::PagePtr ShardedHashEngine::newPage(const Shard& shard, int depth) const {
+    auto page = std::make_shared<Page>();
+    page->depth = depth;
+    page->epoch = shard.epoch;
+    if (shard.dict_trained) {
+        page->map.SetCompression(shard.dict, kMinCompressBytes);
+    }
+    return page;
+}
+
+void ShardedHashEngine::resetShard(Shard& shard) {
+    // 换成新的目录，旧的目录和页留给仍在使用它们的视图
+    shard.dir = std::make_shared<Directory>(1, newPage(shard, 0));
+    shard.dir_epoch = shard.epoch;
+}
+
+size_t ShardedHashEngine::shardSize(const Shard& shard) {
+    size_t total = 0;
+    forEachPage(*shard.dir, [&total](const Page& page) { total += page.map.Size(); });
+    return total;
+}
+
+ShardedHashEngine::Page& ShardedHashEngine::writable(Shard& shard, uint64_t hash) {
+    return writableAt(shard, pageHash(hash) & (shard.dir->size() - 1));
+}
+
+ShardedHashEngine::Page& ShardedHashEngine::writableAt(Shard& shard, size_t slot) {
+    // 视图只在分片锁内推进epoch，早于当前epoch的目录和页可能被视图引用，复制后再改
+    if (shard.dir_epoch != shard.epoch) {
+        shard.dir = std::make_shared<Directory>(*shard.dir);
+        shard.dir_epoch = shard.epoch;
+    }
+    Directory& dir = *shard.dir;
+    if (dir[slot]->epoch != shard.epoch) {
+        auto copy = std::make_shared<Page>(*dir[slot]);
+        copy->epoch = shard.epoch;
+        // 局部深度小于全局深度的页被多个目录项引用，全部指向副本
+        size_t stride = size_t(1) << copy->depth;
+        for (size_t i = slot & (stride - 1); i < dir.size(); i += stride) {
+            dir[i] = copy;
+        }
+    }
+    return *dir[slot];
+}
+
+void ShardedHashEngine::maybeSplit(Shard& shard, uint64_t hash) {
+    // 调用方刚写入这一页，目录和页都已属于当前epoch
+    Directory& dir = *shard.dir;
+    uint64_t bits = pageHash(hash);
+    PagePtr old = dir[bits & (dir.size() - 1)];
+    if (old->map.Size() <= kMaxPageKeys || old->depth >= kMaxPageDepth) {
+        return;
+    }
+    if (old->depth == std::countr_zero(dir.size())) {
+        dir.reserve(dir.size() * 2);
+        std::copy_n(dir.begin(), dir.size(), std::back_inserter(dir));
+    }
+
+    uint64_t bit = uint64_t(1) << old->depth;
+    PagePtr low = newPage(shard, old->depth + 1);
+    PagePtr high = newPage(shard, old->depth + 1);
+    old->map.ForEach([&](std::string_view key, std::string_view value) {
+        uint64_t key_hash = keyHash(key);
+        (pageHash(key_hash) & bit ? high : low)->map.Put(key, key_hash, value);
+    });
+    for (size_t i = bits & (bit - 1); i < dir.size(); i += bit) {
+        dir[i] = (i & bit) ? high : low;
+    }
+}
+
+void ShardedHashEngine::markWritten(uint64_t index) {
+    // 并行apply时不同分片可能被并发写入，用CAS只增不减
+    uint64_t written = written_index_.load(std::memory_order_relaxed);
+    while (index > written &&
+           !written_index_.compare_exchange_weak(written, index, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+// ============================================================================
+// 前置过滤器
+// ============================================================================
+
+void ShardedHashEngine::filterInsert(Shard& shard, uint64_t hash) {
+    if (!shard.filter) {
+        return;
+    }
+    if (++shard.filter_inserts > shard.filter_capacity) {
+        // 超过容量后误判率快速上升，按当前数据量翻倍重建（已包含新key）
+        rebuildFilter(shard);
+        return;
+    }
+    shard.filter->Add(filterHash(hash));
+}
+
+void ShardedHashEngine::filterDelete(Shard& shard) {
+    if (!shard.filter) {
+        return;
+    }
+    // 删除的key仍占着过滤器中的位，累计过多时重建以恢复误判率
+    if (++shard.filter_deletes > shard.filter_capacity / 2) {
+        rebuildFilter(shard);
+    }
+}
+
+void ShardedHashEngine::rebuildFilter(Shard& shard) {
+    size_t size = shardSize(shard);
+    shard.filter_capacity = std::max(kMinFilterCapacity, size * 2);
+    shard.filter = std::make_unique<BlockedBloomFilter>(shard.filter_capacity, filter_bits_per_key_);
+    forEachPage(*shard.dir, [&shard](const Page& page) {
+        page.map.ForEach([&shard](std::string_view key, std::string_view) {
+            shard.filter->Add(filterHash(keyHash(key)));
+        });
+    });
+    shard.filter_inserts = size;
+    shard.filter_deletes = 0;
+}
+
+// ============================================================================
+// 值压缩
+// ============================================================================
+
+void ShardedHashEngine::sampleValue(Shard& shard, const std::string& value) {
+    if (!compress_values_ || shard.dict_trained || value.size() < kMinCompressBytes) {
+        return;
+    }
+    shard.samples.push_back(value);
+    shard.sample_bytes += value.size();
+    if (shard.sample_bytes < kDictSampleBytes) {
+        return;
+    }
+    shard.dict = TrainDictionary(shard.samples, kDictBytes);
+    shard.dict_trained = true;
+    std::vector<std::string>().swap(shard.samples);
+    shard.sample_bytes = 0;
+    // 一次性压缩分片中已有的值，之后新建的页由newPage设置字典
+    for (size_t slot = 0; slot < shard.dir->size(); ++slot) {
+        if ((slot >> (*shard.dir)[slot]->depth) == 0) {
+            Page& page = writableAt(shard, slot);
+            page.map.SetCompression(shard.dict, kMinCompressBytes);
+            page.map.CompressAll();
+        }
+    }
+}
+
+// ============================================================================
+// 读写
+// ============================================================================
+
+bool ShardedHashEngine::Get(const std::string& key, std::string& value) {
+    uint64_t hash = keyHash(key);
+    auto& shard = shardFor(hash);
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    if (shard.filter && !shard.filter->MayContain(filterHash(hash))) {
+        return false;
+    }
+    return pageFor(shard, hash).map.Get(key, hash, value);
+}
+
+void ShardedHashEngine::Put(uint64_t index, const std::string& key, const std::string& value) {
+    uint64_t hash = keyHash(key);
+    auto& shard = shardFor(hash);
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    markWritten(index);
+    sampleValue(shard, value);
+    if (writable(shard, hash).map.Put(key, hash, value)) {
+        filterInsert(shard, hash);
+        maybeSplit(shard, hash);
+    }
+}
+
+void ShardedHashEngine::Append(uint64_t index, const std::string& key, const std::string& value) {
+    uint64_t hash = keyHash(key);
+    auto& shard = shardFor(hash);
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    markWritten(index);
+    if (writable(shard, hash).map.Append(key, hash, value)) {
+        filterInsert(shard, hash);
+        maybeSplit(shard, hash);
+    }
+}
+
+bool ShardedHashEngine::Delete(uint64_t index, const std::string& key) {
+    uint64_t hash = keyHash(key);
+    auto& shard = shardFor(hash);
+    std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+    markWritten(index);
+    if (!pageFor(shard, hash).map.Contains(key, hash)) {
+        return false;
+    }
+    writable(shard, hash).map.Erase(key, hash);
+    filterDelete(shard);
+    return true;
+}
+
+namespace {
+
+template <typename Directory>
+void collectRange(const Directory& dir, const std::string& start, const std::string& end,
+                  std::vector<KvPair>& pairs) {
+    forEachPage(dir, [&](const auto& page) {
+        page.map.ForEach([&](std::string_view key, std::string_view value) {
+            if (key >= start && (end.empty() || key < end)) {
+                pairs.push_back(KvPair{std::string(key), std::string(value)});
+            }
+        });
+    });
+}
+
+// 引擎的Visitor接收std::string，复用同一对缓冲区转换，遍历过程中不再分配
+template <typename Directory>
+void visitAll(const Directory& dir, const IKvEngine::Visitor& visitor) {
+    std::string key_buf;
+    std::string value_buf;
+    forEachPage(dir, [&](const auto& page) {
+        page.map.ForEach([&](std::string_view key, std::string_view value) {
+            key_buf.assign(key.data(), key.size());
+            value_buf.assign(value.data(), value.size());
+            visitor(key_buf, value_buf);
+        });
+    });
+}
+
+void sortAndLimit(std::vector<KvPair>& pairs, size_t limit) {
+    std::sort(pairs.begin(), pairs.end(), [](const KvPair& a, const KvPair& b) {
+        return a.key < b.key;
+    });
+    if (limit > 0 && pairs.size() > limit) {
+        pairs.resize(limit);
+    }
+}
+
+// 按分片号对下标做稳定的计数排序，同一分片内保持原有顺序
+std::vector<uint32_t> groupByShard(const std::vector<uint32_t>& shard_of, size_t shard_count) {
+    std::vector<uint32_t> offsets(shard_count + 1, 0);
+    for (uint32_t shard : shard_of) {
+        ++offsets[shard + 1];
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<uint32_t> order(shard_of.size());
+    for (uint32_t i = 0; i < shard_of.size(); ++i) {
+        order[offsets[shard_of[i]]++] = i;
+    }
+    return order;
+}
+
+} // namespace
+
+// ============================================================================
+// 批量读写
+// ============================================================================
+
+void ShardedHashEngine::Write(uint64_t index, const std::vector<KvMutation>& batch,
+                              std::vector<KvStatus>& statuses) {
+    statuses.assign(batch.size(), KvStatus::OK);
+    std::vector<uint64_t> hashes(batch.size());
+    std::vector<uint32_t> shard_of(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        hashes[i] = keyHash(batch[i].key);
+        shard_of[i] = static_cast<uint32_t>(shardIndex(hashes[i], shard_bits_));
+        // 计算哈希的同时预取分片头（锁和map指针），加锁时不再等待内存
+        __builtin_prefetch(shards_[shard_of[i]].get());
+    }
+    std::vector<uint32_t> order = groupByShard(shard_of, shards_.size());
+
+    // 按分片号升序加锁，其他路径同一时刻最多持有一把分片锁，不会死锁；
+    // 全部持锁后才开始修改，读者不会看到写了一半的批次
+    std::vector<std::unique_lock<fiber::FiberMutex>> locks;
+    for (size_t pos = 0; pos < order.size(); ++pos) {
+        if (pos == 0 || shard_of[order[pos]] != shard_of[order[pos - 1]]) {
+            locks.emplace_back(shards_[shard_of[order[pos]]]->mu);
+        }
+    }
+    markWritten(index);
+
+    size_t pos = 0;
+    while (pos < order.size()) {
+        uint32_t shard_id = shard_of[order[pos]];
+        size_t group_end = pos;
+        while (group_end < order.size() && shard_of[order[group_end]] == shard_id) {
+            ++group_end;
+        }
+        if (group_end < order.size()) {
+            // 已持有下一个分片的锁，可以安全地预取它的目录
+            __builtin_prefetch(shards_[shard_of[order[group_end]]]->dir.get());
+        }
+
+        Shard& shard = *shards_[shard_id];
+        for (; pos < group_end; ++pos) {
+            uint32_t i = order[pos];
+            const auto& op = batch[i];
+            if (op.op == KvOp::PUT) {
+                sampleValue(shard, op.value);
+                if (writable(shard, hashes[i]).map.Put(op.key, hashes[i], op.value)) {
+                    filterInsert(shard, hashes[i]);
+                    maybeSplit(shard, hashes[i]);
+                }
+            } else if (op.op == KvOp::APPEND) {
+                if (writable(shard, hashes[i]).map.Append(op.key, hashes[i], op.value)) {
+                    filterInsert(shard, hashes[i]);
+                    maybeSplit(shard, hashes[i]);
+                }
+            } else if (op.op == KvOp::DELETE) {
+                if (!pageFor(shard, hashes[i]).map.Contains(op.key, hashes[i])) {
+                    statuses[i] = KvStatus::NO_KEY;
+                } else {
+                    writable(shard, hashes[i]).map.Erase(op.key, hashes[i]);
+                    filterDelete(shard);
+                }
+            } else {
+                statuses[i] = KvStatus::INVALID_ARGUMENT;
+            }
+        }
+    }
+}
+
+std::vector<KvResult> ShardedHashEngine::MultiGet(const std::vector<std::string>& keys) {
+    std::vector<KvResult> results(keys.size());
+    std::vector<uint64_t> hashes(keys.size());
+    std::vector<uint32_t> shard_of(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        hashes[i] = keyHash(keys[i]);
+        shard_of[i] = static_cast<uint32_t>(shardIndex(hashes[i], shard_bits_));
+        __builtin_prefetch(shards_[shard_of[i]].get());
+    }
+    std::vector<uint32_t> order = groupByShard(shard_of, shards_.size());
+
+    // 读不需要跨分片原子，逐个分片加锁一次，查完该分片的全部key后释放
+    size_t pos = 0;
+    while (pos < order.size()) {
+        uint32_t shard_id = shard_of[order[pos]];
+        Shard& shard = *shards_[shard_id];
+        std::unique_lock<fiber::FiberMutex> lock(shard.mu);
+        for (; pos < order.size() && shard_of[order[pos]] == shard_id; ++pos) {
+            uint32_t i = order[pos];
+            if (shard.filter && !shard.filter->MayContain(filterHash(hashes[i]))) {
+                results[i].status = KvStatus::NO_KEY;
+                continue;
+            }
+            if (!pageFor(shard, hashes[i]).map.Get(keys[i], hashes[i], results[i].value)) {
+                results[i].status = KvStatus::NO_KEY;
+            }
+        }
+    }
+    return results;
+}
+
+std::vector<KvPair> ShardedHashEngine::Scan(const std::string& start, const std::string& end, size_t limit) {
+    std::vector<KvPair> pairs;
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        collectRange(*shard->dir, start, end, pairs);
+    }
+    sortAndLimit(pairs, limit);
+    return pairs;
+}
+
+size_t ShardedHashEngine::Size() {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        total += shardSize(*shard);
+    }
+    return total;
+}
+
+void ShardedHashEngine::ForEach(const Visitor& visitor) {
+    // 逐分片加锁遍历，只保证单个分片内的一致性；
+    // 需要整体一致的遍历（例如生成快照）应使用NewReadView
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        visitAll(*shard->dir, visitor);
+    }
+}
+
+size_t ShardedHashEngine::MemoryUsage() {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        total += sizeof(Shard) + shard->dir->capacity() * sizeof(PagePtr);
+        forEachPage(*shard->dir, [&total](const Page& page) { total += sizeof(Page) + page.map.MemoryUsage(); });
+        if (shard->filter) {
+            total += shard->filter->SizeBytes();
+        }
+        if (shard->dict) {
+            total += shard->dict->Size();
+        }
+        total += shard->sample_bytes;
+    }
+    return total;
+}
+
+void ShardedHashEngine::Clear() {
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        resetShard(*shard);
+        if (shard->filter) {
+            rebuildFilter(*shard);
+        }
+    }
+    // 清空后从头写入（例如恢复到更早index的快照），之后可以在更小的index上创建视图
+    written_index_.store(0, std::memory_order_release);
+}
+
+// ============================================================================
+// 写时复制读视图
+// ============================================================================
+
+class ShardedHashEngine::View : public ReadView {
+public:
+    View(std::vector<DirectoryPtr> dirs, int shard_bits, uint64_t index) :
+        dirs_(std::move(dirs)), shard_bits_(shard_bits), index_(index) {}
+
+    uint64_t Index() const override { return index_; }
+
+    // 冻结的目录和页不会再被修改，读取无需加锁
+    bool Get(const std::string& key, std::string& value) override {
+        uint64_t hash = keyHash(key);
+        const Directory& dir = *dirs_[shardIndex(hash, shard_bits_)];
+        return dir[pageHash(hash) & (dir.size() - 1)]->map.Get(key, hash, value);
+    }
+
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override {
+        std::vector<KvPair> pairs;
+        for (const auto& dir : dirs_) {
+            collectRange(*dir, start, end, pairs);
+        }
+        sortAndLimit(pairs, limit);
+        return pairs;
+    }
+
+    void ForEach(const Visitor& visitor) override {
+        for (const auto& dir : dirs_) {
+            visitAll(*dir, visitor);
+        }
+    }
+
+private:
+    std::vector<DirectoryPtr> dirs_;
+    int shard_bits_;
+    uint64_t index_;
+};
+
+ReadViewPtr ShardedHashEngine::NewReadView(uint64_t index) {
+    std::vector<DirectoryPtr> dirs;
+    dirs.reserve(shards_.size());
+    for (auto& shard : shards_) {
+        std::unique_lock<fiber::FiberMutex> lock(shard->mu);
+        dirs.push_back(shard->dir);
+        ++shard->epoch;
+    }
+
+    // 写入在修改分片前（持锁）推进written_index_，因此冻结期间若有更新的写入
+    // 进入了已冻结的分片，这里一定能看到
+    uint64_t written = WrittenIndex();
+    if (index == 0) {
+        index = written;
+    } else if (written > index) {
+        return nullptr;
+    }
+    return std::make_shared<View>(std::move(dirs), shard_bits_, index);
+}
+
+} // namespace kv
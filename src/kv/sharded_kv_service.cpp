@@ -0,0 +1,850 @@
+#include "include/sharded_kv_service.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+namespace kv {
+
+namespace {
+
+bool inRange(const ShardRange& range, uint64_t hash) {
+    return hash >= range.first && hash <= range.last;
+}
+
+// 每8次访问采样一次key哈希，采样的开销摊薄到可以忽略
+constexpr uint64_t kSampleMask = 7;
+
+// 采样不足时不按负载分裂
+constexpr size_t kMinSplitSamples = 16;
+
+// 写请求被事务的intent挡住后最多重试的次数
+constexpr int kMaxConflictRetries = 8;
+
+// 命令中的key（事务命令还有anchor）是否都在分片内
+bool ownsCommand(const ShardRange& range, const KvCommand& cmd) {
+    auto owns = [&range](const std::string& key) { return inRange(range, ShardKeyHash(key)); };
+    if (cmd.op == KvOp::TXN_END) {
+        return owns(cmd.txn.anchor);
+    }
+    return std::all_of(cmd.ops.begin(), cmd.ops.end(), [&](const KvMutation& op) { return owns(op.key); }) &&
+           std::all_of(cmd.compares.begin(), cmd.compares.end(),
+                       [&](const KvCompare& compare) { return owns(compare.key); });
+}
+
+} // namespace
+
+void ShardedKvService::Shard::record(uint64_t hash, bool write) {
+    uint64_t n = (write ? writes : reads).fetch_add(1, std::memory_order_relaxed);
+    if ((n & kSampleMask) == 0) {
+        uint64_t pos = sample_pos.fetch_add(1, std::memory_order_relaxed);
+        samples[pos % kLoadSamples].store(hash, std::memory_order_relaxed);
+    }
+}
+
+ShardedKvService::WriteGuard::~WriteGuard() {
+    if (!shard_) {
+        return;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(owner_->mu_);
+    if (--shard_->inflight == 0 && shard_->frozen) {
+        owner_->cond_.notify_all();
+    }
+}
+
+ShardedKvService::ShardedKvService(GroupFactory factory, std::vector<ShardRange> shards, ShardingOptions options) :
+    factory_(std::move(factory)), options_(std::move(options)) {
+    // 事务的组即分片，分片分裂或合并后id改变，协调者重新分组
+    txn_ = std::make_shared<TxnCoordinator>(
+        [this](const std::string& key) {
+            std::unique_lock<fiber::FiberMutex> lock(mu_);
+            auto shard = locate(ShardKeyHash(key));
+            return shard ? shard->range.id : uint64_t{0};
+        },
+        [this](const std::string& key, const KvCommand& cmd) {
+            auto guard = writeShard(key);
+            if (!guard || !ownsCommand(guard.shard()->range, cmd)) {
+                KvResult result;
+                result.status = KvStatus::WRONG_SHARD;
+                return result;
+            }
+            return guard.shard()->service->Propose(cmd);
+        },
+        [this](const std::string& key) {
+            auto service = ServiceFor(key);
+            return service ? service->StateMachine() : nullptr;
+        });
+    if (shards.empty()) {
+        shards = UniformShards(1);
+    }
+    for (auto& range : shards) {
+        if (range.endpoints.empty()) {
+            range.endpoints = options_.endpoints;
+        }
+        auto service = factory_(range.id);
+        if (!service) {
+            LOG_ERROR("ShardedKvService: failed to create group for shard {}", range.id);
+            continue;
+        }
+        service->SetTxnCoordinator(txn_, false);
+        uint64_t first = range.first;
+        shards_[first] = newShard(std::move(range), std::move(service));
+    }
+}
+
+ShardedKvService::~ShardedKvService() {
+    Stop();
+    txn_->Drain();
+}
+
+ShardedKvService::ShardPtr ShardedKvService::newShard(ShardRange range, KvServicePtr service) {
+    auto shard = std::make_shared<Shard>();
+    shard->range = std::move(range);
+    shard->service = std::move(service);
+    return shard;
+}
+
+void ShardedKvService::RegisterRPC(rpc::RpcServerPtr rpc_server) {
+    rpc_server->registerHandler(kMethodGet, [this](const GetArgs& args, GetReply& reply) {
+        return this->Get(args, reply);
+    });
+    rpc_server->registerHandler(kMethodPutAppend, [this](const PutAppendArgs& args, PutAppendReply& reply) {
+        return this->PutAppend(args, reply);
+    });
+    rpc_server->registerHandler(kMethodDelete, [this](const DeleteArgs& args, DeleteReply& reply) {
+        return this->Delete(args, reply);
+    });
+    rpc_server->registerHandler(kMethodScan, [this](const ScanArgs& args, ScanReply& reply) {
+        return this->Scan(args, reply);
+    });
+    rpc_server->registerHandler(kMethodScanPrefix, [this](const ScanPrefixArgs& args, ScanReply& reply) {
+        return this->ScanPrefix(args, reply);
+    });
+    rpc_server->registerHandler(kMethodMultiGet, [this](const MultiGetArgs& args, MultiGetReply& reply) {
+        return this->MultiGet(args, reply);
+    });
+    rpc_server->registerHandler(kMethodMultiPut, [this](const MultiPutArgs& args, MultiPutReply& reply) {
+        return this->MultiPut(args, reply);
+    });
+    rpc_server->registerHandler(kMethodWriteBatch, [this](const WriteBatchArgs& args, WriteBatchReply& reply) {
+        return this->WriteBatch(args, reply);
+    });
+    rpc_server->registerHandler(kMethodCompareAndSwap,
+                                [this](const CompareAndSwapArgs& args, CompareAndSwapReply& reply) {
+                                    return this->CompareAndSwap(args, reply);
+                                });
+    rpc_server->registerHandler(kMethodPutIfAbsent, [this](const PutIfAbsentArgs& args, PutIfAbsentReply& reply) {
+        return this->PutIfAbsent(args, reply);
+    });
+    rpc_server->registerHandler(kMethodIncrement, [this](const IncrementArgs& args, IncrementReply& reply) {
+        return this->Increment(args, reply);
+    });
+    rpc_server->registerHandler(kMethodWatch, [this](const WatchArgs& args, WatchReply& reply) {
+        return this->Watch(args, reply);
+    });
+    rpc_server->registerHandler(kMethodShardMap, [this](const ShardMapArgs& args, ShardMapReply& reply) {
+        return this->ShardMap(args, reply);
+    });
+    rpc_server->registerHandler(kMethodTxn, [this](const TxnArgs& args, TxnReply& reply) {
+        return this->Txn(args, reply);
+    });
+    LOG_INFO("ShardedKvService: registered KV RPC methods");
+}
+
+// ============================================================================
+// 路由
+// ============================================================================
+
+ShardedKvService::ShardPtr ShardedKvService::locate(uint64_t hash) {
+    auto it = shards_.upper_bound(hash);
+    if (it == shards_.begin()) {
+        return nullptr;
+    }
+    --it;
+    return inRange(it->second->range, hash) ? it->second : nullptr;
+}
+
+ShardedKvService::ShardPtr ShardedKvService::readShard(const std::string& key) {
+    uint64_t hash = ShardKeyHash(key);
+    ShardPtr shard;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        shard = locate(hash);
+    }
+    if (shard) {
+        shard->record(hash, false);
+    }
+    return shard;
+}
+
+ShardedKvService::WriteGuard ShardedKvService::writeShard(const std::string& key) {
+    uint64_t hash = ShardKeyHash(key);
+    ShardPtr shard;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        while (true) {
+            shard = locate(hash);
+            if (!shard) {
+                return WriteGuard(this, nullptr);
+            }
+            if (!shard->frozen) {
+                break;
+            }
+            // 迁移完成后分片表已更新，重新定位
+            cond_.wait(lock);
+        }
+        ++shard->inflight;
+    }
+    shard->record(hash, true);
+    return WriteGuard(this, std::move(shard));
+}
+
+KvServicePtr ShardedKvService::ServiceFor(const std::string& key) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto shard = locate(ShardKeyHash(key));
+    return shard ? shard->service : nullptr;
+}
+
+std::vector<ShardRange> ShardedKvService::Shards() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    std::vector<ShardRange> ranges;
+    ranges.reserve(shards_.size());
+    for (const auto& [first, shard] : shards_) {
+        ranges.push_back(shard->range);
+    }
+    return ranges;
+}
+
+std::vector<ShardLoad> ShardedKvService::Loads() {
+    std::vector<ShardPtr> shards;
+    double seconds = 0;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (const auto& [first, shard] : shards_) {
+            shards.push_back(shard);
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - last_loads_).count();
+    }
+    seconds = std::max(seconds, 1e-3);
+
+    std::vector<ShardLoad> loads;
+    loads.reserve(shards.size());
+    for (const auto& shard : shards) {
+        ShardLoad load;
+        load.id = shard->range.id;
+        load.reads_per_sec = shard->reads.load(std::memory_order_relaxed) / seconds;
+        load.writes_per_sec = shard->writes.load(std::memory_order_relaxed) / seconds;
+        load.keys = shard->service->StateMachine()->Engine()->Size();
+        loads.push_back(load);
+    }
+    return loads;
+}
+
+// ============================================================================
+// 分裂与合并
+// ============================================================================
+
+void ShardedKvService::freeze(const ShardPtr& shard) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    shard->frozen = true;
+    while (shard->inflight > 0) {
+        cond_.wait(lock);
+    }
+}
+
+void ShardedKvService::unfreeze(const ShardPtr& shard) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    shard->frozen = false;
+    cond_.notify_all();
+}
+
+bool ShardedKvService::migrate(const KvServicePtr& src, const KvServicePtr& dst, uint64_t first, uint64_t last,
+                               std::vector<std::string>& moved) {
+    const auto& sm = src->StateMachine();
+    std::unordered_map<std::string, uint64_t> ttls;
+    for (const auto& entry : sm->TtlEntries()) {
+        uint64_t hash = ShardKeyHash(entry.key);
+        if (hash >= first && hash <= last) {
+            ttls.emplace(entry.key, entry.expire_at_ms);
+        }
+    }
+
+    // 源分片已暂停写入，遍历期间只可能有EXPIRE删除；已过期的key连同TTL一起迁移，
+    // 由目标组的TtlExpirer删除
+    std::vector<KvMutation> pending;
+    sm->Engine()->ForEach([&](const std::string& key, const std::string& value) {
+        // 状态机的保留key由目标组写入数据时重新生成
+        if (IsStateKey(key)) {
+            return;
+        }
+        uint64_t hash = ShardKeyHash(key);
+        if (hash < first || hash > last) {
+            return;
+        }
+        auto ttl = ttls.find(key);
+        pending.push_back(KvMutation{KvOp::PUT, key, value, ttl == ttls.end() ? 0 : ttl->second});
+    });
+    // 事务的intent最后写入：目标组中数据key上已有intent时，普通写入会被挡住
+    std::stable_partition(pending.begin(), pending.end(), [](const KvMutation& op) { return !IsTxnKey(op.key); });
+
+    size_t batch = std::max<size_t>(options_.migrate_batch, 1);
+    for (size_t begin = 0; begin < pending.size(); begin += batch) {
+        size_t end = std::min(pending.size(), begin + batch);
+        KvCommand cmd;
+        cmd.op = KvOp::BATCH;
+        cmd.ops.assign(std::make_move_iterator(pending.begin() + begin), std::make_move_iterator(pending.begin() + end));
+        auto result = dst->Propose(cmd);
+        if (result.status != KvStatus::OK) {
+            LOG_WARN("ShardedKvService: migration batch failed with status {}", static_cast<int>(result.status));
+            return false;
+        }
+        for (auto& op : cmd.ops) {
+            moved.push_back(std::move(op.key));
+        }
+    }
+    return true;
+}
+
+void ShardedKvService::dropKeys(const KvServicePtr& service, const std::vector<std::string>& keys) {
+    // 先删intent再删数据，同一批中的intent挡不住数据的删除时才能放在一起，所以分开提交
+    std::vector<std::string> intents;
+    std::vector<std::string> data;
+    for (const auto& key : keys) {
+        (IsTxnKey(key) ? intents : data).push_back(key);
+    }
+    size_t batch = std::max<size_t>(options_.migrate_batch, 1);
+    for (const auto* part : {&intents, &data}) {
+        for (size_t begin = 0; begin < part->size(); begin += batch) {
+            KvCommand cmd;
+            cmd.op = KvOp::BATCH;
+            for (size_t i = begin; i < std::min(part->size(), begin + batch); ++i) {
+                cmd.ops.push_back(KvMutation{KvOp::DELETE, (*part)[i]});
+            }
+            auto result = service->Propose(cmd);
+            if (result.status != KvStatus::OK) {
+                // 留下的key不在该组的区间内，不会被读到，只占用空间
+                LOG_WARN("ShardedKvService: failed to drop {} migrated keys, status {}", part->size() - begin,
+                         static_cast<int>(result.status));
+                return;
+            }
+        }
+    }
+}
+
+uint64_t ShardedKvService::splitPoint(const Shard& shard) {
+    size_t count = std::min<uint64_t>(shard.sample_pos.load(std::memory_order_relaxed), kLoadSamples);
+    if (count < kMinSplitSamples) {
+        return 0;
+    }
+    std::vector<uint64_t> samples(count);
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = shard.samples[i].load(std::memory_order_relaxed);
+    }
+    auto [lo, hi] = std::minmax_element(samples.begin(), samples.end());
+    uint64_t min_hash = *lo;
+    if (min_hash == *hi) {
+        // 负载集中在单个key上，分裂无法分散
+        return 0;
+    }
+    std::nth_element(samples.begin(), samples.begin() + count / 2, samples.end());
+    // 中位数等于最小值时（一半以上访问落在同一个key上）往后挪一位，保证左半部分非空
+    return std::max(samples[count / 2], min_hash + 1);
+}
+
+uint64_t ShardedKvService::newShardId() {
+    static thread_local std::mt19937_64 gen(std::random_device{}());
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    while (true) {
+        uint64_t id = gen();
+        bool used = id == 0 || std::any_of(shards_.begin(), shards_.end(),
+                                           [id](const auto& entry) { return entry.second->range.id == id; });
+        if (!used) {
+            return id;
+        }
+    }
+}
+
+std::optional<uint64_t> ShardedKvService::Split(uint64_t shard_id, uint64_t at) {
+    std::unique_lock<fiber::FiberMutex> rebalance(rebalance_mu_);
+    ShardPtr source;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (const auto& [first, shard] : shards_) {
+            if (shard->range.id == shard_id) {
+                source = shard;
+                break;
+            }
+        }
+    }
+    if (!source) {
+        return std::nullopt;
+    }
+    if (at == 0) {
+        at = splitPoint(*source);
+    }
+    if (at <= source->range.first || at > source->range.last) {
+        return std::nullopt;
+    }
+
+    uint64_t id = newShardId();
+    auto group = factory_(id);
+    if (!group) {
+        LOG_WARN("ShardedKvService: failed to create group for split of shard {}", shard_id);
+        return std::nullopt;
+    }
+    group->SetTxnCoordinator(txn_, false);
+
+    auto start = std::chrono::steady_clock::now();
+    freeze(source);
+    std::vector<std::string> moved;
+    if (!migrate(source->service, group, at, source->range.last, moved)) {
+        // 新组还没有对外服务，直接丢弃
+        unfreeze(source);
+        return std::nullopt;
+    }
+
+    ShardRange left = source->range;
+    left.last = at - 1;
+    ++left.epoch;
+    ShardRange right = source->range;
+    right.id = id;
+    right.first = at;
+    right.epoch = left.epoch;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        shards_[left.first] = newShard(left, source->service);
+        shards_[right.first] = newShard(right, group);
+        source->frozen = false;
+        cond_.notify_all();
+    }
+    auto paused = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    dropKeys(source->service, moved);
+    LOG_INFO("ShardedKvService: split shard {} at {:#x}, moved {} keys to shard {} (writes paused {}ms)", shard_id, at,
+             moved.size(), id, paused);
+    return id;
+}
+
+bool ShardedKvService::Merge(uint64_t left_id) {
+    std::unique_lock<fiber::FiberMutex> rebalance(rebalance_mu_);
+    ShardPtr left;
+    ShardPtr right;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (auto it = shards_.begin(); it != shards_.end(); ++it) {
+            if (it->second->range.id != left_id) {
+                continue;
+            }
+            left = it->second;
+            auto next = std::next(it);
+            if (left->range.last != UINT64_MAX && next != shards_.end() &&
+                next->second->range.first == left->range.last + 1) {
+                right = next->second;
+            }
+            break;
+        }
+    }
+    if (!left || !right) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    freeze(left);
+    freeze(right);
+    std::vector<std::string> moved;
+    if (!migrate(right->service, left->service, right->range.first, right->range.last, moved)) {
+        // 已写入左侧组的key不在它的区间内，删掉以免以后区间变化时重新出现
+        dropKeys(left->service, moved);
+        unfreeze(left);
+        unfreeze(right);
+        return false;
+    }
+
+    ShardRange merged = left->range;
+    merged.last = right->range.last;
+    merged.epoch = std::max(left->range.epoch, right->range.epoch) + 1;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        shards_.erase(right->range.first);
+        shards_[merged.first] = newShard(merged, left->service);
+        left->frozen = false;
+        right->frozen = false;
+        cond_.notify_all();
+    }
+    auto paused = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    // 右侧的组在最后一个引用（进行中的读请求）释放后销毁
+    LOG_INFO("ShardedKvService: merged shard {} into shard {}, moved {} keys (writes paused {}ms)", right->range.id,
+             left_id, moved.size(), paused);
+    return true;
+}
+
+bool ShardedKvService::RebalanceOnce() {
+    auto loads = Loads();
+    std::vector<ShardPtr> shards;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (const auto& [first, shard] : shards_) {
+            shard->reads.store(0, std::memory_order_relaxed);
+            shard->writes.store(0, std::memory_order_relaxed);
+            shards.push_back(shard);
+        }
+        last_loads_ = std::chrono::steady_clock::now();
+    }
+    if (loads.size() != shards.size()) {
+        return false;
+    }
+
+    auto ops = [&loads](size_t i) { return loads[i].reads_per_sec + loads[i].writes_per_sec; };
+    if (!loads.empty() && loads.size() < options_.max_shards) {
+        size_t hottest = 0;
+        for (size_t i = 1; i < loads.size(); ++i) {
+            if (ops(i) > ops(hottest)) {
+                hottest = i;
+            }
+        }
+        if (ops(hottest) > options_.split_ops_per_sec && Split(loads[hottest].id).has_value()) {
+            return true;
+        }
+    }
+
+    if (loads.size() > std::max<size_t>(options_.min_shards, 1)) {
+        for (size_t i = 0; i + 1 < loads.size(); ++i) {
+            bool adjacent = shards[i]->range.id == loads[i].id && shards[i]->range.last != UINT64_MAX &&
+                            shards[i + 1]->range.first == shards[i]->range.last + 1;
+            if (adjacent && ops(i) + ops(i + 1) < options_.merge_ops_per_sec && Merge(loads[i].id)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ShardedKvService::Start() {
+    if (!stopped_.exchange(false)) {
+        return;
+    }
+    timer_ = fiber::TimerWheel::getInstance().addTimer(options_.interval_ms, [this]() { tick(); }, true);
+    LOG_INFO("ShardedKvService: load balancing started (interval={}ms)", options_.interval_ms);
+}
+
+void ShardedKvService::Stop() {
+    if (stopped_.exchange(true)) {
+        return;
+    }
+    fiber::TimerWheel::getInstance().cancel(timer_);
+    while (running_.load(std::memory_order_acquire)) {
+        fiber::Fiber::sleep(1);
+    }
+}
+
+void ShardedKvService::tick() {
+    // 定时器回调中不阻塞：迁移放到独立fiber中，上一次还没完成时跳过本次
+    if (stopped_.load(std::memory_order_acquire) || running_.exchange(true)) {
+        return;
+    }
+    fiber::Fiber::go([this]() {
+        if (!stopped_.load(std::memory_order_acquire)) {
+            RebalanceOnce();
+        }
+        running_.store(false, std::memory_order_release);
+    });
+}
+
+// ============================================================================
+// RPC handlers
+// ============================================================================
+
+bool ShardedKvService::retryConflict(KvStatus status, const std::vector<std::string>& keys, int retry) {
+    if (status != KvStatus::TXN_CONFLICT || retry >= kMaxConflictRetries) {
+        return false;
+    }
+    for (const auto& key : keys) {
+        if (!txn_->ResolveIntent(key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<std::string> ShardedKvService::Get(const GetArgs& args, GetReply& reply) {
+    auto shard = readShard(args.key);
+    if (!shard) {
+        reply.status = KvStatus::WRONG_SHARD;
+        return std::nullopt;
+    }
+    return shard->service->Get(args, reply);
+}
+
+std::optional<std::string> ShardedKvService::PutAppend(const PutAppendArgs& args, PutAppendReply& reply) {
+    return forwardWrite(args.key, args, reply, &KvService::PutAppend);
+}
+
+std::optional<std::string> ShardedKvService::Delete(const DeleteArgs& args, DeleteReply& reply) {
+    return forwardWrite(args.key, args, reply, &KvService::Delete);
+}
+
+std::optional<std::string> ShardedKvService::CompareAndSwap(const CompareAndSwapArgs& args,
+                                                            CompareAndSwapReply& reply) {
+    return forwardWrite(args.key, args, reply, &KvService::CompareAndSwap);
+}
+
+std::optional<std::string> ShardedKvService::PutIfAbsent(const PutIfAbsentArgs& args, PutIfAbsentReply& reply) {
+    return forwardWrite(args.key, args, reply, &KvService::PutIfAbsent);
+}
+
+std::optional<std::string> ShardedKvService::Increment(const IncrementArgs& args, IncrementReply& reply) {
+    return forwardWrite(args.key, args, reply, &KvService::Increment);
+}
+
+void ShardedKvService::scanPage(const std::string& start, const std::string& end, uint64_t limit,
+                                ScanReply& reply) {
+    if (limit == 0 || limit > kMaxScanPageSize) {
+        limit = kMaxScanPageSize;
+    }
+    std::vector<ShardPtr> shards;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (const auto& [first, shard] : shards_) {
+            shards.push_back(shard);
+        }
+    }
+
+    // 每个分片取limit+1条；被截断的分片中最小的最后一个key是本页的上界，
+    // 上界之前的key在所有分片中都已取到
+    std::optional<std::string> bound;
+    std::vector<KvPair> merged;
+    for (const auto& shard : shards) {
+        shard->reads.fetch_add(1, std::memory_order_relaxed);
+        auto pairs = shard->service->StateMachine()->Scan(start, end, limit + 1);
+        if (pairs.size() > limit && (!bound || pairs.back().key < *bound)) {
+            bound = pairs.back().key;
+        }
+        for (auto& pair : pairs) {
+            // 迁移后源组中还没删除的key不属于该分片
+            if (inRange(shard->range, ShardKeyHash(pair.key))) {
+                merged.push_back(std::move(pair));
+            }
+        }
+    }
+    std::sort(merged.begin(), merged.end(), [](const KvPair& a, const KvPair& b) { return a.key < b.key; });
+    if (bound) {
+        merged.erase(std::upper_bound(merged.begin(), merged.end(), *bound,
+                                      [](const std::string& key, const KvPair& pair) { return key < pair.key; }),
+                     merged.end());
+    }
+
+    reply.status = KvStatus::OK;
+    reply.has_more = false;
+    if (merged.size() > limit) {
+        reply.has_more = true;
+        reply.next_start = merged[limit].key;
+        merged.resize(limit);
+    } else if (bound) {
+        reply.has_more = true;
+        reply.next_start = *bound + '\0';
+    }
+    reply.pairs = std::move(merged);
+}
+
+std::optional<std::string> ShardedKvService::Scan(const ScanArgs& args, ScanReply& reply) {
+    if (!args.end.empty() && args.end <= args.start) {
+        reply.status = KvStatus::OK;
+        return std::nullopt;
+    }
+    scanPage(args.start, args.end, args.limit, reply);
+    return std::nullopt;
+}
+
+std::optional<std::string> ShardedKvService::ScanPrefix(const ScanPrefixArgs& args, ScanReply& reply) {
+    const std::string& start = args.cursor > args.prefix ? args.cursor : args.prefix;
+    scanPage(start, PrefixEnd(args.prefix), args.limit, reply);
+    return std::nullopt;
+}
+
+std::optional<std::string> ShardedKvService::MultiGet(const MultiGetArgs& args, MultiGetReply& reply) {
+    if (args.keys.size() > kMaxBatchSize) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    reply.results.assign(args.keys.size(), GetReply{});
+
+    // 按分片分组，每个分片一次MultiGet
+    std::unordered_map<Shard*, std::pair<ShardPtr, std::vector<size_t>>> groups;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (size_t i = 0; i < args.keys.size(); ++i) {
+            auto shard = locate(ShardKeyHash(args.keys[i]));
+            if (!shard) {
+                reply.results[i].status = KvStatus::WRONG_SHARD;
+                continue;
+            }
+            auto& group = groups[shard.get()];
+            group.first = std::move(shard);
+            group.second.push_back(i);
+        }
+    }
+    for (auto& [ptr, group] : groups) {
+        auto& [shard, indexes] = group;
+        std::vector<std::string> keys;
+        keys.reserve(indexes.size());
+        for (size_t i : indexes) {
+            shard->record(ShardKeyHash(args.keys[i]), false);
+            keys.push_back(args.keys[i]);
+        }
+        const auto& sm = shard->service->StateMachine();
+        if (sm->IntentCount() > 0) {
+            for (const auto& key : keys) {
+                txn_->ResolveIntent(key, true);
+            }
+        }
+        auto results = sm->MultiGet(keys);
+        for (size_t k = 0; k < indexes.size(); ++k) {
+            reply.results[indexes[k]].status = results[k].status;
+            reply.results[indexes[k]].value = std::move(results[k].value);
+        }
+    }
+    reply.status = KvStatus::OK;
+    return std::nullopt;
+}
+
+std::optional<std::string> ShardedKvService::MultiPut(const MultiPutArgs& args, MultiPutReply& reply) {
+    if (args.pairs.size() > kMaxBatchSize) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    reply.status = KvStatus::OK;
+
+    // 每轮取剩余的第一个key所在的分片（可能等待迁移完成），把落在该分片的pair一起提交
+    std::vector<KvPair> remaining = args.pairs;
+    int conflicts = 0;
+    while (!remaining.empty()) {
+        MultiPutArgs part;
+        part.ttl_ms = args.ttl_ms;
+        part.request = args.request;
+        std::vector<KvPair> rest;
+        MultiPutReply part_reply;
+        {
+            auto guard = writeShard(remaining.front().key);
+            if (!guard) {
+                reply.status = KvStatus::WRONG_SHARD;
+                return std::nullopt;
+            }
+            for (auto& pair : remaining) {
+                if (inRange(guard.shard()->range, ShardKeyHash(pair.key))) {
+                    part.pairs.push_back(std::move(pair));
+                } else {
+                    rest.push_back(std::move(pair));
+                }
+            }
+            auto error = guard.shard()->service->MultiPut(part, part_reply);
+            if (error.has_value()) {
+                return error;
+            }
+        }
+        std::vector<std::string> keys;
+        for (const auto& pair : part.pairs) {
+            keys.push_back(pair.key);
+        }
+        if (retryConflict(part_reply.status, keys, conflicts)) {
+            // 整个部分没有生效，等事务结束后重新提交
+            ++conflicts;
+            rest.insert(rest.begin(), std::make_move_iterator(part.pairs.begin()),
+                        std::make_move_iterator(part.pairs.end()));
+        } else if (part_reply.status != KvStatus::OK && reply.status == KvStatus::OK) {
+            reply.status = part_reply.status;
+            reply.leader = std::move(part_reply.leader);
+        }
+        remaining = std::move(rest);
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> ShardedKvService::WriteBatch(const WriteBatchArgs& args, WriteBatchReply& reply) {
+    if (args.ops.size() > kMaxBatchSize) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    if (args.ops.empty()) {
+        reply.status = KvStatus::OK;
+        return std::nullopt;
+    }
+    std::vector<std::string> keys;
+    for (const auto& op : args.ops) {
+        keys.push_back(op.key);
+    }
+    for (int retry = 0;; ++retry) {
+        std::optional<std::string> error;
+        {
+            auto guard = writeShard(args.ops.front().key);
+            if (!guard) {
+                reply.status = KvStatus::WRONG_SHARD;
+                return std::nullopt;
+            }
+            // 跨分片的原子写使用事务（KV.Txn），这里只接受单个分片内的批次
+            for (const auto& op : args.ops) {
+                if (!inRange(guard.shard()->range, ShardKeyHash(op.key))) {
+                    reply.status = KvStatus::INVALID_ARGUMENT;
+                    return std::nullopt;
+                }
+            }
+            error = guard.shard()->service->WriteBatch(args, reply);
+        }
+        if (error.has_value() || !retryConflict(reply.status, keys, retry)) {
+            return error;
+        }
+    }
+}
+
+std::optional<std::string> ShardedKvService::Watch(const WatchArgs& args, WatchReply& reply) {
+    if (!args.prefix) {
+        auto shard = readShard(args.key);
+        if (!shard) {
+            reply.status = KvStatus::WRONG_SHARD;
+            return std::nullopt;
+        }
+        return shard->service->Watch(args, reply);
+    }
+
+    // 前缀下的key散布在所有分片上，各分片的revision互不相关，无法合并成一个事件流
+    KvServicePtr service;
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        if (shards_.size() == 1) {
+            const auto& range = shards_.begin()->second->range;
+            if (range.first == 0 && range.last == UINT64_MAX) {
+                service = shards_.begin()->second->service;
+            }
+        }
+    }
+    if (!service) {
+        reply.status = KvStatus::INVALID_ARGUMENT;
+        return std::nullopt;
+    }
+    return service->Watch(args, reply);
+}
+
+std::optional<std::string> ShardedKvService::ShardMap(const ShardMapArgs& args, ShardMapReply& reply) {
+    reply.shards = Shards();
+    if (args.include_load) {
+        reply.loads = Loads();
+    }
+    reply.status = KvStatus::OK;
+    return std::nullopt;
+}
+
+std::optional<std::string> ShardedKvService::Txn(const TxnArgs& args, TxnReply& reply) {
+    auto result = txn_->Execute(args.writes, args.compares, args.request);
+    reply.status = result.status;
+    reply.txn_id = result.txn_id;
+    if (result.status == KvStatus::WRONG_LEADER) {
+        reply.leader = std::move(result.key);
+    } else {
+        reply.key = std::move(result.key);
+    }
+    return std::nullopt;
+}
+
+} // namespace kv
@@ -0,0 +1,86 @@
+#include "include/snapshotter.h"
+#include "fiber.h"
+#include "logger.h"
+#include <chrono>
+#include <mutex>
+
+namespace kv {
+
+Snapshotter::Snapshotter(KvStateMachinePtr sm, raft::PersisterPtr persister, RaftStateFunc raftstate) :
+    sm_(std::move(sm)), persister_(std::move(persister)), raftstate_(std::move(raftstate)) {}
+
+Snapshotter::~Snapshotter() {
+    Wait();
+}
+
+bool Snapshotter::Start(DoneCallback done) {
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        if (in_progress_) {
+            return false;
+        }
+        in_progress_ = true;
+    }
+
+    // 逻辑冻结：只登记读视图，不复制数据
+    auto view = sm_->NewReadView();
+    if (!view) {
+        LOG_WARN("Snapshotter: engine does not support read views at index {}", sm_->LastApplied());
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        in_progress_ = false;
+        cond_.notify_all();
+        return false;
+    }
+
+    // TTL索引和会话表不在引擎中，与视图在同一时刻复制
+    auto extras = sm_->CaptureExtras();
+    fiber::Fiber::go([this, view = std::move(view), extras = std::move(extras), done = std::move(done)]() mutable {
+        write(std::move(view), std::move(extras), std::move(done));
+    });
+    return true;
+}
+
+void Snapshotter::write(ReadViewPtr view, SnapshotExtras extras, DoneCallback done) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t index = view->Index();
+    std::vector<uint8_t> snapshot = KvStateMachine::EncodeSnapshot(*view, extras, sm_->GetSnapshotOptions());
+    // 尽早释放视图，让引擎回收冻结期间产生的旧版本/分片副本
+    view.reset();
+
+    std::vector<uint8_t> raftstate = raftstate_ ? raftstate_() : persister_->ReadRaftState();
+    persister_->Save(raftstate, snapshot);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Snapshotter: saved snapshot at index {} ({} bytes, {}ms)", index, snapshot.size(), elapsed);
+    // 快照已包含导入的数据，重放日志不再需要暂存文件
+    sm_->ReleaseIngestFiles(index);
+
+    if (done) {
+        done(index);
+    }
+
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    last_index_ = index;
+    in_progress_ = false;
+    cond_.notify_all();
+}
+
+bool Snapshotter::InProgress() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    return in_progress_;
+}
+
+void Snapshotter::Wait() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    while (in_progress_) {
+        cond_.wait(lock);
+    }
+}
+
+uint64_t Snapshotter::LastSnapshotIndex() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    return last_index_;
+}
+
+} // namespace kv
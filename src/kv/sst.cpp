@@ -0,0 +1,582 @@
+#include "include/sst.h"
+#include "include/bloom_filter.h"
+#include "logger.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kv {
+
+// ============================================================================
+// 编码工具
+// ============================================================================
+
+namespace {
+
+constexpr uint8_t kFlagDeleted = 1;
+constexpr size_t kEntryHeaderSize = 4 + 4 + 1;
+
+// meta block中的压缩方式，以及压缩文件中每个data block的首字节
+constexpr uint8_t kCodecDictLz = 1;
+constexpr char kBlockRaw = 0;
+constexpr char kBlockCompressed = 1;
+
+void putU32(std::string& dst, uint32_t v) {
+    dst.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void putU64(std::string& dst, uint64_t v) {
+    dst.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+uint32_t getU32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t getU64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 带长度前缀的字符串，越界返回false
+bool getLengthPrefixed(const std::string& src, size_t& pos, std::string& out) {
+    if (pos + 4 > src.size()) {
+        return false;
+    }
+    uint32_t len = getU32(src.data() + pos);
+    pos += 4;
+    if (pos + len > src.size()) {
+        return false;
+    }
+    out.assign(src.data() + pos, len);
+    pos += len;
+    return true;
+}
+
+// 解析data block中pos处的条目，成功时把pos推进到下一条
+bool parseEntry(const std::string& block, size_t& pos, std::string& key, std::string& value, bool& deleted) {
+    if (pos + kEntryHeaderSize > block.size()) {
+        return false;
+    }
+    uint32_t key_len = getU32(block.data() + pos);
+    uint32_t value_len = getU32(block.data() + pos + 4);
+    uint8_t flags = static_cast<uint8_t>(block[pos + 8]);
+    size_t body = pos + kEntryHeaderSize;
+    if (body + key_len + value_len > block.size()) {
+        return false;
+    }
+    key.assign(block.data() + body, key_len);
+    value.assign(block.data() + body + key_len, value_len);
+    deleted = (flags & kFlagDeleted) != 0;
+    pos = body + key_len + value_len;
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool preadAll(int fd, char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pread(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
+uint32_t Crc32(const char* data, size_t size, uint32_t crc) {
+    // slicing-by-8：每次查8张表处理8个字节，整文件校验（批量导入）时接近内存带宽
+    static const auto tables = []() {
+        std::vector<std::array<uint32_t, 256>> t(8);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (size_t k = 1; k < 8; ++k) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+            }
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    while (size >= 8) {
+        uint32_t lo = getU32(reinterpret_cast<const char*>(p)) ^ crc;
+        uint32_t hi = getU32(reinterpret_cast<const char*>(p) + 4);
+        crc = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff] ^ tables[5][(lo >> 16) & 0xff] ^
+              tables[4][lo >> 24] ^ tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff] ^
+              tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = tables[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// ============================================================================
+// SstBuilder
+// ============================================================================
+
+SstBuilder::SstBuilder(std::string path, SstOptions options) :
+    path_(std::move(path)), options_(options), fd_(-1), finished_(false), offset_(0), file_crc_(0), num_entries_(0),
+    dict_ready_(!options.compression), pending_bytes_(0) {}
+
+SstBuilder::~SstBuilder() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (!finished_) {
+        ::unlink(path_.c_str());
+    }
+}
+
+bool SstBuilder::Open() {
+    fd_ = ::open(path_.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR("SstBuilder: failed to create {}: {}", path_, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool SstBuilder::Add(const std::string& key, const std::string& value, bool deleted) {
+    if (num_entries_ > 0 && key <= largest_) {
+        LOG_ERROR("SstBuilder: keys out of order in {}", path_);
+        return false;
+    }
+    if (num_entries_ == 0) {
+        smallest_ = key;
+    }
+    largest_ = key;
+    ++num_entries_;
+
+    putU32(block_, static_cast<uint32_t>(key.size()));
+    putU32(block_, static_cast<uint32_t>(value.size()));
+    block_.push_back(static_cast<char>(deleted ? kFlagDeleted : 0));
+    block_.append(key);
+    block_.append(value);
+    if (options_.bloom_bits_per_key > 0) {
+        key_hashes_.push_back(BloomFilter::HashKey(key));
+    }
+    if (!dict_ready_ && !value.empty()) {
+        samples_.push_back(value);
+    }
+
+    if (block_.size() >= options_.block_size) {
+        return flushBlock();
+    }
+    return true;
+}
+
+bool SstBuilder::writeBlock(const std::string& block, uint64_t& offset, uint64_t& size) {
+    std::string crc;
+    putU32(crc, Crc32(block.data(), block.size()));
+    if (!writeAll(fd_, block.data(), block.size()) || !writeAll(fd_, crc.data(), crc.size())) {
+        LOG_ERROR("SstBuilder: write to {} failed: {}", path_, strerror(errno));
+        return false;
+    }
+    offset = offset_;
+    size = block.size();
+    offset_ += block.size() + crc.size();
+    file_crc_ = Crc32(crc.data(), crc.size(), Crc32(block.data(), block.size(), file_crc_));
+    return true;
+}
+
+bool SstBuilder::flushBlock() {
+    if (block_.empty()) {
+        return true;
+    }
+    if (!dict_ready_) {
+        pending_bytes_ += block_.size();
+        pending_.emplace_back(std::move(block_), largest_);
+        block_.clear();
+        return pending_bytes_ < options_.dict_sample_bytes || trainAndFlushPending();
+    }
+    bool ok = writeDataBlock(block_, largest_);
+    block_.clear();
+    return ok;
+}
+
+bool SstBuilder::writeDataBlock(const std::string& block, const std::string& last_key) {
+    uint64_t offset;
+    uint64_t size;
+    if (options_.compression) {
+        std::string encoded(1, kBlockCompressed);
+        encoded.append(Compress(block, dict_.get()));
+        if (encoded.size() >= block.size() + 1) {
+            encoded.assign(1, kBlockRaw);
+            encoded.append(block);
+        }
+        if (!writeBlock(encoded, offset, size)) {
+            return false;
+        }
+    } else if (!writeBlock(block, offset, size)) {
+        return false;
+    }
+    putU32(index_, static_cast<uint32_t>(last_key.size()));
+    index_.append(last_key);
+    putU64(index_, offset);
+    putU64(index_, size);
+    return true;
+}
+
+bool SstBuilder::trainAndFlushPending() {
+    // 样本太少时训练不出字典，仍然压缩，只是没有字典可引用
+    dict_ = TrainDictionary(samples_, options_.dict_bytes);
+    dict_ready_ = true;
+    std::vector<std::string>().swap(samples_);
+    for (const auto& [block, last_key] : pending_) {
+        if (!writeDataBlock(block, last_key)) {
+            return false;
+        }
+    }
+    pending_.clear();
+    pending_bytes_ = 0;
+    return true;
+}
+
+bool SstBuilder::Finish() {
+    if (!flushBlock() || (!dict_ready_ && !trainAndFlushPending())) {
+        return false;
+    }
+
+    std::string bloom;
+    if (options_.bloom_bits_per_key > 0) {
+        bloom = BloomFilter::Build(key_hashes_, options_.bloom_bits_per_key);
+    }
+    std::string meta;
+    putU32(meta, static_cast<uint32_t>(smallest_.size()));
+    meta.append(smallest_);
+    putU32(meta, static_cast<uint32_t>(largest_.size()));
+    meta.append(largest_);
+    if (options_.compression) {
+        meta.push_back(static_cast<char>(kCodecDictLz));
+        std::string dict = dict_ ? dict_->Content() : std::string();
+        putU32(meta, static_cast<uint32_t>(dict.size()));
+        meta.append(dict);
+    }
+
+    std::string footer;
+    for (const std::string* block : {&index_, &bloom, &meta}) {
+        uint64_t offset;
+        uint64_t size;
+        if (!writeBlock(*block, offset, size)) {
+            return false;
+        }
+        putU64(footer, offset);
+        putU64(footer, size);
+    }
+    putU64(footer, num_entries_);
+    putU64(footer, kSstMagic);
+    if (!writeAll(fd_, footer.data(), footer.size()) || ::fsync(fd_) != 0) {
+        LOG_ERROR("SstBuilder: failed to finish {}: {}", path_, strerror(errno));
+        return false;
+    }
+    offset_ += footer.size();
+    file_crc_ = Crc32(footer.data(), footer.size(), file_crc_);
+
+    ::close(fd_);
+    fd_ = -1;
+    finished_ = true;
+    return true;
+}
+
+// ============================================================================
+// SstReader
+// ============================================================================
+
+SstReader::SstReader(std::string path, uint64_t number, int fd, uint64_t file_size) :
+    path_(std::move(path)), number_(number), fd_(fd), file_size_(file_size), num_entries_(0), obsolete_(false),
+    compressed_(false) {}
+
+SstReader::~SstReader() {
+    ::close(fd_);
+    if (obsolete_.load(std::memory_order_acquire)) {
+        ::unlink(path_.c_str());
+    }
+}
+
+std::shared_ptr<SstReader> SstReader::Open(const std::string& path, uint64_t number) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("SstReader: failed to open {}: {}", path, strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<SstReader> reader(new SstReader(path, number, fd, static_cast<uint64_t>(st.st_size)));
+    if (!reader->load()) {
+        LOG_ERROR("SstReader: corrupted table {}", path);
+        return nullptr;
+    }
+    return reader;
+}
+
+bool SstReader::readBlock(uint64_t offset, uint64_t size, std::string& block) const {
+    if (offset + size + 4 > file_size_) {
+        return false;
+    }
+    block.resize(size + 4);
+    if (!preadAll(fd_, block.data(), block.size(), offset)) {
+        return false;
+    }
+    uint32_t expected = getU32(block.data() + size);
+    block.resize(size);
+    return Crc32(block.data(), block.size()) == expected;
+}
+
+bool SstReader::load() {
+    if (file_size_ < kSstFooterSize) {
+        return false;
+    }
+    std::string footer(kSstFooterSize, '\0');
+    if (!preadAll(fd_, footer.data(), footer.size(), file_size_ - kSstFooterSize)) {
+        return false;
+    }
+    if (getU64(footer.data() + 56) != kSstMagic) {
+        return false;
+    }
+    num_entries_ = getU64(footer.data() + 48);
+
+    std::string index;
+    std::string meta;
+    if (!readBlock(getU64(footer.data()), getU64(footer.data() + 8), index) ||
+        !readBlock(getU64(footer.data() + 16), getU64(footer.data() + 24), bloom_) ||
+        !readBlock(getU64(footer.data() + 32), getU64(footer.data() + 40), meta)) {
+        return false;
+    }
+
+    size_t pos = 0;
+    while (pos < index.size()) {
+        BlockHandle handle;
+        if (!getLengthPrefixed(index, pos, handle.last_key) || pos + 16 > index.size()) {
+            return false;
+        }
+        handle.offset = getU64(index.data() + pos);
+        handle.size = getU64(index.data() + pos + 8);
+        pos += 16;
+        blocks_.push_back(std::move(handle));
+    }
+
+    pos = 0;
+    if (!getLengthPrefixed(meta, pos, smallest_) || !getLengthPrefixed(meta, pos, largest_)) {
+        return false;
+    }
+    // 未压缩的文件到此为止
+    if (pos == meta.size()) {
+        return true;
+    }
+    std::string dict;
+    if (static_cast<uint8_t>(meta[pos++]) != kCodecDictLz || !getLengthPrefixed(meta, pos, dict)) {
+        return false;
+    }
+    compressed_ = true;
+    if (!dict.empty()) {
+        dict_ = std::make_shared<CompressionDict>(std::move(dict));
+    }
+    return true;
+}
+
+bool SstReader::readDataBlock(size_t index, std::string& block) const {
+    const auto& handle = blocks_[index];
+    if (!readBlock(handle.offset, handle.size, block)) {
+        return false;
+    }
+    if (!compressed_) {
+        return true;
+    }
+    if (block.empty()) {
+        return false;
+    }
+    if (block[0] == kBlockRaw) {
+        block.erase(0, 1);
+        return true;
+    }
+    std::string raw;
+    if (block[0] != kBlockCompressed || !Decompress(std::string_view(block).substr(1), dict_.get(), raw)) {
+        return false;
+    }
+    block.swap(raw);
+    return true;
+}
+
+size_t SstReader::findBlock(const std::string& key) const {
+    auto it = std::lower_bound(blocks_.begin(), blocks_.end(), key,
+                               [](const BlockHandle& handle, const std::string& k) {
+                                   return handle.last_key < k;
+                               });
+    return it - blocks_.begin();
+}
+
+SstReader::LookupResult SstReader::Get(const std::string& key, std::string& value) const {
+    return Get(key, BloomFilter::HashKey(key), value);
+}
+
+SstReader::LookupResult SstReader::Get(const std::string& key, uint64_t hash, std::string& value) const {
+    if (key < smallest_ || key > largest_ || !BloomFilter::MayContain(bloom_, hash)) {
+        return LookupResult::NOT_FOUND;
+    }
+    size_t b = findBlock(key);
+    if (b == blocks_.size()) {
+        return LookupResult::NOT_FOUND;
+    }
+
+    std::string block;
+    if (!readDataBlock(b, block)) {
+        LOG_ERROR("SstReader: corrupted data in {} block {}", path_, b);
+        return LookupResult::ERROR;
+    }
+    std::string k;
+    std::string v;
+    bool deleted;
+    size_t pos = 0;
+    while (parseEntry(block, pos, k, v, deleted)) {
+        if (k == key) {
+            if (deleted) {
+                return LookupResult::DELETED;
+            }
+            value = std::move(v);
+            return LookupResult::FOUND;
+        }
+        if (k > key) {
+            return LookupResult::NOT_FOUND;
+        }
+    }
+    if (pos != block.size()) {
+        LOG_ERROR("SstReader: truncated entry in {} block {}", path_, b);
+        return LookupResult::ERROR;
+    }
+    return LookupResult::NOT_FOUND;
+}
+
+bool SstReader::VerifyChecksums() const {
+    std::string block;
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        if (!readDataBlock(i, block)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// SstIterator
+// ============================================================================
+
+class SstIterator : public EntryIterator {
+public:
+    explicit SstIterator(std::shared_ptr<const SstReader> reader) :
+        reader_(std::move(reader)), block_index_(0), pos_(0), valid_(false), ok_(true), deleted_(false) {}
+
+    bool Valid() const override { return valid_; }
+    bool status() const override { return ok_; }
+
+    void SeekToFirst() override {
+        loadBlock(0);
+        advance();
+    }
+
+    void Seek(const std::string& target) override {
+        loadBlock(reader_->findBlock(target));
+        advance();
+        while (valid_ && key_ < target) {
+            advance();
+        }
+    }
+
+    void Next() override { advance(); }
+
+    const std::string& key() const override { return key_; }
+    const std::string& value() const override { return value_; }
+    bool deleted() const override { return deleted_; }
+
+private:
+    // 出错后停在末尾，status()一直为false
+    void loadBlock(size_t index) {
+        block_index_ = ok_ ? index : reader_->blocks_.size();
+        pos_ = 0;
+        block_.clear();
+        if (block_index_ < reader_->blocks_.size() && !reader_->readDataBlock(block_index_, block_)) {
+            LOG_ERROR("SstReader: corrupted data in {} block {}", reader_->path_, block_index_);
+            fail();
+        }
+    }
+
+    // 读取下一条，当前块读完时切换到下一个块
+    void advance() {
+        while (block_index_ < reader_->blocks_.size()) {
+            if (parseEntry(block_, pos_, key_, value_, deleted_)) {
+                valid_ = true;
+                return;
+            }
+            if (pos_ != block_.size()) {
+                LOG_ERROR("SstReader: truncated entry in {} block {}", reader_->path_, block_index_);
+                fail();
+                break;
+            }
+            loadBlock(block_index_ + 1);
+        }
+        valid_ = false;
+    }
+
+    void fail() {
+        ok_ = false;
+        block_index_ = reader_->blocks_.size();
+        block_.clear();
+        pos_ = 0;
+    }
+
+    std::shared_ptr<const SstReader> reader_;
+    size_t block_index_;
+    std::string block_;
+    size_t pos_;
+    bool valid_;
+    bool ok_;
+    std::string key_;
+    std::string value_;
+    bool deleted_;
+};
+
+EntryIteratorPtr SstReader::NewIterator() const {
+    return std::make_unique<SstIterator>(shared_from_this());
+}
+
+} // namespace kv
@@ -0,0 +1,117 @@
+#include "include/ttl_expirer.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace kv {
+
+struct TtlExpirer::State {
+    KvStateMachinePtr sm;
+    ProposeFunc propose;
+    TtlExpirerOptions options;
+    std::atomic<bool> stopped{true};
+    std::atomic<uint64_t> expired_count{0};
+
+    fiber::FiberMutex mu;
+    fiber::FiberCondition idle;
+    bool running = false;                   // 上一次tick是否还在提交，由mu保护
+};
+
+TtlExpirer::TtlExpirer(KvStateMachinePtr sm, ProposeFunc propose, TtlExpirerOptions options) :
+    state_(std::make_shared<State>()) {
+    state_->sm = std::move(sm);
+    state_->propose = std::move(propose);
+    state_->options = options;
+}
+
+TtlExpirer::~TtlExpirer() {
+    Stop();
+}
+
+void TtlExpirer::Start() {
+    if (!state_->stopped.exchange(false)) {
+        return;
+    }
+    std::weak_ptr<State> weak = state_;
+    timer_ = fiber::TimerWheel::getInstance().addTimer(
+        state_->options.tick_ms,
+        [weak]() {
+            if (auto state = weak.lock()) {
+                tick(state);
+            }
+        },
+        true);
+    LOG_INFO("TtlExpirer: started (tick={}ms, max {} keys/tick)", state_->options.tick_ms,
+             state_->options.max_keys_per_tick);
+}
+
+void TtlExpirer::Stop() {
+    if (state_->stopped.exchange(true)) {
+        return;
+    }
+    fiber::TimerWheel::getInstance().cancel(timer_);
+    std::unique_lock<fiber::FiberMutex> lock(state_->mu);
+    while (state_->running) {
+        state_->idle.wait(lock);
+    }
+}
+
+uint64_t TtlExpirer::ExpiredCount() const {
+    return state_->expired_count.load(std::memory_order_relaxed);
+}
+
+void TtlExpirer::tick(const std::shared_ptr<State>& state) {
+    // 定时器回调中不阻塞：提交放到独立fiber中，上一次还没完成时跳过本次
+    {
+        std::unique_lock<fiber::FiberMutex> lock(state->mu);
+        if (state->stopped.load(std::memory_order_acquire) || state->running) {
+            return;
+        }
+        state->running = true;
+    }
+    fiber::Fiber::go([state]() {
+        if (!state->stopped.load(std::memory_order_acquire)) {
+            runOnce(*state, NowUnixMs());
+        }
+        std::unique_lock<fiber::FiberMutex> lock(state->mu);
+        state->running = false;
+        state->idle.notify_all();
+    });
+}
+
+size_t TtlExpirer::RunOnce(uint64_t now_ms) {
+    return runOnce(*state_, now_ms);
+}
+
+size_t TtlExpirer::runOnce(State& state, uint64_t now_ms) {
+    const auto& options = state.options;
+    size_t total = 0;
+    while (total < options.max_keys_per_tick) {
+        size_t limit = std::min(options.max_keys_per_entry, options.max_keys_per_tick - total);
+        auto expired = state.sm->PopExpired(now_ms, limit);
+        if (expired.empty()) {
+            break;
+        }
+
+        KvCommand cmd;
+        cmd.op = KvOp::EXPIRE;
+        cmd.ops.reserve(expired.size());
+        for (const auto& entry : expired) {
+            cmd.ops.push_back(KvMutation{KvOp::DELETE, entry.key, std::string(), entry.expire_at_ms});
+        }
+        auto result = state.propose(cmd);
+        if (result.status != KvStatus::OK) {
+            // 不是leader（或提交失败）：放回索引，之后的tick重试
+            state.sm->RequeueExpired(expired);
+            break;
+        }
+        total += expired.size();
+    }
+    if (total > 0) {
+        state.expired_count.fetch_add(total, std::memory_order_relaxed);
+        LOG_DEBUG("TtlExpirer: expired {} keys", total);
+    }
+    return total;
+}
+
+} // namespace kv
@@ -0,0 +1,125 @@
+#include "include/ttl_index.h"
+#include <chrono>
+#include <mutex>
+
+namespace kv {
+
+uint64_t NowUnixMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t TtlIndex::bucketOf(uint64_t expire_at_ms) {
+    // 桶以截止时间标识（向上取整），桶截止时间 <= now 时桶内的key一定都已过期
+    return (expire_at_ms + kBucketMs - 1) / kBucketMs * kBucketMs;
+}
+
+void TtlIndex::Set(const std::string& key, uint64_t expire_at_ms) {
+    if (expire_at_ms == 0) {
+        Remove(key);
+        return;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto [it, inserted] = deadlines_.try_emplace(key, expire_at_ms);
+    if (!inserted) {
+        if (it->second == expire_at_ms) {
+            return;
+        }
+        it->second = expire_at_ms;
+    }
+    buckets_[bucketOf(expire_at_ms)].push_back(key);
+    size_.store(deadlines_.size(), std::memory_order_release);
+}
+
+void TtlIndex::Remove(const std::string& key) {
+    if (Size() == 0) {
+        return;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    deadlines_.erase(key);
+    size_.store(deadlines_.size(), std::memory_order_release);
+}
+
+uint64_t TtlIndex::Deadline(const std::string& key) {
+    if (Size() == 0) {
+        return 0;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    auto it = deadlines_.find(key);
+    return it == deadlines_.end() ? 0 : it->second;
+}
+
+bool TtlIndex::Expired(const std::string& key, uint64_t now_ms) {
+    uint64_t deadline = Deadline(key);
+    return deadline != 0 && deadline <= now_ms;
+}
+
+std::vector<KvTtl> TtlIndex::PopExpired(uint64_t now_ms, size_t limit) {
+    std::vector<KvTtl> expired;
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    while (!buckets_.empty() && expired.size() < limit) {
+        auto bucket = buckets_.begin();
+        if (bucket->first > now_ms) {
+            break;
+        }
+        auto& keys = bucket->second;
+        while (!keys.empty() && expired.size() < limit) {
+            auto it = deadlines_.find(keys.back());
+            // TTL已被清除或推迟到其他桶时跳过
+            if (it != deadlines_.end() && bucketOf(it->second) == bucket->first) {
+                expired.push_back(KvTtl{it->first, it->second});
+            }
+            keys.pop_back();
+        }
+        if (keys.empty()) {
+            buckets_.erase(bucket);
+        }
+    }
+    return expired;
+}
+
+void TtlIndex::Requeue(const std::vector<KvTtl>& entries) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    for (const auto& entry : entries) {
+        auto it = deadlines_.find(entry.key);
+        if (it != deadlines_.end() && it->second == entry.expire_at_ms) {
+            buckets_[bucketOf(entry.expire_at_ms)].push_back(entry.key);
+        }
+    }
+}
+
+std::vector<bool> TtlIndex::RemoveMatching(const std::vector<KvTtl>& entries) {
+    std::vector<bool> removed(entries.size(), false);
+    if (Size() == 0) {
+        return removed;
+    }
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        auto it = deadlines_.find(entries[i].key);
+        if (it != deadlines_.end() && it->second == entries[i].expire_at_ms) {
+            deadlines_.erase(it);
+            removed[i] = true;
+        }
+    }
+    size_.store(deadlines_.size(), std::memory_order_release);
+    return removed;
+}
+
+std::vector<KvTtl> TtlIndex::Entries() {
+    std::vector<KvTtl> entries;
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    entries.reserve(deadlines_.size());
+    for (const auto& [key, expire_at_ms] : deadlines_) {
+        entries.push_back(KvTtl{key, expire_at_ms});
+    }
+    return entries;
+}
+
+void TtlIndex::Clear() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    deadlines_.clear();
+    buckets_.clear();
+    size_.store(0, std::memory_order_release);
+}
+
+} // namespace kv
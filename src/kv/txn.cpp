@@ -0,0 +1,386 @@
+#include "include/txn.h"
+#include "include/kv_rpc.h"
+#include "fiber.h"
+#include "logger.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <unordered_set>
+
+namespace kv {
+
+namespace {
+
+// 组在提交期间被分裂或合并时重新分组的次数上限
+constexpr int kMaxRegroupRounds = 4;
+
+uint64_t newTxnId() {
+    static thread_local std::mt19937_64 gen(std::random_device{}());
+    uint64_t id = 0;
+    while (id == 0) {
+        id = gen();
+    }
+    return id;
+}
+
+// 事务命令的ops只用来携带key
+KvCommand txnCommand(KvOp op, const TxnMeta& meta, TxnState state, const std::vector<std::string>& keys) {
+    KvCommand cmd;
+    cmd.op = op;
+    cmd.txn = meta;
+    cmd.txn.state = state;
+    cmd.txn.keys.clear();
+    cmd.ops.reserve(keys.size());
+    for (const auto& key : keys) {
+        cmd.ops.push_back(KvMutation{KvOp::DELETE, key});
+    }
+    return cmd;
+}
+
+} // namespace
+
+TxnCoordinator::TxnCoordinator(GroupFunc group, ProposeFunc propose, StateMachineFunc sm, TxnOptions options) :
+    group_(std::move(group)), propose_(std::move(propose)), sm_(std::move(sm)), options_(options) {}
+
+TxnCoordinator::~TxnCoordinator() {
+    Drain();
+}
+
+void TxnCoordinator::Drain() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    while (finishing_ > 0) {
+        cond_.wait(lock);
+    }
+}
+
+// ============================================================================
+// 执行事务
+// ============================================================================
+
+TxnResult TxnCoordinator::Execute(const std::vector<KvMutation>& writes, const std::vector<KvCompare>& compares,
+                                  const RequestId& request) {
+    TxnResult result;
+    std::unordered_set<std::string> written;
+    std::unordered_set<std::string> compared;
+    bool valid = !writes.empty() && writes.size() + compares.size() <= kMaxBatchSize;
+    for (const auto& op : writes) {
+        valid = valid && (op.op == KvOp::PUT || op.op == KvOp::APPEND || op.op == KvOp::DELETE) &&
+                !op.key.empty() && !IsTxnKey(op.key) && written.insert(op.key).second;
+    }
+    for (const auto& compare : compares) {
+        valid = valid && !compare.key.empty() && !IsTxnKey(compare.key) && compared.insert(compare.key).second;
+    }
+    if (!valid) {
+        result.status = KvStatus::INVALID_ARGUMENT;
+        return result;
+    }
+
+    for (int attempt = 0;; ++attempt) {
+        result = attemptOnce(writes, compares, request);
+        bool retry = result.status == KvStatus::TXN_CONFLICT || result.status == KvStatus::TXN_ABORTED;
+        if (!retry || attempt >= options_.max_retries) {
+            return result;
+        }
+        // 等另一个事务结束（超时则替它完成恢复）后换一个事务id重试
+        if (result.status == KvStatus::TXN_CONFLICT && !ResolveIntent(result.key)) {
+            return result;
+        }
+    }
+}
+
+TxnResult TxnCoordinator::attemptOnce(const std::vector<KvMutation>& writes, const std::vector<KvCompare>& compares,
+                                      const RequestId& request) {
+    TxnMeta meta;
+    meta.id = newTxnId();
+    meta.anchor = writes.front().key;
+    meta.start_ms = NowUnixMs();
+    meta.timeout_ms = options_.timeout_ms;
+    TxnResult result;
+    result.txn_id = meta.id;
+
+    std::map<uint64_t, Part> parts;
+    std::vector<std::string> keys;      // 事务的全部key，同时被写入和检查的key只出现一次
+    std::unordered_set<std::string_view> seen;
+    auto partFor = [&](const std::string& key) -> Part* {
+        uint64_t id = group_(key);
+        if (id == 0) {
+            result.status = KvStatus::WRONG_SHARD;
+            result.key = key;
+            return nullptr;
+        }
+        if (seen.insert(key).second) {
+            keys.push_back(key);
+        }
+        auto& part = parts[id];
+        if (part.route.empty()) {
+            part.route = key;
+        }
+        return &part;
+    };
+    for (const auto& op : writes) {
+        Part* part = partFor(op.key);
+        if (!part) {
+            return result;
+        }
+        part->ops.push_back(op);
+    }
+    for (const auto& compare : compares) {
+        Part* part = partFor(compare.key);
+        if (!part) {
+            return result;
+        }
+        part->compares.push_back(compare);
+    }
+
+    // 各组并行PREPARE，anchor所在组同时写入事务记录
+    uint64_t anchor_group = group_(meta.anchor);
+    std::vector<std::pair<std::string, KvCommand>> prepares;
+    size_t anchor_index = 0;
+    for (auto& [id, part] : parts) {
+        KvCommand cmd;
+        cmd.op = KvOp::TXN_PREPARE;
+        cmd.ops = std::move(part.ops);
+        cmd.compares = std::move(part.compares);
+        cmd.txn = meta;
+        if (id == anchor_group) {
+            cmd.txn.keys = keys;
+            cmd.txn.request = request;
+            anchor_index = prepares.size();
+        }
+        prepares.emplace_back(std::move(part.route), std::move(cmd));
+    }
+    std::vector<KvResult> results(prepares.size());
+    if (prepares.size() == 1) {
+        results[0] = propose_(prepares[0].first, prepares[0].second);
+    } else {
+        fiber::WaitGroup wg;
+        wg.add(static_cast<int>(prepares.size()));
+        for (size_t i = 0; i < prepares.size(); ++i) {
+            fiber::Fiber::go([&, i]() {
+                results[i] = propose_(prepares[i].first, prepares[i].second);
+                wg.done();
+            });
+        }
+        wg.wait();
+    }
+
+    if (results[anchor_index].status == KvStatus::OK && !results[anchor_index].value.empty()) {
+        // 同一个请求的事务已经提交过：anchor所在组没有执行PREPARE，也不会再有事务记录，
+        // 只需丢弃本次在其他组写入的intent
+        if (prepares.size() > 1) {
+            TxnResult ignored;
+            abort(meta, keys, false, ignored);
+        }
+        return result;
+    }
+
+    for (auto& prepared : results) {
+        if (prepared.status == KvStatus::OK) {
+            continue;
+        }
+        // 条件不成立和冲突优先报告，其余取第一个失败
+        bool keyed = prepared.status == KvStatus::CONDITION_FAILED || prepared.status == KvStatus::TXN_CONFLICT;
+        if (result.status == KvStatus::OK || keyed) {
+            result.status = prepared.status;
+            result.key = std::move(prepared.value);
+            if (keyed) {
+                break;
+            }
+        }
+    }
+    if (result.status == KvStatus::WRONG_SHARD) {
+        // 分组之后组被分裂或合并，中止后重新分组
+        result.status = KvStatus::TXN_ABORTED;
+        result.key.clear();
+    }
+
+    if (result.status != KvStatus::OK) {
+        // anchor所在组明确拒绝了PREPARE时事务记录不存在，也不会再被写入
+        KvStatus anchor_status = results[anchor_index].status;
+        bool has_record = anchor_status != KvStatus::CONDITION_FAILED && anchor_status != KvStatus::TXN_CONFLICT &&
+                          anchor_status != KvStatus::TXN_ABORTED && anchor_status != KvStatus::INVALID_ARGUMENT;
+        abort(meta, keys, has_record, result);
+        return result;
+    }
+    if (!options_.parallel_commit) {
+        finish(meta, keys);
+        return result;
+    }
+    {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        ++finishing_;
+    }
+    fiber::Fiber::go([this, meta = std::move(meta), keys = std::move(keys)]() {
+        finish(meta, keys);
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        if (--finishing_ == 0) {
+            cond_.notify_all();
+        }
+    });
+    return result;
+}
+
+void TxnCoordinator::finish(const TxnMeta& meta, const std::vector<std::string>& keys) {
+    TxnRecord record;
+    KvStatus status = endTxn(meta, TxnState::COMMITTED, record);
+    if (status == KvStatus::TXN_ABORTED) {
+        // 所有intent都已写入时恢复流程只会判定提交，不应出现
+        LOG_ERROR("TxnCoordinator: prepared txn {:#x} was aborted", meta.id);
+        resolveKeys(meta, TxnState::ABORTED, keys);
+        return;
+    }
+    if (status != KvStatus::OK) {
+        // 记录仍是STAGING，事务已隐式提交，由遇到intent的请求完成清理
+        LOG_WARN("TxnCoordinator: failed to commit record of txn {:#x}, status {}", meta.id, static_cast<int>(status));
+        return;
+    }
+    if (!resolveKeys(meta, TxnState::COMMITTED, keys)) {
+        LOG_WARN("TxnCoordinator: failed to resolve intents of txn {:#x}", meta.id);
+    }
+}
+
+void TxnCoordinator::abort(const TxnMeta& meta, const std::vector<std::string>& keys, bool has_record,
+                           TxnResult& result) {
+    // 记录可能存在（或PREPARE还可能迟到）时先置为ABORTED；不需要时不留下记录
+    TxnRecord record;
+    KvStatus status = has_record ? endTxn(meta, TxnState::ABORTED, record) : KvStatus::OK;
+    if (status == KvStatus::CONDITION_FAILED) {
+        // 报告失败的PREPARE实际已生效，恢复流程已判定事务提交
+        resolveKeys(meta, TxnState::COMMITTED, keys);
+        result.status = KvStatus::OK;
+        result.key.clear();
+        return;
+    }
+    // 记录没能置为ABORTED时不能丢弃intent，留给恢复流程
+    if (status != KvStatus::OK || !resolveKeys(meta, TxnState::ABORTED, keys)) {
+        LOG_WARN("TxnCoordinator: failed to abort txn {:#x}, status {}", meta.id, static_cast<int>(status));
+    }
+}
+
+// ============================================================================
+// 提交到各组
+// ============================================================================
+
+bool TxnCoordinator::proposeGrouped(const std::vector<std::string>& keys, const MakeFunc& make,
+                                    const DoneFunc& done) {
+    std::vector<std::string> remaining = keys;
+    for (int round = 0; !remaining.empty(); ++round) {
+        if (round == kMaxRegroupRounds) {
+            return false;
+        }
+        std::map<uint64_t, std::vector<std::string>> groups;
+        for (auto& key : remaining) {
+            uint64_t id = group_(key);
+            if (id == 0) {
+                return false;
+            }
+            groups[id].push_back(std::move(key));
+        }
+        remaining.clear();
+        for (auto& [id, group] : groups) {
+            auto result = propose_(group.front(), make(group));
+            if (result.status == KvStatus::WRONG_SHARD) {
+                remaining.insert(remaining.end(), group.begin(), group.end());
+                continue;
+            }
+            if (result.status != KvStatus::OK) {
+                return false;
+            }
+            if (done) {
+                done(group, result);
+            }
+        }
+    }
+    return true;
+}
+
+KvStatus TxnCoordinator::endTxn(const TxnMeta& meta, TxnState state, TxnRecord& record) {
+    KvCommand cmd = txnCommand(KvOp::TXN_END, meta, state, {});
+    cmd.txn.now_ms = NowUnixMs();
+    auto result = propose_(meta.anchor, cmd);
+    bool decided = result.status == KvStatus::OK || result.status == KvStatus::TXN_ABORTED ||
+                   result.status == KvStatus::CONDITION_FAILED;
+    if (decided && !DecodeTxnValue(result.value, record)) {
+        return KvStatus::INVALID_ARGUMENT;
+    }
+    return result.status;
+}
+
+bool TxnCoordinator::resolveKeys(const TxnMeta& meta, TxnState state, const std::vector<std::string>& keys) {
+    // 提交的事务记录随anchor所在组的RESOLVE删除，之前其他组的intent必须都已清理
+    uint64_t anchor_group = group_(meta.anchor);
+    std::vector<std::string> anchor_keys;
+    std::vector<std::string> others;
+    for (const auto& key : keys) {
+        (group_(key) == anchor_group ? anchor_keys : others).push_back(key);
+    }
+    auto make = [&](const std::vector<std::string>& part) {
+        return txnCommand(KvOp::TXN_RESOLVE, meta, state, part);
+    };
+    return proposeGrouped(others, make) && proposeGrouped(anchor_keys, make);
+}
+
+// ============================================================================
+// 等待与恢复
+// ============================================================================
+
+bool TxnCoordinator::ResolveIntent(const std::string& key, bool for_read) {
+    while (true) {
+        // 每次重新取状态机：等待期间key可能随分片迁移
+        auto sm = sm_(key);
+        TxnIntent intent;
+        if (!sm || !sm->PendingIntent(key, intent) || (for_read && intent.op == KvOp::GET)) {
+            return true;
+        }
+        uint64_t now = NowUnixMs();
+        uint64_t deadline = intent.start_ms + intent.timeout_ms;
+        if (now < deadline) {
+            sm->WaitIntent(key, intent.id, deadline - now);
+            continue;
+        }
+        if (!recover(key, intent)) {
+            return false;
+        }
+    }
+}
+
+bool TxnCoordinator::recover(const std::string& key, const TxnIntent& intent) {
+    TxnMeta meta;
+    meta.id = intent.id;
+    meta.anchor = intent.anchor;
+    meta.start_ms = intent.start_ms;
+    meta.timeout_ms = intent.timeout_ms;
+
+    TxnRecord record;
+    KvStatus status = endTxn(meta, TxnState::PENDING, record);
+    if (status != KvStatus::OK) {
+        return false;
+    }
+    if (record.state == TxnState::STAGING) {
+        // 协调者没有完成提交：intent都在则已隐式提交，否则隔离缺少的key并中止
+        bool complete = true;
+        auto make = [&](const std::vector<std::string>& part) {
+            return txnCommand(KvOp::TXN_FENCE, meta, TxnState::PENDING, part);
+        };
+        auto done = [&](const std::vector<std::string>&, const KvResult& result) {
+            complete = complete && std::all_of(result.statuses.begin(), result.statuses.end(),
+                                               [](KvStatus s) { return s == KvStatus::OK; });
+        };
+        if (!proposeGrouped(record.keys, make, done)) {
+            return false;
+        }
+        status = endTxn(meta, complete ? TxnState::COMMITTED : TxnState::ABORTED, record);
+        if (status != KvStatus::OK && status != KvStatus::TXN_ABORTED && status != KvStatus::CONDITION_FAILED) {
+            return false;
+        }
+    }
+    // 没有记录的事务被置为ABORTED，记录中没有key列表，只清理遇到的这个key
+    std::vector<std::string> keys = record.keys.empty() ? std::vector<std::string>{key} : record.keys;
+    LOG_INFO("TxnCoordinator: recovered txn {:#x} as {}", meta.id,
+             record.state == TxnState::COMMITTED ? "committed" : "aborted");
+    return resolveKeys(meta, record.state, keys);
+}
+
+} // namespace kv
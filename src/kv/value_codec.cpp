@@ -0,0 +1,299 @@
+#include "include/value_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace kv {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr int kDictHashBits = 14;
+constexpr int kMinLocalHashBits = 8;
+constexpr int kMaxLocalHashBits = 16;
+
+// 训练参数：按8字节片段统计出现在多少个样本中，以32字节为单位挑选字典片段
+constexpr size_t kGram = 8;
+constexpr size_t kSegment = 32;
+constexpr size_t kMinTrainSamples = 8;
+
+uint32_t load32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t load64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash4(uint32_t v, int bits) {
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+void putVarint(std::string& dst, uint64_t v) {
+    while (v >= 0x80) {
+        dst.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    dst.push_back(static_cast<char>(v));
+}
+
+bool getVarint(std::string_view src, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < src.size(); shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(src[pos++]);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t matchLength(const char* a, const char* a_end, const char* b, const char* b_end) {
+    size_t len = 0;
+    while (a + len < a_end && b + len < b_end && a[len] == b[len]) {
+        ++len;
+    }
+    return len;
+}
+
+void emitLiterals(std::string& out, std::string_view input, size_t begin, size_t end) {
+    putVarint(out, end - begin);
+    out.append(input.data() + begin, end - begin);
+}
+
+} // namespace
+
+// ============================================================================
+// CompressionDict
+// ============================================================================
+
+CompressionDict::CompressionDict(std::string content) : content_(std::move(content)) {
+    if (content_.size() > kMaxSize) {
+        // 保留末尾：训练时价值最高的片段放在最后
+        content_.erase(0, content_.size() - kMaxSize);
+    }
+    table_.assign(size_t(1) << kDictHashBits, 0);
+    for (size_t i = 0; i + kMinMatch <= content_.size(); ++i) {
+        table_[hash4(load32(content_.data() + i), kDictHashBits)] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+// ============================================================================
+// 压缩与解压
+// ============================================================================
+
+std::string Compress(std::string_view input, const CompressionDict* dict) {
+    std::string out;
+    out.reserve(input.size() / 2 + 16);
+    putVarint(out, input.size());
+
+    const char* in = input.data();
+    const size_t n = input.size();
+    int bits = kMinLocalHashBits;
+    while (bits < kMaxLocalHashBits && (size_t(1) << bits) < n) {
+        ++bits;
+    }
+    std::vector<uint32_t> table(size_t(1) << bits, 0);
+
+    const char* dict_data = dict ? dict->content_.data() : nullptr;
+    const size_t dict_size = dict ? dict->content_.size() : 0;
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + kMinMatch <= n) {
+        uint32_t seq = load32(in + i);
+        size_t best_len = 0;
+        size_t best_dist = 0;
+
+        uint32_t& slot = table[hash4(seq, bits)];
+        if (slot != 0 && load32(in + slot - 1) == seq) {
+            size_t candidate = slot - 1;
+            best_len = matchLength(in + candidate, in + n, in + i, in + n);
+            best_dist = i - candidate;
+        }
+        slot = static_cast<uint32_t>(i + 1);
+
+        if (dict_size > 0) {
+            uint32_t entry = dict->table_[hash4(seq, kDictHashBits)];
+            if (entry != 0 && load32(dict_data + entry - 1) == seq) {
+                size_t candidate = entry - 1;
+                size_t len = matchLength(dict_data + candidate, dict_data + dict_size, in + i, in + n);
+                if (len > best_len) {
+                    best_len = len;
+                    best_dist = dict_size - candidate + i;
+                }
+            }
+        }
+
+        if (best_len < kMinMatch) {
+            ++i;
+            continue;
+        }
+        emitLiterals(out, input, anchor, i);
+        putVarint(out, best_len - kMinMatch);
+        putVarint(out, best_dist);
+        // 匹配覆盖的位置也登记进哈希表，后面的重复片段可以引用它们
+        size_t end = i + best_len;
+        for (++i; i < end && i + kMinMatch <= n; ++i) {
+            table[hash4(load32(in + i), bits)] = static_cast<uint32_t>(i + 1);
+        }
+        i = end;
+        anchor = end;
+    }
+    if (anchor < n) {
+        emitLiterals(out, input, anchor, n);
+    }
+    return out;
+}
+
+bool Decompress(std::string_view input, const CompressionDict* dict, std::string& out) {
+    size_t pos = 0;
+    uint64_t raw_size = 0;
+    if (!getVarint(input, pos, raw_size) || raw_size > (uint64_t(1) << 32)) {
+        return false;
+    }
+    const char* dict_data = dict ? dict->Content().data() : nullptr;
+    const size_t dict_size = dict ? dict->Size() : 0;
+
+    out.clear();
+    // raw_size来自输入，损坏或恶意的数据可以声明接近4GiB；只按输入大小预留，
+    // 超出部分随实际解出的数据增长
+    out.reserve(std::min<uint64_t>(raw_size, input.size() * 4 + 64));
+    while (out.size() < raw_size) {
+        uint64_t literals = 0;
+        if (!getVarint(input, pos, literals) || literals > input.size() - pos ||
+            literals > raw_size - out.size()) {
+            return false;
+        }
+        out.append(input.data() + pos, literals);
+        pos += literals;
+        if (out.size() == raw_size) {
+            break;
+        }
+
+        uint64_t len = 0;
+        uint64_t dist = 0;
+        if (!getVarint(input, pos, len) || !getVarint(input, pos, dist)) {
+            return false;
+        }
+        len += kMinMatch;
+        if (dist == 0 || dist > out.size() + dict_size || len > raw_size - out.size()) {
+            return false;
+        }
+        if (dist > out.size()) {
+            // 先复制落在字典里的部分
+            size_t from = dict_size - (dist - out.size());
+            size_t count = std::min<size_t>(len, dict_size - from);
+            out.append(dict_data + from, count);
+            len -= count;
+        }
+        // 剩余部分在已输出的数据中，可能与正在写入的位置重叠，逐字节复制
+        size_t from = out.size() - dist;
+        for (uint64_t k = 0; k < len; ++k) {
+            out.push_back(out[from + k]);
+        }
+    }
+    return pos == input.size();
+}
+
+// ============================================================================
+// 字典训练
+// ============================================================================
+
+CompressionDictPtr TrainDictionary(const std::vector<std::string>& samples, size_t dict_size) {
+    dict_size = std::min(dict_size, CompressionDict::kMaxSize);
+    if (samples.size() < kMinTrainSamples || dict_size < kSegment) {
+        return nullptr;
+    }
+
+    // 每个8字节片段出现在多少个样本中（同一样本内只计一次）
+    struct GramCount {
+        uint32_t samples = 0;
+        uint32_t last_sample = UINT32_MAX;
+    };
+    std::unordered_map<uint64_t, GramCount> grams;
+    for (uint32_t s = 0; s < samples.size(); ++s) {
+        const std::string& sample = samples[s];
+        for (size_t i = 0; i + kGram <= sample.size(); ++i) {
+            GramCount& count = grams[load64(sample.data() + i)];
+            if (count.last_sample != s) {
+                count.last_sample = s;
+                ++count.samples;
+            }
+        }
+    }
+
+    // 片段得分：其中只出现在一个样本里的gram不计分
+    auto score = [&grams](const std::string& sample, size_t offset, size_t length) {
+        uint64_t total = 0;
+        for (size_t i = offset; i + kGram <= offset + length; ++i) {
+            uint32_t count = grams[load64(sample.data() + i)].samples;
+            if (count > 1) {
+                total += count;
+            }
+        }
+        return total;
+    };
+
+    struct Candidate {
+        uint64_t score;
+        uint32_t sample;
+        uint32_t offset;
+        bool operator<(const Candidate& other) const { return score < other.score; }
+    };
+    std::priority_queue<Candidate> queue;
+    for (uint32_t s = 0; s < samples.size(); ++s) {
+        const std::string& sample = samples[s];
+        for (size_t offset = 0; offset + kGram <= sample.size(); offset += kSegment / 2) {
+            size_t length = std::min(kSegment, sample.size() - offset);
+            uint64_t value = score(sample, offset, length);
+            if (value > 0) {
+                queue.push(Candidate{value, s, static_cast<uint32_t>(offset)});
+            }
+        }
+    }
+
+    // 惰性贪心：选中片段后把其中的gram计数清零，后续候选重新打分，避免重复内容
+    std::vector<std::string_view> chosen;
+    size_t total = 0;
+    while (!queue.empty() && total < dict_size) {
+        Candidate top = queue.top();
+        queue.pop();
+        const std::string& sample = samples[top.sample];
+        size_t length = std::min(kSegment, sample.size() - top.offset);
+        uint64_t current = score(sample, top.offset, length);
+        if (current == 0) {
+            continue;
+        }
+        if (current < top.score && !queue.empty() && current < queue.top().score) {
+            top.score = current;
+            queue.push(top);
+            continue;
+        }
+        length = std::min(length, dict_size - total);
+        chosen.emplace_back(sample.data() + top.offset, length);
+        total += length;
+        for (size_t i = top.offset; i + kGram <= top.offset + length; ++i) {
+            grams[load64(sample.data() + i)].samples = 0;
+        }
+    }
+    if (chosen.empty()) {
+        return nullptr;
+    }
+
+    // 得分最高的片段放在最后，距离待压缩数据最近
+    std::string content;
+    content.reserve(total);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        content.append(it->data(), it->size());
+    }
+    return std::make_shared<CompressionDict>(std::move(content));
+}
+
+} // namespace kv
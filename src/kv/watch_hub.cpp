@@ -0,0 +1,253 @@
+#include "include/watch_hub.h"
+#include "logger.h"
+#include <algorithm>
+#include <mutex>
+
+namespace kv {
+
+// ============================================================================
+// Watcher
+// ============================================================================
+
+Watcher::Watcher(std::weak_ptr<WatchHub> hub, std::string key, bool prefix, uint64_t start_revision,
+                 size_t capacity) :
+    hub_(std::move(hub)), key_(std::move(key)), prefix_(prefix), capacity_(capacity == 0 ? 1 : capacity),
+    chan_(fiber::make_channel<std::vector<WatchEvent>>(capacity_)), next_revision_(start_revision) {}
+
+Watcher::~Watcher() {
+    Cancel();
+}
+
+bool Watcher::matches(const std::string& key) const {
+    if (prefix_) {
+        return key.compare(0, key_.size(), key_) == 0;
+    }
+    return key == key_;
+}
+
+KvStatus Watcher::Next(std::vector<WatchEvent>& events, uint64_t timeout_ms) {
+    events.clear();
+    while (true) {
+        if (compacted_.load(std::memory_order_acquire)) {
+            return KvStatus::COMPACTED;
+        }
+        // backlog_只在Subscribe返回前和本fiber调用resync时被写入
+        if (!backlog_.empty()) {
+            events.swap(backlog_);
+            next_revision_ = events.back().revision + 1;
+            return KvStatus::OK;
+        }
+        // 投递已暂停且channel已取空：从历史环追赶到最新，之后恢复投递
+        if (lagged_.load(std::memory_order_acquire) && pending_.load(std::memory_order_acquire) == 0) {
+            auto hub = hub_.lock();
+            if (!hub || !hub->resync(this, next_revision_)) {
+                compacted_.store(true, std::memory_order_release);
+                return KvStatus::COMPACTED;
+            }
+            continue;
+        }
+
+        std::vector<WatchEvent> batch;
+        if (!chan_->recv_timeout(batch, timeout_ms)) {
+            return compacted_.load(std::memory_order_acquire) ? KvStatus::COMPACTED : KvStatus::OK;
+        }
+        pending_.fetch_sub(1, std::memory_order_acq_rel);
+        if (!batch.empty() && batch.back().revision >= next_revision_) {
+            events = std::move(batch);
+            next_revision_ = events.back().revision + 1;
+            return KvStatus::OK;
+        }
+    }
+}
+
+void Watcher::Cancel() {
+    if (auto hub = hub_.lock()) {
+        hub->unsubscribe(this);
+    }
+    compacted_.store(true, std::memory_order_release);
+    chan_->close();
+}
+
+// ============================================================================
+// WatchHub
+// ============================================================================
+
+namespace {
+
+size_t eventBytes(const WatchEvent& event) {
+    return sizeof(WatchEvent) + event.key.size() + event.value.size();
+}
+
+} // namespace
+
+WatchHub::WatchHub(WatchOptions options) : options_(options) {}
+
+bool WatchHub::Collect(uint64_t revision) {
+    if (options_.history_bytes > 0) {
+        return true;
+    }
+    // 并行apply时各revision的调用顺序不定，只前进不后退
+    uint64_t skipped = skipped_revision_.load(std::memory_order_relaxed);
+    while (skipped < revision && !skipped_revision_.compare_exchange_weak(skipped, revision)) {
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return watcher_count_.load(std::memory_order_relaxed) > 0;
+}
+
+WatcherPtr WatchHub::Subscribe(const std::string& key, bool prefix, uint64_t start_revision) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    // 先计入订阅者再读取跳过的revision（与Collect的握手）
+    watcher_count_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t skipped = skipped_revision_.load(std::memory_order_relaxed);
+    if (start_revision == 0) {
+        start_revision = std::max(last_revision_, skipped) + 1;
+    }
+    if (start_revision <= std::max(compacted_revision_, skipped)) {
+        watcher_count_.fetch_sub(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    WatcherPtr watcher(new Watcher(weak_from_this(), key, prefix, start_revision, options_.channel_capacity));
+    replayLocked(watcher.get(), start_revision);
+    if (prefix) {
+        prefix_watchers_.push_back(watcher.get());
+    } else {
+        key_watchers_[key].push_back(watcher.get());
+    }
+    watcher->registered_ = true;
+    return watcher;
+}
+
+void WatchHub::Publish(uint64_t revision, std::vector<WatchEvent> events) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    last_revision_ = revision;
+
+    // 按事件顺序收集每个订阅者本批次的事件
+    std::vector<Watcher*> touched;
+    auto stage = [&touched](Watcher* watcher, const WatchEvent& event) {
+        if (watcher->lagged_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (watcher->staging_.empty()) {
+            touched.push_back(watcher);
+        }
+        watcher->staging_.push_back(event);
+    };
+    if (watcher_count_.load(std::memory_order_relaxed) > 0) {
+        for (const auto& event : events) {
+            if (!key_watchers_.empty()) {
+                auto it = key_watchers_.find(event.key);
+                if (it != key_watchers_.end()) {
+                    for (Watcher* watcher : it->second) {
+                        stage(watcher, event);
+                    }
+                }
+            }
+            for (Watcher* watcher : prefix_watchers_) {
+                if (watcher->matches(event.key)) {
+                    stage(watcher, event);
+                }
+            }
+        }
+    }
+
+    // pending_未达到容量时channel一定有空位，send不会阻塞
+    for (Watcher* watcher : touched) {
+        if (watcher->pending_.load(std::memory_order_acquire) >= watcher->capacity_) {
+            watcher->lagged_.store(true, std::memory_order_release);
+            watcher->staging_.clear();
+            continue;
+        }
+        watcher->pending_.fetch_add(1, std::memory_order_acq_rel);
+        watcher->chan_->send(std::move(watcher->staging_));
+        watcher->staging_.clear();
+    }
+
+    if (options_.history_bytes == 0) {
+        compacted_revision_ = revision;
+        return;
+    }
+    for (auto& event : events) {
+        history_used_ += eventBytes(event);
+        history_.push_back(std::move(event));
+    }
+    while (history_used_ > options_.history_bytes) {
+        compacted_revision_ = history_.front().revision;
+        history_used_ -= eventBytes(history_.front());
+        history_.pop_front();
+    }
+}
+
+void WatchHub::Reset(uint64_t revision) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    history_.clear();
+    history_used_ = 0;
+    compacted_revision_ = revision;
+    last_revision_ = revision;
+
+    auto detach = [](Watcher* watcher) {
+        watcher->registered_ = false;
+        watcher->compacted_.store(true, std::memory_order_release);
+        watcher->chan_->close();
+    };
+    for (auto& [key, watchers] : key_watchers_) {
+        std::for_each(watchers.begin(), watchers.end(), detach);
+    }
+    std::for_each(prefix_watchers_.begin(), prefix_watchers_.end(), detach);
+    key_watchers_.clear();
+    prefix_watchers_.clear();
+    watcher_count_.store(0, std::memory_order_release);
+}
+
+uint64_t WatchHub::OldestRevision() {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    return compacted_revision_ + 1;
+}
+
+bool WatchHub::replayLocked(Watcher* watcher, uint64_t start_revision) {
+    if (start_revision <= compacted_revision_) {
+        return false;
+    }
+    auto it = std::lower_bound(history_.begin(), history_.end(), start_revision,
+                               [](const WatchEvent& event, uint64_t revision) { return event.revision < revision; });
+    for (; it != history_.end(); ++it) {
+        if (watcher->matches(it->key)) {
+            watcher->backlog_.push_back(*it);
+        }
+    }
+    return true;
+}
+
+bool WatchHub::resync(Watcher* watcher, uint64_t start_revision) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    if (!watcher->registered_ || !replayLocked(watcher, start_revision)) {
+        return false;
+    }
+    watcher->lagged_.store(false, std::memory_order_release);
+    return true;
+}
+
+void WatchHub::unsubscribe(Watcher* watcher) {
+    std::unique_lock<fiber::FiberMutex> lock(mu_);
+    if (!watcher->registered_) {
+        return;
+    }
+    watcher->registered_ = false;
+    auto erase = [watcher](std::vector<Watcher*>& watchers) {
+        watchers.erase(std::remove(watchers.begin(), watchers.end(), watcher), watchers.end());
+    };
+    if (watcher->prefix_) {
+        erase(prefix_watchers_);
+    } else {
+        auto it = key_watchers_.find(watcher->key_);
+        if (it != key_watchers_.end()) {
+            erase(it->second);
+            if (it->second.empty()) {
+                key_watchers_.erase(it);
+            }
+        }
+    }
+    watcher_count_.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+} // namespace kv
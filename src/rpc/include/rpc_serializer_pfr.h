@@ -50,6 +50,17 @@ struct Serializer<uint64_t> {
     }
 };
 
+// int64_t
+template<>
+struct Serializer<int64_t> {
+    static Json::Value serialize(int64_t value) {
+        return Json::Value(static_cast<Json::Int64>(value));
+    }
+    static int64_t deserialize(const Json::Value& json) {
+        return json.asInt64();
+    }
+};
+
 // float
 template<>
 struct Serializer<float> {
@@ -94,6 +105,17 @@ struct Serializer<std::string> {
     }
 };
 
+// 枚举类型 - 按底层整数序列化
+template<typename T>
+struct Serializer<T, std::enable_if_t<std::is_enum_v<T>>> {
+    static Json::Value serialize(T value) {
+        return Json::Value(static_cast<Json::Int64>(static_cast<std::underlying_type_t<T>>(value)));
+    }
+    static T deserialize(const Json::Value& json) {
+        return static_cast<T>(json.asInt64());
+    }
+};
+
 // 容器类型
 template<typename T>
 struct Serializer<std::vector<T>> {
@@ -0,0 +1,195 @@
+#include "channel_select.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "sync.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace fiber;
+
+TEST(SelectTest, RunsTheReadyCase) {
+    auto a = make_mpmc_channel<int>(4);
+    auto b = make_mpmc_channel<std::string>(4);
+    b->send("hello");
+
+    std::string got;
+    Select sel;
+    sel.recv(a, [](int, bool) { FAIL() << "channel a is empty"; })
+        .recv(b, [&](std::string value, bool ok) {
+            EXPECT_TRUE(ok);
+            got = value;
+        });
+    EXPECT_EQ(sel.wait(), 1);
+    EXPECT_EQ(got, "hello");
+
+    // send case：有空位时直接送入
+    auto out = make_mpmc_channel<int>(1);
+    Select sender;
+    bool sent = false;
+    sender.send(out, 7, [&](bool ok) { sent = ok; });
+    EXPECT_EQ(sender.wait(), 0);
+    EXPECT_TRUE(sent);
+    int value = 0;
+    ASSERT_TRUE(out->tryRecv(value));
+    EXPECT_EQ(value, 7);
+
+    EXPECT_EQ(Select().wait(), -1);
+}
+
+TEST(SelectTest, EarliestTimeoutFires) {
+    auto ch = make_mpmc_channel<int>(4);
+    int fired = -1;
+    Select sel;
+    sel.recv(ch, [](int, bool) {})
+        .after(500, [&]() { fired = 500; })
+        .after(100, [&]() { fired = 100; });
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(sel.wait(), 2);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(fired, 100);
+    EXPECT_GE(elapsed, std::chrono::milliseconds(90));
+    EXPECT_LT(elapsed, std::chrono::milliseconds(450));
+
+    // 超时之前有元素到达
+    Fiber::go([ch]() {
+        Fiber::sleep(50);
+        ch->send(1);
+    });
+    int got = 0;
+    Select again;
+    again.recv(ch, [&](int value, bool) { got = value; }).after(1000, []() {});
+    EXPECT_EQ(again.wait(), 0);
+    EXPECT_EQ(got, 1);
+}
+
+TEST(SelectTest, WakesOnSendAndClose) {
+    auto a = make_mpmc_channel<int>(1);
+    auto b = make_mpmc_channel<int>(1);
+    a->send(0);   // a已满
+
+    // 阻塞在“向满的a发送”和“从空的b接收”上，由b的发送方唤醒
+    Fiber::go([b]() {
+        Fiber::sleep(50);
+        b->send(42);
+    });
+    int got = 0;
+    bool sent = false;
+    Select sel;
+    sel.send(a, 1, [&](bool ok) { sent = ok; }).recv(b, [&](int value, bool ok) {
+        EXPECT_TRUE(ok);
+        got = value;
+    });
+    EXPECT_EQ(sel.wait(), 1);
+    EXPECT_EQ(got, 42);
+    EXPECT_FALSE(sent);
+
+    // 接收方取走a中的元素后，send case被唤醒
+    Fiber::go([a]() {
+        Fiber::sleep(50);
+        int drained = 0;
+        a->recv(drained);
+    });
+    EXPECT_EQ(sel.wait(), 0);
+    EXPECT_TRUE(sent);
+
+    // 关闭：recv case返回ok = false
+    Fiber::go([b]() {
+        Fiber::sleep(50);
+        b->close();
+    });
+    Select closing;
+    bool closed_ok = true;
+    closing.recv(b, [&](int, bool ok) { closed_ok = ok; });
+    EXPECT_EQ(closing.wait(), 0);
+    EXPECT_FALSE(closed_ok);
+}
+
+TEST(SelectTest, SendCaseMovesValueOnce) {
+    // 只能移动的元素：成功时移入Channel，case随之失效
+    auto ch = make_mpmc_channel<std::unique_ptr<int>>(1);
+    ch->send(std::make_unique<int>(0));   // 已满
+    Fiber::go([ch]() {
+        Fiber::sleep(50);
+        std::unique_ptr<int> drained;
+        ch->recv(drained);
+    });
+    int sent = 0;
+    Select sel;
+    sel.send(ch, std::make_unique<int>(7), [&](bool ok) { sent += ok ? 1 : 0; });
+    EXPECT_EQ(sel.wait(), 0);
+    EXPECT_EQ(sent, 1);
+    // 再次wait不会重复发送
+    EXPECT_EQ(sel.wait(), -1);
+    std::unique_ptr<int> value;
+    ASSERT_TRUE(ch->tryRecv(value));
+    EXPECT_EQ(*value, 7);
+    EXPECT_FALSE(ch->tryRecv(value));
+}
+
+TEST(SelectTest, ChoosesFairlyAmongReadyCases) {
+    constexpr int kRounds = 4000;
+    auto a = make_mpmc_channel<int>(kRounds);
+    auto b = make_mpmc_channel<int>(kRounds);
+    auto c = make_mpmc_channel<int>(kRounds);
+    for (int i = 0; i < kRounds; ++i) {
+        a->send(i);
+        b->send(i);
+        c->send(i);
+    }
+    int counts[3] = {0, 0, 0};
+    Select sel;
+    sel.recv(a, [](int, bool) {}).recv(b, [](int, bool) {}).recv(c, [](int, bool) {});
+    for (int i = 0; i < kRounds; ++i) {
+        ++counts[sel.wait()];
+    }
+    for (int count : counts) {
+        EXPECT_GT(count, kRounds / 3 - kRounds / 10);
+        EXPECT_LT(count, kRounds / 3 + kRounds / 10);
+    }
+}
+
+TEST(SelectTest, EventLoopReceivesEverything) {
+    // 类似Raft主循环：多个输入Channel + 心跳超时，直到输入全部关闭
+    constexpr int kPerChannel = 3000;
+    auto proposals = make_mpmc_channel<int>(16);
+    auto responses = make_mpmc_channel<int>(16);
+    for (auto ch : {proposals, responses}) {
+        Fiber::go([ch]() {
+            for (int i = 1; i <= kPerChannel; ++i) {
+                ch->send(i);
+            }
+            ch->close();
+        });
+    }
+
+    int64_t sum = 0;
+    bool proposals_done = false;
+    bool responses_done = false;
+    int heartbeats = 0;
+    Select sel;
+    auto consume = [&sum](bool& done) {
+        return [&sum, &done](int value, bool ok) {
+            if (ok) {
+                sum += value;
+            } else {
+                done = true;
+            }
+        };
+    };
+    sel.recv(proposals, consume(proposals_done))
+        .recv(responses, consume(responses_done))
+        .after(1000, [&]() { ++heartbeats; });
+    while (!proposals_done || !responses_done) {
+        sel.wait();
+    }
+    EXPECT_EQ(heartbeats, 0);
+    EXPECT_EQ(sum, 2LL * kPerChannel * (kPerChannel + 1) / 2);
+}
+
+FIBER_MAIN() {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,357 @@
+#include "fiber.h"
+#include "scheduler.h"
+#include "channel.h"
+#include "sync.h"
+#include "timer.h"
+#include "io_fiber.h"
+#include "logger.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace fiber;
+
+// ============================================================================
+// 协程运行时原语的微基准
+// ============================================================================
+// 每项基准在1、2、4 ... max_concurrency条并发通道（lane，每条一个或一对fiber）上运行，
+// 报告全部通道合计的ns/op：通道之间互不依赖的基准，ns/op随调度线程数增加而下降；
+// 共享同一把锁的基准反映争用的代价。
+//
+// 用法：fiber_bench [--json=结果文件] [--baseline=基线文件] [--threshold=0.2]
+//                   [--max-concurrency=N] [--scale=1.0] [--filter=名字子串]
+// 结果以JSON输出（未指定--json时输出到stdout），每条结果独占一行。指定基线时与基线中
+// 同名、同并发度的结果比较，ns/op变慢超过threshold的项目列为回归，进程返回1，
+// 供发布前的流水线判定。
+
+namespace {
+
+struct BenchResult {
+    std::string name;
+    int concurrency = 0;
+    uint64_t ops = 0;
+    double ns_per_op = 0;
+};
+
+struct BenchOptions {
+    std::string json_path;
+    std::string baseline_path;
+    double threshold = 0.2;
+    int max_concurrency = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    double scale = 1.0;
+    std::string filter;
+};
+
+// 一项基准：lane为通道号，ops为该通道要完成的操作数
+struct Bench {
+    std::string name;
+    uint64_t ops_per_lane;
+    std::function<void(int lanes)> setup;       // 可为空：每轮开始前准备共享状态
+    std::function<void(int lane, uint64_t ops)> run;
+};
+
+// 在lanes个fiber上并发执行bench，返回合计的ns/op
+BenchResult measure(const Bench& bench, int lanes, double scale) {
+    uint64_t ops = std::max<uint64_t>(1, static_cast<uint64_t>(bench.ops_per_lane * scale));
+    if (bench.setup) {
+        bench.setup(lanes);
+    }
+    WaitGroup ready;
+    WaitGroup done;
+    ready.add(lanes);
+    done.add(lanes);
+    std::atomic<bool> go{false};
+    for (int lane = 0; lane < lanes; ++lane) {
+        Fiber::go([&, lane]() {
+            ready.done();
+            while (!go.load(std::memory_order_acquire)) {
+                Fiber::yield();
+            }
+            bench.run(lane, ops);
+            done.done();
+        });
+    }
+    ready.wait();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    done.wait();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    BenchResult result;
+    result.name = bench.name;
+    result.concurrency = lanes;
+    result.ops = ops * lanes;
+    result.ns_per_op = ns / static_cast<double>(result.ops);
+    return result;
+}
+
+// ============================================================================
+// 基准项目
+// ============================================================================
+
+std::vector<Bench> makeBenches() {
+    std::vector<Bench> benches;
+
+    // 创建一个立即退出的fiber，等待它结束
+    benches.push_back({"fiber_go", 20000, nullptr, [](int, uint64_t ops) {
+        WaitGroup wg;
+        wg.add(static_cast<int>(ops));
+        for (uint64_t i = 0; i < ops; ++i) {
+            Fiber::go([&wg]() { wg.done(); });
+        }
+        wg.wait();
+    }});
+
+    // 一次yield是一次切出和一次切回
+    benches.push_back({"fiber_yield", 200000, nullptr, [](int, uint64_t ops) {
+        for (uint64_t i = 0; i < ops; ++i) {
+            Fiber::yield();
+        }
+    }});
+
+    // 每条通道一把锁
+    static std::vector<std::unique_ptr<FiberMutex>> lane_mutexes;
+    benches.push_back({"mutex_uncontended", 1000000,
+                       [](int lanes) {
+                           lane_mutexes.clear();
+                           for (int i = 0; i < lanes; ++i) {
+                               lane_mutexes.push_back(std::make_unique<FiberMutex>());
+                           }
+                       },
+                       [](int lane, uint64_t ops) {
+                           FiberMutex& mu = *lane_mutexes[lane];
+                           for (uint64_t i = 0; i < ops; ++i) {
+                               fiber::lock_guard<FiberMutex> lock(mu);
+                           }
+                       }});
+
+    // 全部通道争用同一把锁
+    static FiberMutex shared_mutex;
+    static uint64_t shared_counter = 0;
+    benches.push_back({"mutex_contended", 200000, nullptr, [](int, uint64_t ops) {
+        for (uint64_t i = 0; i < ops; ++i) {
+            fiber::lock_guard<FiberMutex> lock(shared_mutex);
+            ++shared_counter;
+        }
+    }});
+
+    // 每条通道一对生产者/消费者，一个op为一次send加一次recv
+    auto channel_bench = [](size_t capacity) {
+        return [capacity](int, uint64_t ops) {
+            auto ch = make_channel<uint64_t>(capacity);
+            WaitGroup wg;
+            wg.add(1);
+            Fiber::go([ch, ops, &wg]() {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    ch->send(i);
+                }
+                wg.done();
+            });
+            uint64_t value = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                ch->recv(value);
+            }
+            wg.wait();
+        };
+    };
+    benches.push_back({"channel_buffered", 200000, nullptr, channel_bench(1024)});
+    benches.push_back({"channel_unbuffered", 50000, nullptr, channel_bench(0)});
+
+    // 另一个fiber完成计数后唤醒等待者，一个op为一次add/done/wait往返
+    benches.push_back({"waitgroup_roundtrip", 20000, nullptr, [](int, uint64_t ops) {
+        for (uint64_t i = 0; i < ops; ++i) {
+            WaitGroup wg;
+            wg.add(1);
+            Fiber::go([&wg]() { wg.done(); });
+            wg.wait();
+        }
+    }});
+
+    // 添加一个不会到期的定时器并立即取消
+    benches.push_back({"timer_add_cancel", 200000, nullptr, [](int, uint64_t ops) {
+        auto& wheel = TimerWheel::getInstance();
+        for (uint64_t i = 0; i < ops; ++i) {
+            auto timer = wheel.addTimer(static_cast<uint64_t>(60000), []() {});
+            wheel.cancel(timer);
+        }
+    }});
+
+    // 每条通道一个socketpair和一个回显fiber，一个op为64字节的一次往返
+    benches.push_back({"io_echo_roundtrip", 20000, nullptr, [](int, uint64_t ops) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            LOG_ERROR("socketpair() failed: {}", strerror(errno));
+            return;
+        }
+        constexpr size_t kMessageSize = 64;
+        WaitGroup wg;
+        wg.add(1);
+        Fiber::go([fd = sv[1], &wg]() {
+            char buf[kMessageSize];
+            while (true) {
+                auto n = IO::read(fd, buf, sizeof(buf));
+                if (!n || *n <= 0 || IO::write(fd, buf, *n).value_or(-1) != *n) {
+                    break;
+                }
+            }
+            IO::close(fd);
+            wg.done();
+        });
+        char msg[kMessageSize] = {0};
+        char buf[kMessageSize];
+        for (uint64_t i = 0; i < ops; ++i) {
+            IO::write(sv[0], msg, sizeof(msg));
+            size_t received = 0;
+            while (received < sizeof(buf)) {
+                auto n = IO::read(sv[0], buf + received, sizeof(buf) - received);
+                if (!n || *n <= 0) {
+                    break;
+                }
+                received += *n;
+            }
+        }
+        IO::close(sv[0]);
+        wg.wait();
+    }});
+
+    return benches;
+}
+
+// ============================================================================
+// JSON输出与基线比较
+// ============================================================================
+
+std::string resultLine(const BenchResult& r) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "{\"name\": \"%s\", \"concurrency\": %d, \"ops\": %llu, \"ns_per_op\": %.2f}",
+                  r.name.c_str(), r.concurrency, static_cast<unsigned long long>(r.ops), r.ns_per_op);
+    return buf;
+}
+
+std::string toJson(const std::vector<BenchResult>& results, const BenchOptions& options) {
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"suite\": \"fiber_bench\",\n";
+    out << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"max_concurrency\": " << options.max_concurrency << ",\n";
+    out << "  \"scale\": " << options.scale << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out << "    " << resultLine(results[i]) << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+// 读取toJson写出的文件：每条结果独占一行，只解析name、concurrency和ns_per_op
+std::map<std::pair<std::string, int>, double> loadBaseline(const std::string& path) {
+    std::map<std::pair<std::string, int>, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        char name[128];
+        int concurrency = 0;
+        unsigned long long ops = 0;
+        double ns_per_op = 0;
+        auto pos = line.find('{');
+        if (pos != std::string::npos &&
+            std::sscanf(line.c_str() + pos, "{\"name\": \"%127[^\"]\", \"concurrency\": %d, \"ops\": %llu, \"ns_per_op\": %lf",
+                        name, &concurrency, &ops, &ns_per_op) == 4) {
+            baseline[{name, concurrency}] = ns_per_op;
+        }
+    }
+    return baseline;
+}
+
+bool parseArgs(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&arg](const char* flag) -> const char* {
+            size_t len = std::strlen(flag);
+            return arg.compare(0, len, flag) == 0 ? arg.c_str() + len : nullptr;
+        };
+        if (const char* v = value("--json=")) {
+            options.json_path = v;
+        } else if (const char* v = value("--baseline=")) {
+            options.baseline_path = v;
+        } else if (const char* v = value("--threshold=")) {
+            options.threshold = std::atof(v);
+        } else if (const char* v = value("--max-concurrency=")) {
+            options.max_concurrency = std::max(1, std::atoi(v));
+        } else if (const char* v = value("--scale=")) {
+            options.scale = std::atof(v);
+        } else if (const char* v = value("--filter=")) {
+            options.filter = v;
+        } else {
+            LOG_ERROR("unknown argument: {}", arg);
+            return false;
+        }
+    }
+    return options.scale > 0;
+}
+
+} // namespace
+
+FIBER_MAIN() {
+    BenchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        return 2;
+    }
+    LOG_INFO("================= Fiber Runtime Benchmark =====================");
+
+    std::vector<BenchResult> results;
+    for (const auto& bench : makeBenches()) {
+        if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        for (int lanes = 1; lanes <= options.max_concurrency; lanes *= 2) {
+            results.push_back(measure(bench, lanes, options.scale));
+            const auto& r = results.back();
+            LOG_INFO("{:<22} lanes={:<3} {:>10.1f} ns/op", r.name, r.concurrency, r.ns_per_op);
+        }
+    }
+
+    std::string json = toJson(results, options);
+    if (options.json_path.empty()) {
+        std::fwrite(json.data(), 1, json.size(), stdout);
+    } else {
+        std::ofstream(options.json_path) << json;
+        LOG_INFO("results written to {}", options.json_path);
+    }
+
+    if (options.baseline_path.empty()) {
+        return 0;
+    }
+    auto baseline = loadBaseline(options.baseline_path);
+    if (baseline.empty()) {
+        LOG_ERROR("no results in baseline {}", options.baseline_path);
+        return 2;
+    }
+    int regressions = 0;
+    for (const auto& r : results) {
+        auto it = baseline.find({r.name, r.concurrency});
+        if (it == baseline.end() || it->second <= 0) {
+            continue;
+        }
+        double change = r.ns_per_op / it->second - 1;
+        if (change > options.threshold) {
+            LOG_ERROR("REGRESSION {} lanes={}: {:.1f} -> {:.1f} ns/op (+{:.0f}%)", r.name, r.concurrency, it->second,
+                      r.ns_per_op, change * 100);
+            ++regressions;
+        }
+    }
+    LOG_INFO("{} regressions against {} (threshold {:.0f}%)", regressions, options.baseline_path,
+             options.threshold * 100);
+    return regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include "mpmc_channel.h"
+#include "channel.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <chrono>
+#include <vector>
+
+using namespace fiber;
+
+constexpr int TOTAL_ITEMS = 400000;
+constexpr int CONSUMERS = 4;
+constexpr size_t CAPACITY = 1024;
+constexpr size_t BATCH = 64;
+
+// producers个fiber共发送TOTAL_ITEMS个元素，CONSUMERS个fiber接收，返回ns/item
+template <typename ChannelPtr>
+double run(ChannelPtr ch, int producers) {
+    int per_producer = TOTAL_ITEMS / producers;
+    WaitGroup sent;
+    WaitGroup received;
+    sent.add(producers);
+    received.add(CONSUMERS);
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < CONSUMERS; ++c) {
+        Fiber::go([ch, &received]() {
+            uint64_t value = 0;
+            while (ch->recv(value)) {
+            }
+            received.done();
+        });
+    }
+    for (int p = 0; p < producers; ++p) {
+        Fiber::go([ch, per_producer, &sent]() {
+            for (int i = 0; i < per_producer; ++i) {
+                ch->send(static_cast<uint64_t>(i));
+            }
+            sent.done();
+        });
+    }
+    sent.wait();
+    ch->close();
+    received.wait();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / (per_producer * producers);
+}
+
+// 一个生产者、一个消费者，逐个或按BATCH个一批收发，返回ns/item
+double runBatched(bool batched) {
+    auto ch = make_mpmc_channel<uint64_t>(CAPACITY);
+    WaitGroup done;
+    done.add(1);
+    auto start = std::chrono::steady_clock::now();
+    Fiber::go([ch, batched, &done]() {
+        std::vector<uint64_t> out;
+        out.reserve(BATCH);
+        uint64_t value = 0;
+        while (batched ? ch->recv_many(out, BATCH, 1000) > 0 : ch->recv(value)) {
+            out.clear();
+        }
+        done.done();
+    });
+    std::vector<uint64_t> batch(BATCH);
+    for (int i = 0; i < TOTAL_ITEMS; i += BATCH) {
+        if (batched) {
+            ch->send_many(batch);
+        } else {
+            for (size_t j = 0; j < BATCH; ++j) {
+                ch->send(j);
+            }
+        }
+    }
+    ch->close();
+    done.wait();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / TOTAL_ITEMS;
+}
+
+FIBER_MAIN() {
+    LOG_INFO("================= Channel vs MpmcChannel =====================");
+    LOG_INFO("{} items, {} consumers, capacity {}", TOTAL_ITEMS, CONSUMERS, CAPACITY);
+    for (int producers = 1; producers <= 64; producers *= 2) {
+        double locked = run(make_channel<uint64_t>(CAPACITY), producers);
+        double lock_free = run(make_mpmc_channel<uint64_t>(CAPACITY), producers);
+        LOG_INFO("producers={:<3} Channel {:>8.1f} ns/item    MpmcChannel {:>8.1f} ns/item    ({:.2f}x)", producers,
+                 locked, lock_free, locked / lock_free);
+    }
+
+    LOG_INFO("================= send / recv vs send_many / recv_many =====================");
+    double single = runBatched(false);
+    double batched = runBatched(true);
+    LOG_INFO("batch={} send/recv {:>8.1f} ns/item    send_many/recv_many {:>8.1f} ns/item    ({:.2f}x)", BATCH,
+             single, batched, single / batched);
+    return 0;
+}
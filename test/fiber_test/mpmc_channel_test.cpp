@@ -0,0 +1,239 @@
+#include "mpmc_channel.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "sync.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace fiber;
+
+TEST(MpmcChannelTest, BufferedFifoAndTry) {
+    auto ch = make_mpmc_channel<std::string>(3);
+    EXPECT_EQ(ch->capacity(), 4u);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ch->trySend(std::to_string(i)));
+    }
+    EXPECT_FALSE(ch->trySend("full"));
+    EXPECT_EQ(ch->size(), 4u);
+    std::string value;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ch->recv(value));
+        EXPECT_EQ(value, std::to_string(i));
+    }
+    EXPECT_FALSE(ch->tryRecv(value));
+    // 容量为0时按1处理
+    EXPECT_EQ(make_mpmc_channel<int>(0)->capacity(), 1u);
+}
+
+TEST(MpmcChannelTest, Timeouts) {
+    auto ch = make_mpmc_channel<int>(1);
+    int value = 0;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(ch->recv_timeout(value, 100));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+
+    ASSERT_TRUE(ch->send(1));
+    start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(ch->send_timeout(2, 100));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+
+    // 对端在超时之前完成操作
+    Fiber::go([ch]() {
+        Fiber::sleep(50);
+        int drained = 0;
+        ch->recv(drained);
+    });
+    EXPECT_TRUE(ch->send_timeout(3, 1000));
+    Fiber::go([ch]() {
+        Fiber::sleep(50);
+        int drained = 0;
+        ch->recv(drained);
+    });
+    EXPECT_TRUE(ch->send_timeout(4, 1000));
+    ASSERT_TRUE(ch->recv_timeout(value, 1000));
+    EXPECT_EQ(value, 4);
+}
+
+TEST(MpmcChannelTest, CloseDrainsAndWakesWaiters) {
+    auto ch = make_mpmc_channel<int>(4);
+    ch->send(1);
+    ch->send(2);
+    std::atomic<int> woken{0};
+    auto empty = make_mpmc_channel<int>(1);
+    WaitGroup wg;
+    wg.add(3);
+    for (int i = 0; i < 3; ++i) {
+        Fiber::go([&]() {
+            int value = 0;
+            if (!empty->recv(value)) {
+                ++woken;
+            }
+            wg.done();
+        });
+    }
+    Fiber::sleep(50);
+    empty->close();
+    wg.wait();
+    EXPECT_EQ(woken.load(), 3);
+
+    ch->close();
+    EXPECT_FALSE(ch->send(3));
+    EXPECT_FALSE(ch->trySend(3));
+    int value = 0;
+    EXPECT_TRUE(ch->recv(value));
+    EXPECT_EQ(value, 1);
+    EXPECT_TRUE(ch->recv(value));
+    EXPECT_EQ(value, 2);
+    EXPECT_FALSE(ch->recv(value));
+}
+
+TEST(MpmcChannelTest, ManyProducersManyConsumers) {
+    constexpr int kProducers = 16;
+    constexpr int kConsumers = 4;
+    constexpr int kPerProducer = 5000;
+    auto ch = make_mpmc_channel<int>(64);
+    std::vector<std::atomic<int>> seen(kProducers * kPerProducer);
+    std::atomic<int> received{0};
+
+    WaitGroup producers;
+    producers.add(kProducers);
+    for (int p = 0; p < kProducers; ++p) {
+        Fiber::go([&, p]() {
+            for (int i = 0; i < kPerProducer; ++i) {
+                ASSERT_TRUE(ch->send(p * kPerProducer + i));
+            }
+            producers.done();
+        });
+    }
+    WaitGroup consumers;
+    consumers.add(kConsumers);
+    for (int c = 0; c < kConsumers; ++c) {
+        Fiber::go([&]() {
+            int value = 0;
+            int last[kProducers];
+            std::fill(std::begin(last), std::end(last), -1);
+            while (ch->recv(value)) {
+                // 同一个生产者的元素按发送顺序到达
+                int producer = value / kPerProducer;
+                EXPECT_GT(value, last[producer]);
+                last[producer] = value;
+                seen[value].fetch_add(1);
+                ++received;
+            }
+            consumers.done();
+        });
+    }
+    producers.wait();
+    ch->close();
+    consumers.wait();
+    EXPECT_EQ(received.load(), kProducers * kPerProducer);
+    for (size_t i = 0; i < seen.size(); ++i) {
+        ASSERT_EQ(seen[i].load(), 1) << "value " << i;
+    }
+}
+
+TEST(MpmcChannelTest, SendManyRecvMany) {
+    auto ch = make_mpmc_channel<std::string>(8);
+    std::vector<std::string> items = {"a", "b", "c", "d", "e"};
+    EXPECT_EQ(ch->send_many(items), 5u);
+    EXPECT_EQ(ch->size(), 5u);
+
+    std::vector<std::string> out;
+    EXPECT_EQ(ch->recv_many(out, 3, 100), 3u);
+    EXPECT_EQ(ch->recv_many(out, 10, 100), 2u);
+    EXPECT_EQ(out, (std::vector<std::string>{"a", "b", "c", "d", "e"}));
+
+    // 空的Channel：等到超时返回0
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(ch->recv_many(out, 10, 100), 0u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+
+    // 超过容量的一批：分段写入，等待接收方腾出空位
+    std::vector<std::string> big(20);
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = std::to_string(i);
+    }
+    Fiber::go([ch, &big]() { EXPECT_EQ(ch->send_many(big), big.size()); });
+    out.clear();
+    while (out.size() < big.size()) {
+        ASSERT_GT(ch->recv_many(out, 6, 1000), 0u);
+    }
+    for (size_t i = 0; i < out.size(); ++i) {
+        EXPECT_EQ(out[i], std::to_string(i));
+    }
+
+    // 关闭后先取完剩余元素，再返回0；send_many不再写入
+    std::vector<std::string> tail = {"x", "y"};
+    ch->send_many(tail);
+    ch->close();
+    std::vector<std::string> more = {"z"};
+    EXPECT_EQ(ch->send_many(more), 0u);
+    out.clear();
+    EXPECT_EQ(ch->recv_many(out, 10, 100), 2u);
+    EXPECT_EQ(ch->recv_many(out, 10, 100), 0u);
+}
+
+TEST(MpmcChannelTest, ConcurrentBatches) {
+    constexpr int kProducers = 8;
+    constexpr int kConsumers = 4;
+    constexpr int kBatches = 500;
+    constexpr int kBatchSize = 16;
+    auto ch = make_mpmc_channel<int>(64);
+    std::vector<std::atomic<int>> seen(kProducers * kBatches * kBatchSize);
+
+    WaitGroup producers;
+    producers.add(kProducers);
+    for (int p = 0; p < kProducers; ++p) {
+        Fiber::go([&, p]() {
+            std::vector<int> batch(kBatchSize);
+            for (int b = 0; b < kBatches; ++b) {
+                for (int i = 0; i < kBatchSize; ++i) {
+                    batch[i] = (p * kBatches + b) * kBatchSize + i;
+                }
+                ASSERT_EQ(ch->send_many(batch), batch.size());
+            }
+            producers.done();
+        });
+    }
+    // 批量和逐个接收混用
+    WaitGroup consumers;
+    consumers.add(kConsumers);
+    for (int c = 0; c < kConsumers; ++c) {
+        Fiber::go([&, c]() {
+            std::vector<int> out;
+            while (true) {
+                out.clear();
+                if (c % 2 == 0) {
+                    if (ch->recv_many(out, 32, 5000) == 0) {
+                        break;
+                    }
+                } else {
+                    int value = 0;
+                    if (!ch->recv(value)) {
+                        break;
+                    }
+                    out.push_back(value);
+                }
+                for (int value : out) {
+                    seen[value].fetch_add(1);
+                }
+            }
+            consumers.done();
+        });
+    }
+    producers.wait();
+    ch->close();
+    consumers.wait();
+    for (size_t i = 0; i < seen.size(); ++i) {
+        ASSERT_EQ(seen[i].load(), 1) << "value " << i;
+    }
+}
+
+FIBER_MAIN() {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,145 @@
+#include "work_stealing_queue.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace fiber;
+
+TEST(WorkStealingDequeTest, OwnerPopsLifoThievesStealFifo) {
+    WorkStealingDeque<int*> deque(4);
+    std::vector<int> items(100);
+    // 超过初始容量，触发扩容
+    for (auto& item : items) {
+        deque.push(&item);
+    }
+    EXPECT_EQ(deque.size(), items.size());
+    EXPECT_EQ(deque.pop().value(), &items[99]);
+    EXPECT_EQ(deque.steal().value(), &items[0]);
+    EXPECT_EQ(deque.steal().value(), &items[1]);
+    EXPECT_EQ(deque.pop().value(), &items[98]);
+    while (deque.pop()) {
+    }
+    EXPECT_TRUE(deque.empty());
+    EXPECT_FALSE(deque.steal().has_value());
+    EXPECT_FALSE(deque.pop().has_value());
+}
+
+TEST(WorkStealingDequeTest, ConcurrentStealTakesEachItemOnce) {
+    constexpr int kItems = 200000;
+    constexpr int kThieves = 3;
+    WorkStealingDeque<uintptr_t> deque(64);
+    std::vector<std::atomic<int>> taken(kItems + 1);
+    std::atomic<int> consumed{0};
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < kThieves; ++i) {
+        thieves.emplace_back([&]() {
+            while (!done.load(std::memory_order_acquire)) {
+                if (auto item = deque.steal()) {
+                    taken[*item].fetch_add(1);
+                    consumed.fetch_add(1);
+                }
+            }
+        });
+    }
+    // owner交替push和pop，与窃取者争抢最后一个元素
+    for (uintptr_t i = 1; i <= kItems; ++i) {
+        deque.push(i);
+        if (i % 3 == 0) {
+            if (auto item = deque.pop()) {
+                taken[*item].fetch_add(1);
+                consumed.fetch_add(1);
+            }
+        }
+    }
+    while (auto item = deque.pop()) {
+        taken[*item].fetch_add(1);
+        consumed.fetch_add(1);
+    }
+    while (consumed.load() < kItems) {
+        std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+    for (auto& t : thieves) {
+        t.join();
+    }
+    for (int i = 1; i <= kItems; ++i) {
+        ASSERT_EQ(taken[i].load(), 1) << "item " << i;
+    }
+}
+
+TEST(WorkStealingRunQueuesTest, WokenTaskRunsNextOnWaker) {
+    WorkStealingRunQueues<uintptr_t> queues(2);
+    queues.push(0, 1);
+    queues.push(0, 2);
+    queues.pushNext(0, 10);
+    // 新唤醒的任务替换next槽，原来的转入deque
+    queues.pushNext(0, 11);
+    EXPECT_EQ(queues.pending(), 4u);
+    EXPECT_EQ(queues.pop(0).value(), 11u);
+    EXPECT_EQ(queues.pop(0).value(), 10u);
+    // worker 1偷deque顶部最早的任务
+    EXPECT_EQ(queues.pop(1).value(), 1u);
+    EXPECT_EQ(queues.stolen(1), 1u);
+    EXPECT_EQ(queues.pop(0).value(), 2u);
+
+    // 非worker线程提交的任务由任意worker取走；deque都为空时next槽也可以被偷
+    queues.submit(20);
+    EXPECT_EQ(queues.pop(1).value(), 20u);
+    queues.pushNext(0, 30);
+    EXPECT_EQ(queues.pop(1).value(), 30u);
+    EXPECT_FALSE(queues.pop(0).has_value());
+    EXPECT_EQ(queues.pending(), 0u);
+}
+
+TEST(WorkStealingRunQueuesTest, WorkersShareBurstOnOneQueue) {
+    // 全部任务先落在worker 0上（突发的连接都由一个线程accept），每个任务再派生子任务
+    constexpr size_t kWorkers = 4;
+    constexpr uintptr_t kRoots = 2000;
+    constexpr uintptr_t kChildren = 8;
+    constexpr uintptr_t kTotal = kRoots * (kChildren + 1);
+    WorkStealingRunQueues<uintptr_t> queues(kWorkers);
+    for (uintptr_t i = 1; i <= kRoots; ++i) {
+        queues.push(0, i);
+    }
+
+    std::vector<std::atomic<int>> ran(kTotal + 1);
+    std::atomic<uintptr_t> finished{0};
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < kWorkers; ++w) {
+        threads.emplace_back([&, w]() {
+            while (finished.load(std::memory_order_acquire) < kTotal) {
+                auto task = queues.pop(w);
+                if (!task) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                ran[*task].fetch_add(1);
+                if (*task <= kRoots) {
+                    for (uintptr_t c = 0; c < kChildren; ++c) {
+                        uintptr_t child = kRoots + (*task - 1) * kChildren + c + 1;
+                        if (c == 0) {
+                            queues.pushNext(w, child);
+                        } else {
+                            queues.push(w, child);
+                        }
+                    }
+                }
+                finished.fetch_add(1, std::memory_order_release);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (uintptr_t i = 1; i <= kTotal; ++i) {
+        ASSERT_EQ(ran[i].load(), 1) << "task " << i;
+    }
+    uint64_t stolen = 0;
+    for (size_t w = 1; w < kWorkers; ++w) {
+        stolen += queues.stolen(w);
+    }
+    EXPECT_GT(stolen, 0u);
+}
@@ -0,0 +1,238 @@
+#include "backup.h"
+#include "kv_service.h"
+#include "ordered_engine.h"
+#include "rpc_server.h"
+#include "rpc_client.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <unistd.h>
+
+using namespace kv;
+namespace fs = std::filesystem;
+
+static constexpr uint16_t kPort = 9230;
+
+namespace {
+
+std::string tempDir(const std::string& name) {
+    auto dir = fs::temp_directory_path() / ("kv_" + name + "_" + std::to_string(getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir.string();
+}
+
+KvCommand putCommand(const std::string& key, const std::string& value, uint64_t expire_at_ms = 0) {
+    KvCommand cmd;
+    cmd.op = KvOp::PUT;
+    cmd.key = key;
+    cmd.value = value;
+    cmd.expire_at_ms = expire_at_ms;
+    return cmd;
+}
+
+KvCommand deleteCommand(const std::string& key) {
+    KvCommand cmd;
+    cmd.op = KvOp::DELETE;
+    cmd.key = key;
+    return cmd;
+}
+
+void apply(KvStateMachine& sm, const KvCommand& cmd) {
+    sm.Apply(sm.LastApplied() + 1, cmd);
+}
+
+KvStateMachinePtr restored(const std::string& path) {
+    auto persister = raft::MakeMemoryPersister();
+    if (!RestoreBackup(path, persister)) {
+        return nullptr;
+    }
+    EXPECT_EQ(persister->RaftStateSize(), 0);
+    auto sm = MakeKvStateMachine();
+    if (!sm->RestoreSnapshot(persister->ReadSnapshot())) {
+        return nullptr;
+    }
+    return sm;
+}
+
+} // namespace
+
+TEST(BackupTest, ExportsPointInTimeAndRestores) {
+    std::string dir = tempDir("backup_pit");
+    auto sm = MakeKvStateMachine(MakeOrderedEngine());
+    uint64_t far_future = NowUnixMs() + 3600 * 1000;
+    for (int i = 0; i < 100; ++i) {
+        apply(*sm, putCommand("key" + std::to_string(i), "v1", i < 10 ? far_future : 0));
+    }
+    uint64_t point = sm->LastApplied();
+    // 保留point上的版本，再继续写入
+    auto pin = sm->NewReadView(point);
+    ASSERT_NE(pin, nullptr);
+    for (int i = 0; i < 50; ++i) {
+        apply(*sm, putCommand("key" + std::to_string(i), "v2"));
+    }
+    apply(*sm, deleteCommand("key99"));
+    apply(*sm, putCommand("late", "x", far_future));
+
+    BackupInfo old_info;
+    ASSERT_TRUE(ExportBackup(*sm, point, dir + "/old.bak", {}, &old_info));
+    EXPECT_EQ(old_info.index, point);
+    BackupInfo new_info;
+    ASSERT_TRUE(ExportBackup(*sm, 0, dir + "/new.bak", {}, &new_info));
+    EXPECT_EQ(new_info.index, sm->LastApplied());
+    // 临时文件已经rename
+    EXPECT_FALSE(fs::exists(dir + "/old.bak.tmp"));
+
+    auto old_sm = restored(dir + "/old.bak");
+    ASSERT_NE(old_sm, nullptr);
+    EXPECT_EQ(old_sm->LastApplied(), point);
+    EXPECT_EQ(old_sm->Engine()->Size(), 100u);
+    EXPECT_EQ(old_sm->Get("key0").value, "v1");
+    EXPECT_EQ(old_sm->Get("key99").value, "v1");
+    EXPECT_EQ(old_sm->Get("late").status, KvStatus::NO_KEY);
+    // key0..key9的TTL在point之后被覆盖写清除了，早于LastApplied的备份按导出时的TTL索引保留
+    EXPECT_EQ(old_sm->TtlCount(), 0u);
+
+    auto new_sm = restored(dir + "/new.bak");
+    ASSERT_NE(new_sm, nullptr);
+    EXPECT_EQ(new_sm->LastApplied(), sm->LastApplied());
+    EXPECT_EQ(new_sm->Get("key0").value, "v2");
+    EXPECT_EQ(new_sm->Get("key60").value, "v1");
+    EXPECT_EQ(new_sm->Get("key99").status, KvStatus::NO_KEY);
+    EXPECT_EQ(new_sm->TtlCount(), 1u);
+
+    // 尚未apply的index没有读视图
+    EXPECT_FALSE(ExportBackup(*sm, sm->LastApplied() + 10, dir + "/future.bak"));
+    EXPECT_FALSE(fs::exists(dir + "/future.bak"));
+
+    // 损坏的备份不能恢复
+    {
+        std::fstream f(dir + "/new.bak", std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(-3, std::ios::end);
+        f.put('\x7f');
+    }
+    BackupImage image;
+    EXPECT_FALSE(ReadBackupFile(dir + "/new.bak", image));
+    EXPECT_FALSE(RestoreBackup(dir + "/new.bak", raft::MakeMemoryPersister()));
+    fs::remove_all(dir);
+}
+
+TEST(BackupTest, RateLimiterThrottlesExport) {
+    RateLimiter unlimited(0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; ++i) {
+        unlimited.Acquire(1 << 20);
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+
+    std::string dir = tempDir("backup_rate");
+    auto sm = MakeKvStateMachine();
+    std::mt19937 gen(1);
+    for (int i = 0; i < 200; ++i) {
+        std::string value(1000, '\0');
+        for (auto& c : value) {
+            c = static_cast<char>('a' + gen() % 26);
+        }
+        apply(*sm, putCommand("key" + std::to_string(i), value));
+    }
+    // 约200KB，100KB/s分4KB一块写，至少需要接近两秒
+    BackupOptions options;
+    options.bytes_per_sec = 100 << 10;
+    options.chunk_bytes = 4 << 10;
+    start = std::chrono::steady_clock::now();
+    BackupInfo info;
+    ASSERT_TRUE(ExportBackup(*sm, 0, dir + "/slow.bak", options, &info));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GT(info.size, 150000u);
+    EXPECT_GE(elapsed, std::chrono::milliseconds(info.size * 1000 / options.bytes_per_sec - 100));
+
+    auto copy = restored(dir + "/slow.bak");
+    ASSERT_NE(copy, nullptr);
+    EXPECT_EQ(copy->Engine()->Size(), 200u);
+    fs::remove_all(dir);
+}
+
+TEST(BackupTest, FetchesBackupOverRpc) {
+    std::string dir = tempDir("backup_rpc");
+    auto sm = MakeKvStateMachine();
+    for (int i = 0; i < 1000; ++i) {
+        apply(*sm, putCommand("key" + std::to_string(i), "value" + std::to_string(i)));
+    }
+    BackupOptions options;
+    options.chunk_bytes = 1000;
+    auto service = std::make_shared<KvService>(sm, nullptr, nullptr, options);
+    auto server = rpc::RpcServer::Make();
+    service->RegisterRPC(server);
+    server->start(kPort);
+    fiber::Fiber::sleep(100);
+
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kPort));
+    BackupInfo info;
+    auto error = FetchBackup(*client, 0, dir + "/fetched.bak", info);
+    ASSERT_FALSE(error.has_value()) << *error;
+    EXPECT_EQ(info.index, 1000u);
+    EXPECT_GT(info.size, options.chunk_bytes);
+
+    // 导出期间的写入不影响已经开始的导出；最后一块读完后会话结束
+    ExportReply start;
+    ASSERT_FALSE(client->call(kMethodExport, ExportArgs{0}, start).has_value());
+    ASSERT_EQ(start.status, KvStatus::OK);
+    apply(*sm, putCommand("key0", "changed"));
+    ExportReadArgs args{start.export_id, 0};
+    std::string data;
+    ExportReadReply reply;
+    while (true) {
+        ASSERT_FALSE(client->call(kMethodExportRead, args, reply).has_value());
+        ASSERT_EQ(reply.status, KvStatus::OK);
+        if (!reply.last) {
+            // 回复丢失时用同一个offset重读，得到同样的数据；跳过未读的数据是无效的
+            ExportReadReply again;
+            ASSERT_FALSE(client->call(kMethodExportRead, args, again).has_value());
+            ASSERT_EQ(again.status, KvStatus::OK);
+            EXPECT_EQ(again.data, reply.data);
+            ExportReadReply skipped;
+            ExportReadArgs ahead{start.export_id, args.offset + reply.data.size() + 1};
+            ASSERT_FALSE(client->call(kMethodExportRead, ahead, skipped).has_value());
+            EXPECT_EQ(skipped.status, KvStatus::INVALID_ARGUMENT);
+        }
+        data += reply.data;
+        args.offset += reply.data.size();
+        if (reply.last) {
+            break;
+        }
+    }
+    EXPECT_EQ(data.size(), reply.size);
+    EXPECT_EQ(Crc32(data.data(), data.size()), reply.crc);
+    // 导出的是开始时的视图
+    KvStateMachine copy_at_start;
+    ASSERT_TRUE(copy_at_start.RestoreSnapshot(std::vector<uint8_t>(data.begin(), data.end())));
+    EXPECT_EQ(copy_at_start.Get("key0").value, "value0");
+    ExportReadReply after;
+    ASSERT_FALSE(client->call(kMethodExportRead, ExportReadArgs{start.export_id, 0}, after).has_value());
+    EXPECT_EQ(after.status, KvStatus::INVALID_ARGUMENT);
+
+    ExportReply future;
+    ASSERT_FALSE(client->call(kMethodExport, ExportArgs{sm->LastApplied() + 1}, future).has_value());
+    EXPECT_EQ(future.status, KvStatus::INVALID_ARGUMENT);
+
+    auto copy = restored(dir + "/fetched.bak");
+    ASSERT_NE(copy, nullptr);
+    EXPECT_EQ(copy->LastApplied(), 1000u);
+    EXPECT_EQ(copy->Get("key0").value, "value0");
+    EXPECT_EQ(copy->Get("key999").value, "value999");
+
+    client->disconnect();
+    server->shutdown();
+    fs::remove_all(dir);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,169 @@
+#include "kv_state_machine.h"
+#include "ordered_engine.h"
+#include "sharded_hash_engine.h"
+#include "lsm_engine.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <filesystem>
+#include <unistd.h>
+
+using namespace kv;
+namespace fs = std::filesystem;
+
+namespace {
+
+KvCommand batchCommand(std::vector<KvMutation> ops) {
+    KvCommand cmd;
+    cmd.op = KvOp::BATCH;
+    cmd.ops = std::move(ops);
+    return cmd;
+}
+
+// 批次内的操作按顺序生效，后面的操作能看到前面的写入
+void checkBatchSemantics(const KvEnginePtr& engine) {
+    KvStateMachine sm(engine);
+    sm.Apply(1, batchCommand({{KvOp::PUT, "gone", "x"}}));
+
+    auto result = sm.Apply(2, batchCommand({
+        {KvOp::PUT, "a", "1"},
+        {KvOp::APPEND, "a", "2"},
+        {KvOp::DELETE, "missing", ""},
+        {KvOp::PUT, "c", "tmp"},
+        {KvOp::DELETE, "c", ""},
+        {KvOp::APPEND, "d", "new"},
+        {KvOp::DELETE, "gone", ""},
+    }));
+    ASSERT_EQ(result.status, KvStatus::OK);
+    std::vector<KvStatus> expected = {KvStatus::OK, KvStatus::OK, KvStatus::NO_KEY, KvStatus::OK,
+                                      KvStatus::OK, KvStatus::OK, KvStatus::OK};
+    EXPECT_EQ(result.statuses, expected);
+    EXPECT_EQ(sm.LastApplied(), 2u);
+
+    auto values = sm.MultiGet({"a", "c", "d", "gone", "missing"});
+    ASSERT_EQ(values.size(), 5u);
+    EXPECT_EQ(values[0].value, "12");
+    EXPECT_EQ(values[1].status, KvStatus::NO_KEY);
+    EXPECT_EQ(values[2].value, "new");
+    EXPECT_EQ(values[3].status, KvStatus::NO_KEY);
+    EXPECT_EQ(values[4].status, KvStatus::NO_KEY);
+
+    // 含有无法识别的操作时整批拒绝，前面的操作也不生效
+    result = sm.Apply(3, batchCommand({{KvOp::PUT, "a", "changed"}, {KvOp::GET, "a", ""}}));
+    EXPECT_EQ(result.status, KvStatus::INVALID_ARGUMENT);
+    EXPECT_EQ(sm.Get("a").value, "12");
+    EXPECT_EQ(sm.LastApplied(), 3u);
+}
+
+} // namespace
+
+TEST(BatchTest, CommandCodecRoundTrip) {
+    auto cmd = batchCommand({{KvOp::PUT, "k1", "v1"}, {KvOp::DELETE, "k2", ""}});
+    KvCommand decoded;
+    ASSERT_TRUE(DecodeCommand(EncodeCommand(cmd), decoded));
+    EXPECT_EQ(decoded.op, KvOp::BATCH);
+    ASSERT_EQ(decoded.ops.size(), 2u);
+    EXPECT_EQ(decoded.ops[0].key, "k1");
+    EXPECT_EQ(decoded.ops[0].value, "v1");
+    EXPECT_EQ(decoded.ops[1].op, KvOp::DELETE);
+}
+
+TEST(BatchTest, SequentialSemanticsOnAllEngines) {
+    checkBatchSemantics(MakeShardedHashEngine());
+    checkBatchSemantics(MakeShardedHashEngine(4, 10));
+    checkBatchSemantics(MakeOrderedEngine());
+
+    auto dir = fs::temp_directory_path() / ("kv_batch_" + std::to_string(getpid()));
+    fs::remove_all(dir);
+    LsmOptions options;
+    options.dir = dir.string();
+    auto lsm = LsmEngine::Open(options);
+    ASSERT_TRUE(lsm);
+    checkBatchSemantics(lsm);
+    lsm.reset();
+    fs::remove_all(dir);
+}
+
+TEST(BatchTest, LargeBatchAcrossShards) {
+    auto engine = std::make_shared<ShardedHashEngine>(16, 10);
+    std::vector<KvMutation> ops;
+    for (int i = 0; i < 5000; ++i) {
+        ops.push_back({KvOp::PUT, "key" + std::to_string(i), std::to_string(i)});
+    }
+    std::vector<KvStatus> statuses;
+    engine->Write(1, ops, statuses);
+    EXPECT_EQ(engine->Size(), 5000u);
+    EXPECT_EQ(engine->WrittenIndex(), 1u);
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 6000; i += 3) {
+        keys.push_back("key" + std::to_string(i));
+    }
+    auto results = engine->MultiGet(keys);
+    ASSERT_EQ(results.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        int n = static_cast<int>(i) * 3;
+        if (n < 5000) {
+            ASSERT_EQ(results[i].status, KvStatus::OK);
+            EXPECT_EQ(results[i].value, std::to_string(n));
+        } else {
+            EXPECT_EQ(results[i].status, KvStatus::NO_KEY);
+        }
+    }
+}
+
+TEST(BatchTest, ReadersNeverSeeHalfBatch) {
+    auto engine = std::make_shared<OrderedEngine>();
+    const int num_keys = 64;
+    const uint64_t rounds = 500;
+    std::atomic<bool> writer_done{false};
+    std::atomic<int> inconsistent{0};
+
+    fiber::WaitGroup wg;
+    wg.add(5);
+
+    // 写者：每个批次把所有key更新为同一个值
+    fiber::Fiber::go([&]() {
+        std::vector<KvStatus> statuses;
+        for (uint64_t index = 1; index <= rounds; ++index) {
+            std::vector<KvMutation> ops;
+            for (int k = 0; k < num_keys; ++k) {
+                ops.push_back({KvOp::PUT, "key" + std::to_string(k), std::to_string(index)});
+            }
+            engine->Write(index, ops, statuses);
+            if (index % 10 == 0) {
+                engine->CollectGarbage();
+            }
+            fiber::Fiber::yield();
+        }
+        writer_done = true;
+        wg.done();
+    });
+
+    // 读者：最新读看到的所有key必须来自同一个批次
+    for (int r = 0; r < 4; ++r) {
+        fiber::Fiber::go([&]() {
+            while (!writer_done) {
+                auto pairs = engine->Scan("", "", 0);
+                for (const auto& pair : pairs) {
+                    if (pairs.size() != static_cast<size_t>(num_keys) || pair.value != pairs.front().value) {
+                        inconsistent++;
+                        break;
+                    }
+                }
+                fiber::Fiber::yield();
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_EQ(inconsistent.load(), 0);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
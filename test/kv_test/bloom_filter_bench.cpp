@@ -0,0 +1,87 @@
+#include "bloom_filter.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <chrono>
+#include <random>
+
+using namespace kv;
+
+constexpr size_t KEY_COUNT = 1000000;
+constexpr size_t PROBE_COUNT = 20000000;
+
+// 对不存在的key做探测，返回 probes/sec，并统计误判数
+template<typename Probe>
+double measure(const std::vector<uint64_t>& probes, Probe probe, size_t& positives) {
+    positives = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t hash : probes) {
+        positives += probe(hash);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return probes.size() / secs;
+}
+
+void benchFilter(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& probes) {
+    LOG_INFO("---------------- blocked bloom filter ({} keys) ----------------", keys.size());
+    for (int bits_per_key : {4, 6, 8, 10, 12, 16, 20}) {
+        BlockedBloomFilter filter(keys.size(), bits_per_key);
+        for (uint64_t hash : keys) {
+            filter.Add(hash);
+        }
+        std::string serialized = filter.Serialize();
+
+        size_t positives = 0;
+        double scalar = measure(probes, [&](uint64_t h) { return filter.MayContainScalar(h); }, positives);
+        double fpr = static_cast<double>(positives) / probes.size();
+        double avx2 = 0;
+        if (BloomFilter::HasAvx2()) {
+            avx2 = measure(probes, [&](uint64_t h) { return filter.MayContainAvx2(h); }, positives);
+        }
+        double sst = measure(probes, [&](uint64_t h) { return BloomFilter::MayContain(serialized, h); }, positives);
+
+        LOG_INFO("bits/key={:>2}  size={:>8}KB  fpr={:.5f}  scalar={:>6.1f}M/s  avx2={:>6.1f}M/s  sst={:>6.1f}M/s",
+                 bits_per_key, filter.SizeBytes() / 1024, fpr, scalar / 1e6, avx2 / 1e6, sst / 1e6);
+    }
+}
+
+// 前置过滤器对哈希表未命中查询的影响
+void benchFrontFilter() {
+    LOG_INFO("---------------- hash engine misses ----------------");
+    const int keys = 1000000;
+    const int lookups = 2000000;
+    for (int bits_per_key : {0, 10}) {
+        ShardedHashEngine engine(ShardedHashEngine::kDefaultShardCount, bits_per_key);
+        for (int i = 0; i < keys; ++i) {
+            engine.Put(i + 1, "key-" + std::to_string(i), "v");
+        }
+        std::string value;
+        size_t hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i) {
+            hits += engine.Get("absent-" + std::to_string(i), value);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("filter bits/key={:>2}  miss lookups: {:>10.0f} ops/s (hits={})", bits_per_key, lookups / secs, hits);
+    }
+}
+
+FIBER_MAIN() {
+    LOG_INFO("================= Bloom Filter Benchmark =====================");
+    LOG_INFO("keys={}, probes={}, avx2={}", KEY_COUNT, PROBE_COUNT, BloomFilter::HasAvx2());
+
+    std::mt19937_64 rng(2024);
+    std::vector<uint64_t> keys(KEY_COUNT);
+    for (auto& hash : keys) {
+        hash = rng();
+    }
+    // 随机64位哈希与已插入的key几乎不可能重合，探测结果为正即为误判
+    std::vector<uint64_t> probes(PROBE_COUNT);
+    for (auto& hash : probes) {
+        hash = rng();
+    }
+
+    benchFilter(keys, probes);
+    benchFrontFilter();
+    return 0;
+}
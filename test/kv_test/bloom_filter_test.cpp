@@ -0,0 +1,88 @@
+#include "bloom_filter.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace kv;
+
+TEST(BloomFilterTest, NoFalseNegativesAndLowFalsePositiveRate) {
+    const size_t num_keys = 100000;
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> hashes(num_keys);
+    for (auto& hash : hashes) {
+        hash = rng();
+    }
+
+    BlockedBloomFilter filter(num_keys, 10);
+    for (uint64_t hash : hashes) {
+        filter.Add(hash);
+    }
+    std::string serialized = BloomFilter::Build(hashes, 10);
+    EXPECT_EQ(serialized, filter.Serialize());
+
+    for (uint64_t hash : hashes) {
+        ASSERT_TRUE(filter.MayContain(hash));
+        ASSERT_TRUE(filter.MayContainScalar(hash));
+        ASSERT_TRUE(BloomFilter::MayContain(serialized, hash));
+    }
+
+    size_t false_positives = 0;
+    const size_t probes = 1000000;
+    for (size_t i = 0; i < probes; ++i) {
+        uint64_t hash = rng();
+        bool scalar = filter.MayContainScalar(hash);
+        if (BloomFilter::HasAvx2()) {
+            ASSERT_EQ(filter.MayContainAvx2(hash), scalar);
+        }
+        ASSERT_EQ(BloomFilter::MayContain(serialized, hash), scalar);
+        false_positives += scalar;
+    }
+    double fpr = static_cast<double>(false_positives) / probes;
+    LOG_INFO("bits/key=10 fpr={:.4f} avx2={}", fpr, BloomFilter::HasAvx2());
+    EXPECT_LT(fpr, 0.02);
+}
+
+TEST(BloomFilterTest, MalformedFilterIsConservative) {
+    EXPECT_TRUE(BloomFilter::MayContain("", 1));
+    EXPECT_TRUE(BloomFilter::MayContain(std::string(40, '\0'), 1));
+    // 空集合的过滤器对任何key都返回false
+    EXPECT_FALSE(BloomFilter::MayContain(BloomFilter::Build({}, 10), 12345));
+}
+
+TEST(BloomFilterTest, HashEngineFrontFilter) {
+    ShardedHashEngine engine(4, 10);
+    std::string value;
+    uint64_t index = 0;
+
+    // 插入超过初始容量，触发重建
+    for (int i = 0; i < 20000; ++i) {
+        engine.Put(++index, "key" + std::to_string(i), std::to_string(i));
+    }
+    for (int i = 0; i < 20000; ++i) {
+        ASSERT_TRUE(engine.Get("key" + std::to_string(i), value));
+        ASSERT_EQ(value, std::to_string(i));
+    }
+    EXPECT_FALSE(engine.Get("missing", value));
+
+    // 大量删除后重建过滤器，剩余key仍可读
+    for (int i = 0; i < 20000; i += 2) {
+        ASSERT_TRUE(engine.Delete(++index, "key" + std::to_string(i)));
+    }
+    for (int i = 0; i < 20000; ++i) {
+        ASSERT_EQ(engine.Get("key" + std::to_string(i), value), i % 2 == 1);
+    }
+
+    engine.Append(++index, "appended", "x");
+    EXPECT_TRUE(engine.Get("appended", value));
+    engine.Clear();
+    EXPECT_FALSE(engine.Get("appended", value));
+    engine.Put(++index, "appended", "y");
+    EXPECT_TRUE(engine.Get("appended", value));
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
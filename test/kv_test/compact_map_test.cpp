@@ -0,0 +1,128 @@
+#include "compact_map.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_map>
+
+using namespace kv;
+
+namespace {
+
+uint64_t hashOf(const std::string& key) {
+    return std::hash<std::string>{}(key);
+}
+
+void expectSame(const CompactMap& map, const std::unordered_map<std::string, std::string>& expected) {
+    ASSERT_EQ(map.Size(), expected.size());
+    size_t visited = 0;
+    map.ForEach([&](std::string_view key, std::string_view value) {
+        auto it = expected.find(std::string(key));
+        ASSERT_NE(it, expected.end());
+        EXPECT_EQ(value, it->second);
+        ++visited;
+    });
+    EXPECT_EQ(visited, expected.size());
+    std::string value;
+    for (const auto& [key, want] : expected) {
+        ASSERT_TRUE(map.Get(key, hashOf(key), value)) << key;
+        EXPECT_EQ(value, want);
+    }
+}
+
+} // namespace
+
+TEST(CompactMapTest, MatchesUnorderedMap) {
+    CompactMap map;
+    std::unordered_map<std::string, std::string> expected;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> key_dist(0, 2000);
+    std::uniform_int_distribution<int> op_dist(0, 99);
+    std::uniform_int_distribution<int> len_dist(0, 40);
+
+    for (int i = 0; i < 200000; ++i) {
+        std::string key = "key" + std::to_string(key_dist(rng));
+        int op = op_dist(rng);
+        if (op < 45) {
+            std::string value(len_dist(rng), static_cast<char>('a' + i % 26));
+            EXPECT_EQ(map.Put(key, hashOf(key), value), expected.count(key) == 0);
+            expected[key] = value;
+        } else if (op < 60) {
+            std::string value(len_dist(rng) / 4, static_cast<char>('A' + i % 26));
+            EXPECT_EQ(map.Append(key, hashOf(key), value), expected.count(key) == 0);
+            expected[key].append(value);
+        } else if (op < 95) {
+            EXPECT_EQ(map.Erase(key, hashOf(key)), expected.erase(key) == 1);
+        } else {
+            std::string value;
+            EXPECT_EQ(map.Get(key, hashOf(key), value), expected.count(key) == 1);
+        }
+    }
+    expectSame(map, expected);
+
+    // 深拷贝互不影响
+    CompactMap copy(map);
+    expectSame(copy, expected);
+    map.Clear();
+    EXPECT_EQ(map.Size(), 0u);
+    expectSame(copy, expected);
+}
+
+TEST(CompactMapTest, LargeAndGrowingValues) {
+    CompactMap map;
+    std::string large(100000, 'x');
+    map.Put("large", hashOf("large"), large);
+    map.Put("empty", hashOf("empty"), "");
+    std::string log;
+    for (int i = 0; i < 5000; ++i) {
+        std::string piece = std::to_string(i) + ",";
+        map.Append("log", hashOf("log"), piece);
+        log += piece;
+    }
+    std::string value;
+    ASSERT_TRUE(map.Get("large", hashOf("large"), value));
+    EXPECT_EQ(value, large);
+    ASSERT_TRUE(map.Get("empty", hashOf("empty"), value));
+    EXPECT_TRUE(value.empty());
+    ASSERT_TRUE(map.Get("log", hashOf("log"), value));
+    EXPECT_EQ(value, log);
+
+    // 大值缩小后原地覆盖，再次增大时重新分配
+    map.Put("large", hashOf("large"), "small");
+    map.Put("large", hashOf("large"), large + large);
+    ASSERT_TRUE(map.Get("large", hashOf("large"), value));
+    EXPECT_EQ(value.size(), 2 * large.size());
+    EXPECT_TRUE(map.Erase("large", hashOf("large")));
+    EXPECT_FALSE(map.Get("large", hashOf("large"), value));
+}
+
+TEST(CompactMapTest, EngineTracksMemory) {
+    ShardedHashEngine engine(8);
+    size_t empty = engine.MemoryUsage();
+    for (int i = 0; i < 100000; ++i) {
+        engine.Put(i + 1, "user:" + std::to_string(i), "value-" + std::to_string(i));
+    }
+    size_t used = engine.MemoryUsage();
+    EXPECT_GT(used, empty);
+    // 短键值对每条记录48字节，加上3/4负载的16字节槽位
+    double per_key = static_cast<double>(used - empty) / 100000;
+    LOG_INFO("ShardedHashEngine: {:.1f} bytes/key", per_key);
+    EXPECT_LT(per_key, 100.0);
+
+    auto view = engine.NewReadView(0);
+    engine.Put(200000, "user:1", "changed");
+    std::string value;
+    ASSERT_TRUE(view->Get("user:1", value));
+    EXPECT_EQ(value, "value-1");
+    ASSERT_TRUE(engine.Get("user:1", value));
+    EXPECT_EQ(value, "changed");
+    size_t visited = 0;
+    view->ForEach([&](const std::string& key, const std::string& v) { ++visited; });
+    EXPECT_EQ(visited, 100000u);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
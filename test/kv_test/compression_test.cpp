@@ -0,0 +1,245 @@
+#include "value_codec.h"
+#include "sst.h"
+#include "lsm_engine.h"
+#include "kv_state_machine.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+#include <unistd.h>
+
+using namespace kv;
+namespace fs = std::filesystem;
+
+namespace {
+
+// 结构相同、字段值不同的JSON风格值
+std::string jsonValue(std::mt19937& rng) {
+    return "{\"user_id\":" + std::to_string(rng() % 1000000) + ",\"name\":\"user" + std::to_string(rng() % 5000) +
+           "\",\"email\":\"u" + std::to_string(rng() % 999) + "@example.com\",\"active\":" +
+           (rng() % 2 ? "true" : "false") + ",\"tags\":[\"alpha\",\"beta\"]}";
+}
+
+std::string tempDir(const std::string& name) {
+    auto dir = fs::temp_directory_path() / ("kv_" + name + "_" + std::to_string(getpid()));
+    fs::remove_all(dir);
+    return dir.string();
+}
+
+KvCommand putCommand(const std::string& key, const std::string& value) {
+    KvCommand cmd;
+    cmd.op = KvOp::PUT;
+    cmd.key = key;
+    cmd.value = value;
+    return cmd;
+}
+
+} // namespace
+
+TEST(CompressionTest, DictionaryRoundTrip) {
+    std::mt19937 rng(1);
+    std::vector<std::string> samples;
+    for (int i = 0; i < 500; ++i) {
+        samples.push_back(jsonValue(rng));
+    }
+    auto dict = TrainDictionary(samples, 4096);
+    ASSERT_TRUE(dict);
+    EXPECT_LE(dict->Size(), 4096u);
+    EXPECT_FALSE(TrainDictionary({"too", "few"}, 4096));
+
+    size_t raw = 0;
+    size_t plain = 0;
+    size_t with_dict = 0;
+    std::string out;
+    for (int i = 0; i < 2000; ++i) {
+        std::string value = jsonValue(rng);
+        if (i % 10 == 0) {
+            // 不可压缩的随机字节
+            value.clear();
+            for (int k = 0; k < 100; ++k) {
+                value.push_back(static_cast<char>(rng()));
+            }
+        }
+        std::string a = Compress(value);
+        std::string b = Compress(value, dict.get());
+        ASSERT_TRUE(Decompress(a, nullptr, out));
+        EXPECT_EQ(out, value);
+        ASSERT_TRUE(Decompress(b, dict.get(), out));
+        EXPECT_EQ(out, value);
+        raw += value.size();
+        plain += a.size();
+        with_dict += b.size();
+    }
+    LOG_INFO("raw {} bytes, compressed {} bytes, with dictionary {} bytes", raw, plain, with_dict);
+    EXPECT_LT(with_dict * 2, raw);
+
+    // 截断的输入和缺少字典时解压失败，不会越界
+    std::string encoded = Compress(jsonValue(rng), dict.get());
+    for (size_t len = 0; len < encoded.size(); ++len) {
+        EXPECT_FALSE(Decompress(std::string_view(encoded).substr(0, len), dict.get(), out));
+    }
+    EXPECT_FALSE(Decompress(encoded, nullptr, out));
+
+    // 格式头声明接近4GiB但数据很短：按实际数据失败，不按声明的大小预留内存
+    std::string forged = "\xff\xff\xff\xff\x0f";
+    forged += '\x03';
+    forged += "abc";
+    EXPECT_FALSE(Decompress(forged, nullptr, out));
+    EXPECT_LT(out.capacity(), size_t(1) << 20);
+}
+
+TEST(CompressionTest, CompressedSstAndLsm) {
+    std::string dir = tempDir("compressed_sst");
+    fs::create_directories(dir);
+    std::mt19937 rng(2);
+    std::vector<std::pair<std::string, std::string>> entries;
+    for (int i = 0; i < 20000; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%06d", i);
+        entries.emplace_back(key, jsonValue(rng));
+    }
+
+    uint64_t sizes[2];
+    for (bool compression : {false, true}) {
+        std::string path = dir + (compression ? "/compressed.sst" : "/plain.sst");
+        SstOptions options;
+        options.compression = compression;
+        {
+            SstBuilder builder(path, options);
+            ASSERT_TRUE(builder.Open());
+            for (const auto& [key, value] : entries) {
+                ASSERT_TRUE(builder.Add(key, value, false));
+            }
+            ASSERT_TRUE(builder.Finish());
+            sizes[compression] = builder.FileSize();
+        }
+        auto reader = SstReader::Open(path, 1);
+        ASSERT_TRUE(reader);
+        EXPECT_TRUE(reader->VerifyChecksums());
+        std::string value;
+        for (size_t i = 0; i < entries.size(); i += 97) {
+            ASSERT_EQ(reader->Get(entries[i].first, value), SstReader::LookupResult::FOUND);
+            EXPECT_EQ(value, entries[i].second);
+        }
+        auto it = reader->NewIterator();
+        size_t count = 0;
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            ASSERT_EQ(it->value(), entries[count].second);
+            ++count;
+        }
+        EXPECT_EQ(count, entries.size());
+    }
+    LOG_INFO("sst: plain {} bytes, compressed {} bytes", sizes[0], sizes[1]);
+    EXPECT_LT(sizes[1] * 2, sizes[0]);
+
+    // LSM的flush和compaction都使用压缩的SST
+    LsmOptions options;
+    options.dir = dir + "/lsm";
+    options.memtable_bytes = 64 << 10;
+    options.target_file_bytes = 32 << 10;
+    options.level1_max_bytes = 128 << 10;
+    options.level0_compaction_trigger = 2;
+    options.sst.compression = true;
+    options.sst.dict_sample_bytes = 16 << 10;
+    {
+        auto engine = LsmEngine::Open(options);
+        ASSERT_TRUE(engine);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            engine->Put(i + 1, entries[i].first, entries[i].second);
+        }
+        engine->Flush();
+        engine->WaitIdle();
+    }
+    auto engine = LsmEngine::Open(options);
+    ASSERT_TRUE(engine);
+    std::string value;
+    for (size_t i = 0; i < entries.size(); i += 13) {
+        ASSERT_TRUE(engine->Get(entries[i].first, value));
+        EXPECT_EQ(value, entries[i].second);
+    }
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+TEST(CompressionTest, CompressedSnapshot) {
+    std::mt19937 rng(3);
+    SnapshotOptions snapshot;
+    snapshot.compression = true;
+    snapshot.block_bytes = 16 << 10;
+    auto sm = MakeKvStateMachine(MakeShardedHashEngine(8), {}, {}, snapshot);
+    auto plain = MakeKvStateMachine(MakeShardedHashEngine(8));
+    for (uint64_t i = 1; i <= 20000; ++i) {
+        auto cmd = putCommand("user:" + std::to_string(i), jsonValue(rng));
+        sm->Apply(i, cmd);
+        plain->Apply(i, cmd);
+    }
+
+    auto compressed = sm->TakeSnapshot();
+    auto uncompressed = plain->TakeSnapshot();
+    LOG_INFO("snapshot: plain {} bytes, compressed {} bytes", uncompressed.size(), compressed.size());
+    EXPECT_LT(compressed.size() * 3, uncompressed.size());
+
+    // 两种格式都能被任意配置的状态机恢复
+    for (const auto* data : {&compressed, &uncompressed}) {
+        KvStateMachine restored;
+        ASSERT_TRUE(restored.RestoreSnapshot(*data));
+        EXPECT_EQ(restored.LastApplied(), 20000u);
+        EXPECT_EQ(restored.Engine()->Size(), 20000u);
+        for (int i = 1; i <= 20000; i += 111) {
+            std::string key = "user:" + std::to_string(i);
+            EXPECT_EQ(restored.Get(key).value, plain->Get(key).value);
+        }
+    }
+
+    auto corrupted = compressed;
+    corrupted[corrupted.size() / 2] ^= 0x40;
+    KvStateMachine restored;
+    EXPECT_FALSE(restored.RestoreSnapshot(corrupted));
+}
+
+TEST(CompressionTest, CompressedHashEngineValues) {
+    std::mt19937 rng(4);
+    auto plain = std::make_shared<ShardedHashEngine>(4);
+    auto compressed = std::make_shared<ShardedHashEngine>(4, 0, true);
+    std::vector<std::string> values;
+    for (int i = 0; i < 50000; ++i) {
+        values.push_back(jsonValue(rng));
+        plain->Put(i + 1, "key" + std::to_string(i), values.back());
+        compressed->Put(i + 1, "key" + std::to_string(i), values.back());
+    }
+    LOG_INFO("hash engine: plain {} bytes, compressed {} bytes", plain->MemoryUsage(), compressed->MemoryUsage());
+    EXPECT_LT(compressed->MemoryUsage(), plain->MemoryUsage() * 3 / 4);
+
+    // 读视图在压缩前冻结的数据和之后写入的数据都能读出
+    auto view = compressed->NewReadView(0);
+    compressed->Append(50001, "key7", ",more");
+    compressed->Put(50002, "key8", "short");
+    std::string value;
+    ASSERT_TRUE(compressed->Get("key7", value));
+    EXPECT_EQ(value, values[7] + ",more");
+    ASSERT_TRUE(compressed->Get("key8", value));
+    EXPECT_EQ(value, "short");
+    ASSERT_TRUE(view->Get("key8", value));
+    EXPECT_EQ(value, values[8]);
+
+    size_t visited = 0;
+    compressed->ForEach([&](const std::string& key, const std::string& v) {
+        int i = std::stoi(key.substr(3));
+        if (i != 7 && i != 8) {
+            EXPECT_EQ(v, values[i]);
+        }
+        ++visited;
+    });
+    EXPECT_EQ(visited, values.size());
+    auto results = compressed->MultiGet({"key1", "key2", "missing"});
+    EXPECT_EQ(results[0].value, values[1]);
+    EXPECT_EQ(results[1].value, values[2]);
+    EXPECT_EQ(results[2].status, KvStatus::NO_KEY);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,328 @@
+#include "bulk_ingest.h"
+#include "lsm_engine.h"
+#include "kv_service.h"
+#include "rpc_server.h"
+#include "rpc_client.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <unistd.h>
+
+using namespace kv;
+namespace fs = std::filesystem;
+
+static constexpr uint16_t kLeaderPort = 9220;
+static constexpr uint16_t kFollowerPort = 9221;
+
+namespace {
+
+std::string tempDir(const std::string& name) {
+    auto dir = fs::temp_directory_path() / ("kv_" + name + "_" + std::to_string(getpid()));
+    fs::remove_all(dir);
+    return dir.string();
+}
+
+std::string keyOf(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+std::vector<KvPair> range(int begin, int end, const std::string& prefix) {
+    std::vector<KvPair> pairs;
+    for (int i = begin; i < end; ++i) {
+        pairs.push_back(KvPair{keyOf(i), prefix + std::to_string(i)});
+    }
+    return pairs;
+}
+
+IngestOptions smallIngest(const std::string& dir) {
+    IngestOptions options;
+    options.dir = dir;
+    options.target_file_bytes = 16 << 10;
+    options.sst.block_size = 512;
+    return options;
+}
+
+size_t countFiles(const std::string& dir) {
+    if (!fs::exists(dir)) {
+        return 0;
+    }
+    return std::distance(fs::directory_iterator(dir), fs::directory_iterator());
+}
+
+} // namespace
+
+TEST(IngestTest, Crc32MatchesBytewiseReference) {
+    auto reference = [](const std::string& data) {
+        uint32_t crc = ~0u;
+        for (unsigned char c : data) {
+            crc ^= c;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+            }
+        }
+        return ~crc;
+    };
+    EXPECT_EQ(Crc32("123456789", 9), 0xCBF43926u);
+
+    std::mt19937 gen(7);
+    for (size_t size : {0, 1, 7, 8, 9, 63, 64, 1000, 4099}) {
+        std::string data(size, '\0');
+        for (auto& c : data) {
+            c = static_cast<char>(gen());
+        }
+        EXPECT_EQ(Crc32(data.data(), data.size()), reference(data)) << size;
+        // 分段计算与整体一致
+        size_t half = size / 3;
+        EXPECT_EQ(Crc32(data.data() + half, size - half, Crc32(data.data(), half)), reference(data)) << size;
+    }
+}
+
+TEST(IngestTest, BuilderSplitsFilesAndRejectsDisorder) {
+    std::string dir = tempDir("ingest_builder");
+    std::vector<IngestFile> files;
+    {
+        IngestBuilder builder(42, smallIngest(dir));
+        ASSERT_TRUE(builder.Add(range(0, 1000, "v")));
+        // 与上一批不衔接或批内乱序的批次整批拒绝
+        EXPECT_FALSE(builder.Add(range(500, 600, "v")));
+        EXPECT_FALSE(builder.Add({KvPair{keyOf(2000), "a"}, KvPair{keyOf(1500), "b"}}));
+        ASSERT_TRUE(builder.Add(range(1000, 3000, "v")));
+        EXPECT_EQ(builder.NumEntries(), 3000u);
+        ASSERT_TRUE(builder.Finish(files));
+    }
+    ASSERT_GT(files.size(), 1u);
+
+    uint64_t entries = 0;
+    std::string last;
+    for (const auto& file : files) {
+        EXPECT_TRUE(ValidIngestFileName(file.name));
+        std::string path = IngestFilePath(dir, file.name);
+        ASSERT_TRUE(VerifyIngestFile(path, file));
+        auto reader = SstReader::Open(path, 0);
+        ASSERT_NE(reader, nullptr);
+        EXPECT_EQ(reader->NumEntries(), file.entries);
+        EXPECT_GT(reader->Smallest(), last);
+        last = reader->Largest();
+        entries += file.entries;
+    }
+    EXPECT_EQ(entries, 3000u);
+
+    // 内容被改动后校验失败
+    std::string path = IngestFilePath(dir, files[0].name);
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(10);
+        f.put('\x5a');
+    }
+    EXPECT_FALSE(VerifyIngestFile(path, files[0]));
+    EXPECT_FALSE(ValidIngestFileName("../ingest-00.sst"));
+
+    // 没有Finish的导入删除已写出的文件
+    std::string abandoned = tempDir("ingest_abandoned");
+    {
+        IngestBuilder builder(43, smallIngest(abandoned));
+        ASSERT_TRUE(builder.Add(range(0, 3000, "v")));
+        EXPECT_GT(countFiles(abandoned), 0u);
+    }
+    EXPECT_EQ(countFiles(abandoned), 0u);
+    fs::remove_all(dir);
+    fs::remove_all(abandoned);
+}
+
+TEST(IngestTest, LsmEngineLinksFilesWithoutRewriting) {
+    std::string dir = tempDir("ingest_lsm");
+    std::string staging = dir + "/staging";
+    LsmOptions options;
+    options.dir = dir + "/data";
+    options.memtable_bytes = 16 << 10;
+    options.sst.block_size = 512;
+
+    std::vector<IngestFile> low;
+    std::vector<IngestFile> high;
+    {
+        IngestBuilder builder(1, smallIngest(staging));
+        ASSERT_TRUE(builder.Add(range(0, 500, "ingested")));
+        ASSERT_TRUE(builder.Finish(low));
+    }
+    {
+        IngestBuilder builder(2, smallIngest(staging));
+        ASSERT_TRUE(builder.Add(range(5000, 6000, "ingested")));
+        ASSERT_TRUE(builder.Finish(high));
+    }
+    auto paths = [&](const std::vector<IngestFile>& files) {
+        std::vector<std::string> result;
+        for (const auto& file : files) {
+            result.push_back(IngestFilePath(staging, file.name));
+        }
+        return result;
+    };
+
+    {
+        auto engine = LsmEngine::Open(options);
+        ASSERT_NE(engine, nullptr);
+        // 已有数据与第一批导入重叠（一部分还在memtable中）
+        uint64_t index = 0;
+        for (int i = 0; i < 1000; ++i) {
+            engine->Put(++index, keyOf(i), "old");
+        }
+        ASSERT_TRUE(engine->Ingest(++index, paths(low)));
+        EXPECT_EQ(engine->DurableIndex(), index);
+        std::string value;
+        ASSERT_TRUE(engine->Get(keyOf(10), value));
+        EXPECT_EQ(value, "ingested10");
+        ASSERT_TRUE(engine->Get(keyOf(700), value));
+        EXPECT_EQ(value, "old");
+
+        // 与已有数据不重叠的文件直接放到最深一层
+        ASSERT_TRUE(engine->Ingest(++index, paths(high)));
+        auto counts = engine->LevelFileCounts();
+        EXPECT_EQ(counts.back(), high.size());
+        ASSERT_TRUE(engine->Get(keyOf(5999), value));
+        EXPECT_EQ(value, "ingested5999");
+        auto pairs = engine->Scan(keyOf(4990), keyOf(5010), 0);
+        ASSERT_EQ(pairs.size(), 10u);
+        EXPECT_EQ(pairs.front().key, keyOf(5000));
+
+        // 之后的写入比导入的数据新
+        engine->Put(++index, keyOf(5500), "newer");
+        ASSERT_TRUE(engine->Get(keyOf(5500), value));
+        EXPECT_EQ(value, "newer");
+        engine->Flush();
+        engine->WaitIdle();
+    }
+
+    // 导入的文件是硬链接，删除暂存文件不影响引擎；重启后数据仍在
+    fs::remove_all(staging);
+    auto engine = LsmEngine::Open(options);
+    ASSERT_NE(engine, nullptr);
+    std::string value;
+    ASSERT_TRUE(engine->Get(keyOf(499), value));
+    EXPECT_EQ(value, "ingested499");
+    ASSERT_TRUE(engine->Get(keyOf(5500), value));
+    EXPECT_EQ(value, "newer");
+    ASSERT_TRUE(engine->Get(keyOf(5501), value));
+    EXPECT_EQ(value, "ingested5501");
+    fs::remove_all(dir);
+}
+
+TEST(IngestTest, ServiceIngestsThroughOneCommand) {
+    std::string dir = tempDir("ingest_service");
+    auto sm = MakeKvStateMachine(MakeShardedHashEngine(), {}, {}, {}, smallIngest(dir));
+    KvService service(sm);
+
+    PutAppendReply put;
+    service.PutAppend(PutAppendArgs{KvOp::PUT, keyOf(5), "old", 60000}, put);
+    ASSERT_EQ(put.status, KvStatus::OK);
+    ASSERT_EQ(sm->TtlCount(), 1u);
+    uint64_t applied = sm->LastApplied();
+
+    IngestWriteReply write;
+    service.IngestWrite(IngestWriteArgs{7, 1, range(0, 1000, "v")}, write);
+    ASSERT_EQ(write.status, KvStatus::OK);
+    // 重试已写入的批次不会重复写入
+    service.IngestWrite(IngestWriteArgs{7, 1, range(0, 1000, "v")}, write);
+    EXPECT_EQ(write.status, KvStatus::OK);
+    service.IngestWrite(IngestWriteArgs{7, 2, range(1000, 2000, "v")}, write);
+    ASSERT_EQ(write.status, KvStatus::OK);
+    // key倒退的批次被拒绝
+    service.IngestWrite(IngestWriteArgs{7, 3, range(10, 20, "v")}, write);
+    EXPECT_EQ(write.status, KvStatus::INVALID_ARGUMENT);
+    // 不存在的会话只能从第一批开始
+    service.IngestWrite(IngestWriteArgs{8, 2, range(0, 10, "v")}, write);
+    EXPECT_EQ(write.status, KvStatus::INVALID_ARGUMENT);
+
+    IngestCommitReply commit;
+    service.IngestCommit(IngestCommitArgs{7, RequestId{99, 1}}, commit);
+    ASSERT_EQ(commit.status, KvStatus::OK);
+    EXPECT_EQ(commit.entries, 2000u);
+    EXPECT_GT(commit.files, 1u);
+    // 整个导入只占一条日志
+    EXPECT_EQ(sm->LastApplied(), applied + 1);
+
+    EXPECT_EQ(sm->Get(keyOf(5)).value, "v5");
+    EXPECT_EQ(sm->Get(keyOf(1999)).value, "v1999");
+    EXPECT_EQ(sm->TtlCount(), 0u);
+
+    // 内存引擎重放日志还需要暂存文件，快照覆盖之后才删除
+    EXPECT_EQ(countFiles(dir), commit.files);
+    sm->ReleaseIngestFiles(sm->LastApplied());
+    EXPECT_EQ(countFiles(dir), 0u);
+
+    // 会话已提交，迟到的写入和重复的提交都被拒绝
+    service.IngestWrite(IngestWriteArgs{7, 3, range(3000, 3010, "v")}, write);
+    EXPECT_EQ(write.status, KvStatus::INVALID_ARGUMENT);
+    service.IngestCommit(IngestCommitArgs{7, RequestId{99, 2}}, commit);
+    EXPECT_EQ(commit.status, KvStatus::INVALID_ARGUMENT);
+
+    // 放弃的导入不留下文件
+    service.IngestWrite(IngestWriteArgs{9, 1, range(0, 3000, "x")}, write);
+    ASSERT_EQ(write.status, KvStatus::OK);
+    IngestAbortReply abort;
+    service.IngestAbort(IngestAbortArgs{9}, abort);
+    EXPECT_EQ(countFiles(dir), 0u);
+    EXPECT_EQ(sm->Get(keyOf(0)).value, "v0");
+    fs::remove_all(dir);
+}
+
+TEST(IngestTest, FilesAreShippedToReplicasBeforeCommit) {
+    // 两个副本：leader的propose在两个状态机上按同一个index apply，模拟Raft复制
+    std::string dir = tempDir("ingest_replicas");
+    auto leader_sm = MakeKvStateMachine(MakeShardedHashEngine(), {}, {}, {}, smallIngest(dir + "/leader"));
+    auto follower_sm = MakeKvStateMachine(MakeShardedHashEngine(), {}, {}, {}, smallIngest(dir + "/follower"));
+    fiber::FiberMutex mu;
+    auto propose = [&](const KvCommand& cmd) {
+        std::unique_lock<fiber::FiberMutex> lock(mu);
+        uint64_t index = leader_sm->LastApplied() + 1;
+        follower_sm->Apply(index, cmd);
+        return leader_sm->Apply(index, cmd);
+    };
+    auto leader = std::make_shared<KvService>(
+        leader_sm, propose, KvService::MakeIngestShipper({"127.0.0.1:" + std::to_string(kFollowerPort)}));
+    auto follower = std::make_shared<KvService>(follower_sm);
+    auto leader_server = rpc::RpcServer::Make();
+    auto follower_server = rpc::RpcServer::Make();
+    leader->RegisterRPC(leader_server);
+    follower->RegisterRPC(follower_server);
+    leader_server->start(kLeaderPort);
+    follower_server->start(kFollowerPort);
+    fiber::Fiber::sleep(100);
+
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kLeaderPort));
+    int next = 0;
+    IngestCommitReply reply;
+    auto error = BulkIngest(*client, [&](std::vector<KvPair>& batch) {
+        if (next >= 5000) {
+            return false;
+        }
+        batch = range(next, next + 500, "r");
+        next += 500;
+        return true;
+    }, reply);
+    ASSERT_FALSE(error.has_value()) << *error;
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    EXPECT_EQ(reply.entries, 5000u);
+
+    for (int i = 0; i < 5000; i += 97) {
+        EXPECT_EQ(leader_sm->Get(keyOf(i)).value, "r" + std::to_string(i));
+        EXPECT_EQ(follower_sm->Get(keyOf(i)).value, "r" + std::to_string(i));
+    }
+    EXPECT_EQ(leader_sm->LastApplied(), follower_sm->LastApplied());
+
+    client->disconnect();
+    leader_server->shutdown();
+    follower_server->shutdown();
+    fs::remove_all(dir);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+#include "kv_service.h"
+#include "rpc_client.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <chrono>
+
+using namespace kv;
+
+constexpr uint16_t PORT = 9191;
+constexpr int KEY_COUNT = 100000;
+constexpr int BATCH_SIZE = 100;
+
+static std::string keyOf(int i) {
+    return "bench/" + std::to_string(i);
+}
+
+template<typename Fn>
+double opsPerSec(int ops, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ops / secs;
+}
+
+void benchRpc(rpc::RpcClient& client) {
+    LOG_INFO("---------------- {} keys over RPC, batch={} ----------------", KEY_COUNT, BATCH_SIZE);
+
+    double put = opsPerSec(KEY_COUNT, [&]() {
+        PutAppendReply reply;
+        for (int i = 0; i < KEY_COUNT; ++i) {
+            client.call(kMethodPutAppend, PutAppendArgs{KvOp::PUT, keyOf(i), "v"}, reply);
+        }
+    });
+    double multi_put = opsPerSec(KEY_COUNT, [&]() {
+        MultiPutReply reply;
+        for (int i = 0; i < KEY_COUNT; i += BATCH_SIZE) {
+            MultiPutArgs args;
+            for (int k = i; k < i + BATCH_SIZE; ++k) {
+                args.pairs.push_back(KvPair{keyOf(k), "v"});
+            }
+            client.call(kMethodMultiPut, args, reply);
+        }
+    });
+    LOG_INFO("Put       {:>10.0f} keys/s    MultiPut {:>10.0f} keys/s    ({:.1f}x)", put, multi_put,
+             multi_put / put);
+
+    double get = opsPerSec(KEY_COUNT, [&]() {
+        GetReply reply;
+        for (int i = 0; i < KEY_COUNT; ++i) {
+            client.call(kMethodGet, GetArgs{keyOf(i)}, reply);
+        }
+    });
+    double multi_get = opsPerSec(KEY_COUNT, [&]() {
+        MultiGetReply reply;
+        for (int i = 0; i < KEY_COUNT; i += BATCH_SIZE) {
+            MultiGetArgs args;
+            for (int k = i; k < i + BATCH_SIZE; ++k) {
+                args.keys.push_back(keyOf(k));
+            }
+            client.call(kMethodMultiGet, args, reply);
+        }
+    });
+    LOG_INFO("Get       {:>10.0f} keys/s    MultiGet {:>10.0f} keys/s    ({:.1f}x)", get, multi_get,
+             multi_get / get);
+}
+
+// 不经过RPC，对比逐条apply与单条BATCH日志
+void benchApply() {
+    LOG_INFO("---------------- state machine apply, batch={} ----------------", BATCH_SIZE);
+    for (int round = 0; round < 2; ++round) {
+        KvStateMachine single;
+        KvStateMachine batched;
+        double one = opsPerSec(KEY_COUNT, [&]() {
+            KvCommand cmd;
+            cmd.op = KvOp::PUT;
+            for (int i = 0; i < KEY_COUNT; ++i) {
+                cmd.key = keyOf(i);
+                cmd.value = "v";
+                single.Apply(i + 1, cmd);
+            }
+        });
+        double batch = opsPerSec(KEY_COUNT, [&]() {
+            KvCommand cmd;
+            cmd.op = KvOp::BATCH;
+            uint64_t index = 0;
+            for (int i = 0; i < KEY_COUNT; i += BATCH_SIZE) {
+                cmd.ops.clear();
+                for (int k = i; k < i + BATCH_SIZE; ++k) {
+                    cmd.ops.push_back(KvMutation{KvOp::PUT, keyOf(k), "v"});
+                }
+                batched.Apply(++index, cmd);
+            }
+        });
+        LOG_INFO("Apply     {:>10.0f} keys/s    Batch    {:>10.0f} keys/s    ({:.1f}x)", one, batch, batch / one);
+    }
+}
+
+FIBER_MAIN() {
+    LOG_INFO("================= KV Batch RPC Benchmark =====================");
+    auto server = rpc::RpcServer::Make();
+    auto service = std::make_shared<KvService>(MakeKvStateMachine());
+    service->RegisterRPC(server);
+    server->start(PORT);
+    fiber::Fiber::sleep(100);
+
+    auto client = rpc::RpcClient::Make();
+    if (!client->connect("127.0.0.1", PORT)) {
+        LOG_ERROR("failed to connect to benchmark server");
+        return 1;
+    }
+    benchRpc(*client);
+    client->disconnect();
+    benchApply();
+
+    server->shutdown();
+    fiber::Fiber::sleep(100);
+    return 0;
+}
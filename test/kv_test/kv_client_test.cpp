@@ -0,0 +1,286 @@
+#include "kv_client.h"
+#include "kv_service.h"
+#include "sharded_kv_service.h"
+#include "rpc_server.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <map>
+#include <set>
+
+using namespace kv;
+
+static constexpr uint16_t kBasePort = 9210;
+static constexpr int kNodes = 3;
+
+static std::string endpointOf(int node) {
+    return "127.0.0.1:" + std::to_string(kBasePort + node);
+}
+
+// 模拟一个三节点的Raft组：各节点共享一个状态机，只有leader接受写入，
+// 其他节点返回WRONG_LEADER（hints为true时带上leader地址）
+class FakeCluster {
+public:
+    FakeCluster() : sm_(MakeKvStateMachine()) {
+        for (int node = 0; node < kNodes; ++node) {
+            auto service = std::make_shared<KvService>(sm_, [this, node](const KvCommand& cmd) {
+                return propose(node, cmd);
+            });
+            auto server = rpc::RpcServer::Make();
+            service->RegisterRPC(server);
+            server->start(kBasePort + node);
+            services_.push_back(service);
+            servers_.push_back(server);
+        }
+        fiber::Fiber::sleep(100);
+    }
+
+    ~FakeCluster() {
+        for (auto& server : servers_) {
+            server->shutdown();
+        }
+    }
+
+    std::vector<std::string> Endpoints() const {
+        std::vector<std::string> endpoints;
+        for (int node = 0; node < kNodes; ++node) {
+            endpoints.push_back(endpointOf(node));
+        }
+        return endpoints;
+    }
+
+    std::atomic<int> leader{0};     // -1表示没有leader
+    std::atomic<bool> hints{true};
+    std::atomic<uint64_t> proposals{0};
+    std::atomic<int> lost_batch_replies{0};     // 之后几个BATCH提交后丢失应答（leader刚好下台）
+
+    // 每个key被哪些RequestId写过
+    std::map<std::string, std::set<std::pair<uint64_t, uint64_t>>> Writers() {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        return writers_;
+    }
+
+private:
+    KvResult propose(int node, const KvCommand& cmd) {
+        int current = leader.load();
+        if (node != current) {
+            return KvResult{KvStatus::WRONG_LEADER, hints && current >= 0 ? endpointOf(current) : ""};
+        }
+        proposals.fetch_add(1);
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        auto result = sm_->Apply(sm_->LastApplied() + 1, cmd);
+        if (cmd.op != KvOp::BATCH) {
+            writers_[cmd.key].emplace(cmd.request.client_id, cmd.request.seq);
+        }
+        for (const auto& op : cmd.ops) {
+            writers_[op.key].emplace(cmd.request.client_id, cmd.request.seq);
+        }
+        if (cmd.op == KvOp::BATCH && lost_batch_replies.fetch_sub(1) > 0) {
+            return KvResult{KvStatus::WRONG_LEADER, ""};
+        }
+        return result;
+    }
+
+    KvStateMachinePtr sm_;
+    std::map<std::string, std::set<std::pair<uint64_t, uint64_t>>> writers_;
+    fiber::FiberMutex mu_;
+    std::vector<KvServicePtr> services_;
+    std::vector<rpc::RpcServerPtr> servers_;
+};
+
+static KvClientOptions clientOptions(std::vector<std::string> endpoints) {
+    KvClientOptions options;
+    options.endpoints = std::move(endpoints);
+    options.backoff_min_ms = 1;
+    options.backoff_max_ms = 20;
+    options.rpc_timeout_ms = 1000;
+    return options;
+}
+
+TEST(KvClientTest, FollowsLeaderHintAndCachesLeader) {
+    FakeCluster cluster;
+    cluster.leader = 2;
+    KvClient client(clientOptions(cluster.Endpoints()));
+
+    ASSERT_EQ(client.Put("k", "v1"), KvStatus::OK);
+    EXPECT_EQ(client.CachedLeader(0), endpointOf(2));
+    auto stats = client.Stats();
+    EXPECT_LE(stats.redirects, 1u);
+    EXPECT_EQ(stats.retries, 0u);
+
+    // leader已缓存：之后的写直接发往leader
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_EQ(client.Put("key" + std::to_string(i), "v"), KvStatus::OK);
+    }
+    EXPECT_EQ(client.Stats().redirects, stats.redirects);
+    EXPECT_EQ(client.Stats().rpcs, stats.rpcs + 50);
+
+    // leader切换：一次重定向后恢复，不需要退避
+    cluster.leader = 0;
+    ASSERT_EQ(client.Append("k", "+v2"), KvStatus::OK);
+    EXPECT_EQ(client.CachedLeader(0), endpointOf(0));
+    EXPECT_EQ(client.Stats().redirects, stats.redirects + 1);
+    EXPECT_EQ(client.Stats().retries, 0u);
+    EXPECT_EQ(client.Get("k").value, "v1+v2");
+
+    int64_t value = 0;
+    ASSERT_EQ(client.Increment("counter", 5, value), KvStatus::OK);
+    EXPECT_EQ(value, 5);
+    auto cas = client.CompareAndSwap("counter", "4", "x");
+    EXPECT_EQ(cas.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(cas.value, "5");
+    EXPECT_EQ(client.PutIfAbsent("fresh", "1").status, KvStatus::OK);
+    EXPECT_EQ(client.Delete("fresh"), KvStatus::OK);
+    EXPECT_EQ(client.Get("fresh").status, KvStatus::NO_KEY);
+}
+
+TEST(KvClientTest, RetriesWithoutHintsAndSkipsDeadNodes) {
+    FakeCluster cluster;
+    cluster.hints = false;
+    cluster.leader = 1;
+    // 第一个地址上没有服务
+    auto endpoints = cluster.Endpoints();
+    endpoints.insert(endpoints.begin(), "127.0.0.1:" + std::to_string(kBasePort + kNodes));
+    KvClient client(clientOptions(endpoints));
+
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(client.Put("key" + std::to_string(i), "v"), KvStatus::OK);
+    }
+    EXPECT_EQ(client.CachedLeader(0), endpointOf(1));
+    EXPECT_GT(client.Stats().retries, 0u);
+    EXPECT_EQ(cluster.proposals.load(), 10u);
+
+    // 一直没有leader时重试有限次后返回UNAVAILABLE
+    cluster.leader = -1;
+    EXPECT_EQ(client.Put("k", "v"), KvStatus::UNAVAILABLE);
+    cluster.leader = 2;
+    EXPECT_EQ(client.Put("k", "v"), KvStatus::OK);
+}
+
+TEST(KvClientTest, CombinesConcurrentRequests) {
+    FakeCluster cluster;
+    cluster.leader = 1;
+    KvClient client(clientOptions(cluster.Endpoints()));
+    ASSERT_EQ(client.Put("warmup", "v"), KvStatus::OK);
+
+    constexpr int kFibers = 32;
+    constexpr int kOps = 50;
+    std::atomic<int> failures{0};
+    fiber::WaitGroup wg;
+    wg.add(kFibers);
+    for (int f = 0; f < kFibers; ++f) {
+        fiber::Fiber::go([&, f]() {
+            for (int i = 0; i < kOps; ++i) {
+                std::string key = "f" + std::to_string(f) + "_" + std::to_string(i);
+                if (client.Put(key, key) != KvStatus::OK) {
+                    failures.fetch_add(1);
+                }
+                auto result = client.Get(key);
+                if (result.status != KvStatus::OK || result.value != key) {
+                    failures.fetch_add(1);
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_EQ(failures.load(), 0);
+    auto stats = client.Stats();
+    EXPECT_EQ(stats.requests, 1u + 2 * kFibers * kOps);
+    EXPECT_GT(stats.batched_ops, 0u);
+    EXPECT_LE(stats.rpcs, stats.requests);
+    // 每批MultiPut只提交一条日志
+    EXPECT_LE(cluster.proposals.load(), 1u + kFibers * kOps);
+}
+
+TEST(KvClientTest, ResendsFailedBatchWithSameRequestId) {
+    FakeCluster cluster;
+    cluster.hints = false;
+    cluster.leader = 1;
+    // 没有leader提示时每次丢失应答都要轮询节点，放宽重试次数
+    auto options = clientOptions(cluster.Endpoints());
+    options.max_attempts = 32;
+    KvClient client(options);
+    ASSERT_EQ(client.Put("warmup", "v"), KvStatus::OK);
+
+    // MultiPut已经提交但应答丢失：整批用原来的RequestId重发，不能按新请求逐个再写一次
+    cluster.lost_batch_replies = 4;
+    constexpr int kFibers = 16;
+    constexpr int kOps = 10;
+    std::atomic<int> failures{0};
+    fiber::WaitGroup wg;
+    wg.add(kFibers);
+    for (int f = 0; f < kFibers; ++f) {
+        fiber::Fiber::go([&, f]() {
+            for (int i = 0; i < kOps; ++i) {
+                std::string key = "f" + std::to_string(f) + "_" + std::to_string(i);
+                if (client.Put(key, key) != KvStatus::OK) {
+                    failures.fetch_add(1);
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_EQ(failures.load(), 0);
+    EXPECT_GT(client.Stats().batched_ops, 0u);
+    for (const auto& [key, writers] : cluster.Writers()) {
+        EXPECT_EQ(writers.size(), 1u) << key;
+    }
+    for (int f = 0; f < kFibers; ++f) {
+        std::string key = "f" + std::to_string(f) + "_0";
+        EXPECT_EQ(client.Get(key).value, key);
+    }
+}
+
+TEST(KvClientTest, RoutesByShardMap) {
+    auto layout = UniformShards(2);
+    ShardingOptions options_a;
+    options_a.endpoints = {endpointOf(0)};
+    ShardingOptions options_b;
+    options_b.endpoints = {endpointOf(1)};
+    auto groups = [](uint64_t) { return std::make_shared<KvService>(MakeKvStateMachine()); };
+    auto node_a = std::make_shared<ShardedKvService>(groups, std::vector<ShardRange>{layout[0]}, options_a);
+    auto node_b = std::make_shared<ShardedKvService>(groups, std::vector<ShardRange>{layout[1]}, options_b);
+    auto server_a = rpc::RpcServer::Make();
+    auto server_b = rpc::RpcServer::Make();
+    node_a->RegisterRPC(server_a);
+    node_b->RegisterRPC(server_b);
+    server_a->start(kBasePort);
+    server_b->start(kBasePort + 1);
+    fiber::Fiber::sleep(100);
+
+    auto options = clientOptions({endpointOf(0), endpointOf(1)});
+    options.sharded = true;
+    KvClient client(options);
+    for (int i = 0; i < 200; ++i) {
+        std::string key = "key" + std::to_string(i);
+        ASSERT_EQ(client.Put(key, key), KvStatus::OK);
+    }
+    EXPECT_GT(node_a->Loads()[0].keys, 0u);
+    EXPECT_GT(node_b->Loads()[0].keys, 0u);
+    EXPECT_EQ(client.Stats().retries, 0u);
+
+    // 分片在节点内分裂后，旧的路由仍然指向同一节点，请求照常完成
+    uint64_t middle = layout[1].first + (layout[1].last - layout[1].first) / 2;
+    ASSERT_TRUE(node_b->Split(layout[1].id, middle).has_value());
+    for (int i = 0; i < 200; ++i) {
+        std::string key = "key" + std::to_string(i);
+        auto result = client.Get(key);
+        ASSERT_EQ(result.status, KvStatus::OK);
+        EXPECT_EQ(result.value, key);
+    }
+
+    server_a->shutdown();
+    server_b->shutdown();
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,153 @@
+#include "sharded_hash_engine.h"
+#include "ordered_engine.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "sync.h"
+#include "logger.h"
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <mutex>
+
+using namespace kv;
+
+constexpr int KEY_COUNT = 100000;
+constexpr int OPS_PER_FIBER = 200000;
+constexpr int WRITE_PERCENT = 10;
+
+// 基线：单把FiberMutex保护的unordered_map
+class SingleMutexEngine : public IKvEngine {
+public:
+    bool Get(const std::string& key, std::string& value) override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+    void Put(uint64_t index, const std::string& key, const std::string& value) override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        map_[key] = value;
+    }
+    void Append(uint64_t index, const std::string& key, const std::string& value) override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        map_[key].append(value);
+    }
+    bool Delete(uint64_t index, const std::string& key) override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        return map_.erase(key) > 0;
+    }
+    std::vector<KvPair> Scan(const std::string& start, const std::string& end, size_t limit) override {
+        return {};
+    }
+    size_t Size() override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        return map_.size();
+    }
+    void ForEach(const Visitor& visitor) override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        for (const auto& [key, value] : map_) {
+            visitor(key, value);
+        }
+    }
+    void Clear() override {
+        std::unique_lock<fiber::FiberMutex> lock(mu_);
+        map_.clear();
+    }
+
+private:
+    fiber::FiberMutex mu_;
+    std::unordered_map<std::string, std::string> map_;
+};
+
+static std::vector<std::string> g_keys;
+
+// 返回吞吐（ops/s）
+double runWorkload(const KvEnginePtr& engine, int num_fibers) {
+    std::atomic<uint64_t> next_index{KEY_COUNT + 1};
+    fiber::WaitGroup wg;
+    wg.add(num_fibers);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < num_fibers; ++f) {
+        fiber::Fiber::go([&, f]() {
+            std::mt19937 rng(f);
+            std::uniform_int_distribution<int> key_dist(0, KEY_COUNT - 1);
+            std::uniform_int_distribution<int> op_dist(0, 99);
+            std::string value;
+            for (int i = 0; i < OPS_PER_FIBER; ++i) {
+                const auto& key = g_keys[key_dist(rng)];
+                if (op_dist(rng) < WRITE_PERCENT) {
+                    engine->Put(next_index.fetch_add(1, std::memory_order_relaxed), key, "value");
+                } else {
+                    engine->Get(key, value);
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    return static_cast<double>(num_fibers) * OPS_PER_FIBER * 1e6 / static_cast<double>(elapsed);
+}
+
+void preload(const KvEnginePtr& engine) {
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        engine->Put(i + 1, g_keys[i], "value");
+    }
+}
+
+// 有序引擎范围扫描：沿跳表第0层顺序遍历的吞吐
+void benchOrderedScan(int num_keys) {
+    OrderedEngine engine;
+    for (int i = 0; i < num_keys; ++i) {
+        engine.Put(i + 1, "key-" + std::to_string(i), "value");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t scanned = 0;
+    size_t bytes = 0;
+    auto it = engine.NewIterator();
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        ++scanned;
+        bytes += it.key().size() + it.value().size();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    LOG_INFO("ordered scan: {} keys in {} us ({:.1f} M keys/s, {:.1f} MB/s payload)", scanned, elapsed,
+             static_cast<double>(scanned) / static_cast<double>(elapsed),
+             static_cast<double>(bytes) / static_cast<double>(elapsed));
+}
+
+FIBER_MAIN() {
+    LOG_INFO("================= KV Engine Benchmark =====================");
+    LOG_INFO("keys={}, ops/fiber={}, write={}%", KEY_COUNT, OPS_PER_FIBER, WRITE_PERCENT);
+
+    g_keys.reserve(KEY_COUNT);
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        g_keys.push_back("key-" + std::to_string(i));
+    }
+
+    KvEnginePtr baseline = std::make_shared<SingleMutexEngine>();
+    KvEnginePtr sharded = MakeShardedHashEngine();
+    preload(baseline);
+    preload(sharded);
+
+    for (int fibers : {1, 2, 4, 8, 16, 32}) {
+        double base_ops = runWorkload(baseline, fibers);
+        double shard_ops = runWorkload(sharded, fibers);
+        LOG_INFO("fibers={:>2}  single-mutex: {:>12.0f} ops/s  sharded: {:>12.0f} ops/s  speedup: {:.2f}x",
+                 fibers, base_ops, shard_ops, shard_ops / base_ops);
+    }
+
+    benchOrderedScan(1000000);
+
+    LOG_INFO("==================== Benchmark Completed ====================");
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <malloc.h>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace kv;
+
+constexpr int KEY_COUNT = 1000000;
+constexpr int LOOKUPS = 5000000;
+
+// 堆上正在使用的字节数（包括mmap分配的大块），不受RSS回收时机影响
+static size_t heapInUse() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static std::string makeKey(int i) {
+    return "user:" + std::to_string(1000000000 + i) + ":profile";    // 24字节
+}
+
+static std::string makeValue(int i) {
+    return "v" + std::to_string(i * 7919 % 100000000);   // 9字节以内
+}
+
+template <typename LookupFn>
+static double lookupNs(const std::vector<std::string>& keys, LookupFn&& lookup) {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(0, KEY_COUNT - 1);
+    std::vector<int> order(LOOKUPS);
+    for (auto& i : order) {
+        i = dist(rng);
+    }
+    std::string value;
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i : order) {
+        found += lookup(keys[i], value);
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (found != order.size()) {
+        LOG_ERROR("lookup missed {} keys", order.size() - found);
+    }
+    return elapsed / LOOKUPS;
+}
+
+FIBER_MAIN() {
+    LOG_INFO("================= KV Memory Benchmark =====================");
+    std::vector<std::string> keys;
+    keys.reserve(KEY_COUNT);
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        keys.push_back(makeKey(i));
+    }
+
+    // 基线：每个key和value都是独立的std::string（超过15字节的key另有一次堆分配）
+    {
+        size_t before = heapInUse();
+        std::unordered_map<std::string, std::string> map;
+        for (int i = 0; i < KEY_COUNT; ++i) {
+            map.emplace(keys[i], makeValue(i));
+        }
+        size_t bytes = heapInUse() - before;
+        // 与引擎一样在查找时加锁，只比较数据布局的差异
+        fiber::FiberMutex mu;
+        double ns = lookupNs(keys, [&map, &mu](const std::string& key, std::string& value) {
+            std::unique_lock<fiber::FiberMutex> lock(mu);
+            auto it = map.find(key);
+            if (it == map.end()) {
+                return false;
+            }
+            value = it->second;
+            return true;
+        });
+        LOG_INFO("unordered_map<string,string>: {:.1f} MB ({:.1f} B/key), lookup {:.1f} ns", bytes / 1e6,
+                 static_cast<double>(bytes) / KEY_COUNT, ns);
+    }
+
+    {
+        size_t before = heapInUse();
+        auto engine = std::make_shared<ShardedHashEngine>();
+        for (int i = 0; i < KEY_COUNT; ++i) {
+            engine->Put(i + 1, keys[i], makeValue(i));
+        }
+        size_t bytes = heapInUse() - before;
+        double ns = lookupNs(keys, [&engine](const std::string& key, std::string& value) {
+            return engine->Get(key, value);
+        });
+        LOG_INFO("ShardedHashEngine(CompactMap): {:.1f} MB ({:.1f} B/key, tracked {:.1f} B/key), lookup {:.1f} ns",
+                 bytes / 1e6, static_cast<double>(bytes) / KEY_COUNT,
+                 static_cast<double>(engine->MemoryUsage()) / KEY_COUNT, ns);
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "kv_service.h"
+#include "ordered_engine.h"
+#include "rpc_client.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+
+using namespace kv;
+
+static constexpr uint16_t kPort = 9190;
+static rpc::RpcServerPtr g_server;
+static KvServicePtr g_service;
+
+static std::string makeKey(const std::string& prefix, int i) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%s%05d", prefix.c_str(), i);
+    return buf;
+}
+
+TEST(KvServiceTest, PutGetDelete) {
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kPort));
+
+    PutAppendArgs put{KvOp::PUT, "hello", "world"};
+    PutAppendReply put_reply;
+    ASSERT_FALSE(client->call(kMethodPutAppend, put, put_reply).has_value());
+    EXPECT_EQ(put_reply.status, KvStatus::OK);
+
+    PutAppendArgs append{KvOp::APPEND, "hello", "!"};
+    ASSERT_FALSE(client->call(kMethodPutAppend, append, put_reply).has_value());
+
+    GetReply get_reply;
+    ASSERT_FALSE(client->call(kMethodGet, GetArgs{"hello"}, get_reply).has_value());
+    EXPECT_EQ(get_reply.status, KvStatus::OK);
+    EXPECT_EQ(get_reply.value, "world!");
+
+    DeleteReply del_reply;
+    ASSERT_FALSE(client->call(kMethodDelete, DeleteArgs{"hello"}, del_reply).has_value());
+    EXPECT_EQ(del_reply.status, KvStatus::OK);
+    ASSERT_FALSE(client->call(kMethodGet, GetArgs{"hello"}, get_reply).has_value());
+    EXPECT_EQ(get_reply.status, KvStatus::NO_KEY);
+
+    client->disconnect();
+}
+
+TEST(KvServiceTest, ScanPaging) {
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kPort));
+
+    for (int i = 0; i < 250; ++i) {
+        PutAppendReply reply;
+        ASSERT_FALSE(client->call(kMethodPutAppend, PutAppendArgs{KvOp::PUT, makeKey("user/", i), "u"}, reply)
+                             .has_value());
+    }
+    for (int i = 0; i < 10; ++i) {
+        PutAppendReply reply;
+        ASSERT_FALSE(client->call(kMethodPutAppend, PutAppendArgs{KvOp::PUT, makeKey("order/", i), "o"}, reply)
+                             .has_value());
+    }
+
+    // 分页拉取 [user/00000, user/00200)
+    std::vector<std::string> keys;
+    int pages = 0;
+    auto error = ScanPages(*client, ScanArgs{makeKey("user/", 0), makeKey("user/", 200), 64},
+                           [&](const std::vector<KvPair>& page) {
+                               ++pages;
+                               for (const auto& pair : page) {
+                                   keys.push_back(pair.key);
+                               }
+                               return true;
+                           });
+    EXPECT_FALSE(error.has_value());
+    EXPECT_EQ(pages, 4);
+    ASSERT_EQ(keys.size(), 200u);
+    EXPECT_EQ(keys.back(), makeKey("user/", 199));
+
+    // 前缀扫描
+    ScanReply reply;
+    ASSERT_FALSE(client->call(kMethodScanPrefix, ScanPrefixArgs{"order/", "", 6}, reply).has_value());
+    EXPECT_EQ(reply.pairs.size(), 6u);
+    EXPECT_TRUE(reply.has_more);
+    ASSERT_FALSE(client->call(kMethodScanPrefix, ScanPrefixArgs{"order/", reply.next_start, 6}, reply).has_value());
+    EXPECT_EQ(reply.pairs.size(), 4u);
+    EXPECT_FALSE(reply.has_more);
+
+    client->disconnect();
+}
+
+TEST(KvServiceTest, BatchRpcs) {
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kPort));
+
+    MultiPutArgs put;
+    for (int i = 0; i < 100; ++i) {
+        put.pairs.push_back(KvPair{makeKey("batch/", i), std::to_string(i)});
+    }
+    MultiPutReply put_reply;
+    ASSERT_FALSE(client->call(kMethodMultiPut, put, put_reply).has_value());
+    EXPECT_EQ(put_reply.status, KvStatus::OK);
+
+    WriteBatchArgs batch;
+    batch.ops.push_back(KvMutation{KvOp::APPEND, makeKey("batch/", 0), "+"});
+    batch.ops.push_back(KvMutation{KvOp::DELETE, makeKey("batch/", 1), ""});
+    batch.ops.push_back(KvMutation{KvOp::DELETE, "batch/missing", ""});
+    WriteBatchReply batch_reply;
+    ASSERT_FALSE(client->call(kMethodWriteBatch, batch, batch_reply).has_value());
+    EXPECT_EQ(batch_reply.status, KvStatus::OK);
+    ASSERT_EQ(batch_reply.statuses.size(), 3u);
+    EXPECT_EQ(batch_reply.statuses[2], KvStatus::NO_KEY);
+
+    MultiGetArgs get{{makeKey("batch/", 0), makeKey("batch/", 1), makeKey("batch/", 99)}};
+    MultiGetReply get_reply;
+    ASSERT_FALSE(client->call(kMethodMultiGet, get, get_reply).has_value());
+    ASSERT_EQ(get_reply.results.size(), 3u);
+    EXPECT_EQ(get_reply.results[0].value, "0+");
+    EXPECT_EQ(get_reply.results[1].status, KvStatus::NO_KEY);
+    EXPECT_EQ(get_reply.results[2].value, "99");
+
+    // 非法操作使整批被拒绝
+    batch.ops = {KvMutation{KvOp::PUT, makeKey("batch/", 2), "x"}, KvMutation{KvOp::GET, "k", ""}};
+    ASSERT_FALSE(client->call(kMethodWriteBatch, batch, batch_reply).has_value());
+    EXPECT_EQ(batch_reply.status, KvStatus::INVALID_ARGUMENT);
+    GetReply value;
+    ASSERT_FALSE(client->call(kMethodGet, GetArgs{makeKey("batch/", 2)}, value).has_value());
+    EXPECT_EQ(value.value, "2");
+
+    client->disconnect();
+}
+
+TEST(KvServiceTest, ConditionalRpcs) {
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kPort));
+
+    PutIfAbsentReply absent;
+    ASSERT_FALSE(client->call(kMethodPutIfAbsent, PutIfAbsentArgs{"cond/k", "a"}, absent).has_value());
+    EXPECT_EQ(absent.status, KvStatus::OK);
+    ASSERT_FALSE(client->call(kMethodPutIfAbsent, PutIfAbsentArgs{"cond/k", "b"}, absent).has_value());
+    EXPECT_EQ(absent.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(absent.current, "a");
+
+    CompareAndSwapReply cas;
+    ASSERT_FALSE(client->call(kMethodCompareAndSwap, CompareAndSwapArgs{"cond/k", "x", "c"}, cas).has_value());
+    EXPECT_EQ(cas.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(cas.current, "a");
+    ASSERT_FALSE(client->call(kMethodCompareAndSwap, CompareAndSwapArgs{"cond/k", cas.current, "c"}, cas)
+                         .has_value());
+    EXPECT_EQ(cas.status, KvStatus::OK);
+
+    // 多个fiber通过同一连接并发递增同一个计数器，每次更新一次往返
+    const int num_fibers = 4;
+    const int increments = 50;
+    fiber::WaitGroup wg;
+    wg.add(num_fibers);
+    std::atomic<int> failures{0};
+    for (int f = 0; f < num_fibers; ++f) {
+        fiber::Fiber::go([&]() {
+            for (int i = 0; i < increments; ++i) {
+                IncrementReply reply;
+                if (client->call(kMethodIncrement, IncrementArgs{"cond/counter", 2}, reply).has_value() ||
+                    reply.status != KvStatus::OK) {
+                    failures++;
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+    EXPECT_EQ(failures.load(), 0);
+
+    IncrementReply reply;
+    ASSERT_FALSE(client->call(kMethodIncrement, IncrementArgs{"cond/counter", -1}, reply).has_value());
+    EXPECT_EQ(reply.status, KvStatus::OK);
+    EXPECT_EQ(reply.value, num_fibers * increments * 2 - 1);
+
+    client->disconnect();
+}
+
+FIBER_MAIN() {
+    g_server = rpc::RpcServer::Make();
+    g_service = std::make_shared<KvService>(MakeKvStateMachine(MakeOrderedEngine()));
+    g_service->RegisterRPC(g_server);
+    g_server->start(kPort);
+    fiber::Fiber::sleep(100);
+
+    ::testing::InitGoogleTest();
+    int result = RUN_ALL_TESTS();
+
+    g_server->shutdown();
+    fiber::Fiber::sleep(100);
+    g_server = nullptr;
+    return result;
+}
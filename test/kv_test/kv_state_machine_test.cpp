@@ -0,0 +1,162 @@
+#include "kv_state_machine.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+
+using namespace kv;
+
+static KvCommand makeCommand(KvOp op, const std::string& key, const std::string& value = "") {
+    KvCommand cmd;
+    cmd.op = op;
+    cmd.key = key;
+    cmd.value = value;
+    return cmd;
+}
+
+TEST(KvStateMachineTest, PutGetAppendDelete) {
+    KvStateMachine sm;
+
+    EXPECT_EQ(sm.Apply(1, makeCommand(KvOp::PUT, "a", "1")).status, KvStatus::OK);
+    EXPECT_EQ(sm.Get("a").value, "1");
+
+    sm.Apply(2, makeCommand(KvOp::APPEND, "a", "23"));
+    EXPECT_EQ(sm.Get("a").value, "123");
+
+    // APPEND到不存在的key等价于PUT
+    sm.Apply(3, makeCommand(KvOp::APPEND, "b", "x"));
+    EXPECT_EQ(sm.Get("b").value, "x");
+
+    EXPECT_EQ(sm.Apply(4, makeCommand(KvOp::DELETE, "a")).status, KvStatus::OK);
+    EXPECT_EQ(sm.Get("a").status, KvStatus::NO_KEY);
+    EXPECT_EQ(sm.Apply(5, makeCommand(KvOp::DELETE, "a")).status, KvStatus::NO_KEY);
+
+    auto result = sm.Apply(6, makeCommand(KvOp::GET, "b"));
+    EXPECT_EQ(result.status, KvStatus::OK);
+    EXPECT_EQ(result.value, "x");
+    EXPECT_EQ(sm.LastApplied(), 6u);
+}
+
+TEST(KvStateMachineTest, StaleEntryIgnored) {
+    KvStateMachine sm;
+    sm.Apply(5, makeCommand(KvOp::PUT, "k", "new"));
+    sm.Apply(3, makeCommand(KvOp::PUT, "k", "old"));
+    EXPECT_EQ(sm.Get("k").value, "new");
+    EXPECT_EQ(sm.LastApplied(), 5u);
+}
+
+TEST(KvStateMachineTest, CommandCodecRoundTrip) {
+    auto cmd = makeCommand(KvOp::APPEND, "key", "value");
+    KvCommand decoded;
+    ASSERT_TRUE(DecodeCommand(EncodeCommand(cmd), decoded));
+    EXPECT_EQ(decoded.op, KvOp::APPEND);
+    EXPECT_EQ(decoded.key, "key");
+    EXPECT_EQ(decoded.value, "value");
+}
+
+TEST(KvStateMachineTest, ConditionalWrites) {
+    KvStateMachine sm;
+    uint64_t index = 0;
+
+    // CAS：值匹配时写入，不匹配时返回当前值，key不存在时返回NO_KEY
+    auto cas = makeCommand(KvOp::CAS, "k", "v2");
+    cas.expected = "v1";
+    EXPECT_EQ(sm.Apply(++index, cas).status, KvStatus::NO_KEY);
+    sm.Apply(++index, makeCommand(KvOp::PUT, "k", "v0"));
+    auto result = sm.Apply(++index, cas);
+    EXPECT_EQ(result.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(result.value, "v0");
+    cas.expected = "v0";
+    EXPECT_EQ(sm.Apply(++index, cas).status, KvStatus::OK);
+    EXPECT_EQ(sm.Get("k").value, "v2");
+
+    // PUT_IF_ABSENT
+    EXPECT_EQ(sm.Apply(++index, makeCommand(KvOp::PUT_IF_ABSENT, "lock", "owner1")).status, KvStatus::OK);
+    result = sm.Apply(++index, makeCommand(KvOp::PUT_IF_ABSENT, "lock", "owner2"));
+    EXPECT_EQ(result.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(result.value, "owner1");
+    EXPECT_EQ(sm.Get("lock").value, "owner1");
+
+    // INCR：不存在时从0开始，delta为负即递减
+    auto incr = makeCommand(KvOp::INCR, "counter");
+    incr.delta = 5;
+    EXPECT_EQ(sm.Apply(++index, incr).value, "5");
+    incr.delta = -7;
+    EXPECT_EQ(sm.Apply(++index, incr).value, "-2");
+    EXPECT_EQ(sm.Get("counter").value, "-2");
+
+    // 非整数或溢出时拒绝，值保持不变
+    incr.key = "k";
+    EXPECT_EQ(sm.Apply(++index, incr).status, KvStatus::INVALID_ARGUMENT);
+    sm.Apply(++index, makeCommand(KvOp::PUT, "max", std::to_string(INT64_MAX)));
+    incr.key = "max";
+    incr.delta = 1;
+    EXPECT_EQ(sm.Apply(++index, incr).status, KvStatus::INVALID_ARGUMENT);
+    EXPECT_EQ(sm.Get("max").value, std::to_string(INT64_MAX));
+    EXPECT_EQ(sm.LastApplied(), index);
+
+    KvCommand decoded;
+    ASSERT_TRUE(DecodeCommand(EncodeCommand(cas), decoded));
+    EXPECT_EQ(decoded.expected, "v0");
+    ASSERT_TRUE(DecodeCommand(EncodeCommand(incr), decoded));
+    EXPECT_EQ(decoded.delta, 1);
+}
+
+TEST(KvStateMachineTest, SnapshotRoundTrip) {
+    KvStateMachine sm;
+    for (int i = 0; i < 100; ++i) {
+        sm.Apply(i + 1, makeCommand(KvOp::PUT, "key" + std::to_string(i), "value" + std::to_string(i)));
+    }
+    auto snapshot = sm.TakeSnapshot();
+
+    KvStateMachine restored;
+    restored.Apply(1, makeCommand(KvOp::PUT, "garbage", "x"));
+    ASSERT_TRUE(restored.RestoreSnapshot(snapshot));
+    EXPECT_EQ(restored.LastApplied(), 100u);
+    EXPECT_EQ(restored.Engine()->Size(), 100u);
+    EXPECT_EQ(restored.Get("key42").value, "value42");
+    EXPECT_EQ(restored.Get("garbage").status, KvStatus::NO_KEY);
+}
+
+TEST(KvStateMachineTest, ConcurrentReadersAndWriter) {
+    auto engine = MakeShardedHashEngine(16);
+    const int num_readers = 8;
+    const int num_keys = 1000;
+
+    for (int i = 0; i < num_keys; ++i) {
+        engine->Put(i + 1, "key" + std::to_string(i), "v");
+    }
+
+    std::atomic<int> found{0};
+    fiber::WaitGroup wg;
+    wg.add(num_readers + 1);
+
+    fiber::Fiber::go([&]() {
+        for (int i = 0; i < num_keys; ++i) {
+            engine->Append(num_keys + i + 1, "key" + std::to_string(i), "w");
+        }
+        wg.done();
+    });
+    for (int r = 0; r < num_readers; ++r) {
+        fiber::Fiber::go([&]() {
+            std::string value;
+            for (int i = 0; i < num_keys; ++i) {
+                if (engine->Get("key" + std::to_string(i), value) && (value == "v" || value == "vw")) {
+                    found++;
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_EQ(found.load(), num_readers * num_keys);
+    EXPECT_EQ(engine->Size(), static_cast<size_t>(num_keys));
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,449 @@
+#include "lsm_engine.h"
+#include "kv_state_machine.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <unistd.h>
+
+using namespace kv;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string tempDir(const std::string& name) {
+    auto dir = fs::temp_directory_path() / ("kv_" + name + "_" + std::to_string(getpid()));
+    fs::remove_all(dir);
+    return dir.string();
+}
+
+LsmOptions smallOptions(const std::string& dir) {
+    // 很小的memtable和文件，让少量数据就能触发flush和多层compaction
+    LsmOptions options;
+    options.dir = dir;
+    options.memtable_bytes = 16 << 10;
+    options.target_file_bytes = 8 << 10;
+    options.level1_max_bytes = 32 << 10;
+    options.level0_compaction_trigger = 2;
+    options.sst.block_size = 512;
+    return options;
+}
+
+std::string keyOf(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+} // namespace
+
+TEST(LsmEngineTest, SstRoundTrip) {
+    std::string dir = tempDir("sst");
+    fs::create_directories(dir);
+    std::string path = dir + "/000001.sst";
+
+    SstOptions options;
+    options.block_size = 256;
+    {
+        SstBuilder builder(path, options);
+        ASSERT_TRUE(builder.Open());
+        for (int i = 0; i < 1000; ++i) {
+            ASSERT_TRUE(builder.Add(keyOf(i * 2), "v" + std::to_string(i), i % 10 == 0));
+        }
+        EXPECT_FALSE(builder.Add(keyOf(0), "out of order", false));
+        ASSERT_TRUE(builder.Finish());
+    }
+
+    auto reader = SstReader::Open(path, 1);
+    ASSERT_TRUE(reader);
+    EXPECT_EQ(reader->NumEntries(), 1000u);
+    EXPECT_EQ(reader->Smallest(), keyOf(0));
+    EXPECT_EQ(reader->Largest(), keyOf(1998));
+    EXPECT_TRUE(reader->VerifyChecksums());
+
+    std::string value;
+    EXPECT_EQ(reader->Get(keyOf(2), value), SstReader::LookupResult::FOUND);
+    EXPECT_EQ(value, "v1");
+    EXPECT_EQ(reader->Get(keyOf(20), value), SstReader::LookupResult::DELETED);
+    EXPECT_EQ(reader->Get(keyOf(3), value), SstReader::LookupResult::NOT_FOUND);
+    EXPECT_EQ(reader->Get("zzz", value), SstReader::LookupResult::NOT_FOUND);
+
+    auto it = reader->NewIterator();
+    it->Seek(keyOf(1001));
+    ASSERT_TRUE(it->Valid());
+    EXPECT_EQ(it->key(), keyOf(1002));
+    int count = 0;
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        ++count;
+    }
+    EXPECT_EQ(count, 1000);
+
+    // 破坏一个data block后校验失败
+    reader.reset();
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100);
+        file.put('\x7f');
+    }
+    reader = SstReader::Open(path, 1);
+    ASSERT_TRUE(reader);
+    EXPECT_FALSE(reader->VerifyChecksums());
+
+    // 读到损坏的块时报告错误，不能当作key不存在或遍历结束
+    EXPECT_EQ(reader->Get(keyOf(2), value), SstReader::LookupResult::ERROR);
+    EXPECT_EQ(reader->Get(keyOf(1998), value), SstReader::LookupResult::FOUND);
+    it = reader->NewIterator();
+    it->SeekToFirst();
+    EXPECT_FALSE(it->Valid());
+    EXPECT_FALSE(it->status());
+    it = reader->NewIterator();
+    it->Seek(keyOf(1000));
+    ASSERT_TRUE(it->Valid());
+    EXPECT_TRUE(it->status());
+    fs::remove_all(dir);
+}
+
+TEST(LsmEngineTest, CompactionKeepsCorruptedInputs) {
+    std::string dir = tempDir("corrupt");
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+    for (int i = 0; i < 100; ++i) {
+        engine->Put(i + 1, keyOf(i), "first");
+    }
+    engine->Flush();
+    std::vector<std::string> files;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.path().extension() == ".sst") {
+            files.push_back(entry.path().string());
+        }
+    }
+    ASSERT_EQ(files.size(), 1u);
+    {
+        std::fstream file(files[0], std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100);
+        file.put('\x7f');
+    }
+
+    // 第二个level 0文件触发compaction，读到损坏的输入后失败，两个输入文件都保留
+    for (int i = 0; i < 100; ++i) {
+        engine->Put(i + 101, keyOf(i + 50), "second");
+    }
+    engine->Flush();
+    engine->WaitIdle();
+    EXPECT_EQ(engine->LevelFileCounts()[0], 2u);
+    EXPECT_TRUE(fs::exists(files[0]));
+
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+TEST(LsmEngineTest, MatchesReferenceAcrossFlushAndCompaction) {
+    std::string dir = tempDir("lsm");
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+
+    std::map<std::string, std::string> reference;
+    std::mt19937 rng(42);
+    uint64_t index = 0;
+    for (int i = 0; i < 20000; ++i) {
+        std::string key = keyOf(rng() % 3000);
+        int op = rng() % 10;
+        ++index;
+        if (op < 7) {
+            std::string value = "value-" + std::to_string(index);
+            engine->Put(index, key, value);
+            reference[key] = value;
+        } else if (op < 8) {
+            engine->Append(index, key, "+");
+            reference[key] += "+";
+        } else {
+            EXPECT_EQ(engine->Delete(index, key), reference.erase(key) > 0);
+        }
+    }
+    engine->Flush();
+    engine->WaitIdle();
+
+    auto counts = engine->LevelFileCounts();
+    EXPECT_LT(counts[0], 2u);
+    size_t deeper = 0;
+    for (size_t level = 2; level < counts.size(); ++level) {
+        deeper += counts[level];
+    }
+    EXPECT_GT(deeper, 0u);
+
+    std::string value;
+    for (int i = 0; i < 3000; ++i) {
+        auto it = reference.find(keyOf(i));
+        bool found = engine->Get(keyOf(i), value);
+        ASSERT_EQ(found, it != reference.end()) << keyOf(i);
+        if (found) {
+            EXPECT_EQ(value, it->second);
+        }
+    }
+
+    auto pairs = engine->Scan(keyOf(100), keyOf(200), 0);
+    auto first = reference.lower_bound(keyOf(100));
+    auto last = reference.lower_bound(keyOf(200));
+    ASSERT_EQ(pairs.size(), static_cast<size_t>(std::distance(first, last)));
+    for (const auto& pair : pairs) {
+        EXPECT_EQ(pair.value, first->second);
+        ++first;
+    }
+    EXPECT_EQ(engine->Scan("", "", 10).size(), 10u);
+
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+TEST(LsmEngineTest, RecoverFlushedData) {
+    std::string dir = tempDir("recover");
+    {
+        auto engine = LsmEngine::Open(smallOptions(dir));
+        ASSERT_TRUE(engine);
+        for (int i = 1; i <= 500; ++i) {
+            engine->Put(i, keyOf(i), "v" + std::to_string(i));
+        }
+        engine->Flush();
+        EXPECT_EQ(engine->DurableIndex(), 500u);
+        // 未flush的写入在重启后丢失，由Raft日志重放
+        engine->Put(501, keyOf(501), "lost");
+    }
+
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+    EXPECT_EQ(engine->DurableIndex(), 500u);
+    std::string value;
+    EXPECT_TRUE(engine->Get(keyOf(250), value));
+    EXPECT_EQ(value, "v250");
+    EXPECT_FALSE(engine->Get(keyOf(501), value));
+
+    EXPECT_EQ(KvStateMachine(engine).LastApplied(), 500u);
+
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+TEST(LsmEngineTest, StateMachineRecoversTtls) {
+    std::string dir = tempDir("ttl");
+    auto put = [](const std::string& key, uint64_t expire_at_ms) {
+        KvCommand cmd;
+        cmd.op = KvOp::PUT;
+        cmd.key = key;
+        cmd.value = "v";
+        cmd.expire_at_ms = expire_at_ms;
+        return cmd;
+    };
+    {
+        auto engine = LsmEngine::Open(smallOptions(dir));
+        ASSERT_TRUE(engine);
+        KvStateMachine sm(engine);
+        sm.Apply(1, put("a", 1000));
+        sm.Apply(2, put("b", 2000));
+        sm.Apply(3, put("c", 3000));
+        sm.Apply(4, put("b", 0));       // 清除TTL
+
+        KvCommand del;
+        del.op = KvOp::DELETE;
+        del.key = "c";
+        sm.Apply(5, del);
+
+        KvCommand batch;
+        batch.op = KvOp::BATCH;
+        batch.ops.push_back(KvMutation{KvOp::PUT, "d", "v", 4000});
+        batch.ops.push_back(KvMutation{KvOp::PUT, "e", "v", 5000});
+        batch.ops.push_back(KvMutation{KvOp::DELETE, "e", std::string(), 0});
+        sm.Apply(6, batch);
+
+        KvCommand expire;
+        expire.op = KvOp::EXPIRE;
+        expire.ops.push_back(KvMutation{KvOp::DELETE, "d", std::string(), 4000});
+        sm.Apply(7, expire);
+        sm.Apply(8, put("f", 6000));
+        engine->Flush();
+        EXPECT_EQ(sm.TtlCount(), 2u);
+
+        // 保留key对用户的扫描不可见
+        auto pairs = sm.Scan("", "", 0);
+        ASSERT_EQ(pairs.size(), 3u);
+        EXPECT_EQ(pairs[0].key, "a");
+        EXPECT_EQ(pairs[2].key, "f");
+    }
+
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+    KvStateMachine sm(engine);
+    EXPECT_EQ(sm.LastApplied(), 8u);
+    auto entries = sm.TtlEntries();
+    std::sort(entries.begin(), entries.end(), [](const KvTtl& a, const KvTtl& b) { return a.key < b.key; });
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].key, "a");
+    EXPECT_EQ(entries[0].expire_at_ms, 1000u);
+    EXPECT_EQ(entries[1].key, "f");
+    EXPECT_EQ(entries[1].expire_at_ms, 6000u);
+
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+TEST(LsmEngineTest, StateMachineRecoversSessions) {
+    std::string dir = tempDir("session");
+    auto append = [](uint64_t client_id, uint64_t seq) {
+        KvCommand cmd;
+        cmd.op = KvOp::APPEND;
+        cmd.key = "k";
+        cmd.value = "+";
+        cmd.request = RequestId{client_id, seq};
+        return cmd;
+    };
+    SessionOptions options;
+    options.max_sessions = 2;
+    {
+        auto engine = LsmEngine::Open(smallOptions(dir));
+        ASSERT_TRUE(engine);
+        KvStateMachine sm(engine, options);
+        sm.Apply(1, append(1, 1));
+        sm.Apply(2, append(2, 1));
+        sm.Apply(3, append(1, 1));      // 重复请求刷新client 1的活动时间
+        sm.Apply(4, append(3, 1));      // 淘汰最久未活动的client 2
+        engine->Flush();
+        EXPECT_EQ(sm.Sessions().Size(), 2u);
+        EXPECT_EQ(sm.Get("k").value, "+++");
+    }
+
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+    KvStateMachine sm(engine, options);
+    EXPECT_EQ(sm.LastApplied(), 4u);
+    EXPECT_EQ(sm.Sessions().Size(), 2u);
+    EXPECT_FALSE(sm.Sessions().Contains(2));
+
+    // 重启前已执行的请求重试时不再执行
+    sm.Apply(5, append(1, 1));
+    sm.Apply(6, append(3, 1));
+    EXPECT_EQ(sm.Get("k").value, "+++");
+    sm.Apply(7, append(2, 1));
+    EXPECT_EQ(sm.Get("k").value, "++++");
+
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+TEST(LsmEngineTest, StateMachineInstallsSnapshotFiles) {
+    std::string dir = tempDir("install");
+    std::string staging = tempDir("install_staging");
+    IngestOptions ingest;
+    ingest.dir = staging;
+    ingest.target_file_bytes = 4 << 10;
+
+    auto put = [](const std::string& key, const std::string& value, uint64_t expire_at_ms) {
+        KvCommand cmd;
+        cmd.op = KvOp::PUT;
+        cmd.key = key;
+        cmd.value = value;
+        cmd.expire_at_ms = expire_at_ms;
+        return cmd;
+    };
+    // 哈希引擎生成的快照无序，写出的文件互相重叠
+    KvStateMachine source;
+    for (int i = 0; i < 500; ++i) {
+        auto cmd = put(keyOf(i), std::string(32, 'v'), i == 3 ? 9000 : 0);
+        if (i == 0) {
+            cmd.request = RequestId{7, 1};
+        }
+        source.Apply(i + 1, cmd);
+    }
+    auto snapshot = source.TakeSnapshot();
+
+    {
+        auto engine = LsmEngine::Open(smallOptions(dir));
+        ASSERT_TRUE(engine);
+        KvStateMachine sm(engine, {}, {}, {}, ingest);
+        sm.Apply(1, put("stale", "x", 0));
+        ASSERT_TRUE(sm.RestoreSnapshot(snapshot));
+        EXPECT_EQ(sm.LastApplied(), 500u);
+        EXPECT_EQ(sm.DurableIndex(), 500u);
+        EXPECT_EQ(sm.Get("stale").status, KvStatus::NO_KEY);
+        EXPECT_EQ(sm.Get(keyOf(499)).value, std::string(32, 'v'));
+        EXPECT_EQ(sm.Scan("", "", 0).size(), 500u);
+        EXPECT_GT(engine->LevelFileCounts()[0], 1u);
+        // 暂存文件在安装后删除
+        EXPECT_TRUE(fs::is_empty(staging));
+
+        // 引擎已持久化到快照之后，恢复直接跳过
+        sm.Apply(501, put("later", "y", 0));
+        engine->Flush();
+        ASSERT_TRUE(sm.RestoreSnapshot(snapshot));
+        EXPECT_EQ(sm.LastApplied(), 501u);
+        EXPECT_EQ(sm.Get("later").value, "y");
+    }
+
+    // 安装的数据、TTL和会话都已持久化
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+    KvStateMachine sm(engine, {}, {}, {}, ingest);
+    EXPECT_EQ(sm.LastApplied(), 501u);
+    EXPECT_EQ(sm.Get(keyOf(0)).value, std::string(32, 'v'));
+    EXPECT_EQ(sm.TtlCount(), 1u);
+    EXPECT_TRUE(sm.Sessions().Contains(7));
+
+    // LSM引擎生成的快照有序，文件互不重叠，直接放到最底层
+    std::string copy_dir = tempDir("install_copy");
+    {
+        auto copy = LsmEngine::Open(smallOptions(copy_dir));
+        ASSERT_TRUE(copy);
+        KvStateMachine target(copy, {}, {}, {}, ingest);
+        ASSERT_TRUE(target.RestoreSnapshot(sm.TakeSnapshot()));
+        EXPECT_EQ(target.LastApplied(), 501u);
+        EXPECT_EQ(target.Scan("", "", 0).size(), 501u);
+        auto counts = copy->LevelFileCounts();
+        EXPECT_EQ(counts[0], 0u);
+        EXPECT_GT(counts.back(), 1u);
+    }
+
+    engine.reset();
+    fs::remove_all(dir);
+    fs::remove_all(staging);
+    fs::remove_all(copy_dir);
+}
+
+TEST(LsmEngineTest, ReadViewIsFrozen) {
+    std::string dir = tempDir("view");
+    auto engine = LsmEngine::Open(smallOptions(dir));
+    ASSERT_TRUE(engine);
+    uint64_t index = 0;
+    for (int i = 0; i < 1000; ++i) {
+        engine->Put(++index, keyOf(i), "old");
+    }
+
+    auto view = engine->NewReadView(0);
+    ASSERT_TRUE(view);
+    EXPECT_EQ(view->Index(), index);
+    EXPECT_EQ(engine->NewReadView(index - 1), nullptr);
+
+    for (int i = 0; i < 1000; ++i) {
+        engine->Put(++index, keyOf(i), "new");
+    }
+    engine->Clear();
+    engine->WaitIdle();
+
+    size_t count = 0;
+    view->ForEach([&count](const std::string&, const std::string& value) {
+        EXPECT_EQ(value, "old");
+        ++count;
+    });
+    EXPECT_EQ(count, 1000u);
+    EXPECT_EQ(engine->Scan("", "", 0).size(), 0u);
+
+    view.reset();
+    engine.reset();
+    fs::remove_all(dir);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+#include "ordered_engine.h"
+#include "kv_state_machine.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+
+using namespace kv;
+
+TEST(MvccTest, ReadAtIndex) {
+    auto engine = std::make_shared<OrderedEngine>();
+    engine->Put(1, "k", "v1");
+    engine->Put(2, "k", "v2");
+    engine->Delete(3, "k");
+    engine->Put(4, "k", "v4");
+
+    std::string value;
+    auto view1 = engine->NewReadView(1);
+    ASSERT_TRUE(view1);
+    EXPECT_TRUE(view1->Get("k", value));
+    EXPECT_EQ(value, "v1");
+
+    auto view3 = engine->NewReadView(3);
+    EXPECT_FALSE(view3->Get("k", value));
+
+    EXPECT_TRUE(engine->Get("k", value));
+    EXPECT_EQ(value, "v4");
+
+    // 视图不受之后写入影响
+    engine->Put(5, "k2", "x");
+    EXPECT_FALSE(view1->Get("k2", value));
+    EXPECT_EQ(view1->Scan("", "", 0).size(), 1u);
+    EXPECT_EQ(engine->Scan("", "", 0).size(), 2u);
+}
+
+TEST(MvccTest, GarbageCollectionRespectsReaders) {
+    auto engine = std::make_shared<OrderedEngine>();
+    for (uint64_t i = 1; i <= 10; ++i) {
+        engine->Put(i, "k", "v" + std::to_string(i));
+    }
+    EXPECT_EQ(engine->VersionCount(), 10u);
+
+    {
+        // 持有index 4的视图时，保留index 3及之后的版本
+        auto view = engine->NewReadView(4);
+        EXPECT_EQ(engine->CollectGarbage(), 2u);
+        std::string value;
+        EXPECT_TRUE(view->Get("k", value));
+        EXPECT_EQ(value, "v4");
+    }
+
+    // 视图释放后只保留最新版本
+    EXPECT_EQ(engine->CollectGarbage(), 7u);
+    EXPECT_EQ(engine->VersionCount(), 1u);
+
+    // 回收水位之下无法再创建视图
+    EXPECT_EQ(engine->NewReadView(5), nullptr);
+    EXPECT_NE(engine->NewReadView(10), nullptr);
+}
+
+TEST(MvccTest, GarbageCollectionFreesDeletedNodes) {
+    auto engine = std::make_shared<OrderedEngine>();
+    for (int i = 0; i < 8; ++i) {
+        engine->Put(1, "k" + std::to_string(i), "v");
+    }
+    for (int i = 0; i < 4; ++i) {
+        engine->Delete(2, "k" + std::to_string(i));
+    }
+    EXPECT_EQ(engine->NodeCount(), 8u);
+
+    {
+        // 迭代器停在即将被摘除的节点上：节点在迭代器释放前不会被释放
+        auto old = engine->NewReadView(1);
+        auto it = engine->NewIterator();
+        it.SeekToFirst();
+        ASSERT_TRUE(it.Valid());
+        EXPECT_EQ(it.key(), "k4");
+        engine->Put(3, "k9", "v");
+        EXPECT_EQ(engine->CollectGarbage(), 0u);
+        EXPECT_EQ(engine->NodeCount(), 9u);
+        EXPECT_EQ(old->Scan("", "", 0).size(), 8u);
+    }
+
+    // 读视图释放后，墓碑对所有读者可见：节点被摘除，迭代器仍持有epoch时不释放
+    {
+        auto it = engine->NewIterator();
+        EXPECT_EQ(engine->CollectGarbage(), 4u);
+        EXPECT_EQ(engine->NodeCount(), 9u);
+        EXPECT_EQ(engine->VersionCount(), 9u);
+        it.SeekToFirst();
+        ASSERT_TRUE(it.Valid());
+        EXPECT_EQ(it.key(), "k4");
+    }
+    EXPECT_EQ(engine->CollectGarbage(), 4u);
+    EXPECT_EQ(engine->NodeCount(), 5u);
+    EXPECT_EQ(engine->VersionCount(), 5u);
+
+    // Clear写入的墓碑同样在回收后释放节点，之后可以重新写入
+    engine->Clear();
+    engine->CollectGarbage();
+    EXPECT_EQ(engine->NodeCount(), 0u);
+    EXPECT_EQ(engine->VersionCount(), 0u);
+    engine->Put(4, "k0", "v");
+    std::string value;
+    EXPECT_TRUE(engine->Get("k0", value));
+    EXPECT_EQ(engine->Scan("", "", 0).size(), 1u);
+}
+
+TEST(MvccTest, StateMachineGetAt) {
+    KvStateMachine sm(MakeOrderedEngine());
+    KvCommand cmd;
+    cmd.op = KvOp::PUT;
+    cmd.key = "k";
+    cmd.value = "old";
+    sm.Apply(1, cmd);
+    cmd.value = "new";
+    sm.Apply(2, cmd);
+
+    EXPECT_EQ(sm.GetAt("k", 1).value, "old");
+    EXPECT_EQ(sm.GetAt("k", 2).value, "new");
+    EXPECT_EQ(sm.GetAt("k", 3).status, KvStatus::INVALID_ARGUMENT);
+
+    // 单版本引擎只能读取最新的index
+    KvStateMachine hashed;
+    hashed.Apply(1, cmd);
+    hashed.Apply(2, cmd);
+    EXPECT_EQ(hashed.GetAt("k", 1).status, KvStatus::INVALID_ARGUMENT);
+    EXPECT_EQ(hashed.GetAt("k", 2).value, "new");
+}
+
+TEST(MvccTest, ConsistentViewsUnderConcurrentWritesAndGc) {
+    auto engine = std::make_shared<OrderedEngine>();
+    const int num_keys = 64;
+    const uint64_t rounds = 300;
+    std::atomic<bool> writer_done{false};
+    std::atomic<int> inconsistent{0};
+
+    fiber::WaitGroup wg;
+    wg.add(5);
+
+    // 写者：每轮把所有key更新为同一个值（同一index），并周期性回收
+    fiber::Fiber::go([&]() {
+        uint64_t index = 0;
+        for (uint64_t round = 1; round <= rounds; ++round) {
+            ++index;
+            for (int k = 0; k < num_keys; ++k) {
+                engine->Put(index, "key" + std::to_string(k), std::to_string(round));
+            }
+            if (round % 10 == 0) {
+                engine->CollectGarbage();
+            }
+        }
+        writer_done = true;
+        wg.done();
+    });
+
+    // 读者：视图中所有key必须来自同一轮
+    for (int r = 0; r < 4; ++r) {
+        fiber::Fiber::go([&]() {
+            while (!writer_done) {
+                // VisibleIndex()所在的一轮可能还没写完，读取上一轮
+                uint64_t index = engine->VisibleIndex();
+                index = index > 0 ? index - 1 : 0;
+                auto view = index > 0 ? engine->NewReadView(index) : nullptr;
+                if (!view) {
+                    fiber::Fiber::yield();
+                    continue;
+                }
+                auto pairs = view->Scan("", "", 0);
+                for (const auto& pair : pairs) {
+                    if (pair.value != pairs.front().value || pair.value != std::to_string(index)) {
+                        inconsistent++;
+                        break;
+                    }
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_EQ(inconsistent.load(), 0);
+    engine->CollectGarbage();
+    EXPECT_EQ(engine->VersionCount(), static_cast<size_t>(num_keys));
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include "ordered_engine.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+
+using namespace kv;
+
+static std::string makeKey(int i) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+TEST(OrderedEngineTest, PointOperations) {
+    OrderedEngine engine;
+    std::string value;
+
+    EXPECT_FALSE(engine.Get("a", value));
+    engine.Put(1, "b", "2");
+    engine.Put(2, "a", "1");
+    engine.Append(3, "a", "1");
+    EXPECT_TRUE(engine.Get("a", value));
+    EXPECT_EQ(value, "11");
+    EXPECT_EQ(engine.Size(), 2u);
+
+    EXPECT_TRUE(engine.Delete(4, "a"));
+    EXPECT_FALSE(engine.Delete(5, "a"));
+    EXPECT_FALSE(engine.Get("a", value));
+    EXPECT_EQ(engine.Size(), 1u);
+
+    // 墓碑节点被重新写入
+    engine.Put(6, "a", "again");
+    EXPECT_TRUE(engine.Get("a", value));
+    EXPECT_EQ(value, "again");
+    EXPECT_EQ(engine.Size(), 2u);
+}
+
+TEST(OrderedEngineTest, RangeAndPrefixScan) {
+    OrderedEngine engine;
+    for (int i = 999; i >= 0; --i) {
+        engine.Put(1000 - i, makeKey(i), std::to_string(i));
+    }
+    engine.Delete(1001, makeKey(15));
+
+    auto pairs = engine.Scan(makeKey(10), makeKey(20), 0);
+    ASSERT_EQ(pairs.size(), 9u);
+    EXPECT_EQ(pairs.front().key, makeKey(10));
+    EXPECT_EQ(pairs[5].key, makeKey(16));
+    EXPECT_EQ(pairs.back().key, makeKey(19));
+
+    pairs = engine.Scan(makeKey(990), "", 5);
+    ASSERT_EQ(pairs.size(), 5u);
+    EXPECT_EQ(pairs.back().value, "994");
+
+    // key00010x 共10个
+    pairs = engine.Scan("key00010", PrefixEnd("key00010"), 0);
+    EXPECT_EQ(pairs.size(), 10u);
+
+    EXPECT_EQ(PrefixEnd("ab"), "ac");
+    EXPECT_EQ(PrefixEnd(std::string("a\xff", 2)), "b");
+    EXPECT_EQ(PrefixEnd(""), "");
+}
+
+TEST(OrderedEngineTest, HashEngineScanMatchesOrdered) {
+    auto ordered = MakeOrderedEngine();
+    auto hashed = MakeShardedHashEngine();
+    for (int i = 0; i < 500; ++i) {
+        ordered->Put(i + 1, makeKey(i * 7 % 500), "v");
+        hashed->Put(i + 1, makeKey(i * 7 % 500), "v");
+    }
+    auto a = ordered->Scan(makeKey(100), makeKey(200), 30);
+    auto b = hashed->Scan(makeKey(100), makeKey(200), 30);
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        EXPECT_EQ(a[i].key, b[i].key);
+    }
+}
+
+TEST(OrderedEngineTest, ConcurrentScanDuringWrites) {
+    auto engine = std::make_shared<OrderedEngine>();
+    const int num_keys = 5000;
+    const int num_readers = 4;
+    std::atomic<bool> sorted{true};
+    fiber::WaitGroup wg;
+    wg.add(num_readers + 1);
+
+    fiber::Fiber::go([&]() {
+        for (int i = 0; i < num_keys; ++i) {
+            engine->Put(i + 1, makeKey((i * 7919) % num_keys), "v");
+        }
+        wg.done();
+    });
+    for (int r = 0; r < num_readers; ++r) {
+        fiber::Fiber::go([&]() {
+            for (int round = 0; round < 20; ++round) {
+                auto pairs = engine->Scan("", "", 0);
+                for (size_t i = 1; i < pairs.size(); ++i) {
+                    if (!(pairs[i - 1].key < pairs[i].key)) {
+                        sorted = false;
+                    }
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_TRUE(sorted.load());
+    EXPECT_EQ(engine->Scan("", "", 0).size(), static_cast<size_t>(num_keys));
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,59 @@
+#include "kv_state_machine.h"
+#include "raft_config.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <chrono>
+#include <random>
+
+using namespace kv;
+
+constexpr int ENTRY_COUNT = 200000;
+constexpr int HOT_KEYS = 16;
+
+static std::vector<KvCommand> makeEntries(int hot_percent) {
+    std::mt19937 gen(1);
+    std::vector<KvCommand> cmds(ENTRY_COUNT);
+    for (int i = 0; i < ENTRY_COUNT; ++i) {
+        auto& cmd = cmds[i];
+        cmd.op = KvOp::PUT;
+        bool hot = static_cast<int>(gen() % 100) < hot_percent;
+        cmd.key = hot ? "hot/" + std::to_string(gen() % HOT_KEYS) : "key/" + std::to_string(i);
+        cmd.value = std::string(100, 'v');
+        cmd.request = RequestId{1 + static_cast<uint64_t>(i % 1000), 1 + static_cast<uint64_t>(i / 1000)};
+    }
+    return cmds;
+}
+
+// 按RaftConfig::apply_batch_size分批apply，返回entries/s
+static double applyRate(const std::vector<KvCommand>& cmds, size_t batch_size, size_t workers) {
+    KvStateMachine sm;
+    std::vector<KvCommand> batch;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < cmds.size(); i += batch_size) {
+        size_t end = std::min(cmds.size(), i + batch_size);
+        batch.assign(cmds.begin() + i, cmds.begin() + end);
+        sm.ApplyBatch(i + 1, batch, workers);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return cmds.size() / secs;
+}
+
+FIBER_MAIN() {
+    LOG_INFO("================= Parallel Apply Benchmark =====================");
+    raft::RaftConfig config;
+    size_t batch_size = static_cast<size_t>(config.apply_batch_size);
+    for (int hot_percent : {0, 10, 50}) {
+        auto cmds = makeEntries(hot_percent);
+        LOG_INFO("---------------- {} PUTs, {}% on {} hot keys, batch={} ----------------", ENTRY_COUNT,
+                 hot_percent, HOT_KEYS, batch_size);
+        double base = 0;
+        for (size_t workers : {1, 2, 4, 8}) {
+            double rate = applyRate(cmds, batch_size, workers);
+            if (workers == 1) {
+                base = rate;
+            }
+            LOG_INFO("workers={}  {:>10.0f} entries/s  ({:.2f}x)", workers, rate, rate / base);
+        }
+    }
+    return 0;
+}
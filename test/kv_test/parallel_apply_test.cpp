@@ -0,0 +1,268 @@
+#include "kv_service.h"
+#include "ordered_engine.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <random>
+
+using namespace kv;
+
+namespace {
+
+// 一段随机日志：少量热点key制造冲突，大量冷key互不冲突；
+// 带会话的请求中夹杂重试，TTL和EXPIRE使用固定的远期时间
+class Workload {
+public:
+    explicit Workload(uint32_t seed) : gen_(seed) {}
+
+    std::vector<KvCommand> Next(size_t count) {
+        std::vector<KvCommand> cmds;
+        for (size_t i = 0; i < count; ++i) {
+            cmds.push_back(one());
+        }
+        return cmds;
+    }
+
+private:
+    std::string key() {
+        if (gen_() % 4 == 0) {
+            return "hot" + std::to_string(gen_() % 8);
+        }
+        return "cold" + std::to_string(gen_() % 2000);
+    }
+
+    uint64_t deadline() { return kFarFuture + gen_() % 4; }
+
+    KvCommand one() {
+        KvCommand cmd;
+        cmd.key = key();
+        cmd.value = std::to_string(gen_() % 100);
+        switch (gen_() % 10) {
+            case 0:
+                cmd.op = KvOp::APPEND;
+                break;
+            case 1:
+                cmd.op = KvOp::DELETE;
+                break;
+            case 2:
+                cmd.op = KvOp::CAS;
+                cmd.expected = std::to_string(gen_() % 100);
+                break;
+            case 3:
+                cmd.op = KvOp::PUT_IF_ABSENT;
+                cmd.expire_at_ms = gen_() % 2 ? deadline() : 0;
+                break;
+            case 4:
+                cmd.op = KvOp::INCR;
+                cmd.key = "counter" + std::to_string(gen_() % 4);
+                cmd.delta = 1;
+                break;
+            case 5:
+                cmd.op = KvOp::BATCH;
+                for (int k = 0; k < 3; ++k) {
+                    cmd.ops.push_back(KvMutation{gen_() % 3 ? KvOp::PUT : KvOp::DELETE, key(), cmd.value,
+                                                 gen_() % 2 ? deadline() : 0});
+                }
+                break;
+            case 6:
+                cmd.op = KvOp::EXPIRE;
+                cmd.ops.push_back(KvMutation{KvOp::DELETE, key(), std::string(), deadline()});
+                break;
+            case 7:
+                cmd.op = KvOp::GET;
+                break;
+            default:
+                cmd.op = KvOp::PUT;
+                cmd.expire_at_ms = gen_() % 4 == 0 ? deadline() : 0;
+                break;
+        }
+        if (cmd.op != KvOp::GET && gen_() % 2 == 0) {
+            uint64_t client = 1 + gen_() % 24;
+            uint64_t& seq = seqs_[client];
+            // 约1/8为重试（包括已经过期的旧请求）
+            if (seq > 0 && gen_() % 8 == 0) {
+                cmd.request = RequestId{client, seq - gen_() % std::min<uint64_t>(seq, 2)};
+            } else {
+                cmd.request = RequestId{client, ++seq};
+            }
+        }
+        return cmd;
+    }
+
+    static constexpr uint64_t kFarFuture = 4000000000000ULL;
+
+    std::mt19937 gen_;
+    std::map<uint64_t, uint64_t> seqs_;
+};
+
+// 比较两边产生的全部事件，需要保留完整的历史
+WatchOptions withHistory() {
+    WatchOptions options;
+    options.history_bytes = 64 << 20;
+    return options;
+}
+
+std::map<std::string, std::string> contents(KvStateMachine& sm) {
+    std::map<std::string, std::string> data;
+    sm.Engine()->ForEach([&data](const std::string& key, const std::string& value) { data[key] = value; });
+    return data;
+}
+
+std::vector<std::pair<std::string, uint64_t>> ttls(KvStateMachine& sm) {
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    for (const auto& ttl : sm.TtlEntries()) {
+        entries.emplace_back(ttl.key, ttl.expire_at_ms);
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+std::vector<WatchEvent> history(KvStateMachine& sm) {
+    std::vector<WatchEvent> all;
+    auto watcher = sm.Watches()->Subscribe("", true, 1);
+    EXPECT_NE(watcher, nullptr);
+    std::vector<WatchEvent> events;
+    while (watcher && watcher->Next(events, 10) == KvStatus::OK && !events.empty()) {
+        all.insert(all.end(), events.begin(), events.end());
+    }
+    return all;
+}
+
+void expectSameResult(const KvResult& expected, const KvResult& actual, uint64_t index) {
+    EXPECT_EQ(expected.status, actual.status) << "index " << index;
+    EXPECT_EQ(expected.value, actual.value) << "index " << index;
+    EXPECT_EQ(expected.statuses, actual.statuses) << "index " << index;
+}
+
+void expectSameState(KvStateMachine& expected, KvStateMachine& actual) {
+    EXPECT_EQ(expected.LastApplied(), actual.LastApplied());
+    EXPECT_EQ(contents(expected), contents(actual));
+    EXPECT_EQ(ttls(expected), ttls(actual));
+
+    // 会话的LRU顺序决定之后淘汰哪些会话，必须完全一致
+    auto expected_sessions = expected.Sessions().Entries();
+    auto actual_sessions = actual.Sessions().Entries();
+    ASSERT_EQ(expected_sessions.size(), actual_sessions.size());
+    for (size_t i = 0; i < expected_sessions.size(); ++i) {
+        EXPECT_EQ(expected_sessions[i].client_id, actual_sessions[i].client_id);
+        EXPECT_EQ(expected_sessions[i].seq, actual_sessions[i].seq);
+        EXPECT_EQ(expected_sessions[i].last_index, actual_sessions[i].last_index);
+        EXPECT_EQ(expected_sessions[i].status, actual_sessions[i].status);
+    }
+    EXPECT_EQ(expected.Sessions().EvictedCount(), actual.Sessions().EvictedCount());
+
+    auto expected_events = history(expected);
+    auto actual_events = history(actual);
+    ASSERT_EQ(expected_events.size(), actual_events.size());
+    for (size_t i = 0; i < expected_events.size(); ++i) {
+        EXPECT_EQ(expected_events[i].revision, actual_events[i].revision);
+        EXPECT_EQ(expected_events[i].type, actual_events[i].type);
+        EXPECT_EQ(expected_events[i].key, actual_events[i].key);
+        EXPECT_EQ(expected_events[i].value, actual_events[i].value);
+    }
+}
+
+} // namespace
+
+TEST(ParallelApplyTest, MatchesSequentialApply) {
+    // 会话数上限小于客户端数，批次中间会发生淘汰
+    SessionOptions sessions;
+    sessions.max_sessions = 16;
+    KvStateMachine sequential(MakeShardedHashEngine(), sessions, withHistory());
+    KvStateMachine parallel(MakeShardedHashEngine(), sessions, withHistory());
+    ASSERT_TRUE(parallel.Engine()->ConcurrentWrites());
+
+    Workload workload(42);
+    uint64_t index = 1;
+    for (int round = 0; round < 40; ++round) {
+        auto cmds = workload.Next(100);
+        auto results = parallel.ApplyBatch(index, cmds, 4);
+        ASSERT_EQ(results.size(), cmds.size());
+        for (size_t i = 0; i < cmds.size(); ++i) {
+            expectSameResult(sequential.Apply(index + i, cmds[i]), results[i], index + i);
+        }
+        index += cmds.size();
+    }
+    expectSameState(sequential, parallel);
+    EXPECT_GT(parallel.Sessions().EvictedCount(), 0u);
+}
+
+TEST(ParallelApplyTest, BarriersAndIntents) {
+    KvStateMachine sequential(MakeShardedHashEngine(), SessionOptions(), withHistory());
+    KvStateMachine parallel(MakeShardedHashEngine(), SessionOptions(), withHistory());
+
+    // TXN_PREPARE单独成段；之后写intent所在key的命令返回TXN_CONFLICT且不记入会话
+    KvCommand prepare;
+    prepare.op = KvOp::TXN_PREPARE;
+    prepare.txn = TxnMeta{9, "a", NowUnixMs(), 60000, TxnState::PENDING, {"a"}, 0};
+    prepare.ops.push_back(KvMutation{KvOp::PUT, "a", "txn"});
+
+    std::vector<KvCommand> cmds;
+    for (int i = 0; i < 20; ++i) {
+        KvCommand put;
+        put.op = KvOp::PUT;
+        put.key = "k" + std::to_string(i);
+        put.value = "v";
+        cmds.push_back(put);
+    }
+    cmds.push_back(prepare);
+    KvCommand blocked;
+    blocked.op = KvOp::PUT;
+    blocked.key = "a";
+    blocked.value = "plain";
+    blocked.request = RequestId{5, 1};
+    cmds.push_back(blocked);
+    for (int i = 0; i < 20; ++i) {
+        KvCommand append;
+        append.op = KvOp::APPEND;
+        append.key = "k" + std::to_string(i % 5);
+        append.value = "x";
+        cmds.push_back(append);
+    }
+    KvCommand resolve;
+    resolve.op = KvOp::TXN_RESOLVE;
+    resolve.txn = prepare.txn;
+    resolve.txn.state = TxnState::COMMITTED;
+    resolve.ops.push_back(KvMutation{KvOp::GET, "a", ""});
+    cmds.push_back(resolve);
+    cmds.push_back(blocked);
+
+    auto results = parallel.ApplyBatch(1, cmds, 8);
+    for (size_t i = 0; i < cmds.size(); ++i) {
+        expectSameResult(sequential.Apply(1 + i, cmds[i]), results[i], 1 + i);
+    }
+    EXPECT_EQ(results[21].status, KvStatus::TXN_CONFLICT);
+    EXPECT_EQ(results.back().status, KvStatus::OK);
+    EXPECT_EQ(parallel.Get("a").value, "plain");
+    EXPECT_EQ(parallel.Get("k0").value, "vxxxx");
+    EXPECT_EQ(parallel.IntentCount(), 0u);
+    expectSameState(sequential, parallel);
+
+    // 已apply的日志被跳过
+    auto stale = parallel.ApplyBatch(1, cmds, 8);
+    EXPECT_EQ(parallel.LastApplied(), cmds.size());
+    EXPECT_EQ(parallel.Get("k0").value, "vxxxx");
+    EXPECT_EQ(stale.size(), cmds.size());
+}
+
+TEST(ParallelApplyTest, FallsBackForSingleWriterEngines) {
+    // OrderedEngine的写接口只允许一个调用方，ApplyBatch退化为逐条apply
+    auto engine = MakeOrderedEngine();
+    ASSERT_FALSE(engine->ConcurrentWrites());
+    KvStateMachine sequential(MakeOrderedEngine(), SessionOptions(), withHistory());
+    KvStateMachine batched(engine, SessionOptions(), withHistory());
+    Workload workload(7);
+    auto cmds = workload.Next(500);
+    auto results = batched.ApplyBatch(1, cmds, 8);
+    for (size_t i = 0; i < cmds.size(); ++i) {
+        expectSameResult(sequential.Apply(1 + i, cmds[i]), results[i], 1 + i);
+    }
+    expectSameState(sequential, batched);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
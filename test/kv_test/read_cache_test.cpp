@@ -0,0 +1,148 @@
+#include "read_cache.h"
+#include "kv_state_machine.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <random>
+
+using namespace kv;
+
+static KvCommand makeCommand(KvOp op, const std::string& key, const std::string& value = "") {
+    KvCommand cmd;
+    cmd.op = op;
+    cmd.key = key;
+    cmd.value = value;
+    return cmd;
+}
+
+TEST(ReadCacheTest, ApplyInvalidatesCachedValues) {
+    auto engine = std::make_shared<CachedEngine>(MakeShardedHashEngine(8));
+    KvStateMachine sm(engine);
+
+    sm.Apply(1, makeCommand(KvOp::PUT, "a", "1"));
+    EXPECT_EQ(sm.Get("a").value, "1");
+    EXPECT_EQ(sm.Get("a").value, "1");
+    EXPECT_EQ(engine->CacheStats().hits, 1u);
+
+    sm.Apply(2, makeCommand(KvOp::APPEND, "a", "2"));
+    EXPECT_EQ(sm.Get("a").value, "12");
+    sm.Apply(3, makeCommand(KvOp::DELETE, "a"));
+    EXPECT_EQ(sm.Get("a").status, KvStatus::NO_KEY);
+
+    KvCommand batch;
+    batch.op = KvOp::BATCH;
+    batch.ops = {{KvOp::PUT, "a", "x"}, {KvOp::PUT, "b", "y"}};
+    sm.Apply(4, batch);
+    auto results = sm.MultiGet({"a", "b", "c"});
+    EXPECT_EQ(results[0].value, "x");
+    EXPECT_EQ(results[1].value, "y");
+    EXPECT_EQ(results[2].status, KvStatus::NO_KEY);
+
+    // 安装快照会清空引擎，缓存同时清空
+    auto snapshot = sm.TakeSnapshot();
+    sm.Apply(5, makeCommand(KvOp::PUT, "a", "newer"));
+    EXPECT_EQ(sm.Get("a").value, "newer");
+    ASSERT_TRUE(sm.RestoreSnapshot(snapshot));
+    EXPECT_EQ(sm.Get("a").value, "x");
+}
+
+TEST(ReadCacheTest, HotKeysSurviveOneHitScan) {
+    ReadCacheOptions options;
+    options.capacity_bytes = 64 << 10;
+    options.shard_count = 1;
+    auto engine = std::make_shared<CachedEngine>(MakeShardedHashEngine(8), options);
+    const int hot_keys = 100;
+    const int cold_keys = 50000;
+    for (int i = 0; i < cold_keys; ++i) {
+        engine->Put(i + 1, "key" + std::to_string(i), "value");
+    }
+
+    // 每读一次热点key夹杂10个只读一次的冷key，热点的重用距离远超缓存条数，
+    // 纯LRU会全部错过；频率准入应让热点一直留在主区
+    std::string value;
+    int cold = hot_keys;
+    uint64_t hot_hits = 0;
+    uint64_t hot_reads = 0;
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < hot_keys; ++i) {
+            uint64_t before = engine->CacheStats().hits;
+            engine->Get("key" + std::to_string(i), value);
+            if (round >= 50) {
+                hot_hits += engine->CacheStats().hits - before;
+                ++hot_reads;
+            }
+            for (int j = 0; j < 10; ++j) {
+                engine->Get("key" + std::to_string(cold), value);
+                cold = cold + 1 == cold_keys ? hot_keys : cold + 1;
+            }
+        }
+    }
+    auto stats = engine->CacheStats();
+    EXPECT_GE(hot_hits, hot_reads * 9 / 10);
+    EXPECT_GT(stats.rejected, 0u);
+    EXPECT_LE(stats.charged_bytes, options.capacity_bytes);
+    LOG_INFO("hot hit ratio {:.3f}, overall {:.3f}, entries {}, rejected {}",
+             static_cast<double>(hot_hits) / hot_reads, stats.HitRatio(), stats.entries, stats.rejected);
+}
+
+TEST(ReadCacheTest, ReadersNeverSeeOverwrittenValues) {
+    ReadCacheOptions options;
+    options.capacity_bytes = 256 << 10;
+    auto engine = std::make_shared<CachedEngine>(MakeShardedHashEngine(8), options);
+    const int num_keys = 64;
+    const int rounds = 2000;
+    const int num_readers = 4;
+    for (int k = 0; k < num_keys; ++k) {
+        engine->Put(1, "key" + std::to_string(k), "0");
+    }
+
+    // 每个key的值单调递增，读者看到的值不能比它之前看到的小
+    std::atomic<bool> monotonic{true};
+    std::atomic<bool> writing{true};
+    fiber::WaitGroup wg;
+    wg.add(num_readers + 1);
+    fiber::Fiber::go([&]() {
+        for (int round = 1; round <= rounds; ++round) {
+            for (int k = 0; k < num_keys; ++k) {
+                engine->Put(round + 1, "key" + std::to_string(k), std::to_string(round));
+            }
+        }
+        writing = false;
+        wg.done();
+    });
+    for (int r = 0; r < num_readers; ++r) {
+        fiber::Fiber::go([&, r]() {
+            std::vector<int> seen(num_keys, 0);
+            std::mt19937 rng(r);
+            std::string value;
+            for (int i = 0; i < 200000 && writing; ++i) {
+                int k = rng() % num_keys;
+                if (engine->Get("key" + std::to_string(k), value)) {
+                    int v = std::stoi(value);
+                    if (v < seen[k]) {
+                        monotonic = false;
+                    }
+                    seen[k] = v;
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    EXPECT_TRUE(monotonic.load());
+    std::string value;
+    for (int k = 0; k < num_keys; ++k) {
+        ASSERT_TRUE(engine->Get("key" + std::to_string(k), value));
+        EXPECT_EQ(value, std::to_string(rounds));
+    }
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,155 @@
+#include "kv_service.h"
+#include "scheduler.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+
+using namespace kv;
+
+namespace {
+
+KvCommand appendCommand(const std::string& key, const std::string& value, RequestId request) {
+    KvCommand cmd;
+    cmd.op = KvOp::APPEND;
+    cmd.key = key;
+    cmd.value = value;
+    cmd.request = request;
+    return cmd;
+}
+
+KvCommand incrCommand(const std::string& key, int64_t delta, RequestId request) {
+    KvCommand cmd;
+    cmd.op = KvOp::INCR;
+    cmd.key = key;
+    cmd.delta = delta;
+    cmd.request = request;
+    return cmd;
+}
+
+} // namespace
+
+TEST(SessionTest, RetriesApplyOnce) {
+    KvStateMachine sm;
+    uint64_t index = 0;
+
+    // 同一个请求被提交了两次（例如leader切换后客户端重试），只生效一次
+    EXPECT_EQ(sm.Apply(++index, appendCommand("k", "a", {7, 1})).status, KvStatus::OK);
+    EXPECT_EQ(sm.Apply(++index, appendCommand("k", "a", {7, 1})).status, KvStatus::OK);
+    EXPECT_EQ(sm.Get("k").value, "a");
+    EXPECT_EQ(sm.LastApplied(), index);
+
+    // 重复的INCR返回第一次执行的结果
+    EXPECT_EQ(sm.Apply(++index, incrCommand("n", 5, {7, 2})).value, "5");
+    EXPECT_EQ(sm.Apply(++index, incrCommand("n", 5, {7, 2})).value, "5");
+    EXPECT_EQ(sm.Get("n").value, "5");
+
+    // 缓存的失败结果同样返回给重试
+    KvCommand cas;
+    cas.op = KvOp::CAS;
+    cas.key = "k";
+    cas.expected = "wrong";
+    cas.value = "b";
+    cas.request = {7, 3};
+    EXPECT_EQ(sm.Apply(++index, cas).status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(sm.Apply(++index, cas).status, KvStatus::CONDITION_FAILED);
+
+    // 更早的请求被忽略；新请求和其他客户端正常执行
+    EXPECT_EQ(sm.Apply(++index, appendCommand("k", "a", {7, 1})).status, KvStatus::OK);
+    sm.Apply(++index, appendCommand("k", "b", {7, 4}));
+    sm.Apply(++index, appendCommand("k", "c", {8, 1}));
+    // 不带请求标识的命令不去重
+    sm.Apply(++index, appendCommand("k", "d", {}));
+    sm.Apply(++index, appendCommand("k", "d", {}));
+    EXPECT_EQ(sm.Get("k").value, "abcdd");
+    EXPECT_EQ(sm.Sessions().Size(), 2u);
+}
+
+TEST(SessionTest, EvictionBoundsMemory) {
+    SessionOptions options;
+    options.max_sessions = 100;
+    options.expire_entries = 1000;
+    KvStateMachine sm(MakeShardedHashEngine(), options);
+    uint64_t index = 0;
+
+    // 大量一次性客户端：会话数始终不超过上限
+    for (uint64_t client = 1; client <= 10000; ++client) {
+        sm.Apply(++index, appendCommand("churn", "x", {client, 1}));
+        ASSERT_LE(sm.Sessions().Size(), options.max_sessions);
+    }
+    EXPECT_EQ(sm.Sessions().EvictedCount(), 10000u - options.max_sessions);
+
+    // 淘汰最久未活动的会话：持续活跃的客户端保留
+    SessionTable table(options);
+    KvResult ok;
+    table.Record(1, {1, 1}, KvOp::PUT, ok);
+    for (uint64_t client = 2; client <= 100; ++client) {
+        table.Record(client, {client, 1}, KvOp::PUT, ok);
+    }
+    KvResult cached;
+    EXPECT_TRUE(table.Check(101, {1, 1}, KvOp::PUT, cached));
+    table.Record(102, {1000, 1}, KvOp::PUT, ok);
+    EXPECT_EQ(table.Size(), 100u);
+    EXPECT_TRUE(table.Check(103, {1, 1}, KvOp::PUT, cached));
+    EXPECT_FALSE(table.Check(104, {2, 1}, KvOp::PUT, cached));
+
+    // 长时间未活动的会话在新会话加入时过期
+    table.Record(1102, {1001, 1}, KvOp::PUT, ok);
+    EXPECT_EQ(table.Size(), 2u);
+    auto entries = table.Entries();
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].client_id, 1u);
+    EXPECT_EQ(entries[1].client_id, 1001u);
+}
+
+TEST(SessionTest, SnapshotCarriesSessions) {
+    KvStateMachine sm;
+    uint64_t index = 0;
+    sm.Apply(++index, incrCommand("n", 3, {1, 1}));
+    sm.Apply(++index, appendCommand("k", "a", {2, 1}));
+    sm.Apply(++index, appendCommand("k", "b", {1, 2}));
+
+    KvStateMachine restored;
+    ASSERT_TRUE(restored.RestoreSnapshot(sm.TakeSnapshot()));
+    auto entries = restored.Sessions().Entries();
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].client_id, 2u);
+    EXPECT_EQ(entries[1].client_id, 1u);
+    EXPECT_EQ(entries[1].seq, 2u);
+
+    // 快照之后重试的请求在新副本上同样只执行一次
+    restored.Apply(++index, appendCommand("k", "b", {1, 2}));
+    restored.Apply(++index, appendCommand("k", "a", {2, 1}));
+    EXPECT_EQ(restored.Get("k").value, "ab");
+    EXPECT_EQ(restored.Apply(++index, incrCommand("n", 3, {3, 1})).value, "6");
+}
+
+TEST(SessionTest, ServiceRetriesWithClientSession) {
+    auto sm = MakeKvStateMachine();
+    KvService service(sm);
+    ClientSession session;
+    EXPECT_NE(session.ClientId(), 0u);
+
+    PutAppendArgs args{KvOp::APPEND, "log", "entry;"};
+    args.request = session.Next();
+    PutAppendReply reply;
+    service.PutAppend(args, reply);
+    service.PutAppend(args, reply);     // 重试：复用同一个RequestId
+    EXPECT_EQ(sm->Get("log").value, "entry;");
+
+    IncrementArgs incr{"counter", 10};
+    incr.request = session.Next();
+    IncrementReply first;
+    IncrementReply retry;
+    service.Increment(incr, first);
+    service.Increment(incr, retry);
+    EXPECT_EQ(first.value, 10);
+    EXPECT_EQ(retry.value, 10);
+
+    args.request = session.Next();
+    service.PutAppend(args, reply);
+    EXPECT_EQ(sm->Get("log").value, "entry;entry;");
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
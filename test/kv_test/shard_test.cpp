@@ -0,0 +1,331 @@
+#include "sharded_kv_service.h"
+#include "shard_map.h"
+#include "rpc_client.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+using namespace kv;
+
+static constexpr uint16_t kPortA = 9200;
+static constexpr uint16_t kPortB = 9201;
+
+static ShardedKvService::GroupFactory localGroups() {
+    return [](uint64_t) { return std::make_shared<KvService>(MakeKvStateMachine()); };
+}
+
+static size_t totalKeys(ShardedKvService& service) {
+    size_t total = 0;
+    for (const auto& load : service.Loads()) {
+        total += load.keys;
+    }
+    return total;
+}
+
+static void putKey(ShardedKvService& service, const std::string& key, const std::string& value, uint64_t ttl_ms = 0) {
+    PutAppendReply reply;
+    service.PutAppend(PutAppendArgs{KvOp::PUT, key, value, ttl_ms}, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+}
+
+TEST(ShardTest, ShardMapCacheMergesNodeViews) {
+    auto shards = UniformShards(4, {"127.0.0.1:1"});
+    ASSERT_EQ(shards.size(), 4u);
+    EXPECT_EQ(shards.front().first, 0u);
+    EXPECT_EQ(shards.back().last, UINT64_MAX);
+    for (size_t i = 1; i < shards.size(); ++i) {
+        EXPECT_EQ(shards[i].first, shards[i - 1].last + 1);
+    }
+
+    ShardMapCache cache;
+    cache.Update({shards[0], shards[1]});
+    EXPECT_FALSE(cache.Complete());
+    cache.Update({shards[2], shards[3]});
+    EXPECT_TRUE(cache.Complete());
+    for (int i = 0; i < 1000; ++i) {
+        std::string key = "key" + std::to_string(i);
+        auto shard = cache.Locate(key);
+        ASSERT_TRUE(shard.has_value());
+        EXPECT_GE(ShardKeyHash(key), shard->first);
+        EXPECT_LE(ShardKeyHash(key), shard->last);
+    }
+
+    // 分片2分裂：后一半交给分片9，节点只上报它负责的新区间
+    ShardRange left = shards[1];
+    ShardRange right = shards[1];
+    uint64_t mid = shards[1].first + (shards[1].last - shards[1].first) / 2;
+    left.last = mid;
+    left.epoch = right.epoch = 1;
+    right.id = 9;
+    right.first = mid + 1;
+    right.endpoints = {"127.0.0.1:2"};
+    cache.Update({right});
+    EXPECT_TRUE(cache.Complete());
+    EXPECT_EQ(cache.Shards().size(), 5u);
+    cache.Update({left});
+    EXPECT_EQ(cache.Shards().size(), 5u);
+
+    // 旧的描述（epoch更小）不会覆盖新的
+    cache.Update({shards[1]});
+    auto current = cache.Shards();
+    EXPECT_EQ(current[1].last, mid);
+    EXPECT_EQ(current[2].id, 9u);
+
+    std::string host;
+    uint16_t port = 0;
+    EXPECT_TRUE(ParseEndpoint("10.0.0.1:9200", host, port));
+    EXPECT_EQ(host, "10.0.0.1");
+    EXPECT_EQ(port, 9200);
+    EXPECT_FALSE(ParseEndpoint("10.0.0.1", host, port));
+    EXPECT_FALSE(ParseEndpoint("10.0.0.1:99999", host, port));
+}
+
+TEST(ShardTest, SplitAndMergeMoveData) {
+    ShardedKvService service(localGroups());
+    const int num_keys = 5000;
+    for (int i = 0; i < num_keys; ++i) {
+        putKey(service, "key" + std::to_string(i), "value" + std::to_string(i));
+    }
+    putKey(service, "ttl", "v", 3600 * 1000);
+
+    auto id = service.Split(1);
+    ASSERT_TRUE(id.has_value());
+    auto shards = service.Shards();
+    ASSERT_EQ(shards.size(), 2u);
+    EXPECT_EQ(shards[0].last + 1, shards[1].first);
+    EXPECT_EQ(shards[1].id, *id);
+    EXPECT_EQ(shards[0].epoch, 1u);
+
+    // 写入时的采样在整个哈希空间上均匀，按中位数分裂后两边数据量相近
+    auto loads = service.Loads();
+    LOG_INFO("after split: {} / {} keys", loads[0].keys, loads[1].keys);
+    EXPECT_EQ(totalKeys(service), num_keys + 1u);
+    EXPECT_GT(loads[0].keys, num_keys / 4u);
+    EXPECT_GT(loads[1].keys, num_keys / 4u);
+
+    for (int i = 0; i < num_keys; ++i) {
+        GetReply reply;
+        service.Get(GetArgs{"key" + std::to_string(i)}, reply);
+        ASSERT_EQ(reply.status, KvStatus::OK);
+        EXPECT_EQ(reply.value, "value" + std::to_string(i));
+    }
+    EXPECT_EQ(service.ServiceFor("ttl")->StateMachine()->TtlCount(), 1u);
+
+    // 多key请求按分片拆开
+    MultiGetReply multi;
+    service.MultiGet(MultiGetArgs{{"key1", "key2", "key3", "missing"}}, multi);
+    EXPECT_EQ(multi.results[2].value, "value3");
+    EXPECT_EQ(multi.results[3].status, KvStatus::NO_KEY);
+    WriteBatchReply batch;
+    service.WriteBatch(WriteBatchArgs{{{KvOp::PUT, "key1", "x"}, {KvOp::PUT, "key2", "y"}, {KvOp::PUT, "key3", "z"}}},
+                       batch);
+    bool same_shard = service.ServiceFor("key1") == service.ServiceFor("key2") &&
+                      service.ServiceFor("key2") == service.ServiceFor("key3");
+    EXPECT_EQ(batch.status, same_shard ? KvStatus::OK : KvStatus::INVALID_ARGUMENT);
+
+    // 跨分片的有序扫描
+    std::vector<std::string> keys;
+    ScanArgs scan{"key", "kez", 100};
+    while (true) {
+        ScanReply reply;
+        service.Scan(scan, reply);
+        for (const auto& pair : reply.pairs) {
+            keys.push_back(pair.key);
+        }
+        if (!reply.has_more) {
+            break;
+        }
+        scan.start = reply.next_start;
+    }
+    ASSERT_EQ(keys.size(), static_cast<size_t>(num_keys));
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+
+    ASSERT_TRUE(service.Merge(1));
+    shards = service.Shards();
+    ASSERT_EQ(shards.size(), 1u);
+    EXPECT_EQ(shards[0].first, 0u);
+    EXPECT_EQ(shards[0].last, UINT64_MAX);
+    EXPECT_EQ(shards[0].epoch, 2u);
+    EXPECT_EQ(totalKeys(service), num_keys + 1u);
+    EXPECT_EQ(service.ServiceFor("ttl")->StateMachine()->TtlCount(), 1u);
+    EXPECT_FALSE(service.Merge(1));
+}
+
+TEST(ShardTest, WritesDuringSplitAreNotLost) {
+    ShardedKvService service(localGroups());
+    const int num_counters = 64;
+    const int num_fibers = 8;
+    const int increments = 300;
+    for (int i = 0; i < num_counters; ++i) {
+        putKey(service, "counter" + std::to_string(i), "0");
+    }
+
+    std::atomic<int> failures{0};
+    std::atomic<int> done{0};
+    fiber::WaitGroup wg;
+    wg.add(num_fibers + 1);
+    for (int f = 0; f < num_fibers; ++f) {
+        fiber::Fiber::go([&, f]() {
+            for (int i = 0; i < increments; ++i) {
+                IncrementReply reply;
+                service.Increment(IncrementArgs{"counter" + std::to_string((f * increments + i) % num_counters), 1},
+                                  reply);
+                if (reply.status != KvStatus::OK) {
+                    failures++;
+                }
+                if (i % 16 == 0) {
+                    fiber::Fiber::yield();
+                }
+            }
+            done++;
+            wg.done();
+        });
+    }
+    // 写入进行中反复分裂与合并
+    fiber::Fiber::go([&]() {
+        int rounds = 0;
+        while (done.load() < num_fibers) {
+            auto shards = service.Shards();
+            if (shards.size() < 4) {
+                auto& target = shards[rounds % shards.size()];
+                service.Split(target.id, target.first + (target.last - target.first) / 2 + 1);
+            } else {
+                service.Merge(shards[rounds % 3].id);
+            }
+            ++rounds;
+            fiber::Fiber::yield();
+        }
+        LOG_INFO("{} split/merge rounds during writes", rounds);
+        wg.done();
+    });
+    wg.wait();
+
+    EXPECT_EQ(failures.load(), 0);
+    int64_t total = 0;
+    for (int i = 0; i < num_counters; ++i) {
+        GetReply reply;
+        service.Get(GetArgs{"counter" + std::to_string(i)}, reply);
+        ASSERT_EQ(reply.status, KvStatus::OK);
+        total += std::stoll(reply.value);
+    }
+    EXPECT_EQ(total, num_fibers * increments);
+    EXPECT_EQ(totalKeys(service), static_cast<size_t>(num_counters));
+}
+
+TEST(ShardTest, RebalanceFollowsLoad) {
+    ShardingOptions options;
+    options.split_ops_per_sec = 1000;
+    options.merge_ops_per_sec = 100;
+    options.max_shards = 4;
+    ShardedKvService service(localGroups(), {}, options);
+    for (int i = 0; i < 2000; ++i) {
+        putKey(service, "key" + std::to_string(i), "v");
+    }
+    fiber::Fiber::sleep(10);
+
+    // 负载超过阈值的分片被分裂，直到max_shards
+    while (service.RebalanceOnce()) {
+        for (int i = 0; i < 20000; ++i) {
+            GetReply reply;
+            service.Get(GetArgs{"key" + std::to_string(i % 2000)}, reply);
+        }
+        fiber::Fiber::sleep(10);
+    }
+    EXPECT_EQ(service.Shards().size(), options.max_shards);
+
+    // 没有负载之后逐个合并
+    fiber::Fiber::sleep(50);
+    while (service.RebalanceOnce()) {
+        fiber::Fiber::sleep(50);
+    }
+    EXPECT_EQ(service.Shards().size(), 1u);
+    EXPECT_EQ(totalKeys(service), 2000u);
+}
+
+TEST(ShardTest, ClientRoutesWithCachedShardMap) {
+    // 两个节点各负责一半的哈希空间
+    auto layout = UniformShards(2);
+    ShardingOptions options_a;
+    options_a.endpoints = {"127.0.0.1:" + std::to_string(kPortA)};
+    ShardingOptions options_b;
+    options_b.endpoints = {"127.0.0.1:" + std::to_string(kPortB)};
+    auto node_a = std::make_shared<ShardedKvService>(localGroups(), std::vector<ShardRange>{layout[0]}, options_a);
+    auto node_b = std::make_shared<ShardedKvService>(localGroups(), std::vector<ShardRange>{layout[1]}, options_b);
+    auto server_a = rpc::RpcServer::Make();
+    auto server_b = rpc::RpcServer::Make();
+    node_a->RegisterRPC(server_a);
+    node_b->RegisterRPC(server_b);
+    server_a->start(kPortA);
+    server_b->start(kPortB);
+    fiber::Fiber::sleep(100);
+
+    ShardMapCache cache({options_a.endpoints[0], options_b.endpoints[0]});
+    EXPECT_EQ(cache.Refresh(), 2u);
+    ASSERT_TRUE(cache.Complete());
+
+    std::map<std::string, rpc::RpcClientPtr> clients;
+    auto clientFor = [&](const std::string& endpoint) {
+        auto& client = clients[endpoint];
+        if (!client) {
+            std::string host;
+            uint16_t port = 0;
+            EXPECT_TRUE(ParseEndpoint(endpoint, host, port));
+            client = rpc::RpcClient::Make();
+            EXPECT_TRUE(client->connect(host, port));
+        }
+        return client;
+    };
+
+    for (int i = 0; i < 200; ++i) {
+        std::string key = "key" + std::to_string(i);
+        auto shard = cache.Locate(key);
+        ASSERT_TRUE(shard.has_value());
+        PutAppendReply reply;
+        ASSERT_FALSE(clientFor(shard->endpoints[0])->call(kMethodPutAppend, PutAppendArgs{KvOp::PUT, key, "v"}, reply)
+                             .has_value());
+        EXPECT_EQ(reply.status, KvStatus::OK);
+    }
+    EXPECT_GT(totalKeys(*node_a), 0u);
+    EXPECT_GT(totalKeys(*node_b), 0u);
+    EXPECT_EQ(totalKeys(*node_a) + totalKeys(*node_b), 200u);
+
+    // 发错节点时返回WRONG_SHARD
+    std::string key_b;
+    for (int i = 0; key_b.empty(); ++i) {
+        std::string key = "key" + std::to_string(i);
+        if (cache.Locate(key)->id == layout[1].id) {
+            key_b = key;
+        }
+    }
+    GetReply get;
+    ASSERT_FALSE(clientFor(options_a.endpoints[0])->call(kMethodGet, GetArgs{key_b}, get).has_value());
+    EXPECT_EQ(get.status, KvStatus::WRONG_SHARD);
+
+    // 节点内分裂后，刷新的缓存包含新分片
+    uint64_t middle = layout[1].first + (layout[1].last - layout[1].first) / 2;
+    ASSERT_TRUE(node_b->Split(layout[1].id, middle).has_value());
+    EXPECT_EQ(cache.Refresh(), 2u);
+    EXPECT_EQ(cache.Shards().size(), 3u);
+    EXPECT_TRUE(cache.Complete());
+    ShardMapReply map;
+    ASSERT_FALSE(clientFor(options_b.endpoints[0])->call(kMethodShardMap, ShardMapArgs{true}, map).has_value());
+    ASSERT_EQ(map.loads.size(), 2u);
+    EXPECT_EQ(map.loads[0].keys + map.loads[1].keys, totalKeys(*node_b));
+
+    for (auto& [endpoint, client] : clients) {
+        client->disconnect();
+    }
+    server_a->shutdown();
+    server_b->shutdown();
+    fiber::Fiber::sleep(100);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
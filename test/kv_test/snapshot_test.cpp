@@ -0,0 +1,184 @@
+#include "snapshotter.h"
+#include "ordered_engine.h"
+#include "sharded_hash_engine.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+
+using namespace kv;
+
+namespace {
+
+KvCommand putCommand(const std::string& key, const std::string& value) {
+    KvCommand cmd;
+    cmd.op = KvOp::PUT;
+    cmd.key = key;
+    cmd.value = value;
+    return cmd;
+}
+
+} // namespace
+
+TEST(SnapshotTest, HashEngineCopyOnWriteView) {
+    auto engine = std::make_shared<ShardedHashEngine>(4);
+    engine->Put(1, "a", "1");
+    engine->Put(2, "b", "2");
+
+    auto view = engine->NewReadView(0);
+    ASSERT_TRUE(view);
+    EXPECT_EQ(view->Index(), 2u);
+
+    engine->Put(3, "a", "changed");
+    engine->Delete(4, "b");
+    engine->Put(5, "c", "3");
+
+    std::string value;
+    EXPECT_TRUE(view->Get("a", value));
+    EXPECT_EQ(value, "1");
+    EXPECT_TRUE(view->Get("b", value));
+    EXPECT_FALSE(view->Get("c", value));
+    EXPECT_EQ(view->Scan("", "", 0).size(), 2u);
+
+    // 只保存最新版本，无法在更早的index上创建视图
+    EXPECT_EQ(engine->NewReadView(4), nullptr);
+    EXPECT_NE(engine->NewReadView(5), nullptr);
+
+    // 清空后（恢复更早的快照）从头写入，可以在更小的index上创建视图
+    engine->Clear();
+    EXPECT_EQ(engine->Size(), 0u);
+    EXPECT_EQ(view->Scan("", "", 0).size(), 2u);
+    engine->Put(3, "a", "restored");
+    auto restored = engine->NewReadView(3);
+    ASSERT_TRUE(restored);
+    EXPECT_TRUE(restored->Get("a", value));
+    EXPECT_EQ(value, "restored");
+}
+
+TEST(SnapshotTest, HashEngineCopiesOnlyTouchedPages) {
+    // 单个分片，数据量远大于一页
+    auto engine = std::make_shared<ShardedHashEngine>(1);
+    const int num_keys = 64 * ShardedHashEngine::kMaxPageKeys;
+    uint64_t index = 0;
+    for (int i = 0; i < num_keys; ++i) {
+        engine->Put(++index, "key" + std::to_string(i), "v1");
+    }
+    size_t base = engine->MemoryUsage();
+
+    // 视图存在时每次写入最多复制一页（加上一次目录），不复制整个分片
+    auto view = engine->NewReadView(0);
+    engine->Put(++index, "key0", "v2");
+    size_t after_one = engine->MemoryUsage();
+    EXPECT_LT(after_one - base, base / 16);
+    for (int i = 0; i < num_keys; ++i) {
+        engine->Put(++index, "key" + std::to_string(i), "v2");
+    }
+
+    std::string value;
+    ASSERT_TRUE(view->Get("key0", value));
+    EXPECT_EQ(value, "v1");
+    ASSERT_TRUE(engine->Get("key0", value));
+    EXPECT_EQ(value, "v2");
+    size_t visited = 0;
+    view->ForEach([&](const std::string&, const std::string& v) {
+        ++visited;
+        EXPECT_EQ(v, "v1");
+    });
+    EXPECT_EQ(visited, static_cast<size_t>(num_keys));
+    EXPECT_EQ(engine->Size(), static_cast<size_t>(num_keys));
+}
+
+TEST(SnapshotTest, BackgroundSnapshotWhileApplying) {
+    const int num_keys = 2000;
+    for (auto engine : {MakeShardedHashEngine(), MakeOrderedEngine()}) {
+        auto sm = MakeKvStateMachine(engine);
+        auto persister = raft::MakeMemoryPersister();
+        Snapshotter snapshotter(sm, persister);
+
+        uint64_t index = 0;
+        for (int i = 0; i < num_keys; ++i) {
+            sm->Apply(++index, putCommand("key" + std::to_string(i), "v1"));
+        }
+
+        uint64_t done_index = 0;
+        ASSERT_TRUE(snapshotter.Start([&done_index](uint64_t i) { done_index = i; }));
+        EXPECT_FALSE(snapshotter.Start());
+
+        // 快照写入期间继续apply，快照内容不受影响
+        for (int i = 0; i < num_keys; ++i) {
+            sm->Apply(++index, putCommand("key" + std::to_string(i), "v2"));
+        }
+        sm->Apply(++index, putCommand("extra", "x"));
+
+        snapshotter.Wait();
+        EXPECT_FALSE(snapshotter.InProgress());
+        EXPECT_EQ(done_index, static_cast<uint64_t>(num_keys));
+        EXPECT_EQ(snapshotter.LastSnapshotIndex(), static_cast<uint64_t>(num_keys));
+
+        KvStateMachine restored;
+        ASSERT_TRUE(restored.RestoreSnapshot(persister->ReadSnapshot()));
+        EXPECT_EQ(restored.LastApplied(), static_cast<uint64_t>(num_keys));
+        EXPECT_EQ(restored.Engine()->Size(), static_cast<size_t>(num_keys));
+        EXPECT_EQ(restored.Get("key0").value, "v1");
+        EXPECT_EQ(restored.Get("extra").status, KvStatus::NO_KEY);
+
+        // 原状态机保持最新数据
+        EXPECT_EQ(sm->Get("key0").value, "v2");
+    }
+}
+
+TEST(SnapshotTest, ConcurrentWritesDuringCopyOnWrite) {
+    auto sm = MakeKvStateMachine(MakeShardedHashEngine(8));
+    const uint64_t num_keys = 256;
+    const uint64_t num_entries = 200000;
+    std::atomic<bool> writer_done{false};
+    std::atomic<int> views{0};
+    std::atomic<int> inconsistent{0};
+    fiber::WaitGroup wg;
+    wg.add(3);
+
+    // 第i条日志写入 key(i % num_keys) = i
+    fiber::Fiber::go([&]() {
+        for (uint64_t i = 1; i <= num_entries; ++i) {
+            sm->Apply(i, putCommand("key" + std::to_string(i % num_keys), std::to_string(i)));
+        }
+        writer_done = true;
+        wg.done();
+    });
+
+    for (int r = 0; r < 2; ++r) {
+        fiber::Fiber::go([&]() {
+            while (!writer_done) {
+                auto view = sm->NewReadView();
+                if (!view || view->Index() < num_keys) {
+                    fiber::Fiber::yield();
+                    continue;
+                }
+                // 在index I上，每个key的值必须是 <= I 的最后一次写入
+                uint64_t index = view->Index();
+                size_t count = 0;
+                view->ForEach([&](const std::string&, const std::string& value) {
+                    uint64_t v = std::stoull(value);
+                    if (v > index || v + num_keys <= index) {
+                        inconsistent++;
+                    }
+                    ++count;
+                });
+                if (count != num_keys) {
+                    inconsistent++;
+                }
+                views++;
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+    EXPECT_EQ(inconsistent.load(), 0);
+    LOG_INFO("checked {} copy-on-write views", views.load());
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,201 @@
+#include "ttl_expirer.h"
+#include "kv_service.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+
+using namespace kv;
+
+namespace {
+
+KvCommand putCommand(const std::string& key, const std::string& value, uint64_t expire_at_ms) {
+    KvCommand cmd;
+    cmd.op = KvOp::PUT;
+    cmd.key = key;
+    cmd.value = value;
+    cmd.expire_at_ms = expire_at_ms;
+    return cmd;
+}
+
+std::vector<std::string> keysOf(const std::vector<KvTtl>& entries) {
+    std::vector<std::string> keys;
+    for (const auto& entry : entries) {
+        keys.push_back(entry.key);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+} // namespace
+
+TEST(TtlTest, IndexPopsByDeadline) {
+    TtlIndex index;
+    index.Set("a", 1000);
+    index.Set("b", 2000);
+    index.Set("c", 1005);
+    index.Set("d", 3000);
+    index.Set("d", 1001);   // 提前
+    index.Set("c", 5000);   // 推迟：旧桶中的条目被跳过
+    index.Set("e", 1002);
+    index.Remove("e");
+    EXPECT_EQ(index.Size(), 4u);
+    EXPECT_TRUE(index.Expired("a", 1000));
+    EXPECT_FALSE(index.Expired("b", 1999));
+    EXPECT_FALSE(index.Expired("missing", 9999));
+
+    EXPECT_TRUE(index.PopExpired(999, 100).empty());
+    auto expired = index.PopExpired(1500, 100);
+    EXPECT_EQ(keysOf(expired), (std::vector<std::string>{"a", "d"}));
+    // 弹出不清除TTL，放回后可以再次弹出
+    EXPECT_TRUE(index.PopExpired(1500, 100).empty());
+    index.Requeue(expired);
+    EXPECT_EQ(index.PopExpired(1500, 1).size(), 1u);
+    EXPECT_EQ(index.PopExpired(1500, 100).size(), 1u);
+
+    EXPECT_EQ(keysOf(index.PopExpired(10000, 100)), (std::vector<std::string>{"b", "c"}));
+    EXPECT_EQ(index.Entries().size(), 4u);
+    index.Clear();
+    EXPECT_EQ(index.Size(), 0u);
+}
+
+TEST(TtlTest, StateMachineExpiry) {
+    KvStateMachine sm;
+    uint64_t index = 0;
+    uint64_t now = NowUnixMs();
+    sm.Apply(++index, putCommand("past", "v", now - 10));
+    sm.Apply(++index, putCommand("future", "v", now + 60000));
+    sm.Apply(++index, putCommand("rewritten", "v", now - 10));
+    sm.Apply(++index, putCommand("plain", "v", 0));
+    EXPECT_EQ(sm.TtlCount(), 3u);
+
+    // 过期但尚未删除的key对读不可见
+    EXPECT_EQ(sm.Get("past").status, KvStatus::NO_KEY);
+    EXPECT_EQ(sm.Get("future").value, "v");
+    auto multi = sm.MultiGet({"past", "plain"});
+    EXPECT_EQ(multi[0].status, KvStatus::NO_KEY);
+    EXPECT_EQ(multi[1].value, "v");
+    std::string value;
+    EXPECT_TRUE(sm.Engine()->Get("past", value));
+
+    auto expired = sm.PopExpired(NowUnixMs(), 100);
+    ASSERT_EQ(keysOf(expired), (std::vector<std::string>{"past", "rewritten"}));
+
+    // 提交之后被重新写入（清除TTL）的key不会被删除
+    sm.Apply(++index, putCommand("rewritten", "new", 0));
+    KvCommand cmd;
+    cmd.op = KvOp::EXPIRE;
+    for (const auto& entry : expired) {
+        cmd.ops.push_back(KvMutation{KvOp::DELETE, entry.key, "", entry.expire_at_ms});
+    }
+    sm.Apply(++index, cmd);
+    EXPECT_FALSE(sm.Engine()->Get("past", value));
+    EXPECT_EQ(sm.Get("rewritten").value, "new");
+    EXPECT_EQ(sm.TtlCount(), 1u);
+
+    // TTL随快照保存
+    KvStateMachine restored;
+    ASSERT_TRUE(restored.RestoreSnapshot(sm.TakeSnapshot()));
+    EXPECT_EQ(restored.TtlCount(), 1u);
+    auto entries = restored.TtlEntries();
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].key, "future");
+    EXPECT_EQ(entries[0].expire_at_ms, now + 60000);
+
+    // DELETE和不带TTL的PUT清除TTL
+    sm.Apply(++index, putCommand("future", "v", 0));
+    EXPECT_EQ(sm.TtlCount(), 0u);
+}
+
+TEST(TtlTest, ExpirerRequeuesOnWrongLeader) {
+    auto sm = MakeKvStateMachine();
+    uint64_t now = NowUnixMs();
+    for (int i = 0; i < 250; ++i) {
+        sm->Apply(i + 1, putCommand("k" + std::to_string(i), "v", now - 100));
+    }
+
+    bool leader = false;
+    uint64_t entries = 0;
+    TtlExpirerOptions options;
+    options.max_keys_per_entry = 100;
+    options.max_keys_per_tick = 200;
+    TtlExpirer expirer(sm, [&](const KvCommand& cmd) {
+        KvResult result;
+        if (!leader) {
+            result.status = KvStatus::WRONG_LEADER;
+            return result;
+        }
+        ++entries;
+        return sm->Apply(sm->LastApplied() + 1, cmd);
+    }, options);
+
+    EXPECT_EQ(expirer.RunOnce(NowUnixMs()), 0u);
+    EXPECT_EQ(sm->TtlCount(), 250u);
+
+    leader = true;
+    EXPECT_EQ(expirer.RunOnce(NowUnixMs()), 200u);
+    EXPECT_EQ(entries, 2u);
+    EXPECT_EQ(expirer.RunOnce(NowUnixMs()), 50u);
+    EXPECT_EQ(sm->Engine()->Size(), 0u);
+    EXPECT_EQ(sm->TtlCount(), 0u);
+    EXPECT_EQ(expirer.ExpiredCount(), 250u);
+}
+
+TEST(TtlTest, TimerDrivenExpiryThroughService) {
+    auto sm = MakeKvStateMachine();
+    auto service = std::make_shared<KvService>(sm);
+    TtlExpirerOptions options;
+    options.tick_ms = 10;
+    TtlExpirer expirer(sm, [service](const KvCommand& cmd) { return service->Propose(cmd); }, options);
+    expirer.Start();
+
+    const int num_keys = 5000;
+    MultiPutArgs args;
+    for (int i = 0; i < num_keys; ++i) {
+        args.pairs.push_back(KvPair{"ttl" + std::to_string(i), "v"});
+    }
+    args.ttl_ms = 50;
+    MultiPutReply reply;
+    service->MultiPut(args, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    PutAppendReply put_reply;
+    service->PutAppend(PutAppendArgs{KvOp::PUT, "keep", "v"}, put_reply);
+    EXPECT_EQ(sm->Engine()->Size(), static_cast<size_t>(num_keys + 1));
+
+    for (int i = 0; i < 100 && sm->Engine()->Size() > 1; ++i) {
+        fiber::Fiber::sleep(20);
+    }
+    expirer.Stop();
+    EXPECT_EQ(sm->Engine()->Size(), 1u);
+    EXPECT_EQ(sm->Get("keep").value, "v");
+    EXPECT_EQ(expirer.ExpiredCount(), static_cast<uint64_t>(num_keys));
+}
+
+TEST(TtlTest, ExpirerDestroyedWhileTicking) {
+    // 定时器与析构竞争：析构后到达的tick不访问TtlExpirer，进行中的提交在析构前完成
+    auto sm = MakeKvStateMachine();
+    std::atomic<int> proposals{0};
+    for (int round = 0; round < 20; ++round) {
+        uint64_t now = NowUnixMs();
+        sm->Apply(sm->LastApplied() + 1, putCommand("k" + std::to_string(round), "v", now - 1));
+        TtlExpirerOptions options;
+        options.tick_ms = 1;
+        auto expirer = std::make_unique<TtlExpirer>(sm, [&](const KvCommand& cmd) {
+            ++proposals;
+            fiber::Fiber::sleep(2);
+            return sm->Apply(sm->LastApplied() + 1, cmd);
+        }, options);
+        expirer->Start();
+        fiber::Fiber::sleep(round % 4);
+        expirer.reset();
+    }
+    fiber::Fiber::sleep(20);
+    EXPECT_GT(proposals.load(), 0);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
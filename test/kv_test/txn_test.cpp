@@ -0,0 +1,375 @@
+#include "sharded_kv_service.h"
+#include "kv_service.h"
+#include "kv_client.h"
+#include "txn.h"
+#include "rpc_server.h"
+#include "rpc_client.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "sync.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <random>
+#include <set>
+
+using namespace kv;
+
+static constexpr uint16_t kPort = 9240;
+
+namespace {
+
+ShardedKvService::GroupFactory localGroups() {
+    return [](uint64_t) { return std::make_shared<KvService>(MakeKvStateMachine()); };
+}
+
+template <typename Service>
+std::string getValue(Service& service, const std::string& key) {
+    GetReply reply;
+    service.Get(GetArgs{key}, reply);
+    return reply.status == KvStatus::OK ? reply.value : "<none>";
+}
+
+template <typename Service>
+void putKey(Service& service, const std::string& key, const std::string& value) {
+    PutAppendReply reply;
+    service.PutAppend(PutAppendArgs{KvOp::PUT, key, value}, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+}
+
+// 模拟一个在PREPARE之后崩溃的协调者：事务开始于很久以前，已经超时
+KvCommand stalePrepare(uint64_t id, const std::string& anchor, std::vector<KvMutation> ops,
+                       std::vector<std::string> record_keys = {}) {
+    KvCommand cmd;
+    cmd.op = KvOp::TXN_PREPARE;
+    cmd.ops = std::move(ops);
+    cmd.txn.id = id;
+    cmd.txn.anchor = anchor;
+    cmd.txn.start_ms = NowUnixMs() - 60000;
+    cmd.txn.timeout_ms = 100;
+    cmd.txn.keys = std::move(record_keys);
+    return cmd;
+}
+
+} // namespace
+
+TEST(TxnTest, AppliesAtomicallyWithCompares) {
+    KvService service(MakeKvStateMachine());
+    const auto& sm = service.StateMachine();
+    putKey(service, "a", "1");
+    putKey(service, "b", "2");
+
+    TxnReply reply;
+    service.Txn(TxnArgs{{{KvOp::PUT, "a", "10"}, {KvOp::APPEND, "b", "0"}, {KvOp::PUT, "c", "3"}},
+                        {{"a", true, "1"}, {"d", false, ""}}},
+                reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    EXPECT_NE(reply.txn_id, 0u);
+    EXPECT_EQ(getValue(service, "a"), "10");
+    EXPECT_EQ(getValue(service, "b"), "20");
+    EXPECT_EQ(getValue(service, "c"), "3");
+
+    // 条件不成立：不写入任何key
+    service.Txn(TxnArgs{{{KvOp::DELETE, "a"}, {KvOp::PUT, "c", "x"}}, {{"b", true, "2"}}}, reply);
+    EXPECT_EQ(reply.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(reply.key, "b");
+    EXPECT_EQ(getValue(service, "a"), "10");
+    EXPECT_EQ(getValue(service, "c"), "3");
+
+    // 重复的key、非写操作和保留前缀被拒绝
+    service.Txn(TxnArgs{{{KvOp::PUT, "a", "1"}, {KvOp::PUT, "a", "2"}}}, reply);
+    EXPECT_EQ(reply.status, KvStatus::INVALID_ARGUMENT);
+    service.Txn(TxnArgs{{{KvOp::GET, "a"}}}, reply);
+    EXPECT_EQ(reply.status, KvStatus::INVALID_ARGUMENT);
+    service.Txn(TxnArgs{{{KvOp::PUT, TxnIntentKey("a"), "x"}}}, reply);
+    EXPECT_EQ(reply.status, KvStatus::INVALID_ARGUMENT);
+
+    // 提交和中止都不留下intent和事务记录
+    service.Txn(TxnArgs{{{KvOp::DELETE, "c"}}}, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    EXPECT_EQ(getValue(service, "c"), "<none>");
+    EXPECT_EQ(sm->IntentCount(), 0u);
+    EXPECT_EQ(sm->Engine()->Size(), 2u);
+}
+
+TEST(TxnTest, ShardedTransfersPreserveTotal) {
+    ShardedKvService service(localGroups(), UniformShards(2));
+    const int accounts = 16;
+    const int initial = 100;
+    for (int i = 0; i < accounts; ++i) {
+        putKey(service, "acct" + std::to_string(i), std::to_string(initial));
+    }
+    std::set<KvService*> groups;
+    for (int i = 0; i < accounts; ++i) {
+        groups.insert(service.ServiceFor("acct" + std::to_string(i)).get());
+    }
+    ASSERT_EQ(groups.size(), 2u);
+
+    // 并发地在随机账户间转账：读两个余额，以读到的值为条件写入新值
+    const int workers = 4;
+    const int transfers = 50;
+    std::atomic<int> committed{0};
+    fiber::WaitGroup wg;
+    wg.add(workers);
+    for (int w = 0; w < workers; ++w) {
+        fiber::Fiber::go([&, w]() {
+            std::mt19937 gen(w);
+            for (int t = 0; t < transfers; ++t) {
+                std::string from = "acct" + std::to_string(gen() % accounts);
+                std::string to = "acct" + std::to_string(gen() % accounts);
+                if (from == to) {
+                    continue;
+                }
+                std::string from_value = getValue(service, from);
+                std::string to_value = getValue(service, to);
+                int amount = static_cast<int>(gen() % 10);
+                TxnReply reply;
+                service.Txn(TxnArgs{{{KvOp::PUT, from, std::to_string(std::stoi(from_value) - amount)},
+                                     {KvOp::PUT, to, std::to_string(std::stoi(to_value) + amount)}},
+                                    {{from, true, from_value}, {to, true, to_value}}},
+                            reply);
+                if (reply.status == KvStatus::OK) {
+                    ++committed;
+                } else {
+                    EXPECT_TRUE(reply.status == KvStatus::CONDITION_FAILED || reply.status == KvStatus::TXN_CONFLICT)
+                        << static_cast<int>(reply.status);
+                }
+            }
+            wg.done();
+        });
+    }
+    wg.wait();
+    EXPECT_GT(committed.load(), 0);
+
+    int total = 0;
+    MultiGetArgs args;
+    for (int i = 0; i < accounts; ++i) {
+        args.keys.push_back("acct" + std::to_string(i));
+    }
+    MultiGetReply multi;
+    service.MultiGet(args, multi);
+    for (const auto& result : multi.results) {
+        ASSERT_EQ(result.status, KvStatus::OK);
+        total += std::stoi(result.value);
+    }
+    EXPECT_EQ(total, accounts * initial);
+
+    // 跨分片的扫描看不到事务的保留key
+    ScanReply scan;
+    service.Scan(ScanArgs{"", "", 1000}, scan);
+    EXPECT_EQ(scan.pairs.size(), static_cast<size_t>(accounts));
+}
+
+TEST(TxnTest, ReadsSeeParallelCommit) {
+    TxnOptions options;
+    options.parallel_commit = true;
+    auto sm = MakeKvStateMachine();
+    std::mutex mu;
+    auto propose = [&](const std::string&, const KvCommand& cmd) {
+        std::unique_lock<std::mutex> lock(mu);
+        return sm->Apply(sm->LastApplied() + 1, cmd);
+    };
+    TxnCoordinator txn([](const std::string&) { return uint64_t{1}; }, propose,
+                       [&](const std::string&) { return sm; }, options);
+    for (int i = 0; i < 100; ++i) {
+        std::string value = std::to_string(i);
+        auto result = txn.Execute({{KvOp::PUT, "x", value}, {KvOp::PUT, "y", value}});
+        ASSERT_EQ(result.status, KvStatus::OK);
+        // 返回时intent可能还在，读之前等待intent清理
+        ASSERT_TRUE(txn.ResolveIntent("x", true));
+        ASSERT_TRUE(txn.ResolveIntent("y", true));
+        EXPECT_EQ(sm->Get("x").value, value);
+        EXPECT_EQ(sm->Get("y").value, value);
+    }
+    txn.Drain();
+    EXPECT_EQ(sm->IntentCount(), 0u);
+}
+
+TEST(TxnTest, RecoversAbandonedTransactions) {
+    KvService service(MakeKvStateMachine());
+    const auto& sm = service.StateMachine();
+    putKey(service, "a", "old");
+    putKey(service, "b", "old");
+
+    // anchor的PREPARE写入了，b所在组的没有：读a时恢复为中止，b上留下隔离标记
+    ASSERT_EQ(service.Propose(stalePrepare(1, "a", {{KvOp::PUT, "a", "new"}}, {"a", "b"})).status, KvStatus::OK);
+    EXPECT_EQ(sm->IntentCount(), 1u);
+    ScanReply scan;
+    service.Scan(ScanArgs{"", "", 100}, scan);
+    EXPECT_EQ(scan.pairs.size(), 2u);
+    EXPECT_EQ(getValue(service, "a"), "old");
+    EXPECT_EQ(sm->IntentCount(), 0u);
+    // 迟到的PREPARE被拒绝
+    EXPECT_EQ(service.Propose(stalePrepare(1, "a", {{KvOp::PUT, "b", "new"}})).status, KvStatus::TXN_ABORTED);
+    EXPECT_EQ(service.Propose(stalePrepare(1, "a", {{KvOp::PUT, "a", "new"}}, {"a", "b"})).status,
+              KvStatus::TXN_ABORTED);
+    EXPECT_EQ(getValue(service, "b"), "old");
+
+    // 所有PREPARE都写入了：事务已隐式提交，读b时恢复为提交并删除事务记录
+    ASSERT_EQ(service.Propose(stalePrepare(2, "a", {{KvOp::PUT, "a", "new"}}, {"a", "b"})).status, KvStatus::OK);
+    ASSERT_EQ(service.Propose(stalePrepare(2, "a", {{KvOp::APPEND, "b", "+"}})).status, KvStatus::OK);
+    EXPECT_EQ(getValue(service, "b"), "old+");
+    EXPECT_EQ(getValue(service, "a"), "new");
+    EXPECT_EQ(sm->IntentCount(), 0u);
+    std::string record;
+    EXPECT_FALSE(sm->Engine()->Get(TxnRecordKey(2, "a"), record));
+
+    // 普通写遇到超时事务的intent：完成恢复后写入
+    ASSERT_EQ(service.Propose(stalePrepare(3, "c", {{KvOp::PUT, "c", "txn"}}, {"c"})).status, KvStatus::OK);
+    KvCommand put;
+    put.op = KvOp::PUT;
+    put.key = "c";
+    put.value = "plain";
+    KvResult blocked = sm->Apply(sm->LastApplied() + 1, put);
+    EXPECT_EQ(blocked.status, KvStatus::TXN_CONFLICT);
+    EXPECT_EQ(blocked.value, "c");
+    putKey(service, "c", "plain");
+    EXPECT_EQ(getValue(service, "c"), "plain");
+    EXPECT_EQ(sm->IntentCount(), 0u);
+}
+
+TEST(TxnTest, DeduplicatesRetriedRequests) {
+    KvService service(MakeKvStateMachine());
+    const auto& sm = service.StateMachine();
+    putKey(service, "a", "x");
+
+    // 回复丢失后用同一个RequestId重试：已提交的事务不再执行
+    TxnArgs args{{{KvOp::APPEND, "a", "+"}, {KvOp::APPEND, "b", "+"}}, {}, RequestId{42, 1}};
+    TxnReply reply;
+    service.Txn(args, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    service.Txn(args, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    EXPECT_EQ(getValue(service, "a"), "x+");
+    EXPECT_EQ(getValue(service, "b"), "+");
+
+    // 中止的事务不记入会话：重试重新执行
+    TxnArgs failed{{{KvOp::APPEND, "a", "!"}}, {{"c", true, "1"}}, RequestId{42, 2}};
+    service.Txn(failed, reply);
+    EXPECT_EQ(reply.status, KvStatus::CONDITION_FAILED);
+    putKey(service, "c", "1");
+    service.Txn(failed, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    EXPECT_EQ(getValue(service, "a"), "x+!");
+
+    // 原事务还没有结论（协调者在PREPARE之后崩溃）：重试等它被恢复为提交后识别为重复
+    KvCommand prepare = stalePrepare(9, "a", {{KvOp::APPEND, "a", "?"}}, {"a"});
+    prepare.txn.request = RequestId{42, 3};
+    ASSERT_EQ(service.Propose(prepare).status, KvStatus::OK);
+    service.Txn(TxnArgs{{{KvOp::APPEND, "a", "?"}}, {}, RequestId{42, 3}}, reply);
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    EXPECT_EQ(getValue(service, "a"), "x+!?");
+    EXPECT_EQ(sm->IntentCount(), 0u);
+}
+
+TEST(TxnTest, ResolveIntentWakesOnResolve) {
+    auto sm = MakeKvStateMachine();
+    std::mutex mu;
+    auto propose = [&](const std::string&, const KvCommand& cmd) {
+        std::unique_lock<std::mutex> lock(mu);
+        return sm->Apply(sm->LastApplied() + 1, cmd);
+    };
+    TxnCoordinator txn([](const std::string&) { return uint64_t{1}; }, propose,
+                       [&](const std::string&) { return sm; });
+
+    // 一分钟后才超时的事务：等待方在intent清理时被唤醒，而不是等到超时
+    KvCommand prepare = stalePrepare(5, "k", {{KvOp::PUT, "k", "v"}}, {"k"});
+    prepare.txn.start_ms = NowUnixMs();
+    prepare.txn.timeout_ms = 60000;
+    ASSERT_EQ(propose("k", prepare).status, KvStatus::OK);
+
+    fiber::WaitGroup wg;
+    wg.add(1);
+    fiber::Fiber::go([&]() {
+        fiber::Fiber::sleep(50);
+        KvCommand end = prepare;
+        end.op = KvOp::TXN_END;
+        end.txn.state = TxnState::COMMITTED;
+        EXPECT_EQ(propose("k", end).status, KvStatus::OK);
+        KvCommand resolve = end;
+        resolve.op = KvOp::TXN_RESOLVE;
+        EXPECT_EQ(propose("k", resolve).status, KvStatus::OK);
+        wg.done();
+    });
+    uint64_t start = NowUnixMs();
+    ASSERT_TRUE(txn.ResolveIntent("k"));
+    EXPECT_LT(NowUnixMs() - start, 10000u);
+    wg.wait();
+    EXPECT_EQ(sm->Get("k").value, "v");
+    EXPECT_EQ(sm->IntentCount(), 0u);
+}
+
+TEST(TxnTest, IntentsMoveWithSplit) {
+    ShardedKvService service(localGroups());
+    for (int i = 0; i < 200; ++i) {
+        putKey(service, "key" + std::to_string(i), "old");
+    }
+    // 所有key都PREPARE过但没有提交，分裂把intent和事务记录随数据一起迁移
+    std::vector<std::string> keys;
+    std::vector<KvMutation> ops;
+    for (int i = 0; i < 200; ++i) {
+        keys.push_back("key" + std::to_string(i));
+        ops.push_back(KvMutation{KvOp::PUT, keys.back(), "new"});
+    }
+    auto shard = service.ServiceFor("key0");
+    ASSERT_EQ(shard->Propose(stalePrepare(7, "key0", ops, keys)).status, KvStatus::OK);
+    EXPECT_EQ(shard->StateMachine()->IntentCount(), 200u);
+
+    auto range = service.Shards().front();
+    ASSERT_TRUE(service.Split(range.id, range.first + (range.last - range.first) / 2).has_value());
+    std::set<KvService*> groups;
+    for (const auto& key : keys) {
+        groups.insert(service.ServiceFor(key).get());
+    }
+    ASSERT_EQ(groups.size(), 2u);
+    size_t intents = 0;
+    for (auto* group : groups) {
+        EXPECT_GT(group->StateMachine()->IntentCount(), 0u);
+        intents += group->StateMachine()->IntentCount();
+    }
+    EXPECT_EQ(intents, keys.size());
+
+    // 读触发恢复：两个分片上的intent都在，事务提交
+    for (const auto& key : keys) {
+        ASSERT_EQ(getValue(service, key), "new") << key;
+    }
+    for (const auto& key : keys) {
+        EXPECT_EQ(service.ServiceFor(key)->StateMachine()->IntentCount(), 0u);
+    }
+}
+
+TEST(TxnTest, ExecutesOverRpc) {
+    auto service = std::make_shared<KvService>(MakeKvStateMachine());
+    auto server = rpc::RpcServer::Make();
+    service->RegisterRPC(server);
+    server->start(kPort);
+    fiber::Fiber::sleep(100);
+
+    auto client = rpc::RpcClient::Make();
+    ASSERT_TRUE(client->connect("127.0.0.1", kPort));
+    TxnReply reply;
+    ASSERT_FALSE(client->call(kMethodTxn, TxnArgs{{{KvOp::PUT, "k", "v"}}, {{"k", false, ""}}}, reply).has_value());
+    EXPECT_EQ(reply.status, KvStatus::OK);
+    ASSERT_FALSE(client->call(kMethodTxn, TxnArgs{{{KvOp::PUT, "k", "w"}}, {{"k", false, ""}}}, reply).has_value());
+    EXPECT_EQ(reply.status, KvStatus::CONDITION_FAILED);
+    EXPECT_EQ(reply.key, "k");
+    GetReply get;
+    ASSERT_FALSE(client->call(kMethodGet, GetArgs{"k"}, get).has_value());
+    EXPECT_EQ(get.value, "v");
+
+    KvClientOptions options;
+    options.endpoints = {"127.0.0.1:" + std::to_string(kPort)};
+    KvClient kv(options);
+    auto result = kv.Txn({{KvOp::PUT, "k", "x"}, {KvOp::PUT, "j", "y"}}, {{"k", true, "v"}});
+    EXPECT_EQ(result.status, KvStatus::OK);
+    EXPECT_EQ(kv.Get("k").value, "x");
+    EXPECT_EQ(kv.Get("j").value, "y");
+
+    client->disconnect();
+    server->shutdown();
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,242 @@
+#include "kv_service.h"
+#include "scheduler.h"
+#include "fiber.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+
+using namespace kv;
+
+namespace {
+
+KvCommand command(KvOp op, const std::string& key, const std::string& value = "") {
+    KvCommand cmd;
+    cmd.op = op;
+    cmd.key = key;
+    cmd.value = value;
+    return cmd;
+}
+
+WatchOptions withHistory(size_t bytes = 1 << 20) {
+    WatchOptions options;
+    options.history_bytes = bytes;
+    return options;
+}
+
+} // namespace
+
+TEST(WatchTest, KeyAndPrefixEvents) {
+    KvStateMachine sm(MakeShardedHashEngine(), SessionOptions(), withHistory());
+    auto key = sm.Watches()->Subscribe("cfg/a", false, 0);
+    auto prefix = sm.Watches()->Subscribe("cfg/", true, 0);
+    ASSERT_TRUE(key && prefix);
+
+    uint64_t index = 0;
+    sm.Apply(++index, command(KvOp::PUT, "cfg/a", "1"));
+    sm.Apply(++index, command(KvOp::APPEND, "cfg/a", "2"));
+    sm.Apply(++index, command(KvOp::PUT, "other", "x"));
+    sm.Apply(++index, command(KvOp::DELETE, "missing"));       // 没有变更，不产生事件
+    sm.Apply(++index, command(KvOp::GET, "cfg/a"));
+    KvCommand batch;
+    batch.op = KvOp::BATCH;
+    batch.ops = {KvMutation{KvOp::PUT, "cfg/b", "3"}, KvMutation{KvOp::DELETE, "cfg/a", ""}};
+    sm.Apply(++index, batch);
+
+    std::vector<WatchEvent> events;
+    ASSERT_EQ(key->Next(events, 0), KvStatus::OK);
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].revision, 1u);
+    EXPECT_EQ(events[0].value, "1");
+    key->Next(events, 0);
+    EXPECT_EQ(events[0].value, "12");   // APPEND事件带写入后的完整值
+    key->Next(events, 0);
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].revision, 6u);
+    EXPECT_EQ(events[0].type, KvOp::DELETE);
+    EXPECT_EQ(key->NextRevision(), 7u);
+    EXPECT_EQ(key->Next(events, 10), KvStatus::OK);
+    EXPECT_TRUE(events.empty());
+
+    // 前缀订阅：同一条日志的事件在一个批次中
+    prefix->Next(events, 0);
+    prefix->Next(events, 0);
+    prefix->Next(events, 0);
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].key, "cfg/b");
+    EXPECT_EQ(events[1].key, "cfg/a");
+
+    // 从历史中的revision恢复
+    auto resumed = sm.Watches()->Subscribe("cfg/", true, 2);
+    ASSERT_TRUE(resumed);
+    resumed->Next(events, 0);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0].revision, 2u);
+    EXPECT_EQ(resumed->NextRevision(), 7u);
+
+    EXPECT_EQ(sm.Watches()->WatcherCount(), 3u);
+    resumed.reset();
+    EXPECT_EQ(sm.Watches()->WatcherCount(), 2u);
+}
+
+TEST(WatchTest, SlowWatcherCatchesUpFromHistory) {
+    // 历史环恰好容纳100个"k"="v"的事件
+    WatchOptions options = withHistory(100 * (sizeof(WatchEvent) + 2));
+    options.channel_capacity = 4;
+    KvStateMachine sm(MakeShardedHashEngine(), SessionOptions(), options);
+    auto watcher = sm.Watches()->Subscribe("k", false, 0);
+
+    // channel只能容纳4个批次，之后的事件由订阅者从历史环追赶，不丢不重
+    uint64_t index = 0;
+    for (int i = 0; i < 50; ++i) {
+        sm.Apply(++index, command(KvOp::PUT, "k", std::to_string(i)));
+    }
+    std::vector<std::string> values;
+    std::vector<WatchEvent> events;
+    while (watcher->Next(events, 0) == KvStatus::OK && !events.empty()) {
+        for (const auto& event : events) {
+            values.push_back(event.value);
+        }
+    }
+    ASSERT_EQ(values.size(), 50u);
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_EQ(values[i], std::to_string(i));
+    }
+    sm.Apply(++index, command(KvOp::PUT, "k", "live"));
+    ASSERT_EQ(watcher->Next(events, 0), KvStatus::OK);
+    EXPECT_EQ(events[0].value, "live");
+
+    // 落后超过历史环容量：COMPACTED
+    for (int i = 0; i < 200; ++i) {
+        sm.Apply(++index, command(KvOp::PUT, "k", "v"));
+    }
+    while (watcher->Next(events, 0) == KvStatus::OK && !events.empty()) {
+    }
+    EXPECT_EQ(watcher->Next(events, 0), KvStatus::COMPACTED);
+    EXPECT_EQ(sm.Watches()->Subscribe("k", false, 1), nullptr);
+    EXPECT_EQ(sm.Watches()->OldestRevision(), index - 100 + 1);
+
+    // 快照恢复使所有订阅失效
+    auto live = sm.Watches()->Subscribe("k", false, 0);
+    ASSERT_TRUE(sm.RestoreSnapshot(sm.TakeSnapshot()));
+    EXPECT_EQ(live->Next(events, 0), KvStatus::COMPACTED);
+    EXPECT_EQ(sm.Watches()->WatcherCount(), 0u);
+}
+
+TEST(WatchTest, SkipsCollectionWithoutWatchers) {
+    // 默认不保留历史：没有订阅者时不收集事件，之后的订阅只能从最新的revision开始
+    KvStateMachine sm;
+    uint64_t index = 0;
+    sm.Apply(++index, command(KvOp::PUT, "k", "1"));
+    sm.Apply(++index, command(KvOp::APPEND, "k", "2"));
+    EXPECT_EQ(sm.Watches()->Subscribe("k", false, index), nullptr);
+    EXPECT_EQ(sm.Watches()->WatcherCount(), 0u);
+
+    auto watcher = sm.Watches()->Subscribe("k", false, 0);
+    ASSERT_TRUE(watcher);
+    EXPECT_EQ(watcher->NextRevision(), index + 1);
+    sm.Apply(++index, command(KvOp::APPEND, "k", "3"));
+    std::vector<WatchEvent> events;
+    ASSERT_EQ(watcher->Next(events, 0), KvStatus::OK);
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].revision, index);
+    EXPECT_EQ(events[0].value, "123");
+}
+
+TEST(WatchTest, FanOutToManyFibers) {
+    auto sm = MakeKvStateMachine();
+    const int num_watchers = 200;
+    const int num_writes = 100;
+
+    std::vector<WatcherPtr> watchers;
+    for (int i = 0; i < num_watchers; ++i) {
+        watchers.push_back(sm->Watches()->Subscribe(i % 2 == 0 ? "hot" : "h", i % 2 != 0, 0));
+    }
+    std::atomic<int> complete{0};
+    std::atomic<int64_t> max_latency_us{0};
+    fiber::WaitGroup wg;
+    wg.add(num_watchers);
+    for (int i = 0; i < num_watchers; ++i) {
+        fiber::Fiber::go([&, watcher = watchers[i]]() {
+            int received = 0;
+            std::vector<WatchEvent> events;
+            while (received < num_writes && watcher->Next(events, 1000) == KvStatus::OK && !events.empty()) {
+                for (const auto& event : events) {
+                    auto sent = std::chrono::steady_clock::time_point(std::chrono::microseconds(std::stoll(event.value)));
+                    int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - sent).count();
+                    int64_t prev = max_latency_us.load();
+                    while (latency > prev && !max_latency_us.compare_exchange_weak(prev, latency)) {
+                    }
+                }
+                received += static_cast<int>(events.size());
+            }
+            if (received == num_writes) {
+                complete.fetch_add(1);
+            }
+            wg.done();
+        });
+    }
+
+    for (int i = 0; i < num_writes; ++i) {
+        auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        sm->Apply(i + 1, command(KvOp::PUT, "hot", std::to_string(now)));
+        if (i % 10 == 0) {
+            fiber::Fiber::sleep(1);
+        }
+    }
+    wg.wait();
+    EXPECT_EQ(complete.load(), num_watchers);
+    LOG_INFO("watch fan-out: {} watchers x {} writes, max notify latency {}us", num_watchers, num_writes,
+             max_latency_us.load());
+}
+
+TEST(WatchTest, ServiceLongPoll) {
+    // 长轮询的请求之间没有订阅者，用next_revision续订需要历史环
+    auto sm = MakeKvStateMachine(MakeShardedHashEngine(), SessionOptions(), withHistory());
+    KvService service(sm);
+
+    // 没有变更时请求挂起，写入后立即返回
+    WatchReply reply;
+    std::atomic<bool> returned{false};
+    fiber::WaitGroup wg;
+    wg.add(1);
+    fiber::Fiber::go([&]() {
+        service.Watch(WatchArgs{"job/", true, 0, 0, 2000}, reply);
+        returned = true;
+        wg.done();
+    });
+    fiber::Fiber::sleep(20);
+    EXPECT_FALSE(returned.load());
+    PutAppendReply put_reply;
+    service.PutAppend(PutAppendArgs{KvOp::PUT, "job/1", "queued"}, put_reply);
+    wg.wait();
+    ASSERT_EQ(reply.status, KvStatus::OK);
+    ASSERT_EQ(reply.events.size(), 1u);
+    EXPECT_EQ(reply.events[0].key, "job/1");
+
+    // 用next_revision继续：中间的写入不会丢失；max_events按revision截断
+    uint64_t next = reply.next_revision;
+    for (int i = 2; i <= 5; ++i) {
+        service.PutAppend(PutAppendArgs{KvOp::PUT, "job/" + std::to_string(i), "queued"}, put_reply);
+    }
+    WatchReply page;
+    service.Watch(WatchArgs{"job/", true, next, 3, 100}, page);
+    ASSERT_EQ(page.events.size(), 3u);
+    EXPECT_EQ(page.events[0].key, "job/2");
+    service.Watch(WatchArgs{"job/", true, page.next_revision, 3, 100}, page);
+    ASSERT_EQ(page.events.size(), 1u);
+    EXPECT_EQ(page.events[0].key, "job/5");
+
+    // 超时返回空结果，next_revision可以继续使用
+    service.Watch(WatchArgs{"job/", true, page.next_revision, 0, 10}, page);
+    EXPECT_EQ(page.status, KvStatus::OK);
+    EXPECT_TRUE(page.events.empty());
+    EXPECT_EQ(sm->Watches()->WatcherCount(), 0u);
+}
+
+FIBER_MAIN() {
+    ::testing::InitGoogleTest();
+    return RUN_ALL_TESTS();
+}